@@ -1,20 +1,38 @@
-cmake_minimum_required(VERSION 3.20)
 # 
 # Defines
 #   WAYLAND_CLIENT_FOUND to TRUE  if Wayland client  libraries are found 
 #   WAYLAND_CLIENT_LIBRARIES      The library
 #   WAYLAND_CLIENT_LINK_LIBRARIES The full path to the library
 #   WAYLAND_CLIENT_INCLUDE_DIRS
+#   Wayland::Client               Imported target with all of the above
+#
+#   WAYLAND_SCANNER               wayland-scanner, which turns protocol XML
+#                                 files into C
+#   WAYLAND_PROTOCOLS_DIR         Where the wayland-protocols XML files are
 #  
-
-project("Fix CMAKE"
-    VERSION 0.0.1
-    LANGUAGES 
-    C 
-)
+# A find module runs inside the project that calls find_package, so it must
+# not call project() or cmake_minimum_required() itself.
+#
 
 find_package(PkgConfig)
 if(PKG_CONFIG_FOUND)
-    pkg_check_modules(WAYLAND_CLIENT QUIET wayland-client)
+    pkg_check_modules(WAYLAND_CLIENT QUIET IMPORTED_TARGET wayland-client)
+    pkg_get_variable(WAYLAND_PROTOCOLS_DIR wayland-protocols pkgdatadir)
+    pkg_get_variable(WAYLAND_SCANNER_FROM_PC wayland-scanner wayland_scanner)
+endif()
+
+if(WAYLAND_SCANNER_FROM_PC)
+    set(WAYLAND_SCANNER ${WAYLAND_SCANNER_FROM_PC} CACHE FILEPATH "wayland-scanner")
+else()
+    find_program(WAYLAND_SCANNER wayland-scanner)
 endif()
 
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Wayland_Client
+    REQUIRED_VARS WAYLAND_CLIENT_LINK_LIBRARIES
+    VERSION_VAR WAYLAND_CLIENT_VERSION
+)
+
+if(WAYLAND_CLIENT_FOUND AND NOT TARGET Wayland::Client)
+    add_library(Wayland::Client ALIAS PkgConfig::WAYLAND_CLIENT)
+endif()
@@ -0,0 +1,222 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+//
+// xcb bench_framebuffer on the window.h layer, so the same numbers come out
+// of either backend.
+//
+// Each frame rewrites every pixel of a buffer from windowAcquire and shows
+// it with windowPresent, then waits for the WINDOW_EVENT_REDRAW that says
+// the next one can go out. On XCB that is Present's CompleteNotify, on
+// Wayland the frame callback, so both are paced by the display. The time
+// to draw, the time windowPresent takes and the time from one present to
+// the next are printed as JSON.
+//
+// Run it against a private server of the kind it was built for, for example
+//
+//     xvfb-run -a -s "-screen 0 1920x1080x24" ./multiple_bench_framebuffer
+//
+// Usage: multiple_bench_framebuffer [frames] [24|32] [width] [height]
+//
+// 32 asks for a translucent window, 24 for an opaque one.
+//
+
+#include "window.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 100
+#define DEFAULT_DEPTH 24
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define WARMUP_FRAMES 5
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compareU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// p percentile of n sorted values
+static uint64_t percentile(const uint64_t *sorted, uint32_t n, double p) {
+  uint32_t i = (uint32_t)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i < n ? i : n - 1];
+}
+
+// Something that changes every frame so nothing can be skipped. Opaque, so
+// it is the same premultiplied or not.
+static void fill(const WindowBuffer *b, uint32_t frame) {
+  for (uint32_t y = 0; y < b->height; y++) {
+    uint32_t *row = b->pixels + (size_t)y * (b->stride / 4);
+    for (uint32_t x = 0; x < b->width; x++) {
+      row[x] = 0xFF000000 | ((x + frame) & 0xFF) << 16 |
+               ((y + frame) & 0xFF) << 8 | (frame & 0xFF);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+  const int depth = argc > 2 ? atoi(argv[2]) : DEFAULT_DEPTH;
+  const int width = argc > 3 ? atoi(argv[3]) : DEFAULT_WIDTH;
+  const int height = argc > 4 ? atoi(argv[4]) : DEFAULT_HEIGHT;
+  if (frames <= 0 || (depth != 24 && depth != 32) || width <= 0 ||
+      width > UINT16_MAX || height <= 0 || height > UINT16_MAX) {
+    fprintf(stderr, "Usage: %s [frames] [24|32] [width] [height]\n",
+            argv[0]);
+    return -1;
+  }
+
+  Window window;
+  const WindowDesc desc = {
+      .title = "Multiple Bench Framebuffer",
+      .width = width,
+      .height = height,
+      .translucent = depth == 32,
+  };
+  const int result = windowOpen(&window, &desc);
+  if (result) {
+    fprintf(stderr, "Unable to open a %s window (%d)\n", WINDOW_BACKEND_NAME,
+            result);
+    return -1;
+  }
+
+  // Drawing, windowPresent, and present to present, for every timed frame
+  uint64_t *draw = calloc((size_t)frames, sizeof(uint64_t));
+  uint64_t *present = calloc((size_t)frames, sizeof(uint64_t));
+  uint64_t *interval = calloc((size_t)frames, sizeof(uint64_t));
+  if (!draw || !present || !interval) {
+    free(draw);
+    free(present);
+    free(interval);
+    windowClose(&window);
+    return -1;
+  }
+
+  const uint32_t total = WARMUP_FRAMES + (uint32_t)frames;
+  uint32_t drawn = 0;
+  uint64_t starved = 0;
+  uint64_t start = 0;
+  uint64_t last = 0;
+  bool closed = false;
+
+  WindowEvent e;
+  while (drawn < total && !closed && windowWaitEvent(&window, &e)) {
+    switch (e.type) {
+    case WINDOW_EVENT_CLOSE:
+      closed = true;
+      break;
+
+    case WINDOW_EVENT_KEY:
+      closed = e.key == WINDOW_KEY_ESCAPE;
+      break;
+
+    case WINDOW_EVENT_MOTION:
+      break;
+
+    case WINDOW_EVENT_REDRAW: {
+      WindowBuffer b;
+      if (!windowAcquire(&window, &b)) {
+        // Another REDRAW comes once a buffer is free
+        starved += drawn >= WARMUP_FRAMES;
+        break;
+      }
+
+      const uint64_t drawStart = now();
+      fill(&b, drawn);
+      const uint64_t presentStart = now();
+      windowPresent(&window, &b);
+      const uint64_t presentEnd = now();
+
+      if (drawn == WARMUP_FRAMES) {
+        start = presentStart;
+      }
+      if (drawn >= WARMUP_FRAMES) {
+        const uint32_t i = drawn - WARMUP_FRAMES;
+        draw[i] = presentStart - drawStart;
+        present[i] = presentEnd - presentStart;
+        interval[i] = presentStart - last;
+      }
+      last = presentStart;
+      drawn++;
+      break;
+    }
+    }
+  }
+
+  if (drawn < total) {
+    fprintf(stderr, "The window went away after %u of %u frames\n", drawn,
+            total);
+    free(draw);
+    free(present);
+    free(interval);
+    windowClose(&window);
+    return -1;
+  }
+
+  // The first timed frame has no present before it that was timed
+  const uint64_t wall = last - start;
+  const uint32_t intervals = (uint32_t)frames - 1;
+
+  qsort(draw, frames, sizeof(uint64_t), compareU64);
+  qsort(present, frames, sizeof(uint64_t), compareU64);
+  qsort(interval + 1, intervals, sizeof(uint64_t), compareU64);
+
+  const double mbPerS = (double)width * height * 4 * intervals /
+                        (wall / 1000000000.0) / (1024.0 * 1024.0);
+
+  printf("{\n  \"benchmark\": \"framebuffer\",\n  \"backend\": \"%s\",\n"
+         "  \"depth\": %d,\n  \"width\": %d,\n  \"height\": %d,\n"
+         "  \"frames\": %d,\n",
+         WINDOW_BACKEND_NAME, depth, width, height, frames);
+  printf("  \"draw_median_us\": %.1f,\n  \"draw_p99_us\": %.1f,\n",
+         percentile(draw, frames, 50.0) / 1000.0,
+         percentile(draw, frames, 99.0) / 1000.0);
+  printf("  \"present_median_us\": %.1f,\n  \"present_p99_us\": %.1f,\n",
+         percentile(present, frames, 50.0) / 1000.0,
+         percentile(present, frames, 99.0) / 1000.0);
+  if (intervals) {
+    printf("  \"interval_median_ms\": %.3f,\n  \"interval_p99_ms\": %.3f,\n"
+           "  \"interval_max_ms\": %.3f,\n",
+           percentile(interval + 1, intervals, 50.0) / 1e6,
+           percentile(interval + 1, intervals, 99.0) / 1e6,
+           interval[intervals] / 1e6);
+  }
+  printf("  \"mb_per_s\": %.1f,\n  \"fps\": %.1f,\n  \"starved\": %llu\n}\n",
+         wall ? mbPerS : 0.0, wall ? intervals / (wall / 1000000000.0) : 0.0,
+         (unsigned long long)starved);
+
+  free(draw);
+  free(present);
+  free(interval);
+  windowClose(&window);
+  return 0;
+}
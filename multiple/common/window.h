@@ -0,0 +1,89 @@
+#ifndef WINDOW_H_20261017
+#define WINDOW_H_20261017
+
+#include <stdint.h>
+
+//
+// One small window, event and framebuffer API over XCB and Wayland.
+//
+// Which one is used is decided when the program is built, by defining
+// WINDOW_BACKEND_XCB or WINDOW_BACKEND_WAYLAND, see CMakeLists.txt. The
+// backend's header then defines Window and the functions called every frame
+// as static inline functions, so polling events, acquiring a buffer and
+// presenting it are direct calls the compiler can inline. There is no table
+// of function pointers and no cost for the backend that was not chosen.
+//
+
+typedef struct {
+  const char *title;
+  uint16_t width;
+  uint16_t height;
+
+  // Alpha in the pixels shows what is behind the window. Otherwise the
+  // window is opaque and alpha is ignored.
+  bool translucent;
+} WindowDesc;
+
+typedef enum {
+  WINDOW_EVENT_CLOSE,  // The close button, or the connection was lost
+  WINDOW_EVENT_KEY,    // A key was pressed, key is its evdev code
+  WINDOW_EVENT_MOTION, // The pointer moved to x, y
+  WINDOW_EVENT_REDRAW, // A new frame can be drawn and shown now
+} WindowEventType;
+
+// Evdev key codes, the same on every backend. X11 key codes are these
+// plus 8.
+#define WINDOW_KEY_ESCAPE 1
+
+typedef struct {
+  WindowEventType type;
+  uint32_t key;
+  int32_t x;
+  int32_t y;
+} WindowEvent;
+
+//
+// Pixels to draw a frame into, premultiplied 0xAARRGGBB. Every backend
+// shows them as they are, with no conversion, so a buffer still holds
+// what was drawn into it when it is handed out again.
+//
+typedef struct {
+  uint32_t *pixels;
+  uint32_t stride; // Bytes per row
+  uint16_t width;
+  uint16_t height;
+
+  void *handle; // The backend's buffer
+} WindowBuffer;
+
+typedef struct Window Window;
+
+#if defined(WINDOW_BACKEND_XCB)
+#include "window_xcb.h"
+#elif defined(WINDOW_BACKEND_WAYLAND)
+#include "window_wayland.h"
+#else
+#error "Define WINDOW_BACKEND_XCB or WINDOW_BACKEND_WAYLAND"
+#endif
+
+//
+// Every backend provides these. The ones called every frame are static
+// inline in the backend's header:
+//
+//   bool windowPollEvent(Window *w, WindowEvent *e);
+//     The next event if there is one, without waiting.
+//
+//   bool windowWaitEvent(Window *w, WindowEvent *e);
+//     The next event, waiting for it. false if the connection is lost.
+//
+//   bool windowAcquire(Window *w, WindowBuffer *b);
+//     A buffer the server or compositor is not reading, false if there is
+//     none. A WINDOW_EVENT_REDRAW follows once one is free.
+//
+//   void windowPresent(Window *w, WindowBuffer *b);
+//     Show a whole buffer from windowAcquire.
+//
+int windowOpen(Window *w, const WindowDesc *desc);
+void windowClose(Window *w);
+
+#endif
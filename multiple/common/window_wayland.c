@@ -0,0 +1,354 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "window.h"
+#include "xdg-shell-client-protocol.h"
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+//
+// Queue an event for windowPollEvent. Motion events that arrive before the
+// last one was taken replace it, only where the pointer is now matters.
+//
+void windowPush(Window *w, WindowEvent e) {
+  if (e.type == WINDOW_EVENT_MOTION && w->tail != w->head) {
+    WindowEvent *last = &w->queue[(w->tail - 1) % WINDOW_EVENT_QUEUE];
+    if (last->type == WINDOW_EVENT_MOTION) {
+      *last = e;
+      return;
+    }
+  }
+  if (w->tail - w->head == WINDOW_EVENT_QUEUE) {
+    return;
+  }
+  w->queue[w->tail++ % WINDOW_EVENT_QUEUE] = e;
+}
+
+//
+// Read whatever has arrived from the compositor without waiting, and run
+// the listeners, which queue events. A lost connection is reported as
+// WINDOW_EVENT_CLOSE.
+//
+void windowReadEvents(Window *w) {
+  if (wl_display_dispatch_pending(w->display) == -1) {
+    windowPush(w, (WindowEvent){.type = WINDOW_EVENT_CLOSE});
+    return;
+  }
+  if (w->head != w->tail) {
+    return;
+  }
+
+  wl_display_flush(w->display);
+  if (wl_display_prepare_read(w->display) != 0) {
+    wl_display_dispatch_pending(w->display);
+    return;
+  }
+
+  struct pollfd fd = {.fd = wl_display_get_fd(w->display), .events = POLLIN};
+  if (poll(&fd, 1, 0) > 0) {
+    wl_display_read_events(w->display);
+  } else {
+    wl_display_cancel_read(w->display);
+  }
+
+  if (wl_display_dispatch_pending(w->display) == -1) {
+    windowPush(w, (WindowEvent){.type = WINDOW_EVENT_CLOSE});
+  }
+}
+
+// The compositor would show a new frame now
+static void onFrame(void *data, struct wl_callback *callback, uint32_t) {
+  Window *w = data;
+  wl_callback_destroy(callback);
+  w->frame = nullptr;
+  windowPush(w, (WindowEvent){.type = WINDOW_EVENT_REDRAW});
+}
+
+static const struct wl_callback_listener frameListener = {
+    .done = onFrame,
+};
+
+void windowRequestFrame(Window *w) {
+  w->frame = wl_surface_frame(w->surface);
+  wl_callback_add_listener(w->frame, &frameListener, w);
+}
+
+//
+// Every buffer is still held by the compositor. A release carries no event
+// of its own here, so ask for a frame callback instead and try again when
+// it comes.
+//
+void windowStarved(Window *w) {
+  if (!w->frame) {
+    windowRequestFrame(w);
+    wl_surface_commit(w->surface);
+  }
+}
+
+//---------------------------------------------------------------------------
+// Listeners, see wayland example 01
+
+static void onShmFormat(void *data, struct wl_shm *, uint32_t format) {
+  Window *w = data;
+  if (format == WL_SHM_FORMAT_ARGB8888) {
+    w->haveArgb = true;
+  }
+}
+
+static const struct wl_shm_listener shmListener = {
+    .format = onShmFormat,
+};
+
+static void onPing(void *, struct xdg_wm_base *wmBase, uint32_t serial) {
+  xdg_wm_base_pong(wmBase, serial);
+}
+
+static const struct xdg_wm_base_listener wmBaseListener = {
+    .ping = onPing,
+};
+
+// The first configure is when the window can first be drawn
+static void onSurfaceConfigure(void *data, struct xdg_surface *surface,
+                               uint32_t serial) {
+  Window *w = data;
+  xdg_surface_ack_configure(surface, serial);
+  windowPush(w, (WindowEvent){.type = WINDOW_EVENT_REDRAW});
+}
+
+static const struct xdg_surface_listener surfaceListener = {
+    .configure = onSurfaceConfigure,
+};
+
+static void onToplevelConfigure(void *, struct xdg_toplevel *, int32_t,
+                                int32_t, struct wl_array *) {}
+
+static void onToplevelClose(void *data, struct xdg_toplevel *) {
+  windowPush(data, (WindowEvent){.type = WINDOW_EVENT_CLOSE});
+}
+
+static const struct xdg_toplevel_listener toplevelListener = {
+    .configure = onToplevelConfigure,
+    .close = onToplevelClose,
+};
+
+static void onKeymap(void *, struct wl_keyboard *, uint32_t, int32_t fd,
+                     uint32_t) {
+  close(fd);
+}
+
+static void onKeyboardEnter(void *, struct wl_keyboard *, uint32_t,
+                            struct wl_surface *, struct wl_array *) {}
+
+static void onKeyboardLeave(void *, struct wl_keyboard *, uint32_t,
+                            struct wl_surface *) {}
+
+static void onKey(void *data, struct wl_keyboard *, uint32_t, uint32_t,
+                  uint32_t key, uint32_t state) {
+  if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+    windowPush(data, (WindowEvent){.type = WINDOW_EVENT_KEY, .key = key});
+  }
+}
+
+static void onModifiers(void *, struct wl_keyboard *, uint32_t, uint32_t,
+                        uint32_t, uint32_t, uint32_t) {}
+
+static const struct wl_keyboard_listener keyboardListener = {
+    .keymap = onKeymap,
+    .enter = onKeyboardEnter,
+    .leave = onKeyboardLeave,
+    .key = onKey,
+    .modifiers = onModifiers,
+};
+
+static void pushMotion(Window *w, wl_fixed_t x, wl_fixed_t y) {
+  windowPush(w, (WindowEvent){.type = WINDOW_EVENT_MOTION,
+                              .x = wl_fixed_to_int(x),
+                              .y = wl_fixed_to_int(y)});
+}
+
+static void onPointerEnter(void *data, struct wl_pointer *, uint32_t,
+                           struct wl_surface *, wl_fixed_t x, wl_fixed_t y) {
+  pushMotion(data, x, y);
+}
+
+static void onPointerLeave(void *, struct wl_pointer *, uint32_t,
+                           struct wl_surface *) {}
+
+static void onPointerMotion(void *data, struct wl_pointer *, uint32_t,
+                            wl_fixed_t x, wl_fixed_t y) {
+  pushMotion(data, x, y);
+}
+
+static void onButton(void *, struct wl_pointer *, uint32_t, uint32_t,
+                     uint32_t, uint32_t) {}
+
+static void onAxis(void *, struct wl_pointer *, uint32_t, uint32_t,
+                   wl_fixed_t) {}
+
+static const struct wl_pointer_listener pointerListener = {
+    .enter = onPointerEnter,
+    .leave = onPointerLeave,
+    .motion = onPointerMotion,
+    .button = onButton,
+    .axis = onAxis,
+};
+
+static void onSeatCapabilities(void *data, struct wl_seat *seat,
+                               uint32_t capabilities) {
+  Window *w = data;
+
+  if (capabilities & WL_SEAT_CAPABILITY_KEYBOARD && !w->keyboard) {
+    w->keyboard = wl_seat_get_keyboard(seat);
+    wl_keyboard_add_listener(w->keyboard, &keyboardListener, w);
+  }
+  if (capabilities & WL_SEAT_CAPABILITY_POINTER && !w->pointer) {
+    w->pointer = wl_seat_get_pointer(seat);
+    wl_pointer_add_listener(w->pointer, &pointerListener, w);
+  }
+}
+
+static const struct wl_seat_listener seatListener = {
+    .capabilities = onSeatCapabilities,
+};
+
+static void onGlobal(void *data, struct wl_registry *registry, uint32_t name,
+                     const char *interface, uint32_t) {
+  Window *w = data;
+
+  if (strcmp(interface, wl_compositor_interface.name) == 0) {
+    w->compositor =
+        wl_registry_bind(registry, name, &wl_compositor_interface, 1);
+  } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+    w->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    wl_shm_add_listener(w->shm, &shmListener, w);
+  } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+    w->wmBase = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+    xdg_wm_base_add_listener(w->wmBase, &wmBaseListener, w);
+  } else if (strcmp(interface, wl_seat_interface.name) == 0 && !w->seat) {
+    w->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    wl_seat_add_listener(w->seat, &seatListener, w);
+  }
+}
+
+static void onGlobalRemove(void *, struct wl_registry *, uint32_t) {}
+
+static const struct wl_registry_listener registryListener = {
+    .global = onGlobal,
+    .global_remove = onGlobalRemove,
+};
+
+//---------------------------------------------------------------------------
+
+//
+// Connect to the compositor and open a fixed size xdg-shell toplevel, as
+// wayland example 01 does. The first WINDOW_EVENT_REDRAW comes with the
+// first configure.
+//
+// Returns 0 on success, -1 if the compositor cannot be reached, -2 if it
+// lacks a global the window needs, -3 if the buffers cannot be created.
+//
+int windowOpen(Window *w, const WindowDesc *desc) {
+  *w = (Window){};
+
+  w->display = wl_display_connect(nullptr);
+  if (!w->display) {
+    return -1;
+  }
+
+  w->registry = wl_display_get_registry(w->display);
+  wl_registry_add_listener(w->registry, &registryListener, w);
+  wl_display_roundtrip(w->display);
+  wl_display_roundtrip(w->display);
+
+  if (!w->compositor || !w->shm || !w->wmBase || !w->haveArgb) {
+    windowClose(w);
+    return -2;
+  }
+
+  // XRGB8888 tells the compositor the window is opaque, so it need not
+  // blend it
+  const uint32_t format =
+      desc->translucent ? WL_SHM_FORMAT_ARGB8888 : WL_SHM_FORMAT_XRGB8888;
+  if (shmPoolInit(&w->pool, w->shm, desc->width, desc->height, format,
+                  WINDOW_WAYLAND_BUFFERS)) {
+    windowClose(w);
+    return -3;
+  }
+
+  w->surface = wl_compositor_create_surface(w->compositor);
+  w->xdgSurface = xdg_wm_base_get_xdg_surface(w->wmBase, w->surface);
+  xdg_surface_add_listener(w->xdgSurface, &surfaceListener, w);
+  w->toplevel = xdg_surface_get_toplevel(w->xdgSurface);
+  xdg_toplevel_add_listener(w->toplevel, &toplevelListener, w);
+  xdg_toplevel_set_title(w->toplevel, desc->title);
+  xdg_toplevel_set_min_size(w->toplevel, desc->width, desc->height);
+  xdg_toplevel_set_max_size(w->toplevel, desc->width, desc->height);
+
+  wl_surface_commit(w->surface);
+  wl_display_flush(w->display);
+  return 0;
+}
+
+// Also tidies up after a windowOpen that failed part way
+void windowClose(Window *w) {
+  if (w->frame) {
+    wl_callback_destroy(w->frame);
+  }
+  if (w->toplevel) {
+    xdg_toplevel_destroy(w->toplevel);
+  }
+  if (w->xdgSurface) {
+    xdg_surface_destroy(w->xdgSurface);
+  }
+  if (w->surface) {
+    wl_surface_destroy(w->surface);
+  }
+  if (w->pool.pool) {
+    shmPoolDestroy(&w->pool);
+  }
+  if (w->pointer) {
+    wl_pointer_destroy(w->pointer);
+  }
+  if (w->keyboard) {
+    wl_keyboard_destroy(w->keyboard);
+  }
+  if (w->seat) {
+    wl_seat_destroy(w->seat);
+  }
+  if (w->wmBase) {
+    xdg_wm_base_destroy(w->wmBase);
+  }
+  if (w->shm) {
+    wl_shm_destroy(w->shm);
+  }
+  if (w->compositor) {
+    wl_compositor_destroy(w->compositor);
+  }
+  if (w->registry) {
+    wl_registry_destroy(w->registry);
+  }
+  wl_display_disconnect(w->display);
+  *w = (Window){};
+}
@@ -0,0 +1,103 @@
+#ifndef WINDOW_WAYLAND_H_20261017
+#define WINDOW_WAYLAND_H_20261017
+
+// Included by window.h, which defines WindowEvent and WindowBuffer
+
+#include "shmpool.h"
+#include <wayland-client.h>
+
+#define WINDOW_BACKEND_NAME "wayland"
+
+// Buffers in the pool, see shmpool.h
+#define WINDOW_WAYLAND_BUFFERS 3
+
+// Events waiting to be returned. Must be a power of two.
+#define WINDOW_EVENT_QUEUE 64
+
+struct Window {
+  struct wl_display *display;
+  struct wl_registry *registry;
+  struct wl_compositor *compositor;
+  struct wl_shm *shm;
+  struct xdg_wm_base *wmBase;
+  struct wl_seat *seat;
+  struct wl_keyboard *keyboard;
+  struct wl_pointer *pointer;
+
+  struct wl_surface *surface;
+  struct xdg_surface *xdgSurface;
+  struct xdg_toplevel *toplevel;
+  ShmPool pool;
+  bool haveArgb;
+
+  // The frame callback asked for by the last present
+  struct wl_callback *frame;
+
+  // Wayland hands events to listeners, which queue them here for
+  // windowPollEvent to return one at a time
+  WindowEvent queue[WINDOW_EVENT_QUEUE];
+  uint32_t head;
+  uint32_t tail;
+};
+
+void windowPush(Window *w, WindowEvent e);
+void windowReadEvents(Window *w);
+void windowRequestFrame(Window *w);
+
+static inline bool windowPop(Window *w, WindowEvent *e) {
+  if (w->head == w->tail) {
+    return false;
+  }
+  *e = w->queue[w->head++ % WINDOW_EVENT_QUEUE];
+  return true;
+}
+
+static inline bool windowPollEvent(Window *w, WindowEvent *e) {
+  if (windowPop(w, e)) {
+    return true;
+  }
+  windowReadEvents(w);
+  return windowPop(w, e);
+}
+
+static inline bool windowWaitEvent(Window *w, WindowEvent *e) {
+  while (!windowPop(w, e)) {
+    if (wl_display_dispatch(w->display) == -1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void windowStarved(Window *w);
+
+static inline bool windowAcquire(Window *w, WindowBuffer *b) {
+  ShmBuffer *buffer = shmPoolAcquire(&w->pool);
+  if (!buffer) {
+    windowStarved(w);
+    return false;
+  }
+  *b = (WindowBuffer){.pixels = buffer->pixels,
+                      .stride = w->pool.stride,
+                      .width = w->pool.width,
+                      .height = w->pool.height,
+                      .handle = buffer};
+  return true;
+}
+
+//
+// Wayland's ARGB8888 is already premultiplied 0xAARRGGBB, so the pixels go
+// out as they are. The frame callback asked for here is what brings the
+// next WINDOW_EVENT_REDRAW.
+//
+static inline void windowPresent(Window *w, WindowBuffer *b) {
+  shmBufferAttach(b->handle, w->surface);
+  wl_surface_damage(w->surface, 0, 0, INT32_MAX, INT32_MAX);
+  if (!w->frame) {
+    windowRequestFrame(w);
+  }
+  wl_surface_commit(w->surface);
+  wl_display_flush(w->display);
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "window.h"
+#include "pixelformat.h"
+#include "visual.h"
+#include <string.h>
+#include <xcb/xcb_icccm.h>
+#include <xcb/xcb_util.h>
+
+//
+// Connect to the X server and open a fixed size window on the default
+// screen, as xcb examples 03, 04 and 06 do.
+//
+// Returns 0 on success, -1 if the server cannot be reached, -2 if there is
+// no TrueColor visual of the depth needed that lays pixels out as
+// 0xAARRGGBB, -3 if the server has no Present extension or the framebuffers
+// cannot be created.
+//
+int windowOpen(Window *w, const WindowDesc *desc) {
+  *w = (Window){};
+
+  int screenNumber;
+  w->connection = xcb_connect(nullptr, &screenNumber);
+  if (xcb_connection_has_error(w->connection)) {
+    xcb_disconnect(w->connection);
+    return -1;
+  }
+  w->screen = xcb_aux_get_screen(w->connection, screenNumber);
+
+  // A translucent window needs the 32 bit ARGB visual, see xcb example 04.
+  // The visual has to take WindowBuffer's pixels as they are, which is
+  // what a copy only converter checks for. Nearly every server's does.
+  VisualConfig cfg = {};
+  PixelConverter native;
+  w->depth = desc->translucent ? 32 : w->screen->root_depth;
+  if (findDepthAndVisual(w->connection, w->screen, w->depth, &cfg, nullptr) ||
+      pixelConverterInit(&native, cfg.visual, w->depth, PIXEL_ORDER_BGRA,
+                         PIXEL_KERNEL_COPY)) {
+    xcb_disconnect(w->connection);
+    return -2;
+  }
+  w->colormap = cfg.colormap;
+
+  const uint32_t valueMask = XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL |
+                             XCB_CW_EVENT_MASK | XCB_CW_COLORMAP;
+  const uint32_t values[] = {
+      0, // background
+      0, // border
+      XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_EXPOSURE |
+          XCB_EVENT_MASK_POINTER_MOTION,
+      w->colormap,
+  };
+
+  w->window = xcb_generate_id(w->connection);
+  xcb_create_window(w->connection, w->depth, w->window, w->screen->root, 0, 0,
+                    desc->width, desc->height, 0,
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, cfg.visual->visual_id,
+                    valueMask, values);
+
+  xcb_change_property(w->connection, XCB_PROP_MODE_REPLACE, w->window,
+                      XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8,
+                      strlen(desc->title), desc->title);
+
+  // Be told about the close button instead of being disconnected
+  if (internAtoms(w->connection, &w->atoms) == 0) {
+    xcb_change_property(w->connection, XCB_PROP_MODE_REPLACE, w->window,
+                        w->atoms.WM_PROTOCOLS, XCB_ATOM, 32, 1,
+                        &w->atoms.WM_DELETE_WINDOW);
+  }
+
+  // The same minimum and maximum size keeps the window from being resized
+  xcb_size_hints_t sizeHints = {
+      .flags = XCB_ICCCM_SIZE_HINT_P_MIN_SIZE | XCB_ICCCM_SIZE_HINT_P_MAX_SIZE,
+      .min_width = desc->width,
+      .min_height = desc->height,
+      .max_width = desc->width,
+      .max_height = desc->height,
+  };
+  xcb_change_property(w->connection, XCB_PROP_MODE_REPLACE, w->window,
+                      XCB_ATOM_WM_NORMAL_HINTS, XCB_ATOM_WM_SIZE_HINTS, 32,
+                      sizeof(xcb_size_hints_t) / 4, &sizeHints);
+
+  // No dispatcher, windowTranslate hands the scheduler its events
+  if (frameSchedulerInit(&w->frames, w->connection, w->window, w->depth,
+                         desc->width, desc->height, nullptr)) {
+    xcb_destroy_window(w->connection, w->window);
+    xcb_free_colormap(w->connection, w->colormap);
+    xcb_disconnect(w->connection);
+    return -3;
+  }
+  xcb_map_window(w->connection, w->window);
+  xcb_flush(w->connection);
+  return 0;
+}
+
+void windowClose(Window *w) {
+  frameSchedulerDestroy(&w->frames);
+  xcb_destroy_window(w->connection, w->window);
+  xcb_free_colormap(w->connection, w->colormap);
+  atomCacheClear();
+  xcb_disconnect(w->connection);
+  *w = (Window){};
+}
@@ -0,0 +1,154 @@
+#ifndef WINDOW_XCB_H_20261017
+#define WINDOW_XCB_H_20261017
+
+// Included by window.h, which defines WindowEvent and WindowBuffer
+
+#include "atoms.h"
+#include "frames.h"
+#include <stdlib.h>
+#include <xcb/xcb.h>
+
+#define WINDOW_BACKEND_NAME "xcb"
+
+struct Window {
+  xcb_connection_t *connection;
+  xcb_screen_t *screen;
+  xcb_window_t window;
+  xcb_colormap_t colormap;
+  uint8_t depth;
+
+  Atoms atoms;
+
+  // Frames are paced to the display's refresh with Present, see frames.h,
+  // as Wayland paces them with frame callbacks
+  FrameScheduler frames;
+
+  // A frame has been presented, or windowAcquire found no buffer, and a
+  // REDRAW is owed once the scheduler can take the next one
+  bool wantFrame;
+};
+
+// A REDRAW if one is owed and the scheduler would hand out a buffer now
+static inline bool windowFrameReady(Window *w, WindowEvent *e) {
+  if (!w->wantFrame || w->frames.pending) {
+    return false;
+  }
+  for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+    if (!w->frames.buffers[i].busy) {
+      w->wantFrame = false;
+      *e = (WindowEvent){.type = WINDOW_EVENT_REDRAW};
+      return true;
+    }
+  }
+  return false;
+}
+
+// Turn an X event into a WindowEvent, false for events that are not passed on
+static inline bool windowTranslate(Window *w, xcb_generic_event_t *event,
+                                   WindowEvent *e) {
+  const uint8_t type = event->response_type & ~0x80;
+
+  switch (type) {
+  case XCB_KEY_PRESS:
+    *e = (WindowEvent){.type = WINDOW_EVENT_KEY,
+                       .key = ((xcb_key_press_event_t *)event)->detail - 8};
+    return true;
+
+  case XCB_MOTION_NOTIFY: {
+    const xcb_motion_notify_event_t *motion =
+        (xcb_motion_notify_event_t *)event;
+    *e = (WindowEvent){.type = WINDOW_EVENT_MOTION,
+                       .x = motion->event_x,
+                       .y = motion->event_y};
+    return true;
+  }
+
+  // Nothing in the ring holds the whole picture, so an exposed window is
+  // drawn again
+  case XCB_EXPOSE:
+    if (((xcb_expose_event_t *)event)->count) {
+      return false;
+    }
+    *e = (WindowEvent){.type = WINDOW_EVENT_REDRAW};
+    return true;
+
+  case XCB_CLIENT_MESSAGE: {
+    const xcb_client_message_event_t *message =
+        (xcb_client_message_event_t *)event;
+    if (message->type != w->atoms.WM_PROTOCOLS ||
+        message->data.data32[0] != w->atoms.WM_DELETE_WINDOW) {
+      return false;
+    }
+    *e = (WindowEvent){.type = WINDOW_EVENT_CLOSE};
+    return true;
+  }
+
+  // PresentCompleteNotify or PresentIdleNotify. A completed frame is the
+  // same signal as Wayland's frame callback.
+  case XCB_GE_GENERIC:
+    return frameSchedulerHandleEvent(&w->frames, event) &&
+           windowFrameReady(w, e);
+
+  default:
+    return false;
+  }
+}
+
+static inline bool windowPollEvent(Window *w, WindowEvent *e) {
+  xcb_generic_event_t *event;
+  while ((event = xcb_poll_for_event(w->connection))) {
+    const bool translated = windowTranslate(w, event, e);
+    free(event);
+    if (translated) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline bool windowWaitEvent(Window *w, WindowEvent *e) {
+  if (windowPollEvent(w, e)) {
+    return true;
+  }
+
+  xcb_flush(w->connection);
+  xcb_generic_event_t *event;
+  while ((event = xcb_wait_for_event(w->connection))) {
+    const bool translated = windowTranslate(w, event, e);
+    free(event);
+    if (translated) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline bool windowAcquire(Window *w, WindowBuffer *b) {
+  FrameSlot *slot = frameAcquire(&w->frames);
+  if (!slot) {
+    w->wantFrame = true;
+    return false;
+  }
+  *b = (WindowBuffer){.pixels = slot->fb.pixels,
+                      .stride = slot->fb.stride,
+                      .width = slot->fb.width,
+                      .height = slot->fb.height,
+                      .handle = slot};
+  return true;
+}
+
+//
+// windowOpen only takes a visual that is already 0xAARRGGBB, or 0x00RRGGBB
+// at depth 24, so the pixels go out as they are, straight from the memory
+// the pixmap is made of, as on Wayland. Nothing is converted in place, so
+// the buffer still holds premultiplied 0xAARRGGBB when it comes back.
+//
+static inline void windowPresent(Window *w, WindowBuffer *b) {
+  framePresent(&w->frames, b->handle);
+  xcb_flush(w->connection);
+
+  // The next frame is drawn once this one is on screen
+  w->wantFrame = true;
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// The same program on XCB and on Wayland.
+//
+// Everything here goes through window.h. Which backend it runs on is picked
+// when it is built, with -DWINDOW_BACKEND=XCB or -DWINDOW_BACKEND=WAYLAND,
+// and nothing in this file changes.
+//
+// The window shows a translucent gradient with a bright spot that follows
+// the pointer. A frame is drawn each time the backend says one can be
+// shown. It exits on escape or the close button.
+//
+// Usage: example01 [frames]
+//
+// With a frame count it exits after that many frames and prints how long
+// they took, which makes the two backends easy to compare.
+//
+
+#include "window.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIN_WIDTH 400
+#define WIN_HEIGHT 300
+#define SPOT_RADIUS 40
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Premultiplied 0xAARRGGBB, the same on every backend
+static void draw(const WindowBuffer *b, uint32_t frame, int32_t spotX,
+                 int32_t spotY) {
+  const uint32_t pitch = b->stride / 4;
+
+  for (int32_t y = 0; y < b->height; y++) {
+    uint32_t *row = b->pixels + (size_t)y * pitch;
+    const uint32_t a = 255 - (uint32_t)y * 160 / b->height;
+    const int32_t dy = y - spotY;
+
+    for (int32_t x = 0; x < b->width; x++) {
+      const int32_t dx = x - spotX;
+      const bool inSpot = dx * dx + dy * dy < SPOT_RADIUS * SPOT_RADIUS;
+      const uint32_t r = inSpot ? 255 : ((x + frame) % b->width) * 255 /
+                                            b->width;
+      const uint32_t g = inSpot ? 255 : (uint32_t)y * 255 / b->height;
+      const uint32_t blue = inSpot ? 255 : 0x80;
+      row[x] = a << 24 | (r * a / 255) << 16 | (g * a / 255) << 8 |
+               (blue * a / 255);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : 0;
+  if (frames < 0) {
+    fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+    return -1;
+  }
+
+  Window window;
+  const WindowDesc desc = {
+      .title = "Multiple Example 01",
+      .width = WIN_WIDTH,
+      .height = WIN_HEIGHT,
+      .translucent = true,
+  };
+  const int result = windowOpen(&window, &desc);
+  if (result) {
+    fprintf(stderr, "Unable to open a %s window (%d)\n", WINDOW_BACKEND_NAME,
+            result);
+    return -1;
+  }
+  printf("Backend: %s\n", WINDOW_BACKEND_NAME);
+
+  int32_t spotX = WIN_WIDTH / 2;
+  int32_t spotY = WIN_HEIGHT / 2;
+  uint32_t drawn = 0;
+  uint64_t events = 0;
+  uint64_t starved = 0;
+  bool running = true;
+  const uint64_t start = now();
+
+  WindowEvent e;
+  while (running && windowWaitEvent(&window, &e)) {
+    events++;
+
+    switch (e.type) {
+    case WINDOW_EVENT_CLOSE:
+      running = false;
+      break;
+
+    case WINDOW_EVENT_KEY:
+      printf("Keycode: %u\n", e.key);
+      running = e.key != WINDOW_KEY_ESCAPE;
+      break;
+
+    case WINDOW_EVENT_MOTION:
+      spotX = e.x;
+      spotY = e.y;
+      break;
+
+    case WINDOW_EVENT_REDRAW: {
+      WindowBuffer b;
+      if (!windowAcquire(&window, &b)) {
+        // Another REDRAW comes once a buffer is free
+        starved++;
+        break;
+      }
+      draw(&b, drawn, spotX, spotY);
+      windowPresent(&window, &b);
+      drawn++;
+      running = frames == 0 || drawn < (uint32_t)frames;
+      break;
+    }
+    }
+  }
+
+  const double seconds = (now() - start) / 1e9;
+  printf("%u frames in %.3f s, %.1f fps, %llu events, no free buffer %llu "
+         "times\n",
+         drawn, seconds, drawn / seconds, (unsigned long long)events,
+         (unsigned long long)starved);
+
+  windowClose(&window);
+  return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "frames.h"
+
+static uint64_t now(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void frameTimesAdd(FrameTimes *t, uint64_t ns) {
+  if (t->count == 0 || ns < t->min) {
+    t->min = ns;
+  }
+  if (ns > t->max) {
+    t->max = ns;
+  }
+  t->sum += ns;
+  t->count++;
+}
+
+// The frame waiting for this feedback, which is done with after this
+static FramePending *takePending(FrameLoop *l,
+                                 struct wp_presentation_feedback *feedback) {
+  for (uint32_t i = 0; i < FRAME_FEEDBACK_MAX; i++) {
+    if (l->pending[i].feedback == feedback) {
+      wp_presentation_feedback_destroy(feedback);
+      l->pending[i].feedback = nullptr;
+      return &l->pending[i];
+    }
+  }
+  return nullptr;
+}
+
+//---------------------------------------------------------------------------
+// Presentation feedback
+
+static void onSyncOutput(void *, struct wp_presentation_feedback *,
+                         struct wl_output *) {}
+
+//
+// The frame reached the screen. The time is when the refresh it appeared
+// on began, seq counts refreshes, and refresh is the interval in
+// nanoseconds, 0 if the output has no fixed rate.
+//
+static void onPresented(void *data, struct wp_presentation_feedback *feedback,
+                        uint32_t secHi, uint32_t secLo, uint32_t nsec,
+                        uint32_t refresh, uint32_t seqHi, uint32_t seqLo,
+                        uint32_t flags) {
+  FrameLoop *l = data;
+  FramePending *p = takePending(l, feedback);
+  if (!p) {
+    return;
+  }
+  FrameLoopStats *s = &l->stats;
+
+  const uint64_t shownNs =
+      ((uint64_t)secHi << 32 | secLo) * 1000000000ull + nsec;
+  const uint64_t seq = (uint64_t)seqHi << 32 | seqLo;
+
+  s->presented++;
+  if (flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC) {
+    s->vsync++;
+  }
+  if (flags & WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY) {
+    s->zeroCopy++;
+  }
+  if (refresh) {
+    l->refreshNs = refresh;
+  }
+
+  // How long frames take to reach the screen, smoothed so one slow frame
+  // does not move every target after it
+  const uint64_t latency = shownNs > p->committedNs ? shownNs - p->committedNs
+                                                    : 0;
+  frameTimesAdd(&s->latency, latency);
+  l->latencyNs =
+      l->latencyNs ? (l->latencyNs * 7 + latency) / 8 : latency;
+
+  // Aimed at one refresh, shown on a later one
+  if (l->refreshNs && shownNs >= p->targetNs + l->refreshNs / 2) {
+    s->late++;
+  }
+
+  // Only frames shown in order say anything about the refreshes between
+  if (l->haveLast && seq > l->lastSeq) {
+    s->missed += seq - l->lastSeq - 1;
+    frameTimesAdd(&s->interval, shownNs - l->lastShownNs);
+  }
+  if (!l->haveLast || seq > l->lastSeq) {
+    l->lastShownNs = shownNs;
+    l->lastSeq = seq;
+    l->haveLast = true;
+  }
+}
+
+// The frame was never shown, a later one replaced it or the surface is
+// hidden
+static void onDiscarded(void *data,
+                        struct wp_presentation_feedback *feedback) {
+  FrameLoop *l = data;
+  if (takePending(l, feedback)) {
+    l->stats.discarded++;
+  }
+}
+
+static const struct wp_presentation_feedback_listener feedbackListener = {
+    .sync_output = onSyncOutput,
+    .presented = onPresented,
+    .discarded = onDiscarded,
+};
+
+//---------------------------------------------------------------------------
+// Drawing
+
+//
+// When the frame being drawn now can be on screen.
+//
+// That is the first refresh after now plus the time frames have been taking
+// to get there. Refreshes are counted from the last one a frame was shown
+// on. Until the compositor has said anything the answer is simply now.
+//
+static uint64_t predictTarget(const FrameLoop *l, uint64_t t) {
+  if (!l->refreshNs || !l->haveLast) {
+    return t;
+  }
+
+  const uint64_t earliest = t + l->latencyNs;
+  if (earliest <= l->lastShownNs) {
+    return l->lastShownNs + l->refreshNs;
+  }
+  const uint64_t refreshes =
+      (earliest - l->lastShownNs + l->refreshNs - 1) / l->refreshNs;
+  return l->lastShownNs + refreshes * l->refreshNs;
+}
+
+static void onFrame(void *data, struct wl_callback *callback,
+                    uint32_t timeMs);
+
+static const struct wl_callback_listener frameListener = {
+    .done = onFrame,
+};
+
+//
+// Draw a frame, ask to be told when the next one is wanted and commit.
+//
+// If the compositor still holds every buffer nothing is drawn. The surface
+// is committed anyway so the frame callback still comes, and the buffers
+// are tried again then.
+//
+static void drawFrame(FrameLoop *l) {
+  l->callback = wl_surface_frame(l->surface);
+  wl_callback_add_listener(l->callback, &frameListener, l);
+
+  ShmBuffer *b = shmPoolAcquire(l->pool);
+  if (!b) {
+    l->stats.starved++;
+    wl_surface_commit(l->surface);
+    return;
+  }
+
+  const uint64_t committed = now(l->clock);
+  const uint64_t target = predictTarget(l, committed);
+  l->draw(b, target, l->data);
+
+  // Feedback for this frame, if there is room to wait for it
+  if (l->presentation) {
+    for (uint32_t i = 0; i < FRAME_FEEDBACK_MAX; i++) {
+      FramePending *p = &l->pending[i];
+      if (!p->feedback) {
+        p->feedback = wp_presentation_feedback(l->presentation, l->surface);
+        wp_presentation_feedback_add_listener(p->feedback, &feedbackListener,
+                                              l);
+        p->committedNs = committed;
+        p->targetNs = target;
+        break;
+      }
+    }
+  }
+
+  shmBufferAttach(b, l->surface);
+  wl_surface_damage(l->surface, 0, 0, INT32_MAX, INT32_MAX);
+  wl_surface_commit(l->surface);
+  l->stats.drawn++;
+}
+
+//
+// The compositor wants a new frame. Without wp_presentation the time of the
+// callback, in milliseconds, is the only clue to the refresh rate.
+//
+static void onFrame(void *data, struct wl_callback *callback,
+                    uint32_t timeMs) {
+  FrameLoop *l = data;
+  wl_callback_destroy(callback);
+  l->callback = nullptr;
+  l->stats.callbacks++;
+
+  if (!l->presentation && l->lastCallbackMs) {
+    frameTimesAdd(&l->stats.interval,
+                  (uint64_t)(timeMs - l->lastCallbackMs) * 1000000);
+  }
+  l->lastCallbackMs = timeMs;
+
+  drawFrame(l);
+}
+
+//---------------------------------------------------------------------------
+
+//
+// Set up a frame loop for a surface. Nothing is drawn until frameLoopStart.
+//
+// presentation can be nullptr, then frames are still only drawn when the
+// compositor asks but nothing is known about when they are shown. clock is
+// the one wp_presentation.clock_id named, CLOCK_MONOTONIC without it.
+//
+void frameLoopInit(                       //
+    FrameLoop *l,                         ///> loop to set up
+    struct wl_surface *surface,           ///> surface to draw
+    struct wp_presentation *presentation, ///> or nullptr
+    clockid_t clock,                      ///> presentation clock
+    ShmPool *pool,                        ///> buffers to draw into
+    FrameDrawFn draw,                     ///> draws one frame
+    void *data                            ///> passed to draw
+) {
+  *l = (FrameLoop){.surface = surface,
+                   .presentation = presentation,
+                   .clock = clock,
+                   .pool = pool,
+                   .draw = draw,
+                   .data = data};
+}
+
+void frameLoopDestroy(FrameLoop *l) {
+  if (l->callback) {
+    wl_callback_destroy(l->callback);
+  }
+  for (uint32_t i = 0; i < FRAME_FEEDBACK_MAX; i++) {
+    if (l->pending[i].feedback) {
+      wp_presentation_feedback_destroy(l->pending[i].feedback);
+    }
+  }
+  *l = (FrameLoop){};
+}
+
+// Draw the first frame. Every frame after it is drawn from the callback
+// the one before asked for.
+void frameLoopStart(FrameLoop *l) {
+  if (!l->callback) {
+    drawFrame(l);
+  }
+}
+
+static void printTimes(FILE *out, const char *name, const FrameTimes *t) {
+  if (t->count) {
+    fprintf(out, "  %s (ms): mean %.2f, min %.2f, max %.2f\n", name,
+            (double)t->sum / t->count / 1e6, t->min / 1e6, t->max / 1e6);
+  }
+}
+
+void printFrameLoopStats(FILE *out, const FrameLoop *l) {
+  const FrameLoopStats *s = &l->stats;
+
+  fprintf(out,
+          "Frames: %llu drawn, %llu callbacks, %llu presented (%llu vsync, "
+          "%llu zero copy), %llu discarded\n",
+          (unsigned long long)s->drawn, (unsigned long long)s->callbacks,
+          (unsigned long long)s->presented, (unsigned long long)s->vsync,
+          (unsigned long long)s->zeroCopy, (unsigned long long)s->discarded);
+  fprintf(out,
+          "  %llu late, %llu refreshes missed, no free buffer %llu times\n",
+          (unsigned long long)s->late, (unsigned long long)s->missed,
+          (unsigned long long)s->starved);
+  if (l->refreshNs) {
+    fprintf(out, "  refresh %.2f ms\n", l->refreshNs / 1e6);
+  }
+  printTimes(out, "latency", &s->latency);
+  printTimes(out, "interval", &s->interval);
+}
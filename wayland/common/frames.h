@@ -0,0 +1,93 @@
+#ifndef FRAMES_H_20261017
+#define FRAMES_H_20261017
+
+#include "presentation-time-client-protocol.h"
+#include "shmpool.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <wayland-client.h>
+
+// Frames that can wait for presentation feedback at once
+#define FRAME_FEEDBACK_MAX 8
+
+// Count, total and extremes of a series of durations in nanoseconds
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+} FrameTimes;
+
+typedef struct {
+  uint64_t drawn;     // Frames drawn and committed
+  uint64_t callbacks; // wl_surface.frame callbacks received
+  uint64_t presented; // Shown, according to wp_presentation feedback
+  uint64_t discarded; // Replaced or hidden before they were shown
+  uint64_t late;      // Shown a refresh or more after their target
+  uint64_t missed;    // Refreshes that went by without a new frame
+  uint64_t starved;   // Callbacks that found every buffer busy
+  uint64_t vsync;     // Shown in step with the display's refresh
+  uint64_t zeroCopy;  // Shown straight from the client's buffer
+
+  FrameTimes latency;  // Commit to presentation
+  FrameTimes interval; // Between frames reaching the screen
+} FrameLoopStats;
+
+// A frame waiting for its presentation feedback
+typedef struct {
+  struct wp_presentation_feedback *feedback;
+  uint64_t committedNs;
+  uint64_t targetNs;
+} FramePending;
+
+// Draws a frame into b for the moment it is expected on screen, in
+// nanoseconds of the loop's clock
+typedef void (*FrameDrawFn)(ShmBuffer *b, uint64_t targetNs, void *data);
+
+//
+// Draws a surface only when the compositor is ready to show a new frame.
+//
+// Every frame asks for a wl_surface.frame callback, and the next frame is
+// drawn when it arrives. A compositor sends it when a new frame would be
+// worth showing, so a hidden window draws nothing and a visible one draws
+// at most once per refresh.
+//
+// When the compositor offers wp_presentation each frame also asks for
+// feedback, which says when the frame was actually shown, on which refresh
+// and how long a refresh is. The loop uses it to aim each frame at the
+// refresh it can really make, given how long frames have been taking to
+// reach the screen, and to count frames that were late or discarded.
+//
+typedef struct {
+  struct wl_surface *surface;
+  struct wp_presentation *presentation; // nullptr when not offered
+  clockid_t clock; // The clock presentation times are given in
+  ShmPool *pool;
+
+  FrameDrawFn draw;
+  void *data;
+
+  struct wl_callback *callback; // The frame callback being waited for
+
+  FramePending pending[FRAME_FEEDBACK_MAX];
+
+  uint64_t refreshNs;   // Refresh interval, 0 until known
+  uint64_t latencyNs;   // Smoothed commit to presentation time
+  uint64_t lastShownNs; // When the last frame reached the screen
+  uint64_t lastSeq;     // and on which refresh
+  bool haveLast;
+  uint32_t lastCallbackMs; // Frame callback time, without wp_presentation
+
+  FrameLoopStats stats;
+} FrameLoop;
+
+void frameLoopInit(FrameLoop *l, struct wl_surface *surface,
+                   struct wp_presentation *presentation, clockid_t clock,
+                   ShmPool *pool, FrameDrawFn draw, void *data);
+void frameLoopDestroy(FrameLoop *l);
+void frameLoopStart(FrameLoop *l);
+
+void printFrameLoopStats(FILE *out, const FrameLoop *l);
+
+#endif
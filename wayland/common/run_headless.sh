@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Run a Wayland client against a private headless weston and exit with the
+# client's status.
+#
+# weston gets a runtime directory and socket of its own, so this works
+# without a desktop session and does not disturb one that is running.
+#
+# Usage: run_headless.sh <client> [arguments...]
+#
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <client> [arguments...]" >&2
+    exit 2
+fi
+
+runtime=$(mktemp -d) || exit 1
+trap 'rm -rf "$runtime"' EXIT
+
+export XDG_RUNTIME_DIR="$runtime"
+socket=wayland-headless
+
+weston --backend=headless-backend.so --socket="$socket" --idle-time=0 \
+    >"$runtime/weston.log" 2>&1 &
+weston=$!
+
+# Wait up to 5 seconds for the socket to appear
+tries=0
+while [ ! -S "$runtime/$socket" ]; do
+    if ! kill -0 "$weston" 2>/dev/null || [ $tries -ge 50 ]; then
+        echo "weston did not start:" >&2
+        cat "$runtime/weston.log" >&2
+        kill "$weston" 2>/dev/null
+        exit 1
+    fi
+    sleep 0.1
+    tries=$((tries + 1))
+done
+
+WAYLAND_DISPLAY="$socket" "$@"
+status=$?
+
+kill "$weston" 2>/dev/null
+wait "$weston" 2>/dev/null
+exit $status
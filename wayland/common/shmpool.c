@@ -0,0 +1,164 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "shmpool.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The compositor is done reading a buffer
+static void onRelease(void *data, struct wl_buffer *) {
+  ShmBuffer *b = data;
+  if (b->busy) {
+    b->busy = false;
+    b->pool->stats.inFlight--;
+    b->pool->stats.releases++;
+  }
+}
+
+static const struct wl_buffer_listener bufferListener = {
+    .release = onRelease,
+};
+
+//
+// Create count buffers of width x height pixels in one memfd and share it
+// with the compositor.
+//
+// The pixels are 4 bytes each. WL_SHM_FORMAT_ARGB8888 and XRGB8888 are the
+// two every compositor supports, ARGB8888 with premultiplied alpha.
+//
+// Returns 0 on success, -1 if count is out of range, -2 if the memory could
+// not be created or mapped.
+//
+int shmPoolInit(                     //
+    ShmPool *p,                      ///> pool to set up
+    struct wl_shm *shm,              ///> bound from the registry
+    uint32_t width,                  ///> size of each buffer in pixels
+    uint32_t height,                 ///>
+    uint32_t format,                 ///> WL_SHM_FORMAT_*
+    uint32_t count                   ///> buffers, 1 to SHM_POOL_MAX
+) {
+  *p = (ShmPool){.width = width,
+                 .height = height,
+                 .stride = width * 4,
+                 .format = format};
+  if (count < 1 || count > SHM_POOL_MAX || width == 0 || height == 0) {
+    return -1;
+  }
+
+  const size_t bufferSize = (size_t)p->stride * height;
+  p->size = bufferSize * count;
+
+  int fd = memfd_create("wayland-shm-pool", MFD_CLOEXEC);
+  if (fd < 0) {
+    return -2;
+  }
+  if (ftruncate(fd, p->size) < 0) {
+    close(fd);
+    return -2;
+  }
+
+  void *memory =
+      mmap(nullptr, p->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED) {
+    close(fd);
+    return -2;
+  }
+
+  // The compositor gets its own copy of the fd, ours is no longer needed
+  // once the pool exists. The mapping stays valid.
+  p->pool = wl_shm_create_pool(shm, fd, p->size);
+  close(fd);
+  p->memory = memory;
+
+  for (; p->count < count; p->count++) {
+    ShmBuffer *b = &p->buffers[p->count];
+    const size_t offset = bufferSize * p->count;
+    *b = (ShmBuffer){
+        .buffer = wl_shm_pool_create_buffer(p->pool, offset, width, height,
+                                            p->stride, format),
+        .pixels = (uint32_t *)((char *)memory + offset),
+        .pool = p,
+    };
+    wl_buffer_add_listener(b->buffer, &bufferListener, b);
+  }
+  return 0;
+}
+
+// The buffers can be destroyed while the compositor still holds them, it
+// keeps its own reference to the memory until it is done
+void shmPoolDestroy(ShmPool *p) {
+  for (uint32_t i = 0; i < p->count; i++) {
+    wl_buffer_destroy(p->buffers[i].buffer);
+  }
+  if (p->pool) {
+    wl_shm_pool_destroy(p->pool);
+  }
+  if (p->memory) {
+    munmap(p->memory, p->size);
+  }
+  *p = (ShmPool){};
+}
+
+//
+// A buffer the compositor is not reading, or nullptr if they are all busy.
+// The buffers are handed out in turn, so the one returned is the one that
+// was attached longest ago.
+//
+ShmBuffer *shmPoolAcquire(ShmPool *p) {
+  p->stats.acquires++;
+  for (uint32_t i = 0; i < p->count; i++) {
+    const uint32_t index = (p->next + i) % p->count;
+    if (!p->buffers[index].busy) {
+      p->next = (index + 1) % p->count;
+      return &p->buffers[index];
+    }
+  }
+  p->stats.stalls++;
+  return nullptr;
+}
+
+//
+// Attach a buffer to a surface and mark it busy until it is released. The
+// caller damages and commits the surface as usual.
+//
+void shmBufferAttach(ShmBuffer *b, struct wl_surface *surface) {
+  wl_surface_attach(surface, b->buffer, 0, 0);
+  if (!b->busy) {
+    b->busy = true;
+    ShmPoolStats *s = &b->pool->stats;
+    if (++s->inFlight > s->maxInFlight) {
+      s->maxInFlight = s->inFlight;
+    }
+  }
+}
+
+void printShmPoolStats(FILE *out, const ShmPool *p) {
+  const ShmPoolStats *s = &p->stats;
+  fprintf(out,
+          "SHM pool: %u buffers of %ux%u, %llu acquires, %llu releases, at "
+          "most %u in use by the compositor, %llu stalls\n",
+          p->count, p->width, p->height, (unsigned long long)s->acquires,
+          (unsigned long long)s->releases, s->maxInFlight,
+          (unsigned long long)s->stalls);
+}
@@ -0,0 +1,66 @@
+#ifndef SHMPOOL_H_20261017
+#define SHMPOOL_H_20261017
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-client.h>
+
+#define SHM_POOL_MAX 4
+
+typedef struct ShmPool ShmPool;
+
+typedef struct {
+  struct wl_buffer *buffer;
+  uint32_t *pixels;
+  ShmPool *pool;
+
+  // Attached to a surface and not yet given back with wl_buffer.release.
+  // The compositor may read it at any time until then.
+  bool busy;
+} ShmBuffer;
+
+typedef struct {
+  uint64_t acquires;
+  uint64_t releases;
+  uint64_t stalls; // Acquires that found every buffer busy
+  uint32_t inFlight;
+  uint32_t maxInFlight;
+} ShmPoolStats;
+
+//
+// Buffers of one size and format carved out of a single memfd that the
+// compositor maps too, the Wayland version of an MIT-SHM segment.
+//
+// A buffer is drawn into only while the compositor is not using it. It
+// becomes busy when it is attached to a surface and free again when the
+// compositor sends wl_buffer.release, so with more than one buffer the next
+// frame can be drawn while the last is still being read.
+//
+struct ShmPool {
+  struct wl_shm_pool *pool;
+  void *memory;
+  size_t size;
+
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride; // Bytes per row
+  uint32_t format; // WL_SHM_FORMAT_*
+
+  ShmBuffer buffers[SHM_POOL_MAX];
+  uint32_t count;
+  uint32_t next; // Where to start looking for a free buffer
+
+  ShmPoolStats stats;
+};
+
+int shmPoolInit(ShmPool *p, struct wl_shm *shm, uint32_t width,
+                uint32_t height, uint32_t format, uint32_t count);
+void shmPoolDestroy(ShmPool *p);
+
+ShmBuffer *shmPoolAcquire(ShmPool *p);
+void shmBufferAttach(ShmBuffer *b, struct wl_surface *surface);
+
+void printShmPoolStats(FILE *out, const ShmPool *p);
+
+#endif
@@ -0,0 +1,406 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// An animation drawn only when the compositor can show it.
+//
+// Example 01 drew as fast as round trips allowed, which wastes work on
+// frames that are replaced before the screen ever refreshes. Here each
+// frame asks for a wl_surface.frame callback and the next one is drawn when
+// it comes, and wp_presentation says when each frame was really shown. See
+// ../common/frames.c. This is the Wayland counterpart of xcb example 07.
+//
+
+#include "frames.h"
+#include "shmpool.h"
+#include "xdg-shell-client-protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+// Fixed size of the window
+#define WIN_WIDTH 400
+#define WIN_HEIGHT 300
+
+// Three buffers, so a frame can be drawn while the compositor still holds
+// the last one and another is waiting to be shown
+#define BUFFER_COUNT 3
+
+// How far the bar moves, in pixels per second
+#define BAR_SPEED 160
+#define BAR_WIDTH 40
+
+// Evdev key codes are what Wayland sends, KEY_ESC in
+// linux/input-event-codes.h. X11 adds 8 to the same numbers, which is why
+// the xcb examples look for 9.
+#define ESCAPE_KEY 1
+
+// Globals bound from the registry
+static struct {
+  struct wl_display *display;
+  struct wl_registry *registry;
+  struct wl_compositor *compositor;
+  struct wl_shm *shm;
+  struct xdg_wm_base *wmBase;
+  struct wl_seat *seat;
+  struct wl_keyboard *keyboard;
+
+  // Optional, without it frames are still paced but not measured
+  struct wp_presentation *presentation;
+  clockid_t clock;
+
+  // wl_shm lists the pixel formats it takes as events after binding
+  bool haveArgb;
+} wl = {.clock = CLOCK_MONOTONIC};
+
+// State shared with the listeners
+static struct {
+  struct wl_surface *surface;
+  struct xdg_surface *xdgSurface;
+  struct xdg_toplevel *toplevel;
+
+  ShmPool pool;
+  FrameLoop frames;
+
+  // Nothing can be attached before the first configure is acknowledged
+  bool configured;
+  bool should_exit;
+
+  // When the first frame was aimed at, the animation is timed from there
+  uint64_t startNs;
+  bool started;
+} app = {};
+
+//
+// Draw a translucent gradient with a bar sliding across it.
+//
+// The bar's position comes from the time the frame is expected on screen,
+// not from how many frames have been drawn, so it moves at the same speed
+// whatever the refresh rate and however many frames are dropped. Pixels
+// are premultiplied ARGB8888, as in example 01.
+//
+static void draw(ShmBuffer *b, uint64_t targetNs, void *) {
+  const ShmPool *p = b->pool;
+  const uint32_t pitch = p->stride / 4;
+
+  if (!app.started) {
+    app.startNs = targetNs;
+    app.started = true;
+  }
+  const uint64_t elapsedNs = targetNs - app.startNs;
+  const uint32_t barX =
+      (uint32_t)(elapsedNs * BAR_SPEED / 1000000000ull % p->width);
+
+  for (uint32_t y = 0; y < p->height; y++) {
+    uint32_t *row = b->pixels + (size_t)y * pitch;
+    const uint32_t a = 255 - y * 160 / p->height;
+
+    for (uint32_t x = 0; x < p->width; x++) {
+      const bool onBar = (x + p->width - barX) % p->width < BAR_WIDTH;
+      const uint32_t r = onBar ? 255 : x * 255 / p->width;
+      const uint32_t g = onBar ? 255 : y * 255 / p->height;
+      const uint32_t blue = onBar ? 255 : 0x80;
+      row[x] = a << 24 | (r * a / 255) << 16 | (g * a / 255) << 8 |
+               (blue * a / 255);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+// Listeners
+//
+// Wayland delivers events by calling a table of functions registered for
+// each object. Every event the bound version can send needs an entry, even
+// the ones that are ignored.
+
+// wl_shm announces the formats it accepts. ARGB8888 and XRGB8888 are
+// required, the check is only there to be certain.
+static void onShmFormat(void *, struct wl_shm *, uint32_t format) {
+  if (format == WL_SHM_FORMAT_ARGB8888) {
+    wl.haveArgb = true;
+  }
+}
+
+static const struct wl_shm_listener shmListener = {
+    .format = onShmFormat,
+};
+
+// Which clock presentation times are measured with, sent once after binding
+static void onClockId(void *, struct wp_presentation *, uint32_t clock) {
+  wl.clock = (clockid_t)clock;
+}
+
+static const struct wp_presentation_listener presentationListener = {
+    .clock_id = onClockId,
+};
+
+// The compositor checks that the client is still responding
+static void onPing(void *, struct xdg_wm_base *wmBase, uint32_t serial) {
+  xdg_wm_base_pong(wmBase, serial);
+}
+
+static const struct xdg_wm_base_listener wmBaseListener = {
+    .ping = onPing,
+};
+
+//
+// The end of a configure sequence. The toplevel's configure comes first
+// with the suggested size and state. The window is a fixed size so that is
+// ignored, acknowledging it is what matters. The first configure is what
+// allows the window to be shown.
+//
+static void onSurfaceConfigure(void *, struct xdg_surface *surface,
+                               uint32_t serial) {
+  xdg_surface_ack_configure(surface, serial);
+
+  if (!app.configured) {
+    app.configured = true;
+    frameLoopStart(&app.frames);
+  } else {
+    wl_surface_commit(app.surface);
+  }
+}
+
+static const struct xdg_surface_listener surfaceListener = {
+    .configure = onSurfaceConfigure,
+};
+
+static void onToplevelConfigure(void *, struct xdg_toplevel *, int32_t,
+                                int32_t, struct wl_array *) {}
+
+// The close button, or whatever the compositor uses instead
+static void onToplevelClose(void *, struct xdg_toplevel *) {
+  app.should_exit = true;
+}
+
+static const struct xdg_toplevel_listener toplevelListener = {
+    .configure = onToplevelConfigure,
+    .close = onToplevelClose,
+};
+
+// Keyboard events. Only the raw key code is needed to spot escape, so the
+// keymap is not loaded and its fd is just closed.
+static void onKeymap(void *, struct wl_keyboard *, uint32_t, int32_t fd,
+                     uint32_t) {
+  close(fd);
+}
+
+static void onEnter(void *, struct wl_keyboard *, uint32_t,
+                    struct wl_surface *, struct wl_array *) {}
+
+static void onLeave(void *, struct wl_keyboard *, uint32_t,
+                    struct wl_surface *) {}
+
+static void onKey(void *, struct wl_keyboard *, uint32_t, uint32_t,
+                  uint32_t key, uint32_t state) {
+  if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+    printf("Keycode: %d\n", key);
+    if (key == ESCAPE_KEY) {
+      app.should_exit = true;
+    }
+  }
+}
+
+static void onModifiers(void *, struct wl_keyboard *, uint32_t, uint32_t,
+                        uint32_t, uint32_t, uint32_t) {}
+
+static const struct wl_keyboard_listener keyboardListener = {
+    .keymap = onKeymap,
+    .enter = onEnter,
+    .leave = onLeave,
+    .key = onKey,
+    .modifiers = onModifiers,
+};
+
+// A seat is a group of input devices. Ask for its keyboard once it has one.
+static void onSeatCapabilities(void *, struct wl_seat *seat,
+                               uint32_t capabilities) {
+  const bool hasKeyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
+
+  if (hasKeyboard && !wl.keyboard) {
+    wl.keyboard = wl_seat_get_keyboard(seat);
+    wl_keyboard_add_listener(wl.keyboard, &keyboardListener, nullptr);
+  } else if (!hasKeyboard && wl.keyboard) {
+    wl_keyboard_destroy(wl.keyboard);
+    wl.keyboard = nullptr;
+  }
+}
+
+static const struct wl_seat_listener seatListener = {
+    .capabilities = onSeatCapabilities,
+};
+
+//
+// The registry lists every global the compositor offers. Bind the ones the
+// example uses, at the lowest version that has what it needs, so only
+// events this code knows about are ever sent.
+//
+static void onGlobal(void *, struct wl_registry *registry, uint32_t name,
+                     const char *interface, uint32_t) {
+  if (strcmp(interface, wl_compositor_interface.name) == 0) {
+    wl.compositor =
+        wl_registry_bind(registry, name, &wl_compositor_interface, 1);
+  } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+    wl.shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    wl_shm_add_listener(wl.shm, &shmListener, nullptr);
+  } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+    wl.wmBase = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+    xdg_wm_base_add_listener(wl.wmBase, &wmBaseListener, nullptr);
+  } else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+    wl.presentation =
+        wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+    wp_presentation_add_listener(wl.presentation, &presentationListener,
+                                 nullptr);
+  } else if (strcmp(interface, wl_seat_interface.name) == 0 && !wl.seat) {
+    wl.seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    wl_seat_add_listener(wl.seat, &seatListener, nullptr);
+  }
+}
+
+static void onGlobalRemove(void *, struct wl_registry *, uint32_t) {}
+
+static const struct wl_registry_listener registryListener = {
+    .global = onGlobal,
+    .global_remove = onGlobalRemove,
+};
+
+//---------------------------------------------------------------------------
+
+//
+// Usage: example02 [frames]
+//
+// With a frame count the example exits after drawing that many frames,
+// which makes it easy to run under a headless compositor, see
+// ../common/run_headless.sh. Without one it runs until it is closed or
+// escape is pressed.
+//
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : 0;
+  if (frames < 0) {
+    fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+    return -1;
+  }
+
+  // Connect to the compositor named by WAYLAND_DISPLAY
+  wl.display = wl_display_connect(nullptr);
+  if (!wl.display) {
+    fprintf(stderr, "Unable to connect to a Wayland compositor\n");
+    return -1;
+  }
+
+  // The first round trip delivers the globals, the second the events sent
+  // by the objects bound during the first, such as wl_shm's formats and
+  // the presentation clock
+  wl.registry = wl_display_get_registry(wl.display);
+  wl_registry_add_listener(wl.registry, &registryListener, nullptr);
+  wl_display_roundtrip(wl.display);
+  wl_display_roundtrip(wl.display);
+
+  if (!wl.compositor || !wl.shm || !wl.wmBase || !wl.haveArgb) {
+    fprintf(stderr, "The compositor does not offer wl_compositor, wl_shm "
+                    "with ARGB8888 and xdg_wm_base\n");
+    wl_display_disconnect(wl.display);
+    return -1;
+  }
+
+  if (shmPoolInit(&app.pool, wl.shm, WIN_WIDTH, WIN_HEIGHT,
+                  WL_SHM_FORMAT_ARGB8888, BUFFER_COUNT)) {
+    fprintf(stderr, "Unable to create the shared memory buffers\n");
+    wl_display_disconnect(wl.display);
+    return -1;
+  }
+
+  if (!wl.presentation) {
+    printf("No wp_presentation, frames are paced but not measured\n");
+  }
+
+  //
+  // Create the window
+  //
+  app.surface = wl_compositor_create_surface(wl.compositor);
+  app.xdgSurface = xdg_wm_base_get_xdg_surface(wl.wmBase, app.surface);
+  xdg_surface_add_listener(app.xdgSurface, &surfaceListener, nullptr);
+  app.toplevel = xdg_surface_get_toplevel(app.xdgSurface);
+  xdg_toplevel_add_listener(app.toplevel, &toplevelListener, nullptr);
+  xdg_toplevel_set_title(app.toplevel, "Wayland Example 02");
+  xdg_toplevel_set_app_id(app.toplevel, "wayland-example02");
+
+  // The same minimum and maximum size is how xdg-shell says the window
+  // cannot be resized, like WM_NORMAL_HINTS in xcb example 03
+  xdg_toplevel_set_min_size(app.toplevel, WIN_WIDTH, WIN_HEIGHT);
+  xdg_toplevel_set_max_size(app.toplevel, WIN_WIDTH, WIN_HEIGHT);
+
+  // The first frame is drawn once the surface is configured, the rest from
+  // frame callbacks
+  frameLoopInit(&app.frames, app.surface, wl.presentation, wl.clock,
+                &app.pool, draw, nullptr);
+
+  // Committing without a buffer asks for the first configure
+  wl_surface_commit(app.surface);
+
+  //
+  // Event loop
+  //
+  // wl_display_dispatch flushes the requests made so far, waits for events
+  // and calls their listeners. Every frame after the first is drawn from a
+  // listener, so the loop itself does nothing else.
+  //
+  while (!app.should_exit && wl_display_dispatch(wl.display) != -1) {
+    if (frames && app.frames.stats.drawn >= (uint64_t)frames) {
+      break;
+    }
+  }
+
+  // Feedback for the last few frames is still on its way
+  wl_display_roundtrip(wl.display);
+
+  printFrameLoopStats(stdout, &app.frames);
+  printShmPoolStats(stdout, &app.pool);
+
+  // Clean up
+  if (wl.keyboard) {
+    wl_keyboard_destroy(wl.keyboard);
+  }
+  frameLoopDestroy(&app.frames);
+  xdg_toplevel_destroy(app.toplevel);
+  xdg_surface_destroy(app.xdgSurface);
+  wl_surface_destroy(app.surface);
+  shmPoolDestroy(&app.pool);
+  if (wl.seat) {
+    wl_seat_destroy(wl.seat);
+  }
+  if (wl.presentation) {
+    wp_presentation_destroy(wl.presentation);
+  }
+  xdg_wm_base_destroy(wl.wmBase);
+  wl_shm_destroy(wl.shm);
+  wl_compositor_destroy(wl.compositor);
+  wl_registry_destroy(wl.registry);
+  wl_display_disconnect(wl.display);
+
+  return 0;
+}
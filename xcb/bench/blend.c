@@ -0,0 +1,238 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Check and time the blending kernels in ../common/blend.c on a 4K frame.
+//
+// Every kernel is first compared against the scalar one, which is the
+// reference, on random pixels that include fully opaque and fully
+// transparent runs so the shortcuts are covered too. A mismatch is reported
+// and the program exits with an error. Then the best time out of all the
+// frames is reported for each operator. No X server is needed.
+//
+// Usage: bench_blend [frames] [width] [height]
+//
+
+#include "blend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 20
+#define DEFAULT_WIDTH 3840
+#define DEFAULT_HEIGHT 2160
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t random32(void) {
+  return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+//
+// Premultiplied pixels, a quarter of them in opaque runs and a quarter in
+// transparent runs. Runs are 16 pixels so whole vectors see them.
+//
+static void fillSource(const Blender *scalar, uint32_t *p, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    p[i] = random32();
+  }
+  blendPremultiply(scalar, p, p, count);
+
+  for (size_t i = 0; i + 16 <= count; i += 64) {
+    for (size_t j = 0; j < 16; j++) {
+      p[i + j] |= 0xFF000000;
+      p[i + 32 + j] = 0;
+    }
+  }
+}
+
+static bool check(const char *what, const uint32_t *expected,
+                  const uint32_t *actual, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (expected[i] != actual[i]) {
+      fprintf(stderr, "%s differs at pixel %zu: %08x, expected %08x\n", what,
+              i, actual[i], expected[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+  const int width = argc > 2 ? atoi(argv[2]) : DEFAULT_WIDTH;
+  const int height = argc > 3 ? atoi(argv[3]) : DEFAULT_HEIGHT;
+  if (frames <= 0 || width <= 0 || height <= 0) {
+    fprintf(stderr, "Usage: %s [frames] [width] [height]\n", argv[0]);
+    return -1;
+  }
+
+  const size_t count = (size_t)width * height;
+  const size_t bytes = count * 4;
+  uint32_t *src = aligned_alloc(64, bytes);
+  uint32_t *background = aligned_alloc(64, bytes);
+  uint32_t *expected = aligned_alloc(64, bytes);
+  uint32_t *dst = aligned_alloc(64, bytes);
+  uint8_t *mask = malloc(count);
+  if (!src || !background || !expected || !dst || !mask) {
+    return -1;
+  }
+
+  Blender scalar;
+  blenderInit(&scalar, PIXEL_KERNEL_SCALAR);
+
+  srand(1);
+  fillSource(&scalar, src, count);
+  fillSource(&scalar, background, count);
+
+  // Coverage the way glyphs have it, mostly empty or full with antialiased
+  // edges in between
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t r = random32() % 4;
+    mask[i] = r == 0 ? 0 : r == 1 ? 255 : (uint8_t)random32();
+  }
+  const uint32_t maskColor = blendPremultiplyColor(0xC0E0A040);
+
+  printf("# bench_blend width=%d height=%d frames=%d\n", width, height,
+         frames);
+
+  uint64_t scalarOver = 0;
+  uint64_t scalarPremultiply = 0;
+  uint64_t scalarMask = 0;
+  int result = 0;
+
+  const PixelKernel kernels[] = {PIXEL_KERNEL_SCALAR, PIXEL_KERNEL_SSE2,
+                                 PIXEL_KERNEL_AVX2, PIXEL_KERNEL_NEON};
+  for (uint32_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    Blender b;
+    if (blenderInit(&b, kernels[k])) {
+      continue;
+    }
+    const char *const name = pixelKernelName(kernels[k]);
+
+    // Check against the scalar reference. Random 32 bit values are used as
+    // the straight alpha input, and also as a destination for over, so
+    // every combination of channel and alpha comes up.
+    for (size_t i = 0; i < count; i++) {
+      expected[i] = dst[i] = random32();
+    }
+    blendRect(&scalar, BLEND_OVER, expected, width * 4, src, width * 4, width,
+              height);
+    blendRect(&b, BLEND_OVER, dst, width * 4, src, width * 4, width, height);
+    if (!check(name, expected, dst, count)) {
+      result = -1;
+      continue;
+    }
+
+    blendPremultiply(&scalar, expected, background, count);
+    blendPremultiply(&b, dst, background, count);
+    if (!check(name, expected, dst, count)) {
+      result = -1;
+      continue;
+    }
+
+    memcpy(expected, background, bytes);
+    memcpy(dst, background, bytes);
+    blendMask(&scalar, expected, mask, maskColor, count);
+    blendMask(&b, dst, mask, maskColor, count);
+    if (!check(name, expected, dst, count)) {
+      result = -1;
+      continue;
+    }
+
+    uint64_t over = UINT64_MAX;
+    uint64_t premultiply = UINT64_MAX;
+    uint64_t masked = UINT64_MAX;
+    for (int f = 0; f < frames; f++) {
+      memcpy(dst, background, bytes);
+
+      uint64_t start = now();
+      blendRect(&b, BLEND_OVER, dst, width * 4, src, width * 4, width, height);
+      uint64_t ns = now() - start;
+      over = ns < over ? ns : over;
+
+      start = now();
+      blendPremultiply(&b, dst, dst, count);
+      ns = now() - start;
+      premultiply = ns < premultiply ? ns : premultiply;
+
+      start = now();
+      blendMask(&b, dst, mask, maskColor, count);
+      ns = now() - start;
+      masked = ns < masked ? ns : masked;
+    }
+
+    if (kernels[k] == PIXEL_KERNEL_SCALAR) {
+      scalarOver = over;
+      scalarPremultiply = premultiply;
+      scalarMask = masked;
+    }
+
+    printf("blend op=over        kernel=%-6s frame_ms=%.3f gpix_per_s=%.2f "
+           "speedup=%.2f\n",
+           name, over / 1e6, count / (double)over, (double)scalarOver / over);
+    printf("blend op=premultiply kernel=%-6s frame_ms=%.3f gpix_per_s=%.2f "
+           "speedup=%.2f\n",
+           name, premultiply / 1e6, count / (double)premultiply,
+           (double)scalarPremultiply / premultiply);
+    printf("blend op=mask        kernel=%-6s frame_ms=%.3f gpix_per_s=%.2f "
+           "speedup=%.2f\n",
+           name, masked / 1e6, count / (double)masked,
+           (double)scalarMask / masked);
+  }
+
+  // src and clear are a memcpy and a memset, timed for scale
+  uint64_t copy = UINT64_MAX;
+  uint64_t clear = UINT64_MAX;
+  for (int f = 0; f < frames; f++) {
+    uint64_t start = now();
+    blendRect(&scalar, BLEND_SRC, dst, width * 4, src, width * 4, width,
+              height);
+    uint64_t ns = now() - start;
+    copy = ns < copy ? ns : copy;
+
+    start = now();
+    blendRect(&scalar, BLEND_CLEAR, dst, width * 4, nullptr, 0, width,
+              height);
+    ns = now() - start;
+    clear = ns < clear ? ns : clear;
+  }
+  printf("blend op=src         kernel=memcpy frame_ms=%.3f gpix_per_s=%.2f\n",
+         copy / 1e6, count / (double)copy);
+  printf("blend op=clear       kernel=memset frame_ms=%.3f gpix_per_s=%.2f\n",
+         clear / 1e6, count / (double)clear);
+
+  free(src);
+  free(background);
+  free(expected);
+  free(dst);
+  free(mask);
+  return result;
+}
@@ -0,0 +1,192 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Compare the table driven dispatcher in ../common/dispatch.c against the
+// switch the examples used to have.
+//
+// Synthetic events are generated in memory, so no X server is needed. Each
+// run uses a random mix of the given number of event types and reports the
+// best time per event out of several repeats.
+//
+// Usage: bench_dispatch [rounds]
+//
+
+#include "dispatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#define N_EVENTS 4096
+#define REPEATS 5
+#define DEFAULT_ROUNDS 2000
+
+// Errors plus every core event
+#define CORE_EVENTS(X)                                                         \
+  X(0) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14)   \
+  X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) X(26)      \
+  X(27) X(28) X(29) X(30) X(31) X(32) X(33) X(34)
+
+// Roughly how often each type shows up in a real session, most common
+// first. A mix of n types uses the first n.
+static const uint8_t popular[] = {
+    XCB_MOTION_NOTIFY,  XCB_KEY_PRESS,      XCB_KEY_RELEASE,
+    XCB_BUTTON_PRESS,   XCB_BUTTON_RELEASE, XCB_EXPOSE,
+    XCB_CONFIGURE_NOTIFY, XCB_CLIENT_MESSAGE, XCB_ENTER_NOTIFY,
+    XCB_LEAVE_NOTIFY,   XCB_FOCUS_IN,       XCB_FOCUS_OUT,
+    XCB_PROPERTY_NOTIFY, XCB_MAP_NOTIFY,    XCB_UNMAP_NOTIFY,
+    0,                  11, 13, 14, 15, 16, 17, 20, 21, 23, 24, 25, 26,
+    27,                 29, 30, 31, 32, 34,
+};
+static constexpr uint32_t nPopular = sizeof(popular) / sizeof(popular[0]);
+
+static const uint32_t mixes[] = {2, 4, 8, 16, nPopular};
+
+// Each handler gets its own counter so the compiler cannot merge them
+static uint64_t counts[DISPATCH_CORE_SLOTS];
+
+#define DEFINE_HANDLER(n)                                                      \
+  [[gnu::noinline]] static void handle##n(xcb_generic_event_t *, void *) {     \
+    counts[n]++;                                                               \
+  }
+CORE_EVENTS(DEFINE_HANDLER)
+
+// The way the examples used to do it, with the mask fixed
+static void dispatchSwitch(xcb_generic_event_t *event) {
+  switch (event->response_type & ~DISPATCH_SEND_EVENT_BIT) {
+#define SWITCH_CASE(n)                                                         \
+  case n:                                                                      \
+    handle##n(event, nullptr);                                                 \
+    break;
+    CORE_EVENTS(SWITCH_CASE)
+  default:
+    break;
+  }
+}
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Fill events with a random sequence drawn from the first nTypes popular
+// types. About one in eight is marked as sent with xcb_send_event.
+static void makeEvents(xcb_generic_event_t *events, uint32_t nTypes) {
+  uint32_t seed = 12345;
+  for (uint32_t i = 0; i < N_EVENTS; i++) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t r = seed >> 8;
+    events[i] = (xcb_generic_event_t){
+        .response_type = popular[r % nTypes] |
+                         ((r & 0x700000) ? 0 : DISPATCH_SEND_EVENT_BIT),
+    };
+  }
+}
+
+static double timeSwitch(xcb_generic_event_t *events, uint32_t rounds) {
+  uint64_t best = UINT64_MAX;
+  for (uint32_t r = 0; r < REPEATS; r++) {
+    const uint64_t start = now();
+    for (uint32_t j = 0; j < rounds; j++) {
+      for (uint32_t i = 0; i < N_EVENTS; i++) {
+        dispatchSwitch(&events[i]);
+      }
+    }
+    const uint64_t t = now() - start;
+    best = t < best ? t : best;
+  }
+  return (double)best / ((double)rounds * N_EVENTS);
+}
+
+static double timeTable(const EventDispatcher *d, xcb_generic_event_t *events,
+                        uint32_t rounds) {
+  uint64_t best = UINT64_MAX;
+  for (uint32_t r = 0; r < REPEATS; r++) {
+    const uint64_t start = now();
+    for (uint32_t j = 0; j < rounds; j++) {
+      for (uint32_t i = 0; i < N_EVENTS; i++) {
+        dispatchEvent(d, &events[i]);
+      }
+    }
+    const uint64_t t = now() - start;
+    best = t < best ? t : best;
+  }
+  return (double)best / ((double)rounds * N_EVENTS);
+}
+
+int main(int argc, char **argv) {
+  const uint32_t rounds = argc > 1 ? (uint32_t)atoi(argv[1]) : DEFAULT_ROUNDS;
+  if (rounds == 0) {
+    fprintf(stderr, "Usage: %s [rounds]\n", argv[0]);
+    return -1;
+  }
+
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+#define REGISTER(n) dispatcherSetHandler(&dispatcher, n, handle##n, nullptr);
+  CORE_EVENTS(REGISTER)
+
+  static xcb_generic_event_t events[N_EVENTS];
+
+  printf("# bench_dispatch events=%d rounds=%u repeats=%d\n", N_EVENTS, rounds,
+         REPEATS);
+
+  for (uint32_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+    makeEvents(events, mixes[m]);
+
+    // Both ways must call the same handlers the same number of times
+    uint64_t viaSwitch[DISPATCH_CORE_SLOTS];
+    for (uint32_t i = 0; i < DISPATCH_CORE_SLOTS; i++) {
+      counts[i] = 0;
+    }
+    for (uint32_t i = 0; i < N_EVENTS; i++) {
+      dispatchSwitch(&events[i]);
+    }
+    for (uint32_t i = 0; i < DISPATCH_CORE_SLOTS; i++) {
+      viaSwitch[i] = counts[i];
+      counts[i] = 0;
+    }
+    for (uint32_t i = 0; i < N_EVENTS; i++) {
+      dispatchEvent(&dispatcher, &events[i]);
+    }
+    for (uint32_t i = 0; i < DISPATCH_CORE_SLOTS; i++) {
+      if (viaSwitch[i] != counts[i]) {
+        fprintf(stderr, "Dispatch mismatch for event type %u\n", i);
+        return -1;
+      }
+    }
+
+    const double sw = timeSwitch(events, rounds);
+    const double table = timeTable(&dispatcher, events, rounds);
+
+    printf("dispatch types=%-2u switch_ns=%.3f table_ns=%.3f ratio=%.2f\n",
+           mixes[m], sw, table, sw / table);
+  }
+
+  dispatcherDestroy(&dispatcher);
+  return 0;
+}
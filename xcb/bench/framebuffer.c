@@ -0,0 +1,288 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Compare presenting a software framebuffer through MIT-SHM against copying
+// it through the socket with PutImage.
+//
+// Each frame rewrites every pixel, presents the whole framebuffer to a
+// pixmap, and waits for the server to finish with it. A pixmap is used
+// rather than a window so nothing is clipped away and the server always
+// does the full copy. Frame times, the effective bandwidth and the bytes
+// written to the socket are printed as JSON.
+//
+// The last mode draws into a ring of shared memory buffers instead, see
+// shmring.h. It only waits when every buffer is still being read, so the
+// next frame is drawn while the server copies the last one. Its frame time
+// is the time spent waiting for a buffer and presenting, and fps counts the
+// drawing too, for every mode.
+//
+// Run it against a local Xvfb, for example
+//
+//     xvfb-run -a -s "-screen 0 1920x1080x24" ./bench_framebuffer 200 24
+//
+// Usage: bench_framebuffer [frames] [24|32] [width] [height]
+//
+
+#include "dispatch.h"
+#include "framebuffer.h"
+#include "shmring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+
+#define DEFAULT_FRAMES 100
+#define DEFAULT_DEPTH 24
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define WARMUP_FRAMES 5
+#define RING_SIZE 3
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compareU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// p percentile of n sorted values
+static uint64_t percentile(const uint64_t *sorted, uint32_t n, double p) {
+  uint32_t i = (uint32_t)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i < n ? i : n - 1];
+}
+
+// Something that changes every frame so nothing can be skipped
+static void fill(Framebuffer *fb, uint32_t frame) {
+  for (uint32_t y = 0; y < fb->height; y++) {
+    uint32_t *row = fb->pixels + (size_t)y * (fb->stride / 4);
+    for (uint32_t x = 0; x < fb->width; x++) {
+      row[x] = 0xFF000000 | ((x + frame) & 0xFF) << 16 |
+               ((y + frame) & 0xFF) << 8 | (frame & 0xFF);
+    }
+  }
+}
+
+// Present once and wait for the server to be done with it
+static uint64_t presentFrame(xcb_connection_t *c, Framebuffer *fb) {
+  const uint64_t start = now();
+  framebufferPresent(fb, 0, 0, fb->width, fb->height);
+  free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), nullptr));
+  return now() - start;
+}
+
+static int runMode(xcb_connection_t *c, xcb_pixmap_t pixmap, uint8_t depth,
+                   uint16_t width, uint16_t height, FramebufferMode mode,
+                   uint32_t frames, uint64_t *ns, bool last) {
+  Framebuffer fb;
+  if (framebufferCreate(&fb, c, pixmap, depth, width, height, mode)) {
+    fprintf(stderr, "Unable to create a %d bit framebuffer\n", depth);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < WARMUP_FRAMES; i++) {
+    fill(&fb, i);
+    presentFrame(c, &fb);
+  }
+
+  const uint64_t written = xcb_total_written(c);
+  const uint64_t start = now();
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < frames; i++) {
+    fill(&fb, i);
+    ns[i] = presentFrame(c, &fb);
+    total += ns[i];
+  }
+  const uint64_t wall = now() - start;
+  const uint64_t bytes = xcb_total_written(c) - written;
+
+  qsort(ns, frames, sizeof(uint64_t), compareU64);
+
+  // Pixels moved per second of presenting, whether or not they went
+  // through the socket
+  const double mbPerS =
+      (double)fb.size * frames / (total / 1000000000.0) / (1024.0 * 1024.0);
+
+  printf("    {\"name\": \"%s\", \"requested\": \"%s\", \"median_us\": %.1f, "
+         "\"p99_us\": %.1f, \"max_us\": %.1f, \"mb_per_s\": %.1f, "
+         "\"fps\": %.1f, \"bytes_written_per_frame\": %llu}%s\n",
+         framebufferModeName(&fb), mode == FRAMEBUFFER_SHM ? "shm" : "put-image",
+         percentile(ns, frames, 50.0) / 1000.0,
+         percentile(ns, frames, 99.0) / 1000.0, ns[frames - 1] / 1000.0,
+         mbPerS, frames / (wall / 1000000000.0),
+         (unsigned long long)(bytes / frames), last ? "" : ",");
+
+  framebufferDestroy(&fb);
+  return 0;
+}
+
+// Wait for a free buffer, present it whole and move on without waiting
+static uint64_t presentRing(ShmRing *r, uint32_t frame, bool *failed) {
+  const uint64_t start = now();
+  Framebuffer *fb = shmRingAcquireWait(r);
+  if (!fb) {
+    *failed = true;
+    return 0;
+  }
+  const uint64_t waited = now() - start;
+
+  fill(fb, frame);
+
+  const uint64_t sent = now();
+  shmRingPresent(r, fb, 0, 0, fb->width, fb->height);
+  xcb_flush(r->connection);
+  return waited + now() - sent;
+}
+
+static int runRing(xcb_connection_t *c, xcb_pixmap_t pixmap, uint8_t depth,
+                   uint16_t width, uint16_t height, uint32_t frames,
+                   uint64_t *ns, bool last) {
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+
+  ShmRing ring;
+  if (shmRingInit(&ring, c, pixmap, depth, width, height, RING_SIZE,
+                  &dispatcher)) {
+    fprintf(stderr, "Unable to create %d bit framebuffers\n", depth);
+    dispatcherDestroy(&dispatcher);
+    return -1;
+  }
+
+  bool failed = false;
+  for (uint32_t i = 0; i < WARMUP_FRAMES && !failed; i++) {
+    presentRing(&ring, i, &failed);
+  }
+  ring.stats = (ShmRingStats){.inFlight = ring.stats.inFlight};
+
+  const uint64_t written = xcb_total_written(c);
+  const uint64_t start = now();
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < frames && !failed; i++) {
+    ns[i] = presentRing(&ring, i, &failed);
+    total += ns[i];
+  }
+
+  // The server has finished with every frame once this returns
+  free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), nullptr));
+  const uint64_t wall = now() - start;
+  const uint64_t bytes = xcb_total_written(c) - written;
+
+  if (failed) {
+    fprintf(stderr, "Lost the connection waiting for a buffer\n");
+    shmRingDestroy(&ring);
+    dispatcherDestroy(&dispatcher);
+    return -1;
+  }
+
+  qsort(ns, frames, sizeof(uint64_t), compareU64);
+
+  const Framebuffer *fb = &ring.slots[0].fb;
+  const double mbPerS =
+      (double)fb->size * frames / (total / 1000000000.0) / (1024.0 * 1024.0);
+
+  printf("    {\"name\": \"%s ring\", \"requested\": \"shm-ring\", "
+         "\"buffers\": %u, \"median_us\": %.1f, \"p99_us\": %.1f, "
+         "\"max_us\": %.1f, \"mb_per_s\": %.1f, \"fps\": %.1f, "
+         "\"bytes_written_per_frame\": %llu, \"stalls\": %llu, "
+         "\"stall_ms\": %.3f, \"max_in_flight\": %u}%s\n",
+         framebufferModeName(fb), ring.count,
+         percentile(ns, frames, 50.0) / 1000.0,
+         percentile(ns, frames, 99.0) / 1000.0, ns[frames - 1] / 1000.0,
+         mbPerS, frames / (wall / 1000000000.0),
+         (unsigned long long)(bytes / frames),
+         (unsigned long long)ring.stats.stalls, ring.stats.stallNs / 1e6,
+         ring.stats.maxInFlight, last ? "" : ",");
+
+  shmRingDestroy(&ring);
+  dispatcherDestroy(&dispatcher);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+  const int depth = argc > 2 ? atoi(argv[2]) : DEFAULT_DEPTH;
+  const int width = argc > 3 ? atoi(argv[3]) : DEFAULT_WIDTH;
+  const int height = argc > 4 ? atoi(argv[4]) : DEFAULT_HEIGHT;
+  if (frames <= 0 || (depth != 24 && depth != 32) || width <= 0 ||
+      width > UINT16_MAX || height <= 0 || height > UINT16_MAX) {
+    fprintf(stderr, "Usage: %s [frames] [24|32] [width] [height]\n",
+            argv[0]);
+    return -1;
+  }
+
+  int screenNumber;
+  xcb_connection_t *c = xcb_connect(nullptr, &screenNumber);
+  if (xcb_connection_has_error(c)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  xcb_screen_t *screen = xcb_aux_get_screen(c, screenNumber);
+
+  xcb_pixmap_t pixmap = xcb_generate_id(c);
+  xcb_generic_error_t *error = xcb_request_check(
+      c, xcb_create_pixmap_checked(c, depth, pixmap, screen->root, width,
+                                   height));
+  if (error) {
+    fprintf(stderr, "Unable to create a %d bit pixmap\n", depth);
+    free(error);
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  uint64_t *ns = calloc((size_t)frames, sizeof(uint64_t));
+  if (!ns) {
+    return -1;
+  }
+
+  printf("{\n  \"benchmark\": \"framebuffer\",\n  \"depth\": %d,\n"
+         "  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n"
+         "  \"modes\": [\n",
+         depth, width, height, frames);
+
+  int result = runMode(c, pixmap, depth, width, height, FRAMEBUFFER_SHM,
+                       frames, ns, false);
+  if (!result) {
+    result = runMode(c, pixmap, depth, width, height, FRAMEBUFFER_PUT_IMAGE,
+                     frames, ns, false);
+  }
+  if (!result) {
+    result = runRing(c, pixmap, depth, width, height, frames, ns, true);
+  }
+
+  printf("  ]\n}\n");
+
+  free(ns);
+  xcb_free_pixmap(c, pixmap);
+  xcb_disconnect(c);
+  return result;
+}
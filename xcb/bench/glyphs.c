@@ -0,0 +1,188 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Glyphs per second drawn through the glyph atlas in ../common/glyphs.c.
+//
+// cold clears the atlas before every pass, so every distinct character is
+// rendered by FreeType again. warm draws the same text into an atlas that
+// already has it, which must not render anything, and the program exits
+// with an error if it does. churn cycles through more distinct characters
+// than the atlas holds at a large size, so shelves keep being evicted. No X
+// server is needed.
+//
+// Usage: bench_glyphs [passes] [font file] [pixel size]
+//
+
+#include "glyphs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_PASSES 200
+#define DEFAULT_PIXEL_SIZE 16
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+static const char *const paragraph[] = {
+    "The quick brown fox jumps over the lazy dog. 0123456789",
+    "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG! (){}[]<>;:'\"",
+    "Keycode: 38  Keycode: 56  Keycode: 9  press Escape to quit",
+    "Pack my box with five dozen liquor jugs, café, naïve, Zürich",
+    "xcb_create_window xcb_map_window xcb_flush xcb_wait_for_event",
+    "Sphinx of black quartz, judge my vow. ~!@#$%^&*-_=+|\\/?,.",
+};
+#define LINES (sizeof(paragraph) / sizeof(paragraph[0]))
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Draw the paragraph, returns the number of characters drawn
+static uint64_t drawParagraph(GlyphAtlas *a, const TextTarget *target) {
+  uint64_t glyphs = 0;
+  int32_t baseline = a->ascender;
+
+  for (uint32_t i = 0; i < LINES; i++) {
+    const uint64_t before = a->stats.lookups;
+    textDraw(a, target, 8, baseline, paragraph[i], 0xFFE0E0E0);
+    glyphs += a->stats.lookups - before;
+    baseline += a->lineHeight;
+  }
+  return glyphs;
+}
+
+static void report(const char *pass, uint64_t glyphs, uint64_t ns,
+                   const GlyphStats *before, const GlyphStats *after,
+                   int passes) {
+  printf("glyphs pass=%-5s glyphs_per_s=%11.0f ns_per_glyph=%7.1f "
+         "rasterized_per_pass=%7.1f evicted_per_pass=%7.1f\n",
+         pass, glyphs * 1e9 / ns, (double)ns / glyphs,
+         (double)(after->rasterized - before->rasterized) / passes,
+         (double)(after->evicted - before->evicted) / passes);
+}
+
+int main(int argc, char **argv) {
+  const int passes = argc > 1 ? atoi(argv[1]) : DEFAULT_PASSES;
+  const char *const font = argc > 2 ? argv[2] : glyphFindFont();
+  const int pixelSize = argc > 3 ? atoi(argv[3]) : DEFAULT_PIXEL_SIZE;
+  if (passes <= 0 || pixelSize <= 0 || !font) {
+    fprintf(stderr, "Usage: %s [passes] [font file] [pixel size]\n",
+            argv[0]);
+    if (!font) {
+      fprintf(stderr, "No font found, name one or set XCB_EXAMPLES_FONT\n");
+    }
+    return -1;
+  }
+
+  uint32_t *pixels = aligned_alloc(64, (size_t)WIDTH * HEIGHT * 4);
+  if (!pixels) {
+    return -1;
+  }
+  memset(pixels, 0, (size_t)WIDTH * HEIGHT * 4);
+  const TextTarget target = {pixels, WIDTH * 4, 0, 0, WIDTH, HEIGHT};
+
+  Blender blender;
+  blenderInit(&blender, PIXEL_KERNEL_AUTO);
+
+  GlyphAtlas atlas;
+  if (glyphAtlasInit(&atlas, font, pixelSize, &blender)) {
+    fprintf(stderr, "Unable to load %s\n", font);
+    free(pixels);
+    return -1;
+  }
+
+  printf("# bench_glyphs font=%s pixel_size=%d passes=%d atlas=%d "
+         "kernel=%s\n",
+         font, pixelSize, passes, GLYPH_ATLAS_SIZE,
+         pixelKernelName(blender.kernel));
+
+  int result = 0;
+
+  // Cold, every distinct character rendered again each pass
+  GlyphStats before = atlas.stats;
+  uint64_t glyphs = 0;
+  uint64_t start = now();
+  for (int p = 0; p < passes; p++) {
+    glyphAtlasClear(&atlas);
+    glyphs += drawParagraph(&atlas, &target);
+  }
+  report("cold", glyphs, now() - start, &before, &atlas.stats, passes);
+
+  // Warm, the same text again, nothing may be rendered
+  before = atlas.stats;
+  glyphs = 0;
+  start = now();
+  for (int p = 0; p < passes; p++) {
+    glyphs += drawParagraph(&atlas, &target);
+  }
+  report("warm", glyphs, now() - start, &before, &atlas.stats, passes);
+
+  if (atlas.stats.rasterized != before.rasterized) {
+    fprintf(stderr, "Warm passes rasterized %llu glyphs, expected none\n",
+            (unsigned long long)(atlas.stats.rasterized - before.rasterized));
+    result = -1;
+  }
+
+  // Churn, 64 characters at a time out of a few thousand, at a size where
+  // they do not all fit
+  GlyphAtlas big;
+  if (glyphAtlasInit(&big, font, pixelSize * 3, &blender) == 0) {
+    char line[64 * 4 + 1];
+    before = big.stats;
+    glyphs = 0;
+    start = now();
+    for (int p = 0; p < passes; p++) {
+      // Latin, Greek and Cyrillic with a window that slides 16 characters
+      // a pass, so most of each line was drawn by the pass before
+      char *out = line;
+      for (uint32_t i = 0; i < 64; i++) {
+        const uint32_t cp = 0x21 + (p * 16 + i) % 0x4DE;
+        if (cp < 0x80) {
+          *out++ = cp;
+        } else {
+          *out++ = 0xC0 | cp >> 6;
+          *out++ = 0x80 | (cp & 0x3F);
+        }
+      }
+      *out = 0;
+
+      const uint64_t lookups = big.stats.lookups;
+      textDraw(&big, &target, 0, big.ascender, line, 0xFFFFFFFF);
+      glyphs += big.stats.lookups - lookups;
+    }
+    report("churn", glyphs, now() - start, &before, &big.stats, passes);
+    glyphAtlasDestroy(&big);
+  }
+
+  printGlyphStats(stdout, &atlas);
+  glyphAtlasDestroy(&atlas);
+  free(pixels);
+  return result;
+}
@@ -0,0 +1,317 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Flood a window with key presses, key releases and pointer motion through
+// the XTEST extension, at a steady rate, to find the point where an event
+// loop stops keeping up.
+//
+// The events are injected as if they came from the real keyboard and
+// pointer, so the server delivers them exactly as it would real input. The
+// window is given the input focus and the pointer is kept inside it. Every
+// millisecond the events that are due are sent and the connection flushed.
+// Time spent blocked in that flush means the server itself is not reading
+// fast enough, and ticks that start late mean this program is not keeping
+// up either, so both are reported once a second.
+//
+// When it is done it sends the window a client message saying how much it
+// injected, which the example's input meter, see ../common/inputmeter.h,
+// compares with what arrived. For example, with Xvfb on :99
+//
+//     XCB_INPUT_METER=1 DISPLAY=:99 ./example06 &
+//     DISPLAY=:99 ./bench_input_storm "Example 06" 20000 10 mixed
+//
+// The key defaults to keycode 38, "a" on most layouts. Escape, 9, is
+// refused since it closes the examples.
+//
+// Usage: bench_input_storm <window id|title> [events per second] [seconds]
+//                          [keys|motion|mixed] [keycode]
+//
+
+#include "inputmeter.h"
+#include "windowsearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+#include <xcb/xtest.h>
+
+#define DEFAULT_RATE 1000
+#define DEFAULT_SECONDS 5
+#define DEFAULT_KEYCODE 38
+#define ESCAPE_KEYCODE 9
+#define TICK_NS 1000000ull
+#define NS_PER_SECOND 1000000000ull
+
+// Motion stays this far inside the window's edges
+#define MARGIN 8
+
+typedef enum {
+  MIX_KEYS,   // press, release
+  MIX_MOTION, // motion
+  MIX_MIXED,  // press, motion, release, motion
+} Mix;
+
+static const char *const mixNames[] = {"keys", "motion", "mixed"};
+
+// Events in one repeat of each mix. Runs are a whole number of these so
+// no key is left down.
+static const uint32_t mixLength[] = {2, 1, 4};
+
+typedef struct {
+  xcb_connection_t *connection;
+  xcb_window_t root;
+  xcb_window_t window;
+  WindowArea area; // Where the window is on the root
+  uint8_t keycode;
+  Mix mix;
+
+  InputCounts sent;
+} Storm;
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t ns) {
+  const struct timespec ts = {.tv_sec = ns / NS_PER_SECOND,
+                              .tv_nsec = ns % NS_PER_SECOND};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr)) {
+  }
+}
+
+// Find the window and give it the input focus. Motion needs room inside it.
+static int aim(Storm *s) {
+  if (focusWindow(s->connection, s->root, s->window, &s->area)) {
+    return -1;
+  }
+  return s->area.width > 2 * MARGIN && s->area.height > 2 * MARGIN ? 0 : -1;
+}
+
+// Move the pointer somewhere new inside the window. The server sends
+// nothing for a move to where the pointer already is.
+static void move(Storm *s, uint64_t i) {
+  const uint32_t w = s->area.width - 2 * MARGIN;
+  const uint32_t h = s->area.height - 2 * MARGIN;
+  const int16_t x = s->area.x + MARGIN + (int16_t)(i * 7 % w);
+  const int16_t y = s->area.y + MARGIN + (int16_t)(i * 3 % h);
+  xcb_test_fake_input(s->connection, XCB_MOTION_NOTIFY, 0, XCB_CURRENT_TIME,
+                      s->root, x, y, XCB_NONE);
+  s->sent.motions++;
+}
+
+static void key(Storm *s, bool press) {
+  xcb_test_fake_input(s->connection,
+                      press ? XCB_KEY_PRESS : XCB_KEY_RELEASE, s->keycode,
+                      XCB_CURRENT_TIME, s->root, 0, 0, XCB_NONE);
+  if (press) {
+    s->sent.keyPresses++;
+  } else {
+    s->sent.keyReleases++;
+  }
+}
+
+// Inject the i-th event of the run
+static void inject(Storm *s, uint64_t i) {
+  switch (s->mix) {
+  case MIX_KEYS:
+    key(s, i % 2 == 0);
+    break;
+  case MIX_MOTION:
+    move(s, i);
+    break;
+  case MIX_MIXED:
+    if (i % 2) {
+      move(s, i / 2);
+    } else {
+      key(s, i % 4 == 0);
+    }
+    break;
+  }
+}
+
+// Tell the window's owner what was injected, see inputmeter.h
+static void sendSummary(Storm *s) {
+  xcb_connection_t *c = s->connection;
+  xcb_intern_atom_reply_t *atom = xcb_intern_atom_reply(
+      c,
+      xcb_intern_atom(c, 0, strlen(INPUT_METER_STORM_ATOM),
+                      INPUT_METER_STORM_ATOM),
+      nullptr);
+  if (!atom) {
+    return;
+  }
+
+  xcb_client_message_event_t event = {
+      .response_type = XCB_CLIENT_MESSAGE,
+      .format = 32,
+      .window = s->window,
+      .type = atom->atom,
+      .data.data32 = {(uint32_t)s->sent.keyPresses,
+                      (uint32_t)s->sent.keyReleases,
+                      (uint32_t)s->sent.motions},
+  };
+  free(atom);
+
+  // With no event mask the event goes to the client that created the
+  // window
+  xcb_send_event(c, false, s->window, XCB_EVENT_MASK_NO_EVENT,
+                 (const char *)&event);
+  xcb_flush(c);
+}
+
+static int parseMix(const char *name, Mix *mix) {
+  for (uint32_t i = 0; i < sizeof(mixNames) / sizeof(mixNames[0]); i++) {
+    if (strcmp(name, mixNames[i]) == 0) {
+      *mix = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  const int rate = argc > 2 ? atoi(argv[2]) : DEFAULT_RATE;
+  const int seconds = argc > 3 ? atoi(argv[3]) : DEFAULT_SECONDS;
+  const int keycode = argc > 5 ? atoi(argv[5]) : DEFAULT_KEYCODE;
+  Mix mix = MIX_MIXED;
+  if (argc < 2 || rate <= 0 || seconds <= 0 || keycode < 8 ||
+      keycode > 255 || keycode == ESCAPE_KEYCODE ||
+      (argc > 4 && parseMix(argv[4], &mix))) {
+    fprintf(stderr,
+            "Usage: %s <window id|title> [events per second] [seconds] "
+            "[keys|motion|mixed] [keycode]\n",
+            argv[0]);
+    return -1;
+  }
+
+  int screenNumber;
+  xcb_connection_t *c = xcb_connect(nullptr, &screenNumber);
+  if (xcb_connection_has_error(c)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  xcb_screen_t *screen = xcb_aux_get_screen(c, screenNumber);
+
+  const xcb_query_extension_reply_t *xtest =
+      xcb_get_extension_data(c, &xcb_test_id);
+  if (!xtest || !xtest->present) {
+    fprintf(stderr, "The X server does not have the XTEST extension\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  Storm s = {.connection = c,
+             .root = screen->root,
+             .keycode = keycode,
+             .mix = mix};
+
+  s.window = findWindowByIdOrName(c, screen->root, argv[1]);
+  if (!s.window || aim(&s)) {
+    fprintf(stderr, "Unable to find a window called %s\n", argv[1]);
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  // Whole repeats of the mix, so every press has its release
+  const uint64_t length = mixLength[mix];
+  const uint64_t total = (uint64_t)rate * seconds / length * length;
+
+  printf("# bench_input_storm window=0x%x rate=%d seconds=%d mix=%s "
+         "keycode=%d\n",
+         s.window, rate, seconds, mixNames[mix], keycode);
+
+  const uint64_t start = now();
+  uint64_t sent = 0;
+  uint64_t secondStart = 0; // Events sent before this second
+  uint64_t secondBlockedNs = 0;
+  uint32_t secondLate = 0;
+  uint64_t blockedNs = 0;
+  uint64_t late = 0;
+  uint32_t second = 0;
+
+  for (uint64_t tick = 1; sent < total; tick++) {
+    const uint64_t deadline = start + tick * TICK_NS;
+
+    // Everything due by the end of this tick, in whole repeats
+    uint64_t due = (uint64_t)rate * (tick * TICK_NS) / NS_PER_SECOND;
+    due = due / length * length;
+    if (due > total) {
+      due = total;
+    }
+    for (; sent < due; sent++) {
+      inject(&s, sent);
+    }
+
+    const uint64_t flushStart = now();
+    if (xcb_flush(c) <= 0) {
+      fprintf(stderr, "Lost the connection to the X server\n");
+      break;
+    }
+    const uint64_t flushed = now();
+    secondBlockedNs += flushed - flushStart;
+
+    if (flushed > deadline) {
+      // Behind already, no sleeping
+      secondLate++;
+    } else {
+      sleepUntil(deadline);
+    }
+
+    if ((deadline - start) / NS_PER_SECOND > second || sent == total) {
+      printf("storm second=%u sent=%llu flush_blocked_ms=%.1f "
+             "late_ticks=%u\n",
+             second, (unsigned long long)(sent - secondStart),
+             secondBlockedNs / 1e6, secondLate);
+      secondStart = sent;
+      blockedNs += secondBlockedNs;
+      late += secondLate;
+      secondBlockedNs = 0;
+      secondLate = 0;
+      second++;
+    }
+  }
+
+  // Wait for the server to have taken all of it before saying how much
+  free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), nullptr));
+  const double elapsed = (now() - start) / 1e9;
+  sendSummary(&s);
+
+  printf("storm total key_presses=%llu key_releases=%llu motions=%llu "
+         "seconds=%.2f per_s=%.0f flush_blocked_ms=%.1f late_ticks=%llu\n",
+         (unsigned long long)s.sent.keyPresses,
+         (unsigned long long)s.sent.keyReleases,
+         (unsigned long long)s.sent.motions, elapsed, sent / elapsed,
+         blockedNs / 1e6, (unsigned long long)late);
+
+  xcb_disconnect(c);
+  return 0;
+}
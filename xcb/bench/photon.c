@@ -0,0 +1,599 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Input to photon latency: how long from a key press or a pointer move to
+// the window's new pixels being on screen.
+//
+// Each sample injects one input through XTEST, as if it came from the real
+// keyboard or pointer, and then watches the window's region of the root
+// window until its pixels change. That covers the whole path: the server
+// delivering the event, the example's loop taking it, drawing the new
+// frame, presenting it, and the server putting it on screen. Three stages
+// are reported:
+//
+//   to_receipt until the example's loop took the event. The example sets
+//              the _XCB_INPUT_RECEIPT property on its window as it does,
+//              example 06 when run with XCB_INPUT_RECEIPT=1, and the
+//              PropertyNotify says when.
+//   to_damage  until the server reports the window damaged through the
+//              DAMAGE extension, which is when the example's present
+//              reached it
+//   to_pixels  until the pixels read back from the root differ from the
+//              ones grabbed just before the input
+//
+// The region is read back with MIT-SHM GetImage, or plain GetImage without
+// it. Without DAMAGE there is no to_damage, and the region is read back
+// every half millisecond instead of after each damage event. A window that
+// does not mark its receipts has no to_receipt.
+//
+// The window must sit still between inputs, as example 06 does, or every
+// sample ends at the next animation frame instead of at the answer to the
+// input. Example 06 shows the last key pressed, so key samples alternate
+// between two keys, and moves its panel to the pointer, so motion samples
+// alternate between two points. It needs its font to show the key. For
+// example, with Xvfb on :99
+//
+//     DISPLAY=:99 XCB_INPUT_RECEIPT=1 ./example06 &
+//     DISPLAY=:99 ./bench_photon "Example 06" 200 key
+//
+// Samples are spread out by a random gap of 20 to 37 ms so that they land
+// at every point in the example's frame. A sample with no change after a
+// second is counted as missed.
+//
+// The region defaults to the whole window. x and y are from the window's
+// top left corner.
+//
+// Usage: bench_photon <window id|title> [samples] [key|motion]
+//                     [x y width height]
+//
+
+#include "atoms.h"
+#include "framebuffer.h"
+#include "windowsearch.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/damage.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+#include <xcb/xtest.h>
+
+#define DEFAULT_SAMPLES 200
+#define NS_PER_SECOND 1000000000ull
+#define TIMEOUT_NS NS_PER_SECOND
+#define GAP_NS 20000000ull
+#define GAP_JITTER_NS 16666667ull // One frame at 60 Hz
+#define POLL_NS 500000ull         // Between read backs
+
+// Keycodes 38 and 39, "a" and "s" on most layouts
+#define KEY_A 38
+#define KEY_B 39
+
+// Motion alternates between points this far either side of the centre
+#define MOTION_OFFSET 40
+
+// Latency histogram buckets, the first up to 250 us and each one after
+// twice as wide. The last holds everything over a second.
+#define BUCKETS 14
+#define FIRST_BUCKET_NS 250000ull
+
+typedef enum {
+  INPUT_KEY,
+  INPUT_MOTION,
+} Input;
+
+static const char *const inputNames[] = {"key", "motion"};
+
+typedef enum {
+  STAGE_RECEIPT,
+  STAGE_DAMAGE,
+  STAGE_PIXELS,
+  STAGES,
+} Stage;
+
+static const char *const stageNames[] = {"to_receipt", "to_damage",
+                                          "to_pixels"};
+
+typedef struct {
+  xcb_connection_t *connection;
+  xcb_window_t root;
+  xcb_window_t window;
+  WindowArea area; // Where the window is on the root
+  Input input;
+
+  // The region watched, on the root
+  int16_t x, y;
+  uint16_t width, height;
+
+  Framebuffer grab;
+  uint32_t *baseline; // The region before the input
+  size_t bytes;       // In a grab of the region
+
+  bool haveDamage;
+  uint8_t damageEvent; // DamageNotify's response type
+  xcb_damage_damage_t damage;
+
+  xcb_atom_t receiptAtom; // The property the window marks receipts with
+} Photon;
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleepFor(uint64_t ns) {
+  const struct timespec ts = {.tv_sec = ns / NS_PER_SECOND,
+                              .tv_nsec = ns % NS_PER_SECOND};
+  nanosleep(&ts, nullptr);
+}
+
+static int compareU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// p percentile of n sorted values
+static uint64_t percentile(const uint64_t *sorted, uint32_t n, double p) {
+  uint32_t i = (uint32_t)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i < n ? i : n - 1];
+}
+
+//
+// Ask for a DamageNotify the first time the window changes after each
+// damageRearm. NON_EMPTY reports once, however much is drawn, until the
+// damage is subtracted again.
+//
+static void damageWatch(Photon *p) {
+  xcb_connection_t *c = p->connection;
+
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(c, &xcb_damage_id);
+  if (!ext || !ext->present) {
+    return;
+  }
+
+  // The version has to be agreed before any other DAMAGE request
+  xcb_damage_query_version_reply_t *version = xcb_damage_query_version_reply(
+      c, xcb_damage_query_version(c, 1, 1), nullptr);
+  if (!version) {
+    return;
+  }
+  free(version);
+
+  p->damage = xcb_generate_id(c);
+  xcb_damage_create(c, p->damage, p->window,
+                    XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+  p->damageEvent = ext->first_event + XCB_DAMAGE_NOTIFY;
+  p->haveDamage = true;
+}
+
+static void damageRearm(Photon *p) {
+  if (p->haveDamage) {
+    xcb_damage_subtract(p->connection, p->damage, XCB_NONE, XCB_NONE);
+  }
+}
+
+//
+// Ask for a PropertyNotify whenever the window marks a receipt. Whether it
+// does is up to the window, if it does not the events never come.
+//
+static void receiptWatch(Photon *p) {
+  xcb_connection_t *c = p->connection;
+
+  const char *const name = INPUT_RECEIPT_ATOM;
+  if (internAtomList(c, 1, &name, false, &p->receiptAtom)) {
+    return;
+  }
+
+  // Event masks are per client, this one does not disturb the window's own
+  const uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+  xcb_change_window_attributes(c, p->window, XCB_CW_EVENT_MASK, &mask);
+}
+
+// What waitForEvents saw
+enum {
+  SAW_RECEIPT = 1,
+  SAW_DAMAGE = 2,
+};
+
+//
+// Wait up to timeoutNs for a receipt or a DamageNotify. Anything else that
+// arrives is thrown away.
+//
+// Returns the SAW_ bits for what arrived, 0 for the timeout and -1 if the
+// connection failed.
+//
+static int waitForEvents(Photon *p, uint64_t timeoutNs) {
+  xcb_connection_t *c = p->connection;
+  const uint64_t deadline = now() + timeoutNs;
+
+  for (;;) {
+    int saw = 0;
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(c))) {
+      const uint8_t type = event->response_type & 0x7f;
+      if (p->haveDamage && type == p->damageEvent) {
+        saw |= SAW_DAMAGE;
+      } else if (type == XCB_PROPERTY_NOTIFY) {
+        const xcb_property_notify_event_t *property =
+            (xcb_property_notify_event_t *)event;
+        if (property->window == p->window &&
+            property->atom == p->receiptAtom &&
+            property->state == XCB_PROPERTY_NEW_VALUE) {
+          saw |= SAW_RECEIPT;
+        }
+      }
+      free(event);
+    }
+    if (saw) {
+      return saw;
+    }
+    if (xcb_connection_has_error(c)) {
+      return -1;
+    }
+
+    const uint64_t t = now();
+    if (t >= deadline) {
+      return 0;
+    }
+    const uint64_t left = deadline - t;
+    struct pollfd fd = {.fd = xcb_get_file_descriptor(c), .events = POLLIN};
+    const struct timespec ts = {.tv_sec = left / NS_PER_SECOND,
+                                .tv_nsec = left % NS_PER_SECOND};
+    ppoll(&fd, 1, &ts, nullptr);
+  }
+}
+
+//
+// Read the region back from the root into p->grab.pixels. Rows are packed,
+// width * 4 bytes apart, as the server writes them.
+//
+// Returns 0 on success and -1 on failure.
+//
+static int grab(Photon *p) {
+  xcb_connection_t *c = p->connection;
+
+  if (p->grab.mode == FRAMEBUFFER_SHM) {
+    xcb_shm_get_image_reply_t *reply = xcb_shm_get_image_reply(
+        c,
+        xcb_shm_get_image(c, p->root, p->x, p->y, p->width, p->height, ~0u,
+                          XCB_IMAGE_FORMAT_Z_PIXMAP, p->grab.shmSeg, 0),
+        nullptr);
+    free(reply);
+    return reply ? 0 : -1;
+  }
+
+  xcb_get_image_reply_t *reply = xcb_get_image_reply(
+      c,
+      xcb_get_image(c, XCB_IMAGE_FORMAT_Z_PIXMAP, p->root, p->x, p->y,
+                    p->width, p->height, ~0u),
+      nullptr);
+  if (!reply) {
+    return -1;
+  }
+  const size_t length = xcb_get_image_data_length(reply);
+  memcpy(p->grab.pixels, xcb_get_image_data(reply),
+         length < p->bytes ? length : p->bytes);
+  free(reply);
+  return 0;
+}
+
+// Inject the i-th input
+static void inject(Photon *p, uint32_t i) {
+  xcb_connection_t *c = p->connection;
+
+  if (p->input == INPUT_KEY) {
+    const uint8_t key = i % 2 ? KEY_B : KEY_A;
+    xcb_test_fake_input(c, XCB_KEY_PRESS, key, XCB_CURRENT_TIME, p->root, 0,
+                        0, XCB_NONE);
+    xcb_test_fake_input(c, XCB_KEY_RELEASE, key, XCB_CURRENT_TIME, p->root,
+                        0, 0, XCB_NONE);
+    return;
+  }
+
+  const int16_t offset = i % 2 ? MOTION_OFFSET : -MOTION_OFFSET;
+  xcb_test_fake_input(c, XCB_MOTION_NOTIFY, 0, XCB_CURRENT_TIME, p->root,
+                      p->area.x + p->area.width / 2 + offset,
+                      p->area.y + p->area.height / 2 + offset, XCB_NONE);
+}
+
+//
+// Take one sample. ns[STAGE_RECEIPT] is left at 0 without a receipt and
+// ns[STAGE_DAMAGE] without DAMAGE.
+//
+// Returns 0 for a sample, 1 if nothing changed before the timeout and -1
+// if the connection failed.
+//
+static int sample(Photon *p, uint32_t i, uint64_t ns[STAGES]) {
+  if (grab(p)) {
+    return -1;
+  }
+  memcpy(p->baseline, p->grab.pixels, p->bytes);
+
+  // Damage and receipts from before the input, such as the last sample's
+  // frame, must not count
+  damageRearm(p);
+  free(xcb_get_input_focus_reply(p->connection,
+                                 xcb_get_input_focus(p->connection), nullptr));
+  if (waitForEvents(p, 0) < 0) {
+    return -1;
+  }
+
+  ns[STAGE_RECEIPT] = 0;
+  ns[STAGE_DAMAGE] = 0;
+  ns[STAGE_PIXELS] = 0;
+
+  const uint64_t start = now();
+  inject(p, i);
+  xcb_flush(p->connection);
+
+  bool damaged = !p->haveDamage;
+  for (;;) {
+    const uint64_t elapsed = now() - start;
+    if (elapsed >= TIMEOUT_NS) {
+      return 1;
+    }
+
+    // Until the damage arrives there is nothing to read back. After it,
+    // the pixels may still be on their way, so keep looking.
+    const int saw =
+        waitForEvents(p, damaged ? POLL_NS : TIMEOUT_NS - elapsed);
+    if (saw < 0) {
+      return -1;
+    }
+    const uint64_t t = now() - start;
+    if ((saw & SAW_RECEIPT) && !ns[STAGE_RECEIPT]) {
+      ns[STAGE_RECEIPT] = t;
+    }
+    if (!damaged) {
+      if (!(saw & SAW_DAMAGE)) {
+        continue;
+      }
+      ns[STAGE_DAMAGE] = t;
+      damaged = true;
+    }
+
+    if (grab(p)) {
+      return -1;
+    }
+    if (memcmp(p->grab.pixels, p->baseline, p->bytes) != 0) {
+      ns[STAGE_PIXELS] = now() - start;
+      return 0;
+    }
+  }
+}
+
+// Histogram bucket for a latency
+static uint32_t bucketFor(uint64_t ns) {
+  uint32_t bucket = 0;
+  uint64_t limit = FIRST_BUCKET_NS;
+  while (ns > limit && bucket < BUCKETS - 1) {
+    limit *= 2;
+    bucket++;
+  }
+  return bucket;
+}
+
+//
+// One summary line for a stage and then one line per histogram bucket,
+// every bucket, so two runs can be diffed.
+//
+static void report(Stage stage, uint64_t *ns, uint32_t n, uint32_t missed) {
+  if (n == 0) {
+    printf("photon stage=%s samples=0 missed=%u\n", stageNames[stage],
+           missed);
+    return;
+  }
+
+  qsort(ns, n, sizeof(uint64_t), compareU64);
+  printf("photon stage=%s samples=%u missed=%u min_us=%.1f p50_us=%.1f "
+         "p90_us=%.1f p99_us=%.1f max_us=%.1f\n",
+         stageNames[stage], n, missed, ns[0] / 1e3,
+         percentile(ns, n, 50.0) / 1e3, percentile(ns, n, 90.0) / 1e3,
+         percentile(ns, n, 99.0) / 1e3, ns[n - 1] / 1e3);
+
+  uint32_t histogram[BUCKETS] = {};
+  for (uint32_t i = 0; i < n; i++) {
+    histogram[bucketFor(ns[i])]++;
+  }
+  uint64_t limit = FIRST_BUCKET_NS;
+  for (uint32_t i = 0; i < BUCKETS; i++, limit *= 2) {
+    if (i == BUCKETS - 1) {
+      printf("photon stage=%s bucket_us=inf count=%u\n", stageNames[stage],
+             histogram[i]);
+    } else {
+      printf("photon stage=%s bucket_us=%llu count=%u\n", stageNames[stage],
+             (unsigned long long)(limit / 1000), histogram[i]);
+    }
+  }
+}
+
+static int parseInput(const char *name, Input *input) {
+  for (uint32_t i = 0; i < sizeof(inputNames) / sizeof(inputNames[0]); i++) {
+    if (strcmp(name, inputNames[i]) == 0) {
+      *input = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  const int samples = argc > 2 ? atoi(argv[2]) : DEFAULT_SAMPLES;
+  Input input = INPUT_KEY;
+  if (argc < 2 || samples <= 0 || (argc > 3 && parseInput(argv[3], &input)) ||
+      (argc > 4 && argc != 8)) {
+    fprintf(stderr,
+            "Usage: %s <window id|title> [samples] [key|motion] "
+            "[x y width height]\n",
+            argv[0]);
+    return -1;
+  }
+
+  int screenNumber;
+  xcb_connection_t *c = xcb_connect(nullptr, &screenNumber);
+  if (xcb_connection_has_error(c)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  xcb_screen_t *screen = xcb_aux_get_screen(c, screenNumber);
+
+  const xcb_query_extension_reply_t *xtest =
+      xcb_get_extension_data(c, &xcb_test_id);
+  if (!xtest || !xtest->present) {
+    fprintf(stderr, "The X server does not have the XTEST extension\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  Photon p = {.connection = c, .root = screen->root, .input = input};
+
+  p.window = findWindowByIdOrName(c, screen->root, argv[1]);
+  if (!p.window || focusWindow(c, screen->root, p.window, &p.area)) {
+    fprintf(stderr, "Unable to find a window called %s\n", argv[1]);
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  // The region, clipped to the window, which is clipped to the screen
+  int32_t x = 0, y = 0, w = p.area.width, h = p.area.height;
+  if (argc == 8) {
+    x = atoi(argv[4]);
+    y = atoi(argv[5]);
+    w = atoi(argv[6]);
+    h = atoi(argv[7]);
+  }
+  x += p.area.x;
+  y += p.area.y;
+  int32_t x1 = x > p.area.x ? x : p.area.x;
+  int32_t y1 = y > p.area.y ? y : p.area.y;
+  x1 = x1 > 0 ? x1 : 0;
+  y1 = y1 > 0 ? y1 : 0;
+  int32_t x2 = x + w, y2 = y + h;
+  x2 = x2 < p.area.x + p.area.width ? x2 : p.area.x + p.area.width;
+  y2 = y2 < p.area.y + p.area.height ? y2 : p.area.y + p.area.height;
+  x2 = x2 < screen->width_in_pixels ? x2 : screen->width_in_pixels;
+  y2 = y2 < screen->height_in_pixels ? y2 : screen->height_in_pixels;
+  if (x2 <= x1 || y2 <= y1) {
+    fprintf(stderr, "The region is not on the screen\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  p.x = x1;
+  p.y = y1;
+  p.width = x2 - x1;
+  p.height = y2 - y1;
+  p.bytes = (size_t)p.width * p.height * 4;
+
+  // Only used as somewhere for the server to put the grabs
+  if (framebufferCreate(&p.grab, c, screen->root, screen->root_depth, p.width,
+                        p.height, FRAMEBUFFER_SHM)) {
+    fprintf(stderr, "Unable to create a framebuffer\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  // The grab before each input, and every sample's time for each stage
+  p.baseline = malloc(p.bytes);
+  uint64_t *ns[STAGES];
+  bool allocated = p.baseline != nullptr;
+  for (uint32_t s = 0; s < STAGES; s++) {
+    ns[s] = malloc(samples * sizeof(uint64_t));
+    allocated = allocated && ns[s];
+  }
+  if (!allocated) {
+    fprintf(stderr, "Out of memory\n");
+    for (uint32_t s = 0; s < STAGES; s++) {
+      free(ns[s]);
+    }
+    free(p.baseline);
+    framebufferDestroy(&p.grab);
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  damageWatch(&p);
+  receiptWatch(&p);
+
+  printf("# bench_photon window=0x%x samples=%d input=%s region=%d,%d,%ux%u "
+         "grab=%s damage=%s\n",
+         p.window, samples, inputNames[input], p.x - p.area.x,
+         p.y - p.area.y, p.width, p.height,
+         p.grab.mode == FRAMEBUFFER_SHM ? "shm" : "get-image",
+         p.haveDamage ? "yes" : "no");
+
+  uint32_t n[STAGES] = {};
+  uint32_t missed = 0;
+
+  srand(time(nullptr));
+  int result = 0;
+  for (int i = 0; i < samples; i++) {
+    sleepFor(GAP_NS + (uint64_t)rand() % GAP_JITTER_NS);
+
+    uint64_t sampleNs[STAGES];
+    result = sample(&p, i, sampleNs);
+    if (result < 0) {
+      fprintf(stderr, "Lost the connection to the X server\n");
+      break;
+    }
+    if (result > 0) {
+      missed++;
+      result = 0;
+      continue;
+    }
+    for (uint32_t s = 0; s < STAGES; s++) {
+      if (sampleNs[s]) {
+        ns[s][n[s]++] = sampleNs[s];
+      }
+    }
+  }
+
+  // Only windows that mark their receipts have any
+  if (n[STAGE_RECEIPT]) {
+    report(STAGE_RECEIPT, ns[STAGE_RECEIPT], n[STAGE_RECEIPT], missed);
+  }
+  if (p.haveDamage) {
+    report(STAGE_DAMAGE, ns[STAGE_DAMAGE], n[STAGE_DAMAGE], missed);
+  }
+  report(STAGE_PIXELS, ns[STAGE_PIXELS], n[STAGE_PIXELS], missed);
+
+  for (uint32_t s = 0; s < STAGES; s++) {
+    free(ns[s]);
+  }
+  free(p.baseline);
+  if (p.haveDamage) {
+    xcb_damage_destroy(c, p.damage);
+  }
+  framebufferDestroy(&p.grab);
+  xcb_disconnect(c);
+  return result;
+}
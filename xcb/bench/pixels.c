@@ -0,0 +1,176 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Time every pixel conversion kernel in ../common/pixelformat.c on a full
+// 4K frame.
+//
+// The visuals are made up in memory, so no X server is needed. The usual
+// 0x00RRGGBB visual is tried with both source orders, which covers the
+// copying and the red/blue swapping kernels, and a 10 bit per channel
+// visual covers the generic path. Every kernel's output is checked against
+// the generic kernel before it is timed. The best time out of all the
+// frames is reported.
+//
+// Usage: bench_pixels [frames] [width] [height]
+//
+
+#include "pixelformat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#define DEFAULT_FRAMES 20
+#define DEFAULT_WIDTH 3840
+#define DEFAULT_HEIGHT 2160
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct {
+  const char *name;
+  uint8_t depth;
+  xcb_visualtype_t visual;
+} Visual;
+
+static const Visual visuals[] = {
+    {"xrgb8888", 24,
+     {._class = XCB_VISUAL_CLASS_TRUE_COLOR,
+      .bits_per_rgb_value = 8,
+      .red_mask = 0xFF0000,
+      .green_mask = 0xFF00,
+      .blue_mask = 0xFF}},
+    {"argb8888", 32,
+     {._class = XCB_VISUAL_CLASS_TRUE_COLOR,
+      .bits_per_rgb_value = 8,
+      .red_mask = 0xFF0000,
+      .green_mask = 0xFF00,
+      .blue_mask = 0xFF}},
+    {"xrgb2101010", 30,
+     {._class = XCB_VISUAL_CLASS_TRUE_COLOR,
+      .bits_per_rgb_value = 10,
+      .red_mask = 0x3FF00000,
+      .green_mask = 0xFFC00,
+      .blue_mask = 0x3FF}},
+};
+
+// Only the bits the visual uses have to match, at depth 24 the top byte is
+// ignored by the server
+static bool matches(const PixelConverter *pc, const uint32_t *a,
+                    const uint32_t *b, size_t count) {
+  const uint32_t used =
+      pc->masks[0] | pc->masks[1] | pc->masks[2] | pc->masks[3];
+  for (size_t i = 0; i < count; i++) {
+    if ((a[i] ^ b[i]) & used) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static const char *const orderNames[] = {
+    [PIXEL_ORDER_RGBA] = "rgba",
+    [PIXEL_ORDER_BGRA] = "bgra",
+};
+
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+  const int width = argc > 2 ? atoi(argv[2]) : DEFAULT_WIDTH;
+  const int height = argc > 3 ? atoi(argv[3]) : DEFAULT_HEIGHT;
+  if (frames <= 0 || width <= 0 || height <= 0) {
+    fprintf(stderr, "Usage: %s [frames] [width] [height]\n", argv[0]);
+    return -1;
+  }
+
+  const size_t count = (size_t)width * height;
+  uint8_t *src = aligned_alloc(64, count * 4);
+  uint32_t *dst = aligned_alloc(64, count * 4);
+  uint32_t *expected = aligned_alloc(64, count * 4);
+  if (!src || !dst || !expected) {
+    return -1;
+  }
+
+  srand(1);
+  for (size_t i = 0; i < count * 4; i++) {
+    src[i] = (uint8_t)rand();
+  }
+
+  printf("# bench_pixels width=%d height=%d frames=%d\n", width, height,
+         frames);
+
+  int result = 0;
+  for (uint32_t v = 0; v < sizeof(visuals) / sizeof(visuals[0]); v++) {
+    for (PixelOrder order = PIXEL_ORDER_RGBA; order <= PIXEL_ORDER_BGRA;
+         order++) {
+
+      PixelConverter reference;
+      pixelConverterInit(&reference, &visuals[v].visual, visuals[v].depth,
+                         order, PIXEL_KERNEL_GENERIC);
+      pixelConvert(&reference, expected, src, count);
+
+      uint64_t genericNs = 0;
+      for (PixelKernel k = PIXEL_KERNEL_GENERIC; k < PIXEL_KERNEL_COUNT; k++) {
+        PixelConverter pc;
+        if (pixelConverterInit(&pc, &visuals[v].visual, visuals[v].depth,
+                               order, k)) {
+          continue;
+        }
+
+        pixelConvert(&pc, dst, src, count);
+        if (!matches(&pc, dst, expected, count)) {
+          fprintf(stderr, "%s %s %s does not match the generic kernel\n",
+                  visuals[v].name, orderNames[order], pixelKernelName(k));
+          result = -1;
+          continue;
+        }
+
+        uint64_t best = UINT64_MAX;
+        for (int f = 0; f < frames; f++) {
+          const uint64_t start = now();
+          pixelConvert(&pc, dst, src, count);
+          const uint64_t ns = now() - start;
+          best = ns < best ? ns : best;
+        }
+        if (k == PIXEL_KERNEL_GENERIC) {
+          genericNs = best;
+        }
+
+        printf("pixels visual=%-11s order=%s kernel=%-7s frame_ms=%.3f "
+               "gpix_per_s=%.2f speedup=%.2f\n",
+               visuals[v].name, orderNames[order], pixelKernelName(k),
+               best / 1e6, count / (double)best, (double)genericNs / best);
+      }
+    }
+  }
+
+  free(src);
+  free(dst);
+  free(expected);
+  return result;
+}
@@ -0,0 +1,251 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Frames per second of the tiled rasterizer in ../common/raster.c at 1, 2,
+// 4 ... threads, up to one per processor.
+//
+// Three scenes are drawn on a 4K frame: fill, an opaque background with
+// translucent rectangles over it, blit, an image copied around, and blend,
+// translucent images blended over each other. Every thread count's output is
+// checked against the single threaded one, and the program exits with an
+// error if they differ. No X server is needed.
+//
+// Usage: bench_raster [frames] [width] [height] [max threads]
+//
+
+#include "raster.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 30
+#define DEFAULT_WIDTH 3840
+#define DEFAULT_HEIGHT 2160
+
+// Rectangles drawn over the background in each scene
+#define SCENE_RECTS 32
+
+typedef enum {
+  SCENE_FILL,
+  SCENE_BLIT,
+  SCENE_BLEND,
+  SCENE_COUNT,
+} Scene;
+
+static const char *const sceneNames[SCENE_COUNT] = {"fill", "blit", "blend"};
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t random32(void) {
+  return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+// Where the rectangles go, the same for every run
+typedef struct {
+  int32_t x, y, width, height;
+  uint32_t color;
+} Rect;
+
+static Rect rects[SCENE_RECTS];
+
+//
+// Record one frame of a scene. image is a premultiplied picture the size of
+// the frame.
+//
+static void drawScene(Rasterizer *r, Scene scene, const uint32_t *image,
+                      uint32_t width, uint32_t height) {
+  const uint32_t stride = width * 4;
+
+  switch (scene) {
+  case SCENE_FILL:
+    rasterFill(r, 0, 0, width, height, 0xFF202040);
+    for (uint32_t i = 0; i < SCENE_RECTS; i++) {
+      rasterFill(r, rects[i].x, rects[i].y, rects[i].width, rects[i].height,
+                 rects[i].color);
+    }
+    break;
+
+  case SCENE_BLIT:
+    rasterBlit(r, 0, 0, width, height, image, stride);
+    for (uint32_t i = 0; i < SCENE_RECTS; i++) {
+      rasterBlit(r, rects[i].x, rects[i].y, rects[i].width, rects[i].height,
+                 image, stride);
+    }
+    break;
+
+  case SCENE_BLEND:
+    rasterFill(r, 0, 0, width, height, 0xFF000000);
+    rasterBlend(r, 0, 0, width, height, image, stride);
+    for (uint32_t i = 0; i < SCENE_RECTS; i++) {
+      rasterBlend(r, rects[i].x, rects[i].y, rects[i].width, rects[i].height,
+                  image, stride);
+    }
+    break;
+
+  case SCENE_COUNT:
+    break;
+  }
+}
+
+int main(int argc, char **argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+  const int width = argc > 2 ? atoi(argv[2]) : DEFAULT_WIDTH;
+  const int height = argc > 3 ? atoi(argv[3]) : DEFAULT_HEIGHT;
+  const int maxThreads =
+      argc > 4 ? atoi(argv[4]) : (int)threadPoolCpuCount();
+  if (frames <= 0 || width <= 0 || height <= 0 || maxThreads <= 0) {
+    fprintf(stderr, "Usage: %s [frames] [width] [height] [max threads]\n",
+            argv[0]);
+    return -1;
+  }
+
+  const size_t count = (size_t)width * height;
+  const size_t bytes = count * 4;
+  uint32_t *image = aligned_alloc(64, bytes);
+  uint32_t *frame = aligned_alloc(64, bytes);
+  uint32_t *reference[SCENE_COUNT];
+  for (uint32_t s = 0; s < SCENE_COUNT; s++) {
+    reference[s] = malloc(bytes);
+    if (!reference[s]) {
+      return -1;
+    }
+  }
+  if (!image || !frame) {
+    return -1;
+  }
+
+  Blender blender;
+  blenderInit(&blender, PIXEL_KERNEL_AUTO);
+
+  // Random translucent pixels, premultiplied
+  srand(1);
+  for (size_t i = 0; i < count; i++) {
+    image[i] = random32();
+  }
+  blendPremultiply(&blender, image, image, count);
+
+  // Rectangles up to a quarter of the frame wide and high, some hanging off
+  // the edges
+  for (uint32_t i = 0; i < SCENE_RECTS; i++) {
+    rects[i] = (Rect){
+        .x = (int32_t)(random32() % (width + width / 8)) - width / 16,
+        .y = (int32_t)(random32() % (height + height / 8)) - height / 16,
+        .width = 1 + random32() % (width / 4),
+        .height = 1 + random32() % (height / 4),
+        .color = blendPremultiplyColor(random32() | 0x40000000),
+    };
+  }
+
+  printf("# bench_raster width=%d height=%d frames=%d tile=%d kernel=%s "
+         "cpus=%u\n",
+         width, height, frames, RASTER_TILE_SIZE,
+         pixelKernelName(blender.kernel), threadPoolCpuCount());
+
+  // 1, 2, 4 ... and the maximum itself when it is not a power of two
+  uint32_t threadCounts[32];
+  uint32_t runs = 0;
+  for (uint32_t t = 1; t < (uint32_t)maxThreads && runs < 31; t *= 2) {
+    threadCounts[runs++] = t;
+  }
+  threadCounts[runs++] = maxThreads;
+
+  double baseFps[SCENE_COUNT] = {};
+  int result = 0;
+
+  // With trace markers compiled in, XCB_TRACE names a file to write what
+  // every thread did to. The frame rates are not worth much while it is on.
+  TRACE_OPEN_FROM_ENV("XCB_TRACE");
+  TRACE_THREAD_NAME("main");
+
+  for (uint32_t run = 0; run < runs; run++) {
+    const uint32_t threads = threadCounts[run];
+
+    ThreadPool pool;
+    if (threadPoolCreate(&pool, threads)) {
+      fprintf(stderr, "Unable to start %u threads\n", threads);
+      result = -1;
+      break;
+    }
+
+    Rasterizer r;
+    rasterInit(&r, &pool, &blender);
+    rasterTarget(&r, frame, width, height, width * 4);
+
+    for (uint32_t s = 0; s < SCENE_COUNT; s++) {
+      // One frame to check the output and warm up the threads and caches
+      memset(frame, 0, bytes);
+      drawScene(&r, s, image, width, height);
+      rasterFlush(&r);
+
+      if (run == 0) {
+        memcpy(reference[s], frame, bytes);
+      } else if (memcmp(reference[s], frame, bytes)) {
+        fprintf(stderr, "%s with %u threads differs from 1 thread\n",
+                sceneNames[s], threads);
+        result = -1;
+        continue;
+      }
+
+      atomic_store(&pool.steals, 0);
+      const uint64_t start = now();
+      for (int f = 0; f < frames; f++) {
+        drawScene(&r, s, image, width, height);
+        rasterFlush(&r);
+        TRACE_FLUSH();
+      }
+      const uint64_t ns = now() - start;
+
+      const double fps = frames * 1e9 / ns;
+      if (run == 0) {
+        baseFps[s] = fps;
+      }
+      const double speedup = fps / baseFps[s];
+
+      printf("raster scene=%-5s threads=%-3u fps=%8.1f frame_ms=%7.3f "
+             "speedup=%5.2f efficiency=%.2f steals_per_frame=%.1f\n",
+             sceneNames[s], threads, fps, ns / 1e6 / frames, speedup,
+             speedup / threads,
+             (double)atomic_load(&pool.steals) / frames);
+    }
+
+    rasterDestroy(&r);
+    threadPoolDestroy(&pool);
+  }
+  TRACE_CLOSE();
+
+  for (uint32_t s = 0; s < SCENE_COUNT; s++) {
+    free(reference[s]);
+  }
+  free(image);
+  free(frame);
+  return result;
+}
@@ -0,0 +1,350 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// Time each step from xcb_connect to the first Expose of a new window.
+//
+// Every iteration opens a fresh connection and goes through the same steps
+// as example 04. For each phase the wall clock time, the number of times
+// the client blocked waiting on the server, and the bytes sent and received
+// are recorded. The results are printed as JSON so they can be compared
+// between builds.
+//
+// Run it against a local Xvfb, for example
+//
+//     xvfb-run -a ./bench_startup 50 32
+//
+// Usage: bench_startup [iterations] [depth]
+//
+
+#include "atoms.h"
+#include "blend.h"
+#include "roundtrip.h"
+#include "visual.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_icccm.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+
+#define DEFAULT_ITERATIONS 20
+#define DEFAULT_DEPTH 32
+#define WIN_WIDTH 400
+#define WIN_HEIGHT 300
+
+typedef enum {
+  PHASE_CONNECT,
+  PHASE_SCREEN,
+  PHASE_VISUAL,
+  PHASE_WINDOW,
+  PHASE_PROPERTIES,
+  PHASE_MAP_NOTIFY,
+  PHASE_EXPOSE,
+  PHASE_COUNT,
+} Phase;
+
+static const char *const phaseNames[PHASE_COUNT] = {
+    [PHASE_CONNECT] = "connect",
+    [PHASE_SCREEN] = "get_screen",
+    [PHASE_VISUAL] = "find_depth_and_visual",
+    [PHASE_WINDOW] = "create_window",
+    [PHASE_PROPERTIES] = "properties",
+    [PHASE_MAP_NOTIFY] = "map_notify",
+    [PHASE_EXPOSE] = "first_expose",
+};
+
+typedef struct {
+  uint64_t ns;
+  uint64_t roundTrips;
+  uint64_t written;
+  uint64_t read;
+} PhaseSample;
+
+// Where the previous phase left off
+typedef struct {
+  uint64_t ns;
+  RoundTripStats rt;
+  uint64_t written;
+  uint64_t read;
+} Probe;
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void probeStart(Probe *p, xcb_connection_t *c) {
+  roundTripSnapshot(&p->rt);
+  p->written = c ? xcb_total_written(c) : 0;
+  p->read = c ? xcb_total_read(c) : 0;
+  p->ns = now();
+}
+
+//
+// Finish a phase and start the next one. extraRoundTrips covers waits the
+// round trip counter cannot see, such as the connection setup or blocking
+// for an event.
+//
+static void probeMark(Probe *p, xcb_connection_t *c, PhaseSample *sample,
+                      uint64_t extraRoundTrips) {
+  const uint64_t t = now();
+
+  RoundTripStats rt;
+  roundTripSnapshot(&rt);
+  const uint64_t written = xcb_total_written(c);
+  const uint64_t read = xcb_total_read(c);
+
+  *sample = (PhaseSample){
+      .ns = t - p->ns,
+      .roundTrips = rt.roundTrips - p->rt.roundTrips + extraRoundTrips,
+      .written = written - p->written,
+      .read = read - p->read,
+  };
+
+  p->ns = now();
+  p->rt = rt;
+  p->written = written;
+  p->read = read;
+}
+
+//
+// Wait for an event of the given type, throwing away anything else. Errors
+// for the unchecked requests are reported using the journal.
+//
+// Returns the number of times it had to block, or -1 if the connection
+// failed.
+//
+static int waitForEventType(xcb_connection_t *c, uint8_t type,
+                            const RequestJournal *journal) {
+  int blocked = 0;
+
+  for (;;) {
+    xcb_generic_event_t *event = xcb_poll_for_queued_event(c);
+    if (!event) {
+      event = xcb_wait_for_event(c);
+      blocked = 1;
+    }
+    if (!event) {
+      return -1;
+    }
+
+    if (event->response_type == 0) {
+      const xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+      const JournalEntry *e = journalFind(journal, error->full_sequence);
+      fprintf(stderr, "X error %d from %s\n", error->error_code,
+              e ? e->what : "an unknown request");
+    }
+
+    const bool found = (event->response_type & 0x7F) == type;
+    free(event);
+    if (found) {
+      return blocked;
+    }
+  }
+}
+
+// One full startup. Returns 0 on success.
+static int runOnce(uint8_t depth, PhaseSample samples[PHASE_COUNT]) {
+  Probe probe;
+  probeStart(&probe, nullptr);
+
+  int screenNumber;
+  xcb_connection_t *c = xcb_connect(nullptr, &screenNumber);
+  if (xcb_connection_has_error(c)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  // The setup exchange is a round trip of its own
+  probeMark(&probe, c, &samples[PHASE_CONNECT], 1);
+
+  xcb_screen_t *screen = xcb_aux_get_screen(c, screenNumber);
+  probeMark(&probe, c, &samples[PHASE_SCREEN], 0);
+
+  // The colormap is created unchecked, as in example 04
+  RequestJournal journal = {};
+  VisualConfig cfg = {};
+  if (findDepthAndVisual(c, screen, depth, &cfg, &journal)) {
+    fprintf(stderr, "Error finding depth and visual\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  probeMark(&probe, c, &samples[PHASE_VISUAL], 0);
+
+  const uint32_t valueMask = XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL |
+                             XCB_CW_EVENT_MASK | XCB_CW_COLORMAP;
+  const uint32_t values[] = {
+      blendPremultiplyColor(0xA0404050),
+      blendPremultiplyColor(0xA0404050),
+      XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_EXPOSURE |
+          XCB_EVENT_MASK_STRUCTURE_NOTIFY,
+      cfg.colormap,
+  };
+
+  xcb_window_t window = xcb_generate_id(c);
+  xcb_create_window(c, cfg.depth->depth, window, screen->root, 0, 0,
+                    WIN_WIDTH, WIN_HEIGHT, 1, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                    cfg.visual->visual_id, valueMask, values);
+  probeMark(&probe, c, &samples[PHASE_WINDOW], 0);
+
+  const char *const wName = "Startup Benchmark";
+  xcb_change_property(c, XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_NAME,
+                      XCB_ATOM_STRING, 8, strlen(wName), wName);
+
+  Atoms atoms;
+  if (internAtoms(c, &atoms)) {
+    fprintf(stderr, "Unable to get WM_PROTOCOLS or WM_DELETE_WINDOW atom\n");
+  }
+  xcb_change_property(c, XCB_PROP_MODE_REPLACE, window, atoms.WM_PROTOCOLS,
+                      XCB_ATOM, 32, 1, &atoms.WM_DELETE_WINDOW);
+
+  xcb_size_hints_t sizeHints = {
+      .flags = XCB_ICCCM_SIZE_HINT_P_MIN_SIZE | XCB_ICCCM_SIZE_HINT_P_MAX_SIZE,
+      .max_height = WIN_HEIGHT,
+      .min_height = WIN_HEIGHT,
+      .max_width = WIN_WIDTH,
+      .min_width = WIN_WIDTH,
+  };
+  xcb_change_property(c, XCB_PROP_MODE_REPLACE, window,
+                      XCB_ATOM_WM_NORMAL_HINTS, XCB_ATOM_WM_SIZE_HINTS, 32,
+                      sizeof(xcb_size_hints_t) / 4, &sizeHints);
+  probeMark(&probe, c, &samples[PHASE_PROPERTIES], 0);
+
+  xcb_map_window(c, window);
+  xcb_flush(c);
+
+  int blocked = waitForEventType(c, XCB_MAP_NOTIFY, &journal);
+  if (blocked >= 0) {
+    probeMark(&probe, c, &samples[PHASE_MAP_NOTIFY], blocked);
+    blocked = waitForEventType(c, XCB_EXPOSE, &journal);
+  }
+  if (blocked < 0) {
+    fprintf(stderr, "Connection failed while waiting for the window\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  probeMark(&probe, c, &samples[PHASE_EXPOSE], blocked);
+
+  xcb_destroy_window(c, window);
+  xcb_free_colormap(c, cfg.colormap);
+
+  // A new connection must not be able to use atoms cached for this one
+  atomCacheClear();
+  xcb_disconnect(c);
+  return 0;
+}
+
+static int compareU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// p percentile of n sorted values
+static uint64_t percentile(const uint64_t *sorted, uint32_t n, double p) {
+  uint32_t i = (uint32_t)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i < n ? i : n - 1];
+}
+
+static void printTimes(uint64_t *ns, uint32_t n) {
+  qsort(ns, n, sizeof(uint64_t), compareU64);
+  printf("\"median_us\": %.1f, \"p90_us\": %.1f, \"max_us\": %.1f",
+         percentile(ns, n, 50.0) / 1000.0, percentile(ns, n, 90.0) / 1000.0,
+         ns[n - 1] / 1000.0);
+}
+
+int main(int argc, char **argv) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  const int depth = argc > 2 ? atoi(argv[2]) : DEFAULT_DEPTH;
+  if (iterations <= 0 || (depth != 24 && depth != 32)) {
+    fprintf(stderr, "Usage: %s [iterations] [24|32]\n", argv[0]);
+    return -1;
+  }
+
+  PhaseSample *samples = calloc((size_t)iterations * PHASE_COUNT,
+                                sizeof(PhaseSample));
+  uint64_t *ns = calloc((size_t)iterations, sizeof(uint64_t));
+  if (!samples || !ns) {
+    return -1;
+  }
+
+  // One run that is not recorded so the server has loaded everything it
+  // needs before timing starts
+  PhaseSample warmup[PHASE_COUNT];
+  if (runOnce((uint8_t)depth, warmup)) {
+    return -1;
+  }
+
+  for (int i = 0; i < iterations; i++) {
+    if (runOnce((uint8_t)depth, &samples[i * PHASE_COUNT])) {
+      return -1;
+    }
+  }
+
+  printf("{\n  \"benchmark\": \"startup\",\n  \"depth\": %d,\n"
+         "  \"iterations\": %d,\n  \"phases\": [\n",
+         depth, iterations);
+
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    uint64_t roundTrips = 0, written = 0, read = 0;
+    for (int i = 0; i < iterations; i++) {
+      const PhaseSample *s = &samples[i * PHASE_COUNT + p];
+      ns[i] = s->ns;
+      roundTrips = s->roundTrips > roundTrips ? s->roundTrips : roundTrips;
+      written = s->written > written ? s->written : written;
+      read = s->read > read ? s->read : read;
+    }
+
+    printf("    {\"name\": \"%s\", ", phaseNames[p]);
+    printTimes(ns, (uint32_t)iterations);
+    printf(", \"round_trips\": %llu, \"bytes_written\": %llu, "
+           "\"bytes_read\": %llu}%s\n",
+           (unsigned long long)roundTrips, (unsigned long long)written,
+           (unsigned long long)read, p + 1 < PHASE_COUNT ? "," : "");
+  }
+
+  uint64_t totalRoundTrips = 0;
+  for (int i = 0; i < iterations; i++) {
+    ns[i] = 0;
+    uint64_t rt = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      ns[i] += samples[i * PHASE_COUNT + p].ns;
+      rt += samples[i * PHASE_COUNT + p].roundTrips;
+    }
+    totalRoundTrips = rt > totalRoundTrips ? rt : totalRoundTrips;
+  }
+
+  printf("  ],\n  \"total\": {");
+  printTimes(ns, (uint32_t)iterations);
+  printf(", \"round_trips\": %llu}\n}\n", (unsigned long long)totalRoundTrips);
+
+  free(samples);
+  free(ns);
+  return 0;
+}
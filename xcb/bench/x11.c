@@ -0,0 +1,477 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//
+// The X protocol operations the examples lean on, timed one at a time
+// against a live server:
+//
+//   window-cycle     create, map and destroy a window, then sync
+//   send-event-rtt   xcb_send_event to our own window until it comes back
+//   put-image        upload an image to a pixmap through the socket
+//   shm-put-image    the same image through MIT-SHM shared memory
+//   atoms-serial     intern ATOM_COUNT atoms, waiting for each reply
+//   atoms-pipelined  the same atoms, every request sent before any reply
+//   dispatch         pull events off xcb's queue and hand them to the
+//                    dispatcher in ../common/dispatch.c
+//
+// Each case runs a few warm up iterations and then the given number of
+// timed ones. One line per case gives the median, 99th percentile and
+// worst iteration, the median per operation inside an iteration, and the
+// bandwidth for the uploads. The fields are always in the same order so
+// two builds can be diffed.
+//
+// Run it against a local Xvfb, for example
+//
+//     xvfb-run -a -s "-screen 0 1920x1080x24" ./bench_x11 500
+//
+// Usage: bench_x11 [iterations] [case ...]
+//
+
+#include "dispatch.h"
+#include "framebuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+
+#define DEFAULT_ITERATIONS 200
+#define WARMUP_ITERATIONS 10
+#define ATOM_COUNT 64
+#define DISPATCH_EVENTS 256
+#define UPLOAD_WIDTH 512
+#define UPLOAD_HEIGHT 512
+
+typedef struct {
+  xcb_connection_t *connection;
+  xcb_screen_t *screen;
+
+  xcb_window_t window; // Unmapped, the target of sent events
+  xcb_atom_t ping;     // Client message type of sent events
+
+  xcb_pixmap_t pixmap; // Target of the uploads
+  Framebuffer putImage;
+  Framebuffer shm;
+
+  char atomNames[ATOM_COUNT][32];
+
+  EventDispatcher dispatcher;
+  uint32_t dispatched; // Events the dispatcher has handed to countEvent
+
+  uint32_t errors; // X errors that turned up in the event queue
+} Bench;
+
+// One iteration of a case. Stores the time it took in *ns and returns 0,
+// or returns -1 if the connection failed.
+typedef int (*IterationFn)(Bench *b, uint32_t iteration, uint64_t *ns);
+
+typedef struct {
+  const char *name;
+  IterationFn run;
+  uint32_t ops; // Operations in one iteration
+} BenchCase;
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compareU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// p percentile of n sorted values
+static uint64_t percentile(const uint64_t *sorted, uint32_t n, double p) {
+  uint32_t i = (uint32_t)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i < n ? i : n - 1];
+}
+
+// Wait until the server has handled everything sent so far
+static int serverSync(Bench *b) {
+  xcb_get_input_focus_reply_t *reply = xcb_get_input_focus_reply(
+      b->connection, xcb_get_input_focus(b->connection), nullptr);
+  free(reply);
+  return reply ? 0 : -1;
+}
+
+// Throw away queued events, counting any errors among them
+static void drainEvents(Bench *b) {
+  xcb_generic_event_t *event;
+  while ((event = xcb_poll_for_queued_event(b->connection))) {
+    if (event->response_type == 0) {
+      b->errors++;
+    }
+    free(event);
+  }
+}
+
+static void sendPing(Bench *b, uint32_t value) {
+  xcb_client_message_event_t event = {
+      .response_type = XCB_CLIENT_MESSAGE,
+      .format = 32,
+      .window = b->window,
+      .type = b->ping,
+      .data.data32 = {value},
+  };
+  // With no event mask the event goes to the client that created the
+  // window, which is us
+  xcb_send_event(b->connection, false, b->window, XCB_EVENT_MASK_NO_EVENT,
+                 (const char *)&event);
+}
+
+static int windowCycle(Bench *b, uint32_t, uint64_t *ns) {
+  xcb_connection_t *c = b->connection;
+  const uint64_t start = now();
+
+  xcb_window_t window = xcb_generate_id(c);
+  xcb_create_window(c, XCB_COPY_FROM_PARENT, window, b->screen->root, 0, 0,
+                    64, 64, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                    b->screen->root_visual, 0, nullptr);
+  xcb_map_window(c, window);
+  xcb_destroy_window(c, window);
+  const int result = serverSync(b);
+
+  *ns = now() - start;
+  return result;
+}
+
+static int sendEventRoundTrip(Bench *b, uint32_t iteration, uint64_t *ns) {
+  const uint64_t start = now();
+  sendPing(b, iteration);
+  xcb_flush(b->connection);
+
+  for (;;) {
+    xcb_generic_event_t *event = xcb_wait_for_event(b->connection);
+    if (!event) {
+      return -1;
+    }
+    const xcb_client_message_event_t *m = (void *)event;
+    const bool found =
+        (event->response_type & ~DISPATCH_SEND_EVENT_BIT) ==
+            XCB_CLIENT_MESSAGE &&
+        m->type == b->ping && m->data.data32[0] == iteration;
+    if (event->response_type == 0) {
+      b->errors++;
+    }
+    free(event);
+    if (found) {
+      break;
+    }
+  }
+
+  *ns = now() - start;
+  return 0;
+}
+
+// Change every pixel, outside the timed part, and upload the lot
+static int upload(Bench *b, Framebuffer *fb, uint32_t iteration,
+                  uint64_t *ns) {
+  for (uint32_t y = 0; y < fb->height; y++) {
+    uint32_t *row = fb->pixels + (size_t)y * (fb->stride / 4);
+    for (uint32_t x = 0; x < fb->width; x++) {
+      row[x] = 0xFF000000 | ((x + iteration) & 0xFF) << 16 |
+               ((y + iteration) & 0xFF) << 8;
+    }
+  }
+
+  const uint64_t start = now();
+  framebufferPresent(fb, 0, 0, fb->width, fb->height);
+  const int result = serverSync(b);
+  *ns = now() - start;
+  return result;
+}
+
+static int putImageUpload(Bench *b, uint32_t iteration, uint64_t *ns) {
+  return upload(b, &b->putImage, iteration, ns);
+}
+
+static int shmUpload(Bench *b, uint32_t iteration, uint64_t *ns) {
+  return upload(b, &b->shm, iteration, ns);
+}
+
+static int internSerial(Bench *b, uint32_t, uint64_t *ns) {
+  xcb_connection_t *c = b->connection;
+  const uint64_t start = now();
+
+  for (uint32_t i = 0; i < ATOM_COUNT; i++) {
+    const char *name = b->atomNames[i];
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+        c, xcb_intern_atom(c, 0, strlen(name), name), nullptr);
+    if (!reply) {
+      return -1;
+    }
+    free(reply);
+  }
+
+  *ns = now() - start;
+  return 0;
+}
+
+static int internPipelined(Bench *b, uint32_t, uint64_t *ns) {
+  xcb_connection_t *c = b->connection;
+  xcb_intern_atom_cookie_t cookies[ATOM_COUNT];
+  const uint64_t start = now();
+
+  for (uint32_t i = 0; i < ATOM_COUNT; i++) {
+    const char *name = b->atomNames[i];
+    cookies[i] = xcb_intern_atom(c, 0, strlen(name), name);
+  }
+  int result = 0;
+  for (uint32_t i = 0; i < ATOM_COUNT; i++) {
+    xcb_intern_atom_reply_t *reply =
+        xcb_intern_atom_reply(c, cookies[i], nullptr);
+    if (!reply) {
+      result = -1;
+    }
+    free(reply);
+  }
+
+  *ns = now() - start;
+  return result;
+}
+
+static void countEvent(xcb_generic_event_t *, void *data) {
+  Bench *b = data;
+  b->dispatched++;
+}
+
+//
+// The events are sent and waited for first, so the timed part only takes
+// them off xcb's queue and dispatches them, with no reading of the socket.
+//
+static int dispatchBatch(Bench *b, uint32_t iteration, uint64_t *ns) {
+  for (uint32_t i = 0; i < DISPATCH_EVENTS; i++) {
+    sendPing(b, iteration);
+  }
+  if (serverSync(b)) {
+    return -1;
+  }
+
+  const uint32_t before = b->dispatched;
+  const uint64_t start = now();
+
+  xcb_generic_event_t *event;
+  while ((event = xcb_poll_for_queued_event(b->connection))) {
+    dispatchEvent(&b->dispatcher, event);
+    free(event);
+  }
+
+  *ns = now() - start;
+  if (b->dispatched - before != DISPATCH_EVENTS) {
+    fprintf(stderr, "Dispatched %u of %u events\n", b->dispatched - before,
+            DISPATCH_EVENTS);
+  }
+  return 0;
+}
+
+static const BenchCase cases[] = {
+    {"window-cycle", windowCycle, 1},
+    {"send-event-rtt", sendEventRoundTrip, 1},
+    {"put-image", putImageUpload, 1},
+    {"shm-put-image", shmUpload, 1},
+    {"atoms-serial", internSerial, ATOM_COUNT},
+    {"atoms-pipelined", internPipelined, ATOM_COUNT},
+    {"dispatch", dispatchBatch, DISPATCH_EVENTS},
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static int runCase(Bench *b, const BenchCase *bc, uint32_t iterations,
+                   uint64_t *ns) {
+  // The upload cases move the same number of bytes every iteration
+  uint64_t bytes = 0;
+  if (bc->run == shmUpload || bc->run == putImageUpload) {
+    bytes = (uint64_t)UPLOAD_WIDTH * UPLOAD_HEIGHT * 4;
+  }
+  if (bc->run == shmUpload && b->shm.mode != FRAMEBUFFER_SHM) {
+    printf("x11 case=%-16s skipped=no-shm\n", bc->name);
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < WARMUP_ITERATIONS; i++) {
+    uint64_t ignored;
+    if (bc->run(b, i, &ignored)) {
+      return -1;
+    }
+  }
+  for (uint32_t i = 0; i < iterations; i++) {
+    if (bc->run(b, WARMUP_ITERATIONS + i, &ns[i])) {
+      return -1;
+    }
+  }
+  drainEvents(b);
+
+  qsort(ns, iterations, sizeof(uint64_t), compareU64);
+  const uint64_t median = percentile(ns, iterations, 50.0);
+
+  char mbPerS[32] = "-";
+  if (bytes) {
+    snprintf(mbPerS, sizeof(mbPerS), "%.1f",
+             bytes / (median / 1e9) / (1024.0 * 1024.0));
+  }
+
+  printf("x11 case=%-16s iterations=%u ops=%-3u median_us=%9.2f "
+         "p99_us=%9.2f max_us=%9.2f op_median_ns=%9.1f mb_per_s=%s\n",
+         bc->name, iterations, bc->ops, median / 1e3,
+         percentile(ns, iterations, 99.0) / 1e3, ns[iterations - 1] / 1e3,
+         (double)median / bc->ops, mbPerS);
+  return 0;
+}
+
+static int benchInit(Bench *b, xcb_connection_t *c, xcb_screen_t *screen) {
+  *b = (Bench){.connection = c, .screen = screen};
+
+  b->window = xcb_generate_id(c);
+  xcb_create_window(c, XCB_COPY_FROM_PARENT, b->window, screen->root, 0, 0,
+                    1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                    screen->root_visual, 0, nullptr);
+
+  const char ping[] = "BENCH_X11_PING";
+  xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+      c, xcb_intern_atom(c, 0, sizeof(ping) - 1, ping), nullptr);
+  if (!reply) {
+    return -1;
+  }
+  b->ping = reply->atom;
+  free(reply);
+
+  for (uint32_t i = 0; i < ATOM_COUNT; i++) {
+    snprintf(b->atomNames[i], sizeof(b->atomNames[i]), "BENCH_X11_ATOM_%u",
+             i);
+  }
+
+  dispatcherInit(&b->dispatcher);
+  dispatcherSetHandler(&b->dispatcher, XCB_CLIENT_MESSAGE, countEvent, b);
+
+  const uint8_t depth = screen->root_depth;
+  b->pixmap = xcb_generate_id(c);
+  xcb_create_pixmap(c, depth, b->pixmap, screen->root, UPLOAD_WIDTH,
+                    UPLOAD_HEIGHT);
+  if (framebufferCreate(&b->putImage, c, b->pixmap, depth, UPLOAD_WIDTH,
+                        UPLOAD_HEIGHT, FRAMEBUFFER_PUT_IMAGE) ||
+      framebufferCreate(&b->shm, c, b->pixmap, depth, UPLOAD_WIDTH,
+                        UPLOAD_HEIGHT, FRAMEBUFFER_SHM)) {
+    fprintf(stderr, "Unable to create a %d bit framebuffer\n", depth);
+    dispatcherDestroy(&b->dispatcher);
+    return -1;
+  }
+  return serverSync(b);
+}
+
+static void benchDestroy(Bench *b) {
+  framebufferDestroy(&b->shm);
+  framebufferDestroy(&b->putImage);
+  xcb_free_pixmap(b->connection, b->pixmap);
+  xcb_destroy_window(b->connection, b->window);
+  dispatcherDestroy(&b->dispatcher);
+}
+
+static const BenchCase *findCase(const char *name) {
+  for (uint32_t i = 0; i < CASE_COUNT; i++) {
+    if (strcmp(cases[i].name, name) == 0) {
+      return &cases[i];
+    }
+  }
+  return nullptr;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr, "Usage: %s [iterations] [case ...]\nCases:", program);
+  for (uint32_t i = 0; i < CASE_COUNT; i++) {
+    fprintf(stderr, " %s", cases[i].name);
+  }
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Any further arguments pick the cases to run, otherwise all of them
+  const BenchCase *selected[CASE_COUNT];
+  uint32_t count = 0;
+  for (int i = 2; i < argc; i++) {
+    const BenchCase *bc = findCase(argv[i]);
+    if (!bc || count == CASE_COUNT) {
+      usage(argv[0]);
+      return -1;
+    }
+    selected[count++] = bc;
+  }
+  if (count == 0) {
+    for (uint32_t i = 0; i < CASE_COUNT; i++) {
+      selected[count++] = &cases[i];
+    }
+  }
+
+  int screenNumber;
+  xcb_connection_t *c = xcb_connect(nullptr, &screenNumber);
+  if (xcb_connection_has_error(c)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    xcb_disconnect(c);
+    return -1;
+  }
+  xcb_screen_t *screen = xcb_aux_get_screen(c, screenNumber);
+  const xcb_setup_t *setup = xcb_get_setup(c);
+
+  uint64_t *ns = calloc((size_t)iterations, sizeof(uint64_t));
+  Bench b;
+  if (!ns || benchInit(&b, c, screen)) {
+    fprintf(stderr, "Unable to set up the benchmarks\n");
+    free(ns);
+    xcb_disconnect(c);
+    return -1;
+  }
+
+  printf("# bench_x11 iterations=%d warmup=%d vendor=\"%.*s\" release=%u "
+         "depth=%u\n",
+         iterations, WARMUP_ITERATIONS, xcb_setup_vendor_length(setup),
+         xcb_setup_vendor(setup), setup->release_number, screen->root_depth);
+
+  int result = 0;
+  for (uint32_t i = 0; i < count && !result; i++) {
+    result = runCase(&b, selected[i], (uint32_t)iterations, ns);
+  }
+  if (result) {
+    fprintf(stderr, "Lost the connection to the X server\n");
+  }
+  if (b.errors) {
+    fprintf(stderr, "%u X errors\n", b.errors);
+    result = -1;
+  }
+
+  benchDestroy(&b);
+  free(ns);
+  xcb_disconnect(c);
+  return result;
+}
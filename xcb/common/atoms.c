@@ -0,0 +1,180 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "atoms.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const atomNames[ATOM_COUNT] = {
+#define ATOM_NAME(name) #name,
+    ATOM_LIST(ATOM_NAME)
+#undef ATOM_NAME
+};
+
+//
+// Atoms never change for the life of a connection, so every atom interned
+// is remembered and later requests for the same name skip the server.
+//
+// The cache belongs to a single connection and is emptied if a different
+// one is used. It is not thread safe.
+//
+static struct {
+  xcb_connection_t *connection;
+  struct {
+    char *name;
+    xcb_atom_t atom;
+  } entries[ATOM_CACHE_SIZE];
+  uint32_t count;
+} cache = {};
+
+// FNV-1a
+static uint32_t hashName(const char *name) {
+  uint32_t h = 2166136261u;
+  for (; *name; name++) {
+    h = (h ^ (uint8_t)*name) * 16777619u;
+  }
+  return h;
+}
+
+// Empty the cache and free the names it holds
+void atomCacheClear(void) {
+  for (uint32_t i = 0; i < ATOM_CACHE_SIZE; i++) {
+    free(cache.entries[i].name);
+    cache.entries[i].name = nullptr;
+    cache.entries[i].atom = XCB_ATOM_NONE;
+  }
+  cache.count = 0;
+  cache.connection = nullptr;
+}
+
+// Returns the cached atom for the name or XCB_ATOM_NONE if there is none
+xcb_atom_t atomCacheLookup(xcb_connection_t *c, const char *name) {
+  if (c != cache.connection) {
+    return XCB_ATOM_NONE;
+  }
+
+  for (uint32_t i = hashName(name);; i++) {
+    const uint32_t slot = i & (ATOM_CACHE_SIZE - 1);
+    if (!cache.entries[slot].name) {
+      return XCB_ATOM_NONE;
+    }
+    if (strcmp(cache.entries[slot].name, name) == 0) {
+      return cache.entries[slot].atom;
+    }
+  }
+}
+
+static void atomCacheInsert(xcb_connection_t *c, const char *name,
+                            xcb_atom_t atom) {
+  if (c != cache.connection) {
+    atomCacheClear();
+    cache.connection = c;
+  }
+
+  // Keep at least one slot empty so lookups always finish. Once the cache is
+  // full, new atoms simply are not remembered.
+  if (cache.count == ATOM_CACHE_SIZE - 1) {
+    return;
+  }
+
+  for (uint32_t i = hashName(name);; i++) {
+    const uint32_t slot = i & (ATOM_CACHE_SIZE - 1);
+    if (!cache.entries[slot].name) {
+      cache.entries[slot].name = strdup(name);
+      if (cache.entries[slot].name) {
+        cache.entries[slot].atom = atom;
+        cache.count++;
+      }
+      return;
+    }
+    if (strcmp(cache.entries[slot].name, name) == 0) {
+      return;
+    }
+  }
+}
+
+//
+// Intern a list of atoms with a single round trip.
+//
+// Every xcb_intern_atom request is sent before any reply is waited on, so
+// the replies arrive together. Interning one at a time pays a full round
+// trip for each atom, which is very noticeable over a slow link. Atoms that
+// are already in the cache are not sent at all.
+//
+// Returns the number of atoms that could not be interned (they are set to
+// XCB_ATOM_NONE), or -1 if out of memory.
+//
+int internAtomList(               //
+    xcb_connection_t *c,          ///> server connection
+    uint32_t n,                   ///> number of names
+    const char *const names[],    ///> atom names
+    bool onlyIfExists,            ///> don't create atoms that don't exist
+    xcb_atom_t atoms[]            ///> receives the n atoms
+) {
+  if (n == 0) {
+    return 0;
+  }
+
+  xcb_intern_atom_cookie_t *cookies = malloc(n * sizeof(*cookies));
+  if (!cookies) {
+    return -1;
+  }
+
+  // Send every request
+  for (uint32_t i = 0; i < n; i++) {
+    atoms[i] = atomCacheLookup(c, names[i]);
+    if (atoms[i] == XCB_ATOM_NONE) {
+      cookies[i] = xcb_intern_atom(c, onlyIfExists, strlen(names[i]), names[i]);
+    }
+  }
+
+  // Then collect every reply. The first call blocks, the rest are waiting.
+  int failed = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (atoms[i] != XCB_ATOM_NONE) {
+      continue;
+    }
+
+    xcb_intern_atom_reply_t *reply =
+        xcb_intern_atom_reply(c, cookies[i], nullptr);
+    if (reply) {
+      atoms[i] = reply->atom;
+      free(reply);
+    }
+
+    if (atoms[i] == XCB_ATOM_NONE) {
+      failed++;
+    } else {
+      atomCacheInsert(c, names[i], atoms[i]);
+    }
+  }
+
+  free(cookies);
+  return failed;
+}
+
+// Intern every atom in ATOM_LIST. Returns 0 if they were all found.
+int internAtoms(xcb_connection_t *c, Atoms *atoms) {
+  return internAtomList(c, ATOM_COUNT, atomNames, false, atoms->list);
+}
@@ -0,0 +1,40 @@
+#ifndef ATOMS_H_20261017
+#define ATOMS_H_20261017
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+// Atoms the examples need. Add a name here and it will be interned along
+// with the others by internAtoms and show up as a field in Atoms.
+#define ATOM_LIST(X)                                                           \
+  X(WM_PROTOCOLS)                                                              \
+  X(WM_DELETE_WINDOW)
+
+#define ATOM_COUNT_ONE(name) +1
+#define ATOM_COUNT (0 ATOM_LIST(ATOM_COUNT_ONE))
+
+// The atoms in ATOM_LIST. Each one can be used by name, for example
+// atoms.WM_PROTOCOLS, or through list in the same order as ATOM_LIST.
+typedef union {
+  struct {
+#define ATOM_FIELD(name) xcb_atom_t name;
+    ATOM_LIST(ATOM_FIELD)
+#undef ATOM_FIELD
+  };
+  xcb_atom_t list[ATOM_COUNT];
+} Atoms;
+
+// Property an example sets on its window each time its loop takes an input
+// event, when asked to. bench_photon watches for it to time the receipt.
+#define INPUT_RECEIPT_ATOM "_XCB_INPUT_RECEIPT"
+
+// Size of the cache kept by internAtomList. Must be a power of two.
+#define ATOM_CACHE_SIZE 256
+
+int internAtoms(xcb_connection_t *c, Atoms *atoms);
+int internAtomList(xcb_connection_t *c, uint32_t n, const char *const names[],
+                   bool onlyIfExists, xcb_atom_t atoms[]);
+xcb_atom_t atomCacheLookup(xcb_connection_t *c, const char *name);
+void atomCacheClear(void);
+
+#endif
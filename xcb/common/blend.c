@@ -0,0 +1,542 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "blend.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+//---------------------------------------------------------------------------
+// Scalar reference
+//
+// The vector kernels below have to match these bit for bit.
+
+// x / 255 rounded to nearest, exact for 0 <= x <= 255 * 255
+static inline uint32_t div255(uint32_t x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t overPixel(uint32_t s, uint32_t d) {
+  const uint32_t ia = 255 - (s >> 24);
+
+  uint32_t out = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    const uint32_t c = (s >> shift & 0xFF) + div255((d >> shift & 0xFF) * ia);
+    out |= (c > 255 ? 255 : c) << shift;
+  }
+  return out;
+}
+
+static inline uint32_t premultiplyPixel(uint32_t p) {
+  const uint32_t a = p >> 24;
+
+  uint32_t out = p & 0xFF000000;
+  for (int shift = 0; shift < 24; shift += 8) {
+    out |= div255((p >> shift & 0xFF) * a) << shift;
+  }
+  return out;
+}
+
+static void overScalar(uint32_t *dst, const uint32_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t s = src[i];
+
+    // Opaque pixels replace what is there and empty ones change nothing,
+    // which is most pixels of most sprites and glyphs
+    if (s >= 0xFF000000) {
+      dst[i] = s;
+    } else if (s) {
+      dst[i] = overPixel(s, dst[i]);
+    }
+  }
+}
+
+static void premultiplyScalar(uint32_t *dst, const uint32_t *src,
+                              size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = premultiplyPixel(src[i]);
+  }
+}
+
+static void maskScalar(uint32_t *dst, const uint8_t *mask, uint32_t color,
+                       size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t m = mask[i];
+
+    if (m == 0) {
+      continue;
+    }
+    if (m == 255) {
+      dst[i] = overPixel(color, dst[i]);
+      continue;
+    }
+
+    uint32_t s = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      s |= div255((color >> shift & 0xFF) * m) << shift;
+    }
+    dst[i] = overPixel(s, dst[i]);
+  }
+}
+
+//---------------------------------------------------------------------------
+// SSE2, 4 pixels at a time
+//
+// Each pixel's channels are widened to 16 bits so they can be multiplied,
+// and the pixel's alpha is copied into all four of its lanes.
+
+#if defined(__SSE2__)
+static inline __m128i div255Sse2(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Alpha of each of the two pixels in x copied to all of its lanes
+static inline __m128i alphaSse2(__m128i x) {
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xFF), 0xFF);
+}
+
+static void overSse2(uint32_t *dst, const uint32_t *src, size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+  const __m128i max = _mm_set1_epi16(255);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alpha), alpha)) ==
+        0xFFFF) {
+      _mm_storeu_si128((__m128i *)(dst + i), s);
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF) {
+      continue;
+    }
+
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    const __m128i sLo = _mm_unpacklo_epi8(s, zero);
+    const __m128i sHi = _mm_unpackhi_epi8(s, zero);
+    const __m128i dLo = _mm_unpacklo_epi8(d, zero);
+    const __m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+    const __m128i lo = div255Sse2(
+        _mm_mullo_epi16(dLo, _mm_sub_epi16(max, alphaSse2(sLo))));
+    const __m128i hi = div255Sse2(
+        _mm_mullo_epi16(dHi, _mm_sub_epi16(max, alphaSse2(sHi))));
+
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+  }
+  overScalar(dst + i, src + i, count - i);
+}
+
+static void premultiplySse2(uint32_t *dst, const uint32_t *src,
+                            size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    const __m128i sLo = _mm_unpacklo_epi8(s, zero);
+    const __m128i sHi = _mm_unpackhi_epi8(s, zero);
+
+    const __m128i lo = div255Sse2(_mm_mullo_epi16(sLo, alphaSse2(sLo)));
+    const __m128i hi = div255Sse2(_mm_mullo_epi16(sHi, alphaSse2(sHi)));
+
+    // The alpha lane was multiplied by itself, put the original back
+    const __m128i p = _mm_packus_epi16(lo, hi);
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_or_si128(_mm_andnot_si128(alpha, p),
+                                  _mm_and_si128(alpha, s)));
+  }
+  premultiplyScalar(dst + i, src + i, count - i);
+}
+
+static void maskSse2(uint32_t *dst, const uint8_t *mask, uint32_t color,
+                     size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max = _mm_set1_epi16(255);
+  const __m128i c = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32_t m4;
+    memcpy(&m4, mask + i, 4);
+    if (m4 == 0) {
+      continue;
+    }
+
+    // Each pixel's coverage copied to all four of its lanes
+    __m128i m = _mm_unpacklo_epi16(
+        _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)m4), zero), zero);
+    m = _mm_or_si128(m, _mm_slli_epi32(m, 16));
+    const __m128i sLo =
+        div255Sse2(_mm_mullo_epi16(c, _mm_unpacklo_epi32(m, m)));
+    const __m128i sHi =
+        div255Sse2(_mm_mullo_epi16(c, _mm_unpackhi_epi32(m, m)));
+
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    const __m128i dLo = _mm_unpacklo_epi8(d, zero);
+    const __m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+    const __m128i lo = div255Sse2(
+        _mm_mullo_epi16(dLo, _mm_sub_epi16(max, alphaSse2(sLo))));
+    const __m128i hi = div255Sse2(
+        _mm_mullo_epi16(dHi, _mm_sub_epi16(max, alphaSse2(sHi))));
+
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_adds_epu8(_mm_packus_epi16(lo, hi),
+                                   _mm_packus_epi16(sLo, sHi)));
+  }
+  maskScalar(dst + i, mask + i, color, count - i);
+}
+#endif
+
+//---------------------------------------------------------------------------
+// AVX2, 8 pixels at a time
+//
+// The same as SSE2. Unpacking and packing both work within each 128 bit
+// half, so pixels come back out in the order they went in.
+
+#if defined(__x86_64__) || defined(__i386__)
+[[gnu::target("avx2")]]
+static inline __m256i div255Avx2(__m256i x) {
+  x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+[[gnu::target("avx2")]]
+static inline __m256i alphaAvx2(__m256i x) {
+  return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, 0xFF), 0xFF);
+}
+
+[[gnu::target("avx2")]]
+static void overAvx2(uint32_t *dst, const uint32_t *src, size_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+  const __m256i max = _mm256_set1_epi16(255);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(
+            _mm256_and_si256(s, alpha), alpha)) == -1) {
+      _mm256_storeu_si256((__m256i *)(dst + i), s);
+      continue;
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1) {
+      continue;
+    }
+
+    const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    const __m256i sLo = _mm256_unpacklo_epi8(s, zero);
+    const __m256i sHi = _mm256_unpackhi_epi8(s, zero);
+    const __m256i dLo = _mm256_unpacklo_epi8(d, zero);
+    const __m256i dHi = _mm256_unpackhi_epi8(d, zero);
+
+    const __m256i lo = div255Avx2(
+        _mm256_mullo_epi16(dLo, _mm256_sub_epi16(max, alphaAvx2(sLo))));
+    const __m256i hi = div255Avx2(
+        _mm256_mullo_epi16(dHi, _mm256_sub_epi16(max, alphaAvx2(sHi))));
+
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s));
+  }
+  overScalar(dst + i, src + i, count - i);
+}
+
+[[gnu::target("avx2")]]
+static void premultiplyAvx2(uint32_t *dst, const uint32_t *src,
+                            size_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+    const __m256i sLo = _mm256_unpacklo_epi8(s, zero);
+    const __m256i sHi = _mm256_unpackhi_epi8(s, zero);
+
+    const __m256i lo =
+        div255Avx2(_mm256_mullo_epi16(sLo, alphaAvx2(sLo)));
+    const __m256i hi =
+        div255Avx2(_mm256_mullo_epi16(sHi, alphaAvx2(sHi)));
+
+    const __m256i p = _mm256_packus_epi16(lo, hi);
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_or_si256(_mm256_andnot_si256(alpha, p),
+                                        _mm256_and_si256(alpha, s)));
+  }
+  premultiplyScalar(dst + i, src + i, count - i);
+}
+
+[[gnu::target("avx2")]]
+static void maskAvx2(uint32_t *dst, const uint8_t *mask, uint32_t color,
+                     size_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i max = _mm256_set1_epi16(255);
+  const __m256i c =
+      _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    // The load clears the upper 8 bytes, so all 16 compare equal when
+    // the 8 coverage values are zero. _mm_cvtsi128_si64 would be shorter
+    // but does not exist on i386.
+    const __m128i m8 = _mm_loadl_epi64((const __m128i *)(mask + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(m8, _mm_setzero_si128())) ==
+        0xFFFF) {
+      continue;
+    }
+
+    // Pixels 0-3 end up in the low half and 4-7 in the high half, the
+    // same as the unpacked destination
+    __m256i m = _mm256_cvtepu8_epi32(m8);
+    m = _mm256_or_si256(m, _mm256_slli_epi32(m, 16));
+    const __m256i sLo =
+        div255Avx2(_mm256_mullo_epi16(c, _mm256_unpacklo_epi32(m, m)));
+    const __m256i sHi =
+        div255Avx2(_mm256_mullo_epi16(c, _mm256_unpackhi_epi32(m, m)));
+
+    const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    const __m256i dLo = _mm256_unpacklo_epi8(d, zero);
+    const __m256i dHi = _mm256_unpackhi_epi8(d, zero);
+
+    const __m256i lo = div255Avx2(
+        _mm256_mullo_epi16(dLo, _mm256_sub_epi16(max, alphaAvx2(sLo))));
+    const __m256i hi = div255Avx2(
+        _mm256_mullo_epi16(dHi, _mm256_sub_epi16(max, alphaAvx2(sHi))));
+
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_adds_epu8(_mm256_packus_epi16(lo, hi),
+                                         _mm256_packus_epi16(sLo, sHi)));
+  }
+  maskScalar(dst + i, mask + i, color, count - i);
+}
+#endif
+
+//---------------------------------------------------------------------------
+// NEON, 16 pixels at a time
+//
+// vld4q_u8 splits the pixels into one register per channel, so alpha does
+// not need to be copied around.
+
+#if defined(__ARM_NEON)
+// c * a / 255 for 16 channels, rounded as div255 does
+static inline uint8x16_t mulDiv255Neon(uint8x16_t c, uint8x16_t a) {
+  const uint16x8_t half = vdupq_n_u16(128);
+
+  uint16x8_t lo = vaddq_u16(vmull_u8(vget_low_u8(c), vget_low_u8(a)), half);
+  uint16x8_t hi = vaddq_u16(vmull_u8(vget_high_u8(c), vget_high_u8(a)), half);
+
+  // vaddhn keeps the high byte of the sum, (x + (x >> 8)) >> 8
+  return vcombine_u8(vaddhn_u16(lo, vshrq_n_u16(lo, 8)),
+                     vaddhn_u16(hi, vshrq_n_u16(hi, 8)));
+}
+
+static void overNeon(uint32_t *dst, const uint32_t *src, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x4_t s = vld4q_u8((const uint8_t *)(src + i));
+    uint8x16x4_t d = vld4q_u8((const uint8_t *)(dst + i));
+    const uint8x16_t ia = vmvnq_u8(s.val[3]);
+
+    for (int c = 0; c < 4; c++) {
+      d.val[c] = vqaddq_u8(s.val[c], mulDiv255Neon(d.val[c], ia));
+    }
+    vst4q_u8((uint8_t *)(dst + i), d);
+  }
+  overScalar(dst + i, src + i, count - i);
+}
+
+static void premultiplyNeon(uint32_t *dst, const uint32_t *src,
+                            size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x4_t p = vld4q_u8((const uint8_t *)(src + i));
+
+    for (int c = 0; c < 3; c++) {
+      p.val[c] = mulDiv255Neon(p.val[c], p.val[3]);
+    }
+    vst4q_u8((uint8_t *)(dst + i), p);
+  }
+  premultiplyScalar(dst + i, src + i, count - i);
+}
+
+static void maskNeon(uint32_t *dst, const uint8_t *mask, uint32_t color,
+                     size_t count) {
+  uint8x16_t c[4];
+  for (int k = 0; k < 4; k++) {
+    c[k] = vdupq_n_u8(color >> (k * 8) & 0xFF);
+  }
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16_t m = vld1q_u8(mask + i);
+    if (vmaxvq_u8(m) == 0) {
+      continue;
+    }
+
+    uint8x16x4_t d = vld4q_u8((const uint8_t *)(dst + i));
+    uint8x16_t s[4];
+    for (int k = 0; k < 4; k++) {
+      s[k] = mulDiv255Neon(c[k], m);
+    }
+    const uint8x16_t ia = vmvnq_u8(s[3]);
+
+    for (int k = 0; k < 4; k++) {
+      d.val[k] = vqaddq_u8(s[k], mulDiv255Neon(d.val[k], ia));
+    }
+    vst4q_u8((uint8_t *)(dst + i), d);
+  }
+  maskScalar(dst + i, mask + i, color, count - i);
+}
+#endif
+
+//---------------------------------------------------------------------------
+
+//
+// Pick the blending kernels. PIXEL_KERNEL_AUTO gives the fastest the CPU
+// has. Asking for a particular one is meant for benchmarks and tests.
+//
+// Returns 0 on success, -1 if the kernel is not available.
+//
+int blenderInit(Blender *b, PixelKernel kernel) {
+  if (kernel == PIXEL_KERNEL_AUTO) {
+    const PixelKernel fastest[] = {PIXEL_KERNEL_AVX2, PIXEL_KERNEL_NEON,
+                                   PIXEL_KERNEL_SSE2, PIXEL_KERNEL_SCALAR};
+    for (uint32_t i = 0; i < sizeof(fastest) / sizeof(fastest[0]); i++) {
+      if (pixelKernelAvailable(fastest[i])) {
+        kernel = fastest[i];
+        break;
+      }
+    }
+  }
+  if (!pixelKernelAvailable(kernel)) {
+    return -1;
+  }
+
+  switch (kernel) {
+  case PIXEL_KERNEL_SCALAR:
+    *b = (Blender){kernel, overScalar, premultiplyScalar, maskScalar};
+    return 0;
+#if defined(__SSE2__)
+  case PIXEL_KERNEL_SSE2:
+    *b = (Blender){kernel, overSse2, premultiplySse2, maskSse2};
+    return 0;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  case PIXEL_KERNEL_AVX2:
+    *b = (Blender){kernel, overAvx2, premultiplyAvx2, maskAvx2};
+    return 0;
+#endif
+#if defined(__ARM_NEON)
+  case PIXEL_KERNEL_NEON:
+    *b = (Blender){kernel, overNeon, premultiplyNeon, maskNeon};
+    return 0;
+#endif
+  default:
+    break;
+  }
+  return -1;
+}
+
+// Blend a rectangle of src onto dst. Strides are in bytes.
+void blendRect(const Blender *b, BlendOp op, uint32_t *dst,
+               uint32_t dstStride, const uint32_t *src, uint32_t srcStride,
+               uint32_t width, uint32_t height) {
+  for (uint32_t y = 0; y < height; y++) {
+    uint32_t *d = (uint32_t *)((uint8_t *)dst + (size_t)y * dstStride);
+    const uint32_t *s =
+        (const uint32_t *)((const uint8_t *)src + (size_t)y * srcStride);
+
+    switch (op) {
+    case BLEND_CLEAR:
+      memset(d, 0, (size_t)width * 4);
+      break;
+    case BLEND_SRC:
+      memmove(d, s, (size_t)width * 4);
+      break;
+    case BLEND_OVER:
+      b->over(d, s, width);
+      break;
+    }
+  }
+}
+
+//
+// Blend a solid premultiplied color over dst through a coverage mask, one
+// byte per pixel, the way glyphs are drawn. Each pixel gets the color scaled
+// by its coverage and then blended over.
+//
+void blendMask(const Blender *b, uint32_t *dst, const uint8_t *mask,
+               uint32_t color, size_t count) {
+  b->mask(dst, mask, color, count);
+}
+
+//
+// Convert straight alpha pixels to premultiplied. This is the way into the
+// pipeline, for pixels from image files and colors picked by hand. dst may
+// be the same buffer as src.
+//
+void blendPremultiply(const Blender *b, uint32_t *dst, const uint32_t *src,
+                      size_t count) {
+  b->premultiply(dst, src, count);
+}
+
+//
+// Convert premultiplied pixels back to straight alpha, the way out of the
+// pipeline. Only needed when saving or inspecting pixels, so there is only
+// a scalar version.
+//
+void blendUnpremultiply(uint32_t *dst, const uint32_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t p = src[i];
+    const uint32_t a = p >> 24;
+
+    uint32_t out = p & 0xFF000000;
+    if (a) {
+      for (int shift = 0; shift < 24; shift += 8) {
+        const uint32_t c = ((p >> shift & 0xFF) * 255 + a / 2) / a;
+        out |= (c > 255 ? 255 : c) << shift;
+      }
+    }
+    dst[i] = out;
+  }
+}
+
+// A single straight alpha color, such as a window background, premultiplied
+uint32_t blendPremultiplyColor(uint32_t color) {
+  return premultiplyPixel(color);
+}
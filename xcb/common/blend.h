@@ -0,0 +1,48 @@
+#ifndef BLEND_H_20261017
+#define BLEND_H_20261017
+
+#include "pixelformat.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Porter-Duff operators
+typedef enum {
+  BLEND_CLEAR, // dst = 0
+  BLEND_SRC,   // dst = src
+  BLEND_OVER,  // dst = src + dst * (1 - src alpha)
+} BlendOp;
+
+typedef void (*BlendFn)(uint32_t *dst, const uint32_t *src, size_t count);
+typedef void (*BlendMaskFn)(uint32_t *dst, const uint8_t *mask,
+                            uint32_t color, size_t count);
+
+//
+// Blending for 32 bit pixels with alpha in the top byte and premultiplied
+// colors, which is what a compositor expects from a 32 bit ARGB window.
+// The other three channels are treated alike, so any order of red, green
+// and blue works.
+//
+// Every kernel gives exactly the same result as the scalar one, rounding
+// included.
+//
+typedef struct {
+  PixelKernel kernel; // PIXEL_KERNEL_SCALAR, _SSE2, _AVX2 or _NEON
+  BlendFn over;
+  BlendFn premultiply;
+  BlendMaskFn mask;
+} Blender;
+
+int blenderInit(Blender *b, PixelKernel kernel);
+
+void blendRect(const Blender *b, BlendOp op, uint32_t *dst,
+               uint32_t dstStride, const uint32_t *src, uint32_t srcStride,
+               uint32_t width, uint32_t height);
+
+void blendMask(const Blender *b, uint32_t *dst, const uint8_t *mask,
+               uint32_t color, size_t count);
+void blendPremultiply(const Blender *b, uint32_t *dst, const uint32_t *src,
+                      size_t count);
+void blendUnpremultiply(uint32_t *dst, const uint32_t *src, size_t count);
+uint32_t blendPremultiplyColor(uint32_t color);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "damage.h"
+
+static inline int64_t area(const DamageBox *b) {
+  return (int64_t)(b->x2 - b->x1) * (b->y2 - b->y1);
+}
+
+static inline int32_t min32(int32_t a, int32_t b) { return a < b ? a : b; }
+static inline int32_t max32(int32_t a, int32_t b) { return a > b ? a : b; }
+
+static inline DamageBox unite(const DamageBox *a, const DamageBox *b) {
+  return (DamageBox){min32(a->x1, b->x1), min32(a->y1, b->y1),
+                     max32(a->x2, b->x2), max32(a->y2, b->y2)};
+}
+
+// Whether a covers all of b
+static inline bool contains(const DamageBox *a, const DamageBox *b) {
+  return a->x1 <= b->x1 && a->y1 <= b->y1 && a->x2 >= b->x2 &&
+         a->y2 >= b->y2;
+}
+
+static inline int64_t overlap(const DamageBox *a, const DamageBox *b) {
+  const int32_t w = min32(a->x2, b->x2) - max32(a->x1, b->x1);
+  const int32_t h = min32(a->y2, b->y2) - max32(a->y1, b->y1);
+  return w > 0 && h > 0 ? (int64_t)w * h : 0;
+}
+
+//
+// Pixels that replacing a and b with the box around them would add to the
+// upload. Negative when they overlap enough that one box sends less than
+// two.
+//
+static inline int64_t mergeCost(const DamageBox *a, const DamageBox *b) {
+  const DamageBox u = unite(a, b);
+  return area(&u) - area(a) - area(b) + overlap(a, b);
+}
+
+static void removeBox(DamageTracker *d, uint32_t i) {
+  d->boxes[i] = d->boxes[--d->count];
+}
+
+static void addBox(DamageTracker *d, DamageBox r) {
+  for (;;) {
+    // Already covered
+    for (uint32_t i = 0; i < d->count; i++) {
+      if (contains(&d->boxes[i], &r)) {
+        return;
+      }
+    }
+
+    // Drop boxes the new one covers
+    for (uint32_t i = 0; i < d->count;) {
+      if (contains(&r, &d->boxes[i])) {
+        removeBox(d, i);
+      } else {
+        i++;
+      }
+    }
+
+    // The box that is cheapest to merge with
+    int64_t bestCost = INT64_MAX;
+    uint32_t best = 0;
+    for (uint32_t i = 0; i < d->count; i++) {
+      const int64_t cost = mergeCost(&d->boxes[i], &r);
+      if (cost < bestCost) {
+        bestCost = cost;
+        best = i;
+      }
+    }
+
+    // Cheaper to send a few more pixels than another box. The merged box
+    // might now cover or overlap others, so go around again.
+    if (d->count && bestCost <= (int64_t)d->boxCost) {
+      r = unite(&d->boxes[best], &r);
+      removeBox(d, best);
+      continue;
+    }
+
+    if (d->count < DAMAGE_MAX_BOXES) {
+      d->boxes[d->count++] = r;
+      return;
+    }
+
+    // Out of room. Merge whichever pair is cheapest, counting the new box.
+    int64_t pairCost = INT64_MAX;
+    uint32_t pairA = 0, pairB = 0;
+    for (uint32_t i = 0; i < d->count; i++) {
+      for (uint32_t j = i + 1; j < d->count; j++) {
+        const int64_t cost = mergeCost(&d->boxes[i], &d->boxes[j]);
+        if (cost < pairCost) {
+          pairCost = cost;
+          pairA = i;
+          pairB = j;
+        }
+      }
+    }
+
+    if (bestCost <= pairCost) {
+      r = unite(&d->boxes[best], &r);
+      removeBox(d, best);
+    } else {
+      // Swap the new box in for the pair and add their union instead
+      const DamageBox merged = unite(&d->boxes[pairA], &d->boxes[pairB]);
+      removeBox(d, pairB);
+      d->boxes[pairA] = r;
+      r = merged;
+    }
+  }
+}
+
+void damageInit(DamageTracker *d, int32_t width, int32_t height) {
+  *d = (DamageTracker){
+      .width = width,
+      .height = height,
+      .boxCost = DAMAGE_BOX_COST,
+  };
+}
+
+//
+// Change the size of the surface. Boxes already collected are clipped to
+// the new size, the parts that are new are not marked, that is up to the
+// caller.
+//
+void damageResize(DamageTracker *d, int32_t width, int32_t height) {
+  d->width = width;
+  d->height = height;
+
+  for (uint32_t i = 0; i < d->count;) {
+    DamageBox *b = &d->boxes[i];
+    b->x2 = min32(b->x2, width);
+    b->y2 = min32(b->y2, height);
+    if (b->x1 >= b->x2 || b->y1 >= b->y2) {
+      removeBox(d, i);
+    } else {
+      i++;
+    }
+  }
+}
+
+// Mark a rectangle as changed. Anything outside the surface is ignored.
+void damageAdd(DamageTracker *d, int32_t x, int32_t y, int32_t width,
+               int32_t height) {
+  DamageBox r = {max32(x, 0), max32(y, 0), min32(x + width, d->width),
+                 min32(y + height, d->height)};
+  if (r.x1 >= r.x2 || r.y1 >= r.y2) {
+    return;
+  }
+  addBox(d, r);
+}
+
+// Mark the whole surface as changed, for example after a resize
+void damageAddAll(DamageTracker *d) {
+  d->boxes[0] = (DamageBox){0, 0, d->width, d->height};
+  d->count = d->width > 0 && d->height > 0;
+}
+
+// Pixels the current boxes will upload
+uint64_t damageArea(const DamageTracker *d) {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < d->count; i++) {
+    total += area(&d->boxes[i]);
+  }
+  return total;
+}
+
+// Call once the boxes have been drawn and uploaded
+void damageFrameDone(DamageTracker *d, DamageStats *stats) {
+  if (stats && d->count) {
+    stats->frames++;
+    stats->boxes += d->count;
+    stats->pixels += damageArea(d);
+    stats->fullPixels += (uint64_t)d->width * d->height;
+  }
+  d->count = 0;
+}
+
+void printDamageStats(FILE *out, const DamageStats *stats,
+                      uint32_t bytesPerPixel) {
+  if (!stats->frames) {
+    fprintf(out, "Damage: no frames\n");
+    return;
+  }
+
+  const double frames = (double)stats->frames;
+  const double sent = stats->pixels * bytesPerPixel / frames;
+  const double full = stats->fullPixels * bytesPerPixel / frames;
+
+  fprintf(out,
+          "Damage: %llu frames, %.1f boxes per frame, %.0f bytes per frame "
+          "instead of %.0f, %.0f bytes (%.1f%%) saved per frame\n",
+          (unsigned long long)stats->frames, stats->boxes / frames, sent,
+          full, full - sent, full > 0 ? 100.0 * (full - sent) / full : 0.0);
+}
@@ -0,0 +1,63 @@
+#ifndef DAMAGE_H_20261017
+#define DAMAGE_H_20261017
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Most separate boxes kept before they are forced together
+#define DAMAGE_MAX_BOXES 16
+
+// What one extra box costs compared to uploading extra pixels, in pixels.
+// Covers the request header, the server's per request work and, for the
+// copying path, the rows being packed.
+#define DAMAGE_BOX_COST 2048
+
+// Rectangle from (x1, y1) up to but not including (x2, y2)
+typedef struct {
+  int32_t x1, y1;
+  int32_t x2, y2;
+} DamageBox;
+
+//
+// Collects the parts of a surface that changed since the last frame.
+//
+// Every rectangle added is clipped to the surface and then either dropped,
+// if it is already covered, merged into an existing box, or kept as a box
+// of its own. Merging is chosen when the pixels it adds cost less than
+// sending another box. When DAMAGE_MAX_BOXES is reached the two boxes that
+// are cheapest to merge are merged.
+//
+typedef struct {
+  DamageBox boxes[DAMAGE_MAX_BOXES];
+  uint32_t count;
+
+  int32_t width;
+  int32_t height;
+
+  // Defaults to DAMAGE_BOX_COST
+  uint64_t boxCost;
+} DamageTracker;
+
+typedef struct {
+  uint64_t frames;
+  uint64_t boxes;
+  uint64_t pixels;     // Pixels uploaded
+  uint64_t fullPixels; // Pixels that whole frame uploads would have been
+} DamageStats;
+
+void damageInit(DamageTracker *d, int32_t width, int32_t height);
+void damageResize(DamageTracker *d, int32_t width, int32_t height);
+void damageAdd(DamageTracker *d, int32_t x, int32_t y, int32_t width,
+               int32_t height);
+void damageAddAll(DamageTracker *d);
+
+static inline bool damageEmpty(const DamageTracker *d) {
+  return d->count == 0;
+}
+
+uint64_t damageArea(const DamageTracker *d);
+void damageFrameDone(DamageTracker *d, DamageStats *stats);
+void printDamageStats(FILE *out, const DamageStats *stats,
+                      uint32_t bytesPerPixel);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "dispatch.h"
+#include <stdlib.h>
+
+// Placed in every slot that has no handler so dispatchEvent never has to
+// check for one
+static void ignoreEvent(xcb_generic_event_t *, void *) {}
+
+// Second level lookup for XGE events, registered in the XCB_GE_GENERIC slot
+static void dispatchGeneric(xcb_generic_event_t *event, void *data) {
+  const EventDispatcher *d = data;
+  const xcb_ge_generic_event_t *ge = (xcb_ge_generic_event_t *)event;
+
+  const GenericEventTable *table = d->generic[ge->extension & 0x7F];
+  if (!table || ge->event_type >= DISPATCH_GE_EVENTS_MAX) {
+    return;
+  }
+
+  const EventHandler *h = &table->handlers[ge->event_type];
+  h->fn(event, h->data);
+}
+
+// Set every slot to ignore its event. The generic slot keeps a pointer to
+// the dispatcher, so it must not be copied or moved afterwards.
+void dispatcherInit(EventDispatcher *d) {
+  for (uint32_t i = 0; i < DISPATCH_CORE_SLOTS; i++) {
+    d->core[i] = (EventHandler){.fn = ignoreEvent, .data = nullptr};
+  }
+  d->core[XCB_GE_GENERIC] = (EventHandler){.fn = dispatchGeneric, .data = d};
+
+  for (uint32_t i = 0; i < 128; i++) {
+    d->generic[i] = nullptr;
+  }
+}
+
+// Free the generic event tables
+void dispatcherDestroy(EventDispatcher *d) {
+  for (uint32_t i = 0; i < 128; i++) {
+    free(d->generic[i]);
+    d->generic[i] = nullptr;
+  }
+}
+
+//
+// Register the handler for a core event, an error (responseType 0), or a
+// non-generic extension event (the extension's first_event plus its code).
+// Passing nullptr for fn removes the handler.
+//
+// Returns 0 on success.
+//
+int dispatcherSetHandler(     //
+    EventDispatcher *d,       ///> dispatcher to modify
+    uint8_t responseType,     ///> event code, the send event bit is ignored
+    EventHandlerFn fn,        ///> handler, nullptr to ignore the event
+    void *data                ///> passed to fn
+) {
+  responseType &= ~DISPATCH_SEND_EVENT_BIT;
+
+  // The generic slot belongs to the dispatcher
+  if (responseType == XCB_GE_GENERIC) {
+    return -1;
+  }
+
+  d->core[responseType] = (EventHandler){
+      .fn = fn ? fn : ignoreEvent,
+      .data = data,
+  };
+  return 0;
+}
+
+//
+// Register the handler for an event delivered through the generic event
+// extension. The extension opcode is the major_opcode from
+// xcb_query_extension or xcb_get_extension_data.
+//
+// Returns 0 on success.
+//
+int dispatcherSetGenericHandler( //
+    EventDispatcher *d,          ///> dispatcher to modify
+    uint8_t extension,           ///> extension major opcode
+    uint16_t eventType,          ///> the event's event_type
+    EventHandlerFn fn,           ///> handler, nullptr to ignore the event
+    void *data                   ///> passed to fn
+) {
+  if (extension < 128 || eventType >= DISPATCH_GE_EVENTS_MAX) {
+    return -1;
+  }
+
+  GenericEventTable **table = &d->generic[extension & 0x7F];
+  if (!*table) {
+    *table = malloc(sizeof(GenericEventTable));
+    if (!*table) {
+      return -2;
+    }
+    for (uint32_t i = 0; i < DISPATCH_GE_EVENTS_MAX; i++) {
+      (*table)->handlers[i] = (EventHandler){.fn = ignoreEvent};
+    }
+  }
+
+  (*table)->handlers[eventType] = (EventHandler){
+      .fn = fn ? fn : ignoreEvent,
+      .data = data,
+  };
+  return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef DISPATCH_H_20261017
+#define DISPATCH_H_20261017
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+// The high bit of response_type is set on events sent with xcb_send_event.
+// Everything else is the event code, 0 for errors.
+#define DISPATCH_SEND_EVENT_BIT 0x80
+#define DISPATCH_CORE_SLOTS 128
+
+// Event types an extension can send through the generic event (XGE) path.
+// XInput 2 uses the most at a little under 30.
+#define DISPATCH_GE_EVENTS_MAX 64
+
+typedef void (*EventHandlerFn)(xcb_generic_event_t *event, void *data);
+
+typedef struct {
+  EventHandlerFn fn;
+  void *data;
+} EventHandler;
+
+// Handlers for one extension's generic events, indexed by event_type
+typedef struct {
+  EventHandler handlers[DISPATCH_GE_EVENTS_MAX];
+} GenericEventTable;
+
+//
+// Flat handler table indexed by response_type with the send event bit
+// cleared. Errors are slot 0. Extension events that are not generic events
+// land in the 64-127 range and are registered using the extension's
+// first_event plus their code.
+//
+// Every slot always holds a callable handler, so dispatching is one masked
+// index and one indirect call no matter how many handlers are registered.
+// Generic events go through a slot that does the second lookup by
+// extension opcode and event type.
+//
+typedef struct {
+  EventHandler core[DISPATCH_CORE_SLOTS];
+
+  // Indexed by extension major opcode - 128
+  GenericEventTable *generic[128];
+} EventDispatcher;
+
+void dispatcherInit(EventDispatcher *d);
+void dispatcherDestroy(EventDispatcher *d);
+
+int dispatcherSetHandler(EventDispatcher *d, uint8_t responseType,
+                         EventHandlerFn fn, void *data);
+int dispatcherSetGenericHandler(EventDispatcher *d, uint8_t extension,
+                                uint16_t eventType, EventHandlerFn fn,
+                                void *data);
+
+// Hand the event to whatever handler was registered for its type
+static inline void dispatchEvent(const EventDispatcher *d,
+                                 xcb_generic_event_t *event) {
+  const EventHandler *h =
+      &d->core[event->response_type & ~DISPATCH_SEND_EVENT_BIT];
+  h->fn(event, h->data);
+}
+
+#endif
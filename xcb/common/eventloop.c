@@ -0,0 +1,386 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "eventloop.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// Current time of the monotonic clock in nanoseconds
+uint64_t eventLoopNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void recordLatency(LoopLatency *l, uint64_t ns) {
+  l->count++;
+  l->totalNs += ns;
+  if (ns > l->maxNs) {
+    l->maxNs = ns;
+  }
+}
+
+// Add a file descriptor to the epoll set. Returns the index of the new
+// source or -1 on failure.
+static int addSource(EventLoop *loop, LoopSourceType type, int fd,
+                     LoopHandler handler, void *data) {
+  if (loop->sourceCount == EVENT_LOOP_MAX_SOURCES) {
+    return -1;
+  }
+
+  const uint32_t index = loop->sourceCount;
+
+  // The index is stored with the fd so a ready event leads straight back to
+  // its source without a search
+  struct epoll_event ev = {.events = EPOLLIN, .data.u32 = index};
+  if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &ev)) {
+    return -1;
+  }
+
+  loop->sources[index] = (LoopSource){
+      .type = type,
+      .fd = fd,
+      .handler = handler,
+      .data = data,
+  };
+  loop->sourceCount++;
+  return (int)index;
+}
+
+//
+// Set up an event loop for the connection. The X connection's file
+// descriptor and an eventfd for eventLoopWake are always watched.
+//
+// Returns 0 on success.
+//
+int eventLoopInit(             //
+    EventLoop *loop,           ///> loop to set up
+    xcb_connection_t *c,       ///> server connection
+    LoopEventHandler onEvent,  ///> called for every X event
+    void *eventData            ///> passed to onEvent
+) {
+  *loop = (EventLoop){
+      .connection = c,
+      .onEvent = onEvent,
+      .eventData = eventData,
+  };
+
+  loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop->epollFd < 0) {
+    return -1;
+  }
+
+  if (addSource(loop, LOOP_SOURCE_XCB, xcb_get_file_descriptor(c), nullptr,
+                nullptr) < 0) {
+    close(loop->epollFd);
+    return -2;
+  }
+
+  int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int wake = wakeFd < 0 ? -1
+                        : addSource(loop, LOOP_SOURCE_WAKE, wakeFd, nullptr,
+                                    nullptr);
+  if (wake < 0) {
+    if (wakeFd >= 0) {
+      close(wakeFd);
+    }
+    close(loop->epollFd);
+    return -3;
+  }
+  loop->wakeSource = (uint32_t)wake;
+  atomic_init(&loop->wakeSentNs, 0);
+
+  return 0;
+}
+
+// Close every file descriptor the loop created. The X connection is left
+// alone, as are descriptors added through eventLoopAddFd.
+void eventLoopDestroy(EventLoop *loop) {
+  for (uint32_t i = 0; i < loop->sourceCount; i++) {
+    LoopSource *s = &loop->sources[i];
+    if (s->type == LOOP_SOURCE_WAKE || s->type == LOOP_SOURCE_TIMER) {
+      close(s->fd);
+    }
+  }
+  close(loop->epollFd);
+  loop->sourceCount = 0;
+}
+
+// Set the function run on the loop's thread after eventLoopWake is called
+int eventLoopSetWakeHandler(EventLoop *loop, LoopHandler handler, void *data) {
+  loop->sources[loop->wakeSource].handler = handler;
+  loop->sources[loop->wakeSource].data = data;
+  return 0;
+}
+
+//
+// Add a periodic timer. The first expiration is one period from now. The
+// deadlines are absolute, so a late handler does not push later ticks back.
+//
+// Returns the source index or a negative value on failure.
+//
+int eventLoopAddTimer(      //
+    EventLoop *loop,        ///> loop to add the timer to
+    uint64_t periodNs,      ///> time between expirations
+    LoopHandler handler,    ///> called on expiration
+    void *data              ///> passed to handler
+) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  const uint64_t first = eventLoopNow() + periodNs;
+  const struct itimerspec spec = {
+      .it_value = {.tv_sec = first / 1000000000ull,
+                   .tv_nsec = first % 1000000000ull},
+      .it_interval = {.tv_sec = periodNs / 1000000000ull,
+                      .tv_nsec = periodNs % 1000000000ull},
+  };
+
+  if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr)) {
+    close(fd);
+    return -2;
+  }
+
+  int index = addSource(loop, LOOP_SOURCE_TIMER, fd, handler, data);
+  if (index < 0) {
+    close(fd);
+    return -3;
+  }
+
+  loop->sources[index].periodNs = periodNs;
+  loop->sources[index].nextDeadlineNs = first;
+  return index;
+}
+
+// Watch another file descriptor. The handler is called whenever it is
+// readable and is responsible for reading from it.
+int eventLoopAddFd(EventLoop *loop, int fd, LoopHandler handler, void *data) {
+  return addSource(loop, LOOP_SOURCE_FD, fd, handler, data);
+}
+
+//
+// Wake the loop from any thread. Wakeups that arrive before the loop gets
+// around to them are folded together and the handler sees the total.
+//
+void eventLoopWake(EventLoop *loop) {
+  uint64_t expected = 0;
+  atomic_compare_exchange_strong(&loop->wakeSentNs, &expected,
+                                 eventLoopNow());
+
+  const uint64_t one = 1;
+  ssize_t written = write(loop->sources[loop->wakeSource].fd, &one, sizeof(one));
+  (void)written;
+}
+
+// Ask the loop to return once the current handler finishes
+void eventLoopStop(EventLoop *loop) { loop->running = false; }
+
+//
+// Hand every event xcb has already queued to onEvent.
+//
+// xcb reads events off the socket while it waits for replies, so there can
+// be events waiting even though the socket is not readable. When readSocket
+// is set the socket is read once first. It is not read again, so a flood of
+// input cannot keep the loop from getting to its timers.
+//
+// Returns the number of events handled.
+//
+static uint32_t dispatchXEvents(EventLoop *loop, bool readSocket,
+                                uint64_t receivedNs) {
+  TRACE_SCOPE("dispatch");
+
+  uint32_t handled = 0;
+  xcb_generic_event_t *event;
+
+  while (loop->running) {
+    event = readSocket ? xcb_poll_for_event(loop->connection)
+                       : xcb_poll_for_queued_event(loop->connection);
+    readSocket = false;
+    if (!event) {
+      break;
+    }
+
+    recordLatency(&loop->stats.xcb, eventLoopNow() - receivedNs);
+    loop->onEvent(loop, event, loop->eventData);
+    free(event);
+    handled++;
+  }
+
+  loop->stats.xEvents += handled;
+  return handled;
+}
+
+// Handle a timer that epoll reported as readable. Returns false if it had
+// not actually expired.
+static bool dispatchTimer(EventLoop *loop, LoopSource *s) {
+  uint64_t expirations = 0;
+  if (read(s->fd, &expirations, sizeof(expirations)) != sizeof(expirations) ||
+      expirations == 0) {
+    return false;
+  }
+
+  const uint64_t now = eventLoopNow();
+  recordLatency(&loop->stats.timer,
+                now > s->nextDeadlineNs ? now - s->nextDeadlineNs : 0);
+
+  s->missed += expirations - 1;
+  s->nextDeadlineNs += expirations * s->periodNs;
+
+  if (s->handler) {
+    s->handler(loop, expirations, s->data);
+  }
+  return true;
+}
+
+static bool dispatchWake(EventLoop *loop, LoopSource *s) {
+  uint64_t count = 0;
+  if (read(s->fd, &count, sizeof(count)) != sizeof(count) || count == 0) {
+    return false;
+  }
+
+  const uint64_t sent = atomic_exchange(&loop->wakeSentNs, 0);
+  if (sent) {
+    const uint64_t now = eventLoopNow();
+    recordLatency(&loop->stats.wake, now > sent ? now - sent : 0);
+  }
+
+  if (s->handler) {
+    s->handler(loop, count, s->data);
+  }
+  return true;
+}
+
+//
+// Run the loop until eventLoopStop is called or the X connection fails.
+//
+// The thread only ever sleeps in epoll_wait, so there is no polling. Before
+// sleeping, anything xcb has queued is handled and the output buffer is
+// flushed once.
+//
+// Returns 0 when stopped and -1 on an error.
+//
+int eventLoopRun(EventLoop *loop) {
+  struct epoll_event ready[EVENT_LOOP_MAX_SOURCES];
+
+  loop->running = true;
+  while (loop->running) {
+
+    dispatchXEvents(loop, false, eventLoopNow());
+    if (!loop->running) {
+      break;
+    }
+
+    {
+      TRACE_SCOPE("flush");
+      xcb_flush(loop->connection);
+    }
+    if (xcb_connection_has_error(loop->connection)) {
+      return -1;
+    }
+
+    int n;
+    {
+      TRACE_SCOPE("wait");
+      n = epoll_wait(loop->epollFd, ready, EVENT_LOOP_MAX_SOURCES, -1);
+    }
+    const uint64_t now = eventLoopNow();
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+
+    loop->stats.wakeups++;
+
+    bool didWork = false;
+    for (int i = 0; i < n && loop->running; i++) {
+      LoopSource *s = &loop->sources[ready[i].data.u32];
+
+      switch (s->type) {
+      case LOOP_SOURCE_XCB:
+        didWork |= dispatchXEvents(loop, true, now) > 0;
+        break;
+
+      case LOOP_SOURCE_TIMER:
+        didWork |= dispatchTimer(loop, s);
+        break;
+
+      case LOOP_SOURCE_WAKE:
+        didWork |= dispatchWake(loop, s);
+        break;
+
+      case LOOP_SOURCE_FD:
+        if (s->handler) {
+          s->handler(loop, 1, s->data);
+        }
+        didWork = true;
+        break;
+      }
+    }
+
+    if (!didWork) {
+      loop->stats.idleWakeups++;
+    }
+  }
+
+  return 0;
+}
+
+static void printLatency(FILE *out, const char *name, const LoopLatency *l) {
+  if (l->count == 0) {
+    fprintf(out, "  %-9s none\n", name);
+    return;
+  }
+  fprintf(out, "  %-9s %8llu handled, avg %8.1f us, max %8.1f us\n", name,
+          (unsigned long long)l->count,
+          (double)l->totalNs / (double)l->count / 1000.0,
+          (double)l->maxNs / 1000.0);
+}
+
+// Print how often the loop woke up and how long each kind of work waited
+void printEventLoopStats(FILE *out, const EventLoop *loop) {
+  const EventLoopStats *s = &loop->stats;
+
+  uint64_t missed = 0;
+  for (uint32_t i = 0; i < loop->sourceCount; i++) {
+    missed += loop->sources[i].missed;
+  }
+
+  fprintf(out, "Event loop: %llu wakeups, %llu with nothing to do\n",
+          (unsigned long long)s->wakeups, (unsigned long long)s->idleWakeups);
+  printLatency(out, "X events", &s->xcb);
+  printLatency(out, "timers", &s->timer);
+  printLatency(out, "wakeups", &s->wake);
+  fprintf(out, "  missed timer ticks: %llu\n", (unsigned long long)missed);
+}
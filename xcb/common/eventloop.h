@@ -0,0 +1,96 @@
+#ifndef EVENTLOOP_H_20261017
+#define EVENTLOOP_H_20261017
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+// The most timers and extra file descriptors a loop can watch
+#define EVENT_LOOP_MAX_SOURCES 16
+
+typedef struct EventLoop EventLoop;
+
+// Called for every X event. The loop frees the event afterwards.
+typedef void (*LoopEventHandler)(EventLoop *loop, xcb_generic_event_t *event,
+                                 void *data);
+
+// Called when a timer expires, a wakeup is received, or a file descriptor is
+// readable. count is the number of timer expirations or wakeups since the
+// last call and is 1 for plain file descriptors.
+typedef void (*LoopHandler)(EventLoop *loop, uint64_t count, void *data);
+
+typedef enum {
+  LOOP_SOURCE_XCB,
+  LOOP_SOURCE_WAKE,
+  LOOP_SOURCE_TIMER,
+  LOOP_SOURCE_FD,
+} LoopSourceType;
+
+// Latency numbers kept for each kind of source
+typedef struct {
+  uint64_t count;   // Number of times a handler ran
+  uint64_t totalNs; // Sum of latencies
+  uint64_t maxNs;   // Worst latency seen
+} LoopLatency;
+
+typedef struct {
+  LoopSourceType type;
+  int fd;
+  LoopHandler handler;
+  void *data;
+
+  // Timers only
+  uint64_t periodNs;
+  uint64_t nextDeadlineNs; // When the next expiration is due
+  uint64_t missed;         // Expirations that were folded into a later one
+} LoopSource;
+
+typedef struct {
+  uint64_t wakeups;     // Times epoll_wait returned
+  uint64_t idleWakeups; // Times it returned with nothing to do
+  uint64_t xEvents;     // X events handled
+
+  LoopLatency xcb;   // socket readable -> handler
+  LoopLatency timer; // timer deadline -> handler
+  LoopLatency wake;  // eventLoopWake -> handler
+} EventLoopStats;
+
+struct EventLoop {
+  int epollFd;
+  xcb_connection_t *connection;
+
+  LoopEventHandler onEvent;
+  void *eventData;
+
+  LoopSource sources[EVENT_LOOP_MAX_SOURCES];
+  uint32_t sourceCount;
+
+  // Index of the eventfd source used by eventLoopWake
+  uint32_t wakeSource;
+
+  // Time of the oldest wakeup not yet handled, zero if none is pending.
+  // Written by other threads.
+  _Atomic uint64_t wakeSentNs;
+
+  bool running;
+  EventLoopStats stats;
+};
+
+int eventLoopInit(EventLoop *loop, xcb_connection_t *c,
+                  LoopEventHandler onEvent, void *eventData);
+void eventLoopDestroy(EventLoop *loop);
+
+int eventLoopSetWakeHandler(EventLoop *loop, LoopHandler handler, void *data);
+int eventLoopAddTimer(EventLoop *loop, uint64_t periodNs, LoopHandler handler,
+                      void *data);
+int eventLoopAddFd(EventLoop *loop, int fd, LoopHandler handler, void *data);
+
+int eventLoopRun(EventLoop *loop);
+void eventLoopStop(EventLoop *loop);
+void eventLoopWake(EventLoop *loop);
+
+uint64_t eventLoopNow(void);
+void printEventLoopStats(FILE *out, const EventLoop *loop);
+
+#endif
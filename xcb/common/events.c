@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "events.h"
+#include "trace.h"
+#include <stdlib.h>
+
+// Returns the histogram bucket for a batch of n events. Bucket i holds
+// batches of 2^i up to 2^(i+1) - 1 events.
+static uint32_t batchBucket(uint32_t n) {
+  uint32_t bucket = 0;
+  while (n > 1 && bucket < EVENT_BATCH_BUCKETS - 1) {
+    n >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+//
+// Block until at least one event arrives, then take every other event that
+// xcb has already read from the socket without blocking again.
+//
+// xcb_poll_for_queued_event never reads from the socket, so the whole batch
+// costs a single wakeup. The caller is expected to handle every event in the
+// batch, call freeEventBatch, and then flush once.
+//
+// Returns the number of events in the batch. Zero means the connection has
+// failed and the event loop should stop.
+//
+uint32_t waitForEventBatch(  //
+    xcb_connection_t *c,     ///> server connection
+    EventBatch *batch,       ///> batch to fill, must be empty
+    EventBatchStats *stats   ///> optional statistics, may be nullptr
+) {
+  uint32_t capacity = batch->capacity;
+  if (capacity == 0 || capacity > EVENT_BATCH_MAX) {
+    capacity = EVENT_BATCH_MAX;
+  }
+
+  batch->count = 0;
+
+  xcb_generic_event_t *event;
+  {
+    TRACE_SCOPE("wait");
+    event = xcb_wait_for_event(c);
+  }
+  if (!event) {
+    return 0;
+  }
+  batch->events[batch->count++] = event;
+
+  // Anything left over stays in xcb's queue and the next call to
+  // xcb_wait_for_event returns it without blocking.
+  while (batch->count < capacity &&
+         (event = xcb_poll_for_queued_event(c))) {
+    batch->events[batch->count++] = event;
+  }
+
+  if (stats) {
+    stats->wakeups++;
+    stats->events += batch->count;
+    if (batch->count > stats->largest) {
+      stats->largest = batch->count;
+    }
+    stats->histogram[batchBucket(batch->count)]++;
+  }
+
+  return batch->count;
+}
+
+// Free every event in the batch and mark it empty
+void freeEventBatch(EventBatch *batch) {
+  for (uint32_t i = 0; i < batch->count; i++) {
+    free(batch->events[i]);
+  }
+  batch->count = 0;
+}
+
+//
+// Print a summary of the batches seen.
+//
+// Every event after the first in a batch is one blocking wait and one flush
+// that a one event per wakeup loop would have paid for.
+//
+void printEventBatchStats(FILE *out, const EventBatchStats *stats) {
+  if (stats->wakeups == 0) {
+    fprintf(out, "Event batches: none\n");
+    return;
+  }
+
+  const uint64_t avoided = stats->events - stats->wakeups;
+
+  fprintf(out, "Event batches: %llu wakeups, %llu events, %.2f events/wakeup\n",
+          (unsigned long long)stats->wakeups,
+          (unsigned long long)stats->events,
+          (double)stats->events / (double)stats->wakeups);
+  fprintf(out, "  largest batch %u, waits and flushes avoided %llu\n",
+          stats->largest, (unsigned long long)avoided);
+
+  for (uint32_t i = 0; i < EVENT_BATCH_BUCKETS; i++) {
+    if (stats->histogram[i] == 0) {
+      continue;
+    }
+    const uint32_t low = 1u << i;
+    const uint32_t high = (i == EVENT_BATCH_BUCKETS - 1) ? EVENT_BATCH_MAX
+                                                         : (low << 1) - 1;
+    fprintf(out, "  %3u - %3u events: %llu\n", low, high,
+            (unsigned long long)stats->histogram[i]);
+  }
+}
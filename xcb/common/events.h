@@ -0,0 +1,37 @@
+#ifndef EVENTS_H_20261017
+#define EVENTS_H_20261017
+
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+// The most events that will be pulled from xcb in a single batch
+#define EVENT_BATCH_MAX 64
+
+// Batch sizes are recorded in power of two buckets: 1, 2-3, 4-7, ... 64
+#define EVENT_BATCH_BUCKETS 7
+
+// A group of events that were all waiting in xcb's queue at the same time
+typedef struct {
+  xcb_generic_event_t *events[EVENT_BATCH_MAX];
+  uint32_t count;
+
+  // How many events may be placed in events. A capacity of 1 gives the
+  // classic one event per wakeup loop. Zero is treated as EVENT_BATCH_MAX.
+  uint32_t capacity;
+} EventBatch;
+
+// Statistics gathered by waitForEventBatch
+typedef struct {
+  uint64_t wakeups; // Times the loop blocked in xcb_wait_for_event
+  uint64_t events;  // Total number of events handed out
+  uint32_t largest; // Largest batch seen
+  uint64_t histogram[EVENT_BATCH_BUCKETS];
+} EventBatchStats;
+
+uint32_t waitForEventBatch(xcb_connection_t *c, EventBatch *batch,
+                           EventBatchStats *stats);
+void freeEventBatch(EventBatch *batch);
+void printEventBatchStats(FILE *out, const EventBatchStats *stats);
+
+#endif
@@ -0,0 +1,502 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "framebuffer.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// True when the client and server are on the same machine, which is the only
+// time memory can be shared. fds can only be passed over a unix socket.
+static bool isLocalConnection(xcb_connection_t *c) {
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(xcb_get_file_descriptor(c), (struct sockaddr *)&addr,
+                  &len) < 0) {
+    return false;
+  }
+  return addr.ss_family == AF_UNIX;
+}
+
+// Create the segment with memfd_create and hand the fd to the server
+static int attachMemfd(Framebuffer *fb) {
+  int fd = memfd_create("xcb-framebuffer", MFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (ftruncate(fd, fb->size) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  void *pixels =
+      mmap(nullptr, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (pixels == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  // xcb closes the fd once it has been sent, the mapping stays valid
+  fb->shmSeg = xcb_generate_id(fb->connection);
+  xcb_generic_error_t *error = xcb_request_check(
+      fb->connection,
+      xcb_shm_attach_fd_checked(fb->connection, fb->shmSeg, fd, false));
+  if (error) {
+    free(error);
+    munmap(pixels, fb->size);
+    return -1;
+  }
+
+  fb->pixels = pixels;
+  fb->segment = FRAMEBUFFER_SEGMENT_MEMFD;
+  return 0;
+}
+
+// Create the segment with shmget and tell the server its id
+static int attachSysV(Framebuffer *fb) {
+  fb->shmId = shmget(IPC_PRIVATE, fb->size, IPC_CREAT | 0600);
+  if (fb->shmId < 0) {
+    return -1;
+  }
+
+  void *pixels = shmat(fb->shmId, nullptr, 0);
+  if (pixels == (void *)-1) {
+    shmctl(fb->shmId, IPC_RMID, nullptr);
+    return -1;
+  }
+
+  fb->shmSeg = xcb_generate_id(fb->connection);
+  xcb_generic_error_t *error = xcb_request_check(
+      fb->connection,
+      xcb_shm_attach_checked(fb->connection, fb->shmSeg, fb->shmId, false));
+
+  // Once both sides are attached the segment can be marked for removal. It
+  // goes away when the last of them detaches, even if this process crashes.
+  shmctl(fb->shmId, IPC_RMID, nullptr);
+
+  if (error) {
+    free(error);
+    shmdt(pixels);
+    return -1;
+  }
+
+  fb->pixels = pixels;
+  fb->segment = FRAMEBUFFER_SEGMENT_SYSV;
+  return 0;
+}
+
+static int attachShm(Framebuffer *fb) {
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(fb->connection, &xcb_shm_id);
+  if (!ext || !ext->present || !isLocalConnection(fb->connection)) {
+    return -1;
+  }
+
+  xcb_shm_query_version_reply_t *version = xcb_shm_query_version_reply(
+      fb->connection, xcb_shm_query_version(fb->connection), nullptr);
+  if (!version) {
+    return -1;
+  }
+
+  // ShmAttachFd arrived in MIT-SHM 1.2
+  const bool haveFd = version->major_version > 1 ||
+                      (version->major_version == 1 &&
+                       version->minor_version >= 2);
+
+  // Pixmaps whose pixels live in the segment, see framebufferCreatePixmap
+  fb->sharedPixmaps = version->shared_pixmaps &&
+                      version->pixmap_format == XCB_IMAGE_FORMAT_Z_PIXMAP;
+  free(version);
+
+  if (haveFd && attachMemfd(fb) == 0) {
+    return 0;
+  }
+  return attachSysV(fb);
+}
+
+// Ordinary memory for the copying path, and room to pack rows into
+static int allocateLocal(Framebuffer *fb) {
+  // 64 byte aligned so whole cache lines can be written at once
+  fb->pixels = aligned_alloc(64, (fb->size + 63) & ~(size_t)63);
+
+  // Room to pack as many rows as fit in one request
+  fb->scratchSize = fb->maxRequestBytes - sizeof(xcb_put_image_request_t);
+  if (fb->scratchSize > fb->size) {
+    fb->scratchSize = fb->size;
+  }
+  fb->scratch = malloc(fb->scratchSize);
+
+  if (!fb->pixels || !fb->scratch) {
+    free(fb->pixels);
+    free(fb->scratch);
+    fb->pixels = nullptr;
+    fb->scratch = nullptr;
+    return -1;
+  }
+  fb->mode = FRAMEBUFFER_PUT_IMAGE;
+  fb->segment = FRAMEBUFFER_SEGMENT_NONE;
+  return 0;
+}
+
+// The server has its own mapping of the segment, so this side can unmap it
+// without waiting for presents still in flight
+static void releasePixels(Framebuffer *fb) {
+  switch (fb->segment) {
+  case FRAMEBUFFER_SEGMENT_MEMFD:
+    xcb_shm_detach(fb->connection, fb->shmSeg);
+    munmap(fb->pixels, fb->size);
+    break;
+  case FRAMEBUFFER_SEGMENT_SYSV:
+    xcb_shm_detach(fb->connection, fb->shmSeg);
+    shmdt(fb->pixels);
+    break;
+  case FRAMEBUFFER_SEGMENT_NONE:
+    free(fb->pixels);
+    free(fb->scratch);
+    break;
+  }
+  fb->pixels = nullptr;
+}
+
+//
+// Set up a framebuffer for a drawable of the given depth.
+//
+// With FRAMEBUFFER_SHM the pixels live in shared memory and presenting only
+// sends a small request, the server reads the pixels straight out of the
+// segment. If MIT-SHM is missing, the server is on another machine, or the
+// attach fails, the framebuffer quietly falls back to copying the pixels
+// through the socket with PutImage. fb->mode says which one was used.
+//
+// Returns 0 on success, -1 if the depth is not stored as 32 bits per pixel,
+// -2 if the server wants pixels in the other byte order, -3 if out of memory.
+//
+int framebufferCreate(               //
+    Framebuffer *fb,                 ///> framebuffer to set up
+    xcb_connection_t *c,             ///> server connection
+    xcb_drawable_t drawable,         ///> window or pixmap to draw to
+    uint8_t depth,                   ///> depth of the drawable, 24 or 32
+    uint16_t width,                  ///> size in pixels
+    uint16_t height,                 ///>
+    FramebufferMode preferred        ///> FRAMEBUFFER_SHM to try shared memory
+) {
+  *fb = (Framebuffer){
+      .connection = c,
+      .drawable = drawable,
+      .depth = depth,
+      .width = width,
+      .height = height,
+      .shmId = -1,
+  };
+
+  const xcb_setup_t *setup = xcb_get_setup(c);
+
+  // Both the 24 and 32 bit visuals store each pixel in 32 bits on every
+  // server that matters, but check rather than assume
+  bool found = false;
+  for (xcb_format_iterator_t f = xcb_setup_pixmap_formats_iterator(setup);
+       f.rem; xcb_format_next(&f)) {
+    if (f.data->depth == depth && f.data->bits_per_pixel == 32) {
+      found = true;
+      break;
+    }
+  }
+  if (!found || !width || !height) {
+    return -1;
+  }
+
+  // Pixels are written as host uint32_t values, which is only what the server
+  // expects when the two agree on byte order
+  const uint16_t one = 1;
+  const bool hostLsbFirst = *(const uint8_t *)&one;
+  if (hostLsbFirst != (setup->image_byte_order == XCB_IMAGE_ORDER_LSB_FIRST)) {
+    return -2;
+  }
+
+  fb->stride = (uint32_t)width * 4;
+  fb->size = (size_t)fb->stride * height;
+  fb->maxRequestBytes = xcb_get_maximum_request_length(c) * 4;
+
+  if (preferred == FRAMEBUFFER_SHM && attachShm(fb) == 0) {
+    fb->mode = FRAMEBUFFER_SHM;
+  } else if (allocateLocal(fb)) {
+    return -3;
+  }
+
+  fb->gc = xcb_generate_id(c);
+  xcb_create_gc(c, fb->gc, drawable, 0, nullptr);
+
+  return 0;
+}
+
+void framebufferDestroy(Framebuffer *fb) {
+  if (!fb->pixels) {
+    return;
+  }
+
+  xcb_free_gc(fb->connection, fb->gc);
+  releasePixels(fb);
+}
+
+//
+// Change the size of the framebuffer, keeping the pixels that are in both
+// the old and the new size where they are.
+//
+// Memory only ever grows, and when it has to it grows by half again in
+// each direction that ran out, so dragging a window edge allocates a
+// handful of times instead of once for every pixel. Shrinking, and growing
+// back into memory that is already there, only changes width and height.
+// A new shared memory segment is made the same way as the first one, and
+// if that fails the framebuffer falls back to copying.
+//
+// Returns 0 on success, -1 for a zero size, -3 if out of memory, in which
+// case the framebuffer is left as it was.
+//
+int framebufferResize(               //
+    Framebuffer *fb,                 ///> framebuffer to resize
+    uint16_t width,                  ///> new size in pixels
+    uint16_t height                  ///>
+) {
+  if (!width || !height) {
+    return -1;
+  }
+
+  const uint32_t capacityWidth = fb->stride / 4;
+  const uint32_t capacityHeight = fb->size / fb->stride;
+  if (width <= capacityWidth && height <= capacityHeight) {
+    fb->width = width;
+    fb->height = height;
+    return 0;
+  }
+
+  uint32_t newWidth = capacityWidth;
+  uint32_t newHeight = capacityHeight;
+  if (width > capacityWidth) {
+    newWidth = capacityWidth + capacityWidth / 2;
+    newWidth = newWidth < width ? width : newWidth;
+    newWidth = newWidth > UINT16_MAX ? UINT16_MAX : newWidth;
+  }
+  if (height > capacityHeight) {
+    newHeight = capacityHeight + capacityHeight / 2;
+    newHeight = newHeight < height ? height : newHeight;
+    newHeight = newHeight > UINT16_MAX ? UINT16_MAX : newHeight;
+  }
+
+  Framebuffer old = *fb;
+  fb->stride = newWidth * 4;
+  fb->size = (size_t)fb->stride * newHeight;
+  fb->scratch = nullptr;
+
+  int result = -1;
+  switch (old.segment) {
+  case FRAMEBUFFER_SEGMENT_MEMFD:
+    result = attachMemfd(fb);
+    break;
+  case FRAMEBUFFER_SEGMENT_SYSV:
+    result = attachSysV(fb);
+    break;
+  case FRAMEBUFFER_SEGMENT_NONE:
+    break;
+  }
+  if (result && allocateLocal(fb)) {
+    *fb = old;
+    return -3;
+  }
+
+  // Keep what is in both sizes, a row at a time as the strides differ
+  const uint32_t rows = old.height < height ? old.height : height;
+  const uint32_t columns = old.width < width ? old.width : width;
+  for (uint32_t y = 0; y < rows; y++) {
+    memcpy((uint8_t *)fb->pixels + (size_t)y * fb->stride,
+           (const uint8_t *)old.pixels + (size_t)y * old.stride,
+           (size_t)columns * 4);
+  }
+  releasePixels(&old);
+
+  fb->width = width;
+  fb->height = height;
+  fb->reallocations++;
+  return 0;
+}
+
+//
+// Copy a rectangle of the framebuffer to the same place in the drawable.
+//
+// In shared memory mode the server reads the pixels when it gets to the
+// request, not when this returns, so call framebufferSync before drawing
+// over pixels that have not been shown yet, or present with
+// framebufferPresentNotify and wait for the ShmCompletion.
+//
+// The copying path sends full width rectangles straight out of the
+// framebuffer. Narrower ones are packed into a scratch buffer first so only
+// their own pixels go through the socket. Either way they are split into as
+// many requests as the server's maximum request size needs.
+//
+static bool present(Framebuffer *fb, int16_t x, int16_t y, uint16_t width,
+                    uint16_t height, bool notify) {
+  TRACE_SCOPE("upload");
+
+  // Clip to the framebuffer
+  if (x < 0) {
+    width = -x < width ? width + x : 0;
+    x = 0;
+  }
+  if (y < 0) {
+    height = -y < height ? height + y : 0;
+    y = 0;
+  }
+  if (x >= fb->width || y >= fb->height) {
+    return false;
+  }
+  if (width > fb->width - x) {
+    width = fb->width - x;
+  }
+  if (height > fb->height - y) {
+    height = fb->height - y;
+  }
+  if (!width || !height) {
+    return false;
+  }
+
+  if (fb->mode == FRAMEBUFFER_SHM) {
+    // The image in the segment is the whole of the memory, so the server
+    // steps through it by stride
+    xcb_shm_put_image(fb->connection, fb->drawable, fb->gc, fb->stride / 4,
+                      fb->size / fb->stride, x, y, width, height, x, y,
+                      fb->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, notify,
+                      fb->shmSeg, 0);
+    return notify;
+  }
+
+  const uint32_t rowBytes = (uint32_t)width * 4;
+  uint32_t rowsPerRequest = fb->scratchSize / rowBytes;
+  if (!rowsPerRequest) {
+    rowsPerRequest = 1;
+  }
+
+  for (uint32_t row = y; row < (uint32_t)y + height; row += rowsPerRequest) {
+    uint32_t rows = (uint32_t)y + height - row;
+    if (rows > rowsPerRequest) {
+      rows = rowsPerRequest;
+    }
+
+    const uint8_t *data =
+        (const uint8_t *)fb->pixels + (size_t)row * fb->stride + x * 4;
+    if (rowBytes != fb->stride) {
+      for (uint32_t i = 0; i < rows; i++) {
+        memcpy(fb->scratch + (size_t)i * rowBytes,
+               data + (size_t)i * fb->stride, rowBytes);
+      }
+      data = fb->scratch;
+    }
+
+    // xcb has copied or written the pixels by the time this returns, so the
+    // scratch buffer can be reused straight away
+    xcb_put_image(fb->connection, XCB_IMAGE_FORMAT_Z_PIXMAP, fb->drawable,
+                  fb->gc, width, rows, x, row, 0, fb->depth, rows * rowBytes,
+                  data);
+  }
+  return false;
+}
+
+void framebufferPresent(Framebuffer *fb, int16_t x, int16_t y, uint16_t width,
+                        uint16_t height) {
+  present(fb, x, y, width, height, false);
+}
+
+//
+// framebufferPresent, and ask the server to send a ShmCompletion event once
+// it has read the pixels, so the caller can tell when it is safe to draw
+// into them again without a round trip.
+//
+// Returns true if a ShmCompletion will follow. Nothing is sent for a
+// rectangle that is clipped away, and the copying path is done with the
+// pixels as soon as this returns, so neither gets one.
+//
+bool framebufferPresentNotify(Framebuffer *fb, int16_t x, int16_t y,
+                              uint16_t width, uint16_t height) {
+  return present(fb, x, y, width, height, true);
+}
+
+//
+// Create a pixmap that uses the framebuffer's pixels as its own.
+//
+// Drawing into the framebuffer then draws into the pixmap, with nothing to
+// upload. The server reads the pixels whenever it uses the pixmap, so they
+// must not be changed while a request that reads the pixmap is pending.
+//
+// Only possible in shared memory mode, when the server supports shared
+// pixmaps, and before the framebuffer has been resized into memory bigger
+// than it is. Returns the pixmap, or 0 if it could not be created.
+//
+xcb_pixmap_t framebufferCreatePixmap(Framebuffer *fb) {
+  if (fb->mode != FRAMEBUFFER_SHM || !fb->sharedPixmaps ||
+      fb->size != (size_t)fb->width * fb->height * 4) {
+    return 0;
+  }
+
+  const xcb_pixmap_t pixmap = xcb_generate_id(fb->connection);
+  xcb_generic_error_t *error = xcb_request_check(
+      fb->connection,
+      xcb_shm_create_pixmap_checked(fb->connection, pixmap, fb->drawable,
+                                    fb->width, fb->height, fb->depth,
+                                    fb->shmSeg, 0));
+  if (error) {
+    free(error);
+    return 0;
+  }
+  return pixmap;
+}
+
+//
+// Wait until the server has finished with every present sent so far.
+//
+// Requests are handled in order, so once the reply to a request sent after
+// the presents comes back they are done. Copied pixels are in xcb's hands as
+// soon as xcb_put_image returns, so there is nothing to wait for then.
+//
+void framebufferSync(Framebuffer *fb) {
+  if (fb->mode != FRAMEBUFFER_SHM) {
+    return;
+  }
+  free(xcb_get_input_focus_reply(
+      fb->connection, xcb_get_input_focus(fb->connection), nullptr));
+}
+
+const char *framebufferModeName(const Framebuffer *fb) {
+  switch (fb->segment) {
+  case FRAMEBUFFER_SEGMENT_MEMFD:
+    return "shm-memfd";
+  case FRAMEBUFFER_SEGMENT_SYSV:
+    return "shm-sysv";
+  case FRAMEBUFFER_SEGMENT_NONE:
+    break;
+  }
+  return "put-image";
+}
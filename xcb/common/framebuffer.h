@@ -0,0 +1,77 @@
+#ifndef FRAMEBUFFER_H_20261017
+#define FRAMEBUFFER_H_20261017
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xcb/shm.h>
+#include <xcb/xcb.h>
+
+// How the pixels get to the server
+typedef enum {
+  FRAMEBUFFER_SHM,       // Shared memory, the server reads the pixels itself
+  FRAMEBUFFER_PUT_IMAGE, // Pixels are copied through the socket
+} FramebufferMode;
+
+// How the shared memory segment was created
+typedef enum {
+  FRAMEBUFFER_SEGMENT_NONE,
+  FRAMEBUFFER_SEGMENT_MEMFD, // memfd passed with ShmAttachFd (MIT-SHM 1.2)
+  FRAMEBUFFER_SEGMENT_SYSV,  // shmget id passed with ShmAttach
+} FramebufferSegment;
+
+//
+// Client side pixels for a window or pixmap.
+//
+// Pixels are 32 bits each in the host's byte order, laid out as the visual's
+// masks say. For the usual 24 and 32 bit TrueColor visuals that is
+// 0xAARRGGBB, with the alpha byte ignored at depth 24.
+//
+// After framebufferResize the memory can be bigger than width by height.
+// Rows are always stride bytes apart, and the memory holds size / stride of
+// them.
+//
+typedef struct {
+  xcb_connection_t *connection;
+  xcb_drawable_t drawable;
+  xcb_gcontext_t gc;
+  uint8_t depth;
+
+  uint16_t width;
+  uint16_t height;
+  uint32_t stride; // Bytes per row
+  uint32_t *pixels;
+  size_t size; // Bytes in pixels
+
+  // Times framebufferResize had to allocate new memory
+  uint32_t reallocations;
+
+  FramebufferMode mode;
+  FramebufferSegment segment;
+  xcb_shm_seg_t shmSeg;
+  int shmId;          // SysV only
+  bool sharedPixmaps; // Server can make pixmaps out of the segment
+
+  // Largest PutImage request in bytes, for the copying path
+  uint32_t maxRequestBytes;
+
+  // Copying path only, narrower than full width rectangles are packed here
+  uint8_t *scratch;
+  uint32_t scratchSize;
+} Framebuffer;
+
+int framebufferCreate(Framebuffer *fb, xcb_connection_t *c,
+                      xcb_drawable_t drawable, uint8_t depth, uint16_t width,
+                      uint16_t height, FramebufferMode preferred);
+void framebufferDestroy(Framebuffer *fb);
+int framebufferResize(Framebuffer *fb, uint16_t width, uint16_t height);
+
+void framebufferPresent(Framebuffer *fb, int16_t x, int16_t y, uint16_t width,
+                        uint16_t height);
+bool framebufferPresentNotify(Framebuffer *fb, int16_t x, int16_t y,
+                              uint16_t width, uint16_t height);
+void framebufferSync(Framebuffer *fb);
+xcb_pixmap_t framebufferCreatePixmap(Framebuffer *fb);
+
+const char *framebufferModeName(const Framebuffer *fb);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "frames.h"
+#include "trace.h"
+#include <stdlib.h>
+
+// The queued frame has been shown, or skipped in favor of a later one
+static void onComplete(xcb_generic_event_t *event, void *data) {
+  FrameScheduler *s = data;
+  const xcb_present_complete_notify_event_t *e =
+      (xcb_present_complete_notify_event_t *)event;
+
+  if (e->event != s->eventId || e->kind != XCB_PRESENT_COMPLETE_KIND_PIXMAP) {
+    return;
+  }
+
+  s->stats.completed++;
+  if (e->serial == s->serial) {
+    s->pending = false;
+  }
+
+  switch (e->mode) {
+  case XCB_PRESENT_COMPLETE_MODE_FLIP:
+    s->stats.flips++;
+    break;
+  case XCB_PRESENT_COMPLETE_MODE_COPY:
+  case XCB_PRESENT_COMPLETE_MODE_SUBOPTIMAL_COPY:
+    s->stats.copies++;
+    break;
+  case XCB_PRESENT_COMPLETE_MODE_SKIP:
+    // Never reached the screen, so says nothing about timing
+    s->stats.skipped++;
+    return;
+  }
+
+  // A target of 0 means as soon as possible, which cannot be late
+  if (s->targetMsc && e->msc > s->targetMsc) {
+    s->stats.missed += e->msc - s->targetMsc;
+  }
+
+  if (s->haveMsc && e->ust > s->lastUst) {
+    latencyHistogramAdd(&s->stats.interval, (e->ust - s->lastUst) * 1000);
+  }
+
+  s->lastMsc = e->msc;
+  s->lastUst = e->ust;
+  s->haveMsc = true;
+}
+
+// The server will not read a presented pixmap again
+static void onIdle(xcb_generic_event_t *event, void *data) {
+  FrameScheduler *s = data;
+  const xcb_present_idle_notify_event_t *e =
+      (xcb_present_idle_notify_event_t *)event;
+
+  if (e->event != s->eventId) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+    FrameSlot *slot = &s->buffers[i];
+    if (slot->pixmap == e->pixmap && slot->serial == e->serial) {
+      slot->busy = false;
+    }
+  }
+}
+
+//
+// Set up Present for a window and create the pool of back buffers.
+//
+// Each buffer is a shared memory framebuffer with a pixmap made out of the
+// same memory where the server allows it, so drawing a frame draws straight
+// into the pixmap that is presented. Otherwise each buffer gets an ordinary
+// pixmap that the framebuffer is uploaded to before presenting.
+//
+// The Present events are registered with the dispatcher, so they are
+// handled by the same event loop as everything else. Without a dispatcher
+// the caller hands them to frameSchedulerHandleEvent itself.
+//
+// Returns 0 on success, -1 if the server has no Present extension, -2 if
+// the buffers could not be created.
+//
+int frameSchedulerInit(              //
+    FrameScheduler *s,               ///> scheduler to set up
+    xcb_connection_t *c,             ///> server connection
+    xcb_window_t window,             ///> window frames are presented to
+    uint8_t depth,                   ///> depth of the window
+    uint16_t width,                  ///> size of the window
+    uint16_t height,                 ///>
+    EventDispatcher *d               ///> where to register, or nullptr
+) {
+  *s = (FrameScheduler){
+      .connection = c,
+      .window = window,
+      .interval = 1,
+  };
+
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(c, &xcb_present_id);
+  if (!ext || !ext->present) {
+    return -1;
+  }
+
+  s->presentOpcode = ext->major_opcode;
+
+  xcb_present_query_version_reply_t *version = xcb_present_query_version_reply(
+      c, xcb_present_query_version(c, 1, 2), nullptr);
+  if (!version) {
+    return -1;
+  }
+  free(version);
+
+  for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+    FrameSlot *slot = &s->buffers[i];
+
+    if (framebufferCreate(&slot->fb, c, window, depth, width, height,
+                          FRAMEBUFFER_SHM)) {
+      frameSchedulerDestroy(s);
+      return -2;
+    }
+
+    slot->pixmap = framebufferCreatePixmap(&slot->fb);
+    slot->shared = slot->pixmap != 0;
+
+    if (!slot->shared) {
+      slot->pixmap = xcb_generate_id(c);
+      xcb_create_pixmap(c, depth, slot->pixmap, window, width, height);
+
+      // Same depth and screen as the window, so the framebuffer's GC works
+      // for the pixmap too
+      slot->fb.drawable = slot->pixmap;
+    }
+  }
+
+  s->eventId = xcb_generate_id(c);
+  xcb_present_select_input(c, s->eventId, window,
+                           XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY |
+                               XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY);
+
+  if (d) {
+    dispatcherSetGenericHandler(d, ext->major_opcode,
+                                XCB_PRESENT_COMPLETE_NOTIFY, onComplete, s);
+    dispatcherSetGenericHandler(d, ext->major_opcode,
+                                XCB_PRESENT_IDLE_NOTIFY, onIdle, s);
+  }
+  return 0;
+}
+
+void frameSchedulerDestroy(FrameScheduler *s) {
+  if (s->eventId) {
+    xcb_present_select_input(s->connection, s->eventId, s->window,
+                             XCB_PRESENT_EVENT_MASK_NO_EVENT);
+  }
+
+  for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+    FrameSlot *slot = &s->buffers[i];
+    if (slot->pixmap) {
+      xcb_free_pixmap(s->connection, slot->pixmap);
+      slot->pixmap = 0;
+    }
+    framebufferDestroy(&slot->fb);
+  }
+}
+
+//
+// Handle an event if it is one of Present's, for event loops that switch on
+// the event type rather than going through a dispatcher.
+//
+// Returns true if it was a Present event, whichever window it was for.
+//
+bool frameSchedulerHandleEvent(FrameScheduler *s,
+                               xcb_generic_event_t *event) {
+  const xcb_ge_generic_event_t *ge = (xcb_ge_generic_event_t *)event;
+  if ((event->response_type & 0x7F) != XCB_GE_GENERIC ||
+      ge->extension != s->presentOpcode) {
+    return false;
+  }
+
+  switch (ge->event_type) {
+  case XCB_PRESENT_COMPLETE_NOTIFY:
+    onComplete(event, s);
+    break;
+  case XCB_PRESENT_IDLE_NOTIFY:
+    onIdle(event, s);
+    break;
+  }
+  return true;
+}
+
+//
+// A buffer to draw the next frame into, or nullptr if it is not time yet.
+//
+// It is time once the previous frame has been shown. Call this whenever the
+// event loop has handled a batch of events. Whatever was in the buffer
+// before is still there, it is not cleared.
+//
+FrameSlot *frameAcquire(FrameScheduler *s) {
+  if (s->pending) {
+    return nullptr;
+  }
+
+  for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+    if (!s->buffers[i].busy) {
+      return &s->buffers[i];
+    }
+  }
+
+  s->stats.starved++;
+  return nullptr;
+}
+
+//
+// Queue a buffer filled by the caller to be shown on the refresh after the
+// last frame, or interval refreshes after it.
+//
+void framePresent(FrameScheduler *s, FrameSlot *slot) {
+  TRACE_SCOPE("present");
+
+  if (!slot->shared) {
+    framebufferPresent(&slot->fb, 0, 0, slot->fb.width, slot->fb.height);
+  }
+
+  s->serial++;
+  s->targetMsc = s->haveMsc ? s->lastMsc + s->interval : 0;
+
+  xcb_present_pixmap(s->connection, s->window, slot->pixmap, s->serial,
+                     XCB_NONE,           // valid region, all of it
+                     XCB_NONE,           // update region, all of it
+                     0, 0,               // offset into the window
+                     XCB_NONE,           // crtc, let the server pick
+                     XCB_NONE,           // wait fence
+                     XCB_NONE,           // idle fence
+                     XCB_PRESENT_OPTION_NONE, s->targetMsc,
+                     0, 0,               // divisor and remainder
+                     0, nullptr);        // no other windows to notify
+
+  slot->busy = true;
+  slot->serial = s->serial;
+  s->pending = true;
+  s->stats.presented++;
+}
+
+void printFrameStats(FILE *out, const FrameScheduler *s) {
+  const FrameStats *f = &s->stats;
+
+  fprintf(out,
+          "Frames: %llu presented, %llu completed (%llu flipped, %llu "
+          "copied, %llu skipped)\n",
+          (unsigned long long)f->presented, (unsigned long long)f->completed,
+          (unsigned long long)f->flips, (unsigned long long)f->copies,
+          (unsigned long long)f->skipped);
+  fprintf(out, "  %llu refreshes missed, no idle buffer %llu times\n",
+          (unsigned long long)f->missed, (unsigned long long)f->starved);
+
+  if (f->interval.total) {
+    fprintf(out,
+            "  frame interval (ms): p50 %.2f, p99 %.2f, min %.2f, max %.2f\n",
+            latencyHistogramPercentile(&f->interval, 50.0) / 1e6,
+            latencyHistogramPercentile(&f->interval, 99.0) / 1e6,
+            f->interval.min / 1e6, f->interval.max / 1e6);
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef FRAMES_H_20261017
+#define FRAMES_H_20261017
+
+#include "dispatch.h"
+#include "framebuffer.h"
+#include "latency.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/present.h>
+#include <xcb/xcb.h>
+
+// Back buffers. Three lets one be on screen, one be queued and one be drawn.
+#define FRAME_POOL_SIZE 3
+
+// A back buffer and the pixmap that is presented from it
+typedef struct {
+  Framebuffer fb;
+  xcb_pixmap_t pixmap;
+
+  // The pixmap shares the framebuffer's memory. Otherwise the pixels are
+  // uploaded to it before each present.
+  bool shared;
+
+  // Handed to the server and not yet reported idle
+  bool busy;
+  uint32_t serial;
+} FrameSlot;
+
+typedef struct {
+  uint64_t presented; // PresentPixmap requests sent
+  uint64_t completed; // PresentCompleteNotify received
+  uint64_t flips;     // Completed by swapping the buffer in
+  uint64_t copies;    // Completed by copying the buffer
+  uint64_t skipped;   // Replaced by a later frame before being shown
+  uint64_t missed;    // Refreshes that went by after a frame's target
+  uint64_t starved;   // Times every buffer was still busy
+
+  // Time between frames reaching the screen, from the server's UST
+  LatencyHistogram interval;
+} FrameStats;
+
+//
+// Paces drawing to the display's refresh using the Present extension.
+//
+// Each frame is drawn into an idle buffer from the pool and presented with a
+// target MSC, the refresh count it should appear on. Only one frame is
+// queued at a time. When the server says it has been shown, with
+// PresentCompleteNotify, the next one can be drawn, aimed at the refresh
+// after. A buffer is drawn into again only after PresentIdleNotify says the
+// server is finished with it.
+//
+typedef struct {
+  xcb_connection_t *connection;
+  xcb_window_t window;
+  xcb_present_event_t eventId;
+  uint8_t presentOpcode; // Present's major opcode, which its events carry
+
+  FrameSlot buffers[FRAME_POOL_SIZE];
+
+  // Refreshes per frame, 1 for every refresh, 2 for every other one...
+  uint64_t interval;
+
+  uint32_t serial;      // Serial of the last frame presented
+  bool pending;         // A frame is queued and not yet complete
+  uint64_t targetMsc;   // The refresh the queued frame is aimed at
+  uint64_t lastMsc;     // The refresh the last frame appeared on
+  uint64_t lastUst;     // and when, in microseconds
+  bool haveMsc;
+
+  FrameStats stats;
+} FrameScheduler;
+
+int frameSchedulerInit(FrameScheduler *s, xcb_connection_t *c,
+                       xcb_window_t window, uint8_t depth, uint16_t width,
+                       uint16_t height, EventDispatcher *d);
+void frameSchedulerDestroy(FrameScheduler *s);
+bool frameSchedulerHandleEvent(FrameScheduler *s,
+                               xcb_generic_event_t *event);
+
+FrameSlot *frameAcquire(FrameScheduler *s);
+void framePresent(FrameScheduler *s, FrameSlot *slot);
+
+void printFrameStats(FILE *out, const FrameScheduler *s);
+
+#endif
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#
+# Generate protocol_tables.c from the xcb-proto XML descriptions.
+#
+# Every request, error and event name for the core protocol and for every
+# extension is written out as plain C arrays indexed by opcode or number, so
+# protocol.c can name anything with a couple of array lookups.
+#
+# Usage: gen_protocol.py <xcb-proto xml directory> <output .c file>
+#
+# protocol_core.c, which the build uses when xcb-proto is not installed, is
+# this script's output for a directory holding only xproto.xml.
+#
+
+import os
+import sys
+import xml.etree.ElementTree as ET
+
+
+def numbered(root, tag, copy_tag):
+    """Return {number: name} for every tag and copy_tag element."""
+    names = {}
+    for element in list(root.iter(tag)) + list(root.iter(copy_tag)):
+        number = int(element.get("number"))
+        # GLX has a catch all error numbered -1, it has no code of its own
+        if number >= 0:
+            names[number] = element.get("name")
+    return names
+
+
+def load(path):
+    root = ET.parse(path).getroot()
+    header = root.get("header")
+
+    ext = {
+        "header": header,
+        "xname": root.get("extension-xname"),
+        "name": root.get("extension-name") or "Core",
+        "requests": {},
+        "errors": numbered(root, "error", "errorcopy"),
+        "events": {},
+        "generic": {},
+    }
+
+    for request in root.iter("request"):
+        ext["requests"][int(request.get("opcode"))] = request.get("name")
+
+    for event in list(root.iter("event")) + list(root.iter("eventcopy")):
+        number = int(event.get("number"))
+        if event.get("xge") == "true":
+            ext["generic"][number] = event.get("name")
+        else:
+            ext["events"][number] = event.get("name")
+
+    # eventcopy elements refer to an event and share its xge setting
+    for copy in root.iter("eventcopy"):
+        ref = copy.get("ref")
+        for event in root.iter("event"):
+            if event.get("name") == ref and event.get("xge") == "true":
+                number = int(copy.get("number"))
+                ext["events"].pop(number, None)
+                ext["generic"][number] = copy.get("name")
+
+    # XKB sends all of its events with one event code and tells them apart by
+    # a sub type, so only the one code exists on the wire
+    if header == "xkb":
+        ext["events"] = {0: "XkbEvent"}
+
+    return ext
+
+
+def c_array(out, name, entries):
+    """Write a sparse designated initializer array, returns its length."""
+    length = max(entries) + 1 if entries else 0
+    if length == 0:
+        return 0
+    out.write("static const char *const %s[%d] = {\n" % (name, length))
+    for number in sorted(entries):
+        out.write('    [%d] = "%s",\n' % (number, entries[number]))
+    out.write("};\n\n")
+    return length
+
+
+def write_extension(out, ext, prefix):
+    counts = {}
+    for kind in ("requests", "errors", "events", "generic"):
+        counts[kind] = c_array(out, "%s_%s" % (prefix, kind), ext[kind])
+    return counts
+
+
+def initializer(ext, prefix, counts, indent="    "):
+    fields = ['.name = "%s"' % ext["name"]]
+    if ext["xname"]:
+        fields.append('.xname = "%s"' % ext["xname"])
+    for kind, field, count in (
+        ("requests", "requests", "nRequests"),
+        ("errors", "errors", "nErrors"),
+        ("events", "events", "nEvents"),
+        ("generic", "genericEvents", "nGenericEvents"),
+    ):
+        if counts[kind]:
+            fields.append(".%s = %s_%s" % (field, prefix, kind))
+            fields.append(".%s = %d" % (count, counts[kind]))
+    inner = "\n" + indent + "    "
+    return "{" + inner + ("," + inner).join(fields) + ",\n" + indent + "}"
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("Usage: gen_protocol.py <xcb-proto xml directory> <output>")
+
+    directory, output = sys.argv[1], sys.argv[2]
+
+    core = None
+    extensions = []
+    for filename in sorted(os.listdir(directory)):
+        if not filename.endswith(".xml"):
+            continue
+        ext = load(os.path.join(directory, filename))
+        if ext["header"] == "xproto":
+            core = ext
+        elif ext["xname"]:
+            extensions.append(ext)
+
+    if core is None:
+        sys.exit("xproto.xml not found in " + directory)
+
+    # The core GenericEvent is a real event code, the one every XGE event
+    # arrives with
+    core["events"].update(core["generic"])
+    core["generic"] = {}
+
+    with open(output, "w") as out:
+        out.write("// Generated by gen_protocol.py from the xcb-proto XML "
+                  "files. Do not edit.\n\n")
+        out.write('#include "protocol.h"\n\n')
+
+        counts = write_extension(out, core, "core")
+        out.write("const ProtocolExtension protocolCore = %s;\n\n"
+                  % initializer(core, "core", counts, ""))
+
+        entries = []
+        for ext in extensions:
+            prefix = ext["header"]
+            counts = write_extension(out, ext, prefix)
+            entries.append(initializer(ext, prefix, counts))
+
+        if entries:
+            out.write("const ProtocolExtension protocolExtensions[] = {\n    ")
+            out.write(",\n    ".join(entries))
+            out.write(",\n};\n\n")
+        else:
+            # Core only, C has no empty arrays
+            out.write("const ProtocolExtension protocolExtensions[1] = {};\n\n")
+        out.write("const uint32_t protocolExtensionCount = %d;\n"
+                  % len(extensions))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,438 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "glyphs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Not on a shelf, for glyphs with nothing to draw such as spaces
+#define NO_SHELF UINT16_MAX
+
+static inline uint32_t bucketOf(uint32_t codepoint) {
+  return codepoint * 2654435761u % GLYPH_HASH_BUCKETS;
+}
+
+//
+// Next code point of a UTF-8 string. Anything that is not valid UTF-8
+// comes out as U+FFFD one byte at a time.
+//
+static uint32_t nextCodepoint(const char **text) {
+  const uint8_t *s = (const uint8_t *)*text;
+
+  uint32_t length;
+  uint32_t cp;
+  if (s[0] < 0x80) {
+    *text += 1;
+    return s[0];
+  } else if ((s[0] & 0xE0) == 0xC0) {
+    length = 2;
+    cp = s[0] & 0x1F;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    length = 3;
+    cp = s[0] & 0x0F;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    length = 4;
+    cp = s[0] & 0x07;
+  } else {
+    *text += 1;
+    return 0xFFFD;
+  }
+
+  for (uint32_t i = 1; i < length; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *text += 1;
+      return 0xFFFD;
+    }
+    cp = cp << 6 | (s[i] & 0x3F);
+  }
+  *text += length;
+  return cp;
+}
+
+static void removeGlyph(GlyphAtlas *a, int32_t index) {
+  Glyph *g = &a->glyphs[index];
+
+  int32_t *link = &a->buckets[bucketOf(g->codepoint)];
+  while (*link != index) {
+    link = &a->glyphs[*link].next;
+  }
+  *link = g->next;
+
+  if (g->shelf != NO_SHELF) {
+    a->shelves[g->shelf].glyphs--;
+  }
+  g->next = a->freeGlyph;
+  a->freeGlyph = index;
+  a->stats.evicted++;
+}
+
+// Drop every glyph on a shelf and start filling it again from the left
+static void evictShelf(GlyphAtlas *a, uint32_t shelf) {
+  for (uint32_t b = 0; b < GLYPH_HASH_BUCKETS && a->shelves[shelf].glyphs;
+       b++) {
+    for (int32_t i = a->buckets[b]; i >= 0;) {
+      const int32_t next = a->glyphs[i].next;
+      if (a->glyphs[i].shelf == shelf) {
+        removeGlyph(a, i);
+      }
+      i = next;
+    }
+  }
+  a->shelves[shelf].used = 0;
+  a->stats.shelvesEvicted++;
+}
+
+//
+// The shelf that was drawn from longest ago out of those at least height
+// tall, or -1 if there are none.
+//
+static int32_t leastRecentShelf(const GlyphAtlas *a, uint32_t height) {
+  int32_t best = -1;
+  for (uint32_t i = 0; i < a->shelfCount; i++) {
+    const GlyphShelf *s = &a->shelves[i];
+    if (s->height >= height &&
+        (best < 0 || s->lastUsed < a->shelves[best].lastUsed)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+//
+// Find room for a width by height bitmap, evicting a shelf if the atlas is
+// full. Returns the shelf, or -1 if the bitmap is bigger than the atlas.
+//
+static int32_t allocate(GlyphAtlas *a, uint32_t width, uint32_t height,
+                        uint16_t *x, uint16_t *y) {
+  if (width > GLYPH_ATLAS_SIZE || height > GLYPH_ATLAS_SIZE) {
+    return -1;
+  }
+  const uint32_t rounded = (height + GLYPH_SHELF_ROUND - 1) /
+                           GLYPH_SHELF_ROUND * GLYPH_SHELF_ROUND;
+
+  int32_t shelf = -1;
+
+  // A shelf for this height with room left
+  for (uint32_t i = 0; i < a->shelfCount && shelf < 0; i++) {
+    const GlyphShelf *s = &a->shelves[i];
+    if (s->height == rounded && s->used + width <= GLYPH_ATLAS_SIZE) {
+      shelf = i;
+    }
+  }
+
+  // A new shelf
+  if (shelf < 0 && a->shelfTop + rounded <= GLYPH_ATLAS_SIZE &&
+      a->shelfCount < GLYPH_MAX_SHELVES) {
+    shelf = a->shelfCount++;
+    a->shelves[shelf] = (GlyphShelf){.y = a->shelfTop, .height = rounded};
+    a->shelfTop += rounded;
+  }
+
+  // Reuse the least recently drawn shelf that is tall enough. If none are,
+  // the shelves were all made for smaller glyphs, so start over.
+  if (shelf < 0) {
+    shelf = leastRecentShelf(a, rounded);
+    if (shelf < 0) {
+      for (uint32_t i = 0; i < a->shelfCount; i++) {
+        evictShelf(a, i);
+      }
+      a->shelfCount = 0;
+      a->shelfTop = 0;
+      return allocate(a, width, height, x, y);
+    }
+    evictShelf(a, shelf);
+  }
+
+  GlyphShelf *s = &a->shelves[shelf];
+  *x = s->used;
+  *y = s->y;
+  s->used += width;
+  s->lastUsed = a->clock;
+  return shelf;
+}
+
+// A free glyph entry, evicting a shelf's worth if there are none
+static int32_t newGlyph(GlyphAtlas *a) {
+  if (a->freeGlyph < 0) {
+    int32_t shelf = -1;
+    for (uint32_t i = 0; i < a->shelfCount; i++) {
+      const GlyphShelf *s = &a->shelves[i];
+      if (s->glyphs &&
+          (shelf < 0 || s->lastUsed < a->shelves[shelf].lastUsed)) {
+        shelf = i;
+      }
+    }
+    if (shelf >= 0) {
+      evictShelf(a, shelf);
+    } else {
+      // Every entry is a glyph with nothing to draw
+      glyphAtlasClear(a);
+    }
+  }
+
+  const int32_t index = a->freeGlyph;
+  a->freeGlyph = a->glyphs[index].next;
+  return index;
+}
+
+//
+// Render a glyph with FreeType and copy its coverage into the atlas.
+//
+static const Glyph *rasterize(GlyphAtlas *a, uint32_t codepoint) {
+  const FT_UInt index = FT_Get_Char_Index(a->face, codepoint);
+
+  // Index 0 is the font's missing glyph box
+  if (FT_Load_Glyph(a->face, index, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL)) {
+    return nullptr;
+  }
+  const FT_GlyphSlot slot = a->face->glyph;
+  const FT_Bitmap *bitmap = &slot->bitmap;
+  a->stats.rasterized++;
+
+  const int32_t i = newGlyph(a);
+  Glyph *g = &a->glyphs[i];
+  *g = (Glyph){
+      .codepoint = codepoint,
+      .left = slot->bitmap_left,
+      .top = slot->bitmap_top,
+      .advance = (slot->advance.x + 32) >> 6,
+      .shelf = NO_SHELF,
+  };
+
+  // Only 8 bit coverage is drawn. Anything else, such as the 1 bit
+  // bitmaps of some bitmap fonts, takes up space but shows nothing.
+  if (bitmap->pixel_mode == FT_PIXEL_MODE_GRAY && bitmap->width &&
+      bitmap->rows) {
+    const int32_t shelf =
+        allocate(a, bitmap->width, bitmap->rows, &g->x, &g->y);
+    if (shelf >= 0) {
+      g->shelf = shelf;
+      g->width = bitmap->width;
+      g->height = bitmap->rows;
+      a->shelves[shelf].glyphs++;
+
+      for (uint32_t row = 0; row < bitmap->rows; row++) {
+        memcpy(a->atlas + (size_t)(g->y + row) * GLYPH_ATLAS_SIZE + g->x,
+               bitmap->buffer + (ptrdiff_t)row * bitmap->pitch,
+               bitmap->width);
+      }
+    }
+  }
+
+  const uint32_t b = bucketOf(codepoint);
+  g->next = a->buckets[b];
+  a->buckets[b] = i;
+  return g;
+}
+
+//
+// Open a font and set up an empty atlas for it.
+//
+// Returns 0 on success, -1 if the font could not be loaded.
+//
+int glyphAtlasInit(                //
+    GlyphAtlas *a,                 ///> atlas to set up
+    const char *fontPath,          ///> any font file FreeType can read
+    uint32_t pixelSize,            ///> height of the font in pixels
+    const Blender *blender         ///> used to draw the glyphs
+) {
+  *a = (GlyphAtlas){.blender = blender, .pixelSize = pixelSize};
+
+  if (FT_Init_FreeType(&a->library)) {
+    return -1;
+  }
+  if (FT_New_Face(a->library, fontPath, 0, &a->face) ||
+      FT_Set_Pixel_Sizes(a->face, 0, pixelSize)) {
+    glyphAtlasDestroy(a);
+    return -1;
+  }
+
+  a->atlas = malloc(GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE);
+  if (!a->atlas) {
+    glyphAtlasDestroy(a);
+    return -1;
+  }
+
+  // Metrics are 26.6 fixed point
+  const FT_Size_Metrics *m = &a->face->size->metrics;
+  a->ascender = (m->ascender + 63) >> 6;
+  a->descender = (-m->descender + 63) >> 6;
+  a->lineHeight = (m->height + 63) >> 6;
+
+  glyphAtlasClear(a);
+  return 0;
+}
+
+void glyphAtlasDestroy(GlyphAtlas *a) {
+  if (a->face) {
+    FT_Done_Face(a->face);
+  }
+  if (a->library) {
+    FT_Done_FreeType(a->library);
+  }
+  free(a->atlas);
+  a->face = nullptr;
+  a->library = nullptr;
+  a->atlas = nullptr;
+}
+
+// Forget every glyph, keeping the font and the statistics
+void glyphAtlasClear(GlyphAtlas *a) {
+  a->shelfCount = 0;
+  a->shelfTop = 0;
+
+  for (uint32_t i = 0; i < GLYPH_HASH_BUCKETS; i++) {
+    a->buckets[i] = -1;
+  }
+  for (uint32_t i = 0; i < GLYPH_CACHE_MAX; i++) {
+    a->glyphs[i].next = i + 1 < GLYPH_CACHE_MAX ? (int32_t)i + 1 : -1;
+  }
+  a->freeGlyph = 0;
+}
+
+//
+// The glyph for a code point, rendered and added to the atlas the first
+// time it is asked for. The pointer is good until the next lookup. Returns
+// nullptr if FreeType could not render it.
+//
+const Glyph *glyphLookup(GlyphAtlas *a, uint32_t codepoint) {
+  a->stats.lookups++;
+
+  for (int32_t i = a->buckets[bucketOf(codepoint)]; i >= 0;
+       i = a->glyphs[i].next) {
+    const Glyph *g = &a->glyphs[i];
+    if (g->codepoint == codepoint) {
+      if (g->shelf != NO_SHELF) {
+        a->shelves[g->shelf].lastUsed = a->clock;
+      }
+      a->stats.hits++;
+      return g;
+    }
+  }
+
+  return rasterize(a, codepoint);
+}
+
+//
+// Draw a line of UTF-8 text in a premultiplied color with its baseline
+// starting at (x, baseline). Everything outside the target's rectangle is
+// left alone.
+//
+// Returns the pen position after the last glyph, where more text would go.
+//
+int32_t textDraw(                  //
+    GlyphAtlas *a,                 ///> font and cached glyphs
+    const TextTarget *target,      ///> where to draw
+    int32_t x,                     ///> pen position
+    int32_t baseline,              ///>
+    const char *text,              ///> UTF-8, up to a nul
+    uint32_t color                 ///> premultiplied 0xAARRGGBB
+) {
+  a->clock++;
+
+  while (*text) {
+    const Glyph *g = glyphLookup(a, nextCodepoint(&text));
+    if (!g) {
+      continue;
+    }
+
+    const int32_t gx = x + g->left;
+    const int32_t gy = baseline - g->top;
+    x += g->advance;
+
+    const int32_t x1 = gx > target->x1 ? gx : target->x1;
+    const int32_t y1 = gy > target->y1 ? gy : target->y1;
+    const int32_t x2 =
+        gx + g->width < target->x2 ? gx + g->width : target->x2;
+    const int32_t y2 =
+        gy + g->height < target->y2 ? gy + g->height : target->y2;
+    if (x1 >= x2 || y1 >= y2) {
+      continue;
+    }
+
+    for (int32_t y = y1; y < y2; y++) {
+      uint32_t *dst = (uint32_t *)((uint8_t *)target->pixels +
+                                   (size_t)y * target->stride) +
+                      x1;
+      const uint8_t *mask = a->atlas +
+                            (size_t)(g->y + y - gy) * GLYPH_ATLAS_SIZE +
+                            g->x + (x1 - gx);
+      blendMask(a->blender, dst, mask, color, x2 - x1);
+    }
+  }
+  return x;
+}
+
+// How far textDraw would move the pen for a string
+int32_t textWidth(GlyphAtlas *a, const char *text) {
+  int32_t width = 0;
+  while (*text) {
+    const Glyph *g = glyphLookup(a, nextCodepoint(&text));
+    if (g) {
+      width += g->advance;
+    }
+  }
+  return width;
+}
+
+//
+// A font to use when none was asked for. The XCB_EXAMPLES_FONT environment
+// variable comes first, then a few places common fonts are installed.
+// Returns nullptr if none of them are there.
+//
+const char *glyphFindFont(void) {
+  const char *const env = getenv("XCB_EXAMPLES_FONT");
+  if (env && *env) {
+    return env;
+  }
+
+  static const char *const fonts[] = {
+      "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+      "/usr/share/fonts/TTF/DejaVuSans.ttf",
+      "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+      "/usr/share/fonts/dejavu-sans-fonts/DejaVuSans.ttf",
+      "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+      "/usr/share/fonts/liberation-sans/LiberationSans-Regular.ttf",
+      "/usr/share/fonts/truetype/noto/NotoSans-Regular.ttf",
+      "/usr/share/fonts/noto/NotoSans-Regular.ttf",
+  };
+  for (uint32_t i = 0; i < sizeof(fonts) / sizeof(fonts[0]); i++) {
+    if (access(fonts[i], R_OK) == 0) {
+      return fonts[i];
+    }
+  }
+  return nullptr;
+}
+
+void printGlyphStats(FILE *out, const GlyphAtlas *a) {
+  const GlyphStats *s = &a->stats;
+  fprintf(out,
+          "Glyphs: %llu looked up, %.1f%% from the atlas, %llu rasterized, "
+          "%llu evicted from %llu shelves\n",
+          (unsigned long long)s->lookups,
+          s->lookups ? 100.0 * s->hits / s->lookups : 0.0,
+          (unsigned long long)s->rasterized, (unsigned long long)s->evicted,
+          (unsigned long long)s->shelvesEvicted);
+}
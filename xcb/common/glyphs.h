@@ -0,0 +1,108 @@
+#ifndef GLYPHS_H_20261017
+#define GLYPHS_H_20261017
+
+#include "blend.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stdint.h>
+#include <stdio.h>
+
+// The atlas is one square 8 bit coverage image
+#define GLYPH_ATLAS_SIZE 512
+
+// Most glyphs cached at once, and buckets in the table that finds them
+#define GLYPH_CACHE_MAX 1024
+#define GLYPH_HASH_BUCKETS 2048
+
+// Shelf heights are rounded up to this, so a shelf freed by one size of
+// glyph fits others of about the same size
+#define GLYPH_SHELF_ROUND 8
+#define GLYPH_MAX_SHELVES (GLYPH_ATLAS_SIZE / GLYPH_SHELF_ROUND)
+
+// One rasterized glyph and where it sits in the atlas
+typedef struct {
+  uint32_t codepoint;
+  uint16_t x, y;          // Top left corner in the atlas
+  uint16_t width, height; // Size of the bitmap
+  int16_t left;           // Pen position to the bitmap's left edge
+  int16_t top;            // Baseline up to the bitmap's top edge
+  int16_t advance;        // Pen movement to the next glyph
+  uint16_t shelf;
+  int32_t next;           // Next glyph in the same bucket, or the free list
+} Glyph;
+
+// A row of the atlas that glyphs of about the same height are packed into
+// from left to right
+typedef struct {
+  uint16_t y, height;
+  uint16_t used;     // Width taken so far
+  uint32_t glyphs;   // Glyphs in it
+  uint64_t lastUsed; // The atlas clock when one of them was last drawn
+} GlyphShelf;
+
+typedef struct {
+  uint64_t lookups;    // Glyphs looked up, to draw or measure
+  uint64_t hits;       // of those, already in the atlas
+  uint64_t rasterized; // Glyphs FreeType rendered
+  uint64_t evicted;    // Glyphs dropped to make room
+  uint64_t shelvesEvicted;
+} GlyphStats;
+
+//
+// Text drawn with FreeType into 32 bit premultiplied framebuffers.
+//
+// Each glyph is rendered once as an 8 bit coverage mask and packed into the
+// atlas, so drawing a string that has been drawn before is only lookups and
+// blending. Glyphs are packed on shelves. When the atlas is full the shelf
+// that was used longest ago is emptied and reused, which keeps whatever is
+// on screen now while glyphs that are no longer drawn make room.
+//
+typedef struct {
+  FT_Library library;
+  FT_Face face;
+  const Blender *blender;
+
+  uint32_t pixelSize;
+  int32_t ascender;   // Baseline up to the top of the tallest glyphs
+  int32_t descender;  // Baseline down to the bottom, as a positive number
+  int32_t lineHeight; // Baseline to baseline
+
+  uint8_t *atlas;
+
+  GlyphShelf shelves[GLYPH_MAX_SHELVES];
+  uint32_t shelfCount;
+  uint32_t shelfTop; // Height taken by shelves so far
+
+  Glyph glyphs[GLYPH_CACHE_MAX];
+  int32_t buckets[GLYPH_HASH_BUCKETS];
+  int32_t freeGlyph;
+
+  // Advances once per string drawn
+  uint64_t clock;
+
+  GlyphStats stats;
+} GlyphAtlas;
+
+// Where text is drawn, and the part of it that may be drawn to
+typedef struct {
+  uint32_t *pixels;
+  uint32_t stride; // in bytes
+  int32_t x1, y1;
+  int32_t x2, y2;
+} TextTarget;
+
+int glyphAtlasInit(GlyphAtlas *a, const char *fontPath, uint32_t pixelSize,
+                   const Blender *blender);
+void glyphAtlasDestroy(GlyphAtlas *a);
+void glyphAtlasClear(GlyphAtlas *a);
+
+const Glyph *glyphLookup(GlyphAtlas *a, uint32_t codepoint);
+
+int32_t textDraw(GlyphAtlas *a, const TextTarget *target, int32_t x,
+                 int32_t baseline, const char *text, uint32_t color);
+int32_t textWidth(GlyphAtlas *a, const char *text);
+
+const char *glyphFindFont(void);
+void printGlyphStats(FILE *out, const GlyphAtlas *a);
+
+#endif
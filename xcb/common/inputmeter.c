@@ -0,0 +1,259 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "inputmeter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SECOND 1000000000ull
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//
+// Create a meter that prints a line to out every second input arrives.
+// Interns the storm's client message atom, which is one round trip.
+//
+// Returns nullptr if out of memory.
+//
+InputMeter *inputMeterCreate(xcb_connection_t *c, FILE *out) {
+  InputMeter *m = calloc(1, sizeof(InputMeter));
+  if (!m) {
+    return nullptr;
+  }
+  m->out = out;
+
+  xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+      c,
+      xcb_intern_atom(c, 0, strlen(INPUT_METER_STORM_ATOM),
+                      INPUT_METER_STORM_ATOM),
+      nullptr);
+  if (reply) {
+    m->stormAtom = reply->atom;
+    free(reply);
+  }
+  return m;
+}
+
+// Create a meter only if the environment variable is set to something
+// other than 0. Otherwise returns nullptr and nothing is measured.
+InputMeter *inputMeterCreateFromEnv(xcb_connection_t *c, FILE *out,
+                                    const char *variable) {
+  const char *value = getenv(variable);
+  if (!value || !*value || strcmp(value, "0") == 0) {
+    return nullptr;
+  }
+  return inputMeterCreate(c, out);
+}
+
+// Print the second that just ended and start the next one
+static void endSecond(InputMeter *m, uint64_t t) {
+  if (m->secondEvents) {
+    fprintf(m->out,
+            "input second=%u events=%llu full_batches=%u largest_batch=%u "
+            "max_lag_ms=%u\n",
+            m->second, (unsigned long long)m->secondEvents, m->secondFull,
+            m->secondLargest, m->secondMaxLagMs);
+  }
+  if (m->secondEvents > m->peakPerSecond) {
+    m->peakPerSecond = m->secondEvents;
+  }
+
+  const uint64_t elapsed = (t - m->secondStartNs) / NS_PER_SECOND;
+  m->second += elapsed;
+  m->secondStartNs += elapsed * NS_PER_SECOND;
+  m->secondEvents = 0;
+  m->secondFull = 0;
+  m->secondLargest = 0;
+  m->secondMaxLagMs = 0;
+}
+
+// Time from the server stamping the event to t, in milliseconds
+static uint32_t lagMs(InputMeter *m, uint32_t serverMs, uint64_t t) {
+  // Work modulo 2^32 since the server's millisecond clock wraps
+  const uint32_t difference = (uint32_t)(t / 1000000) - serverMs;
+  if (!m->haveOffset || (int32_t)(difference - m->clockOffsetMs) < 0) {
+    m->clockOffsetMs = difference;
+    m->haveOffset = true;
+  }
+  return difference - m->clockOffsetMs;
+}
+
+//
+// Look at a batch just taken from xcb, before it is dispatched. Does
+// nothing if m is nullptr.
+//
+void inputMeterBatch(InputMeter *m, const EventBatch *batch) {
+  if (!m) {
+    return;
+  }
+  const uint64_t t = now();
+
+  uint32_t input = 0;
+  uint32_t maxLag = 0;
+  for (uint32_t i = 0; i < batch->count; i++) {
+    const xcb_generic_event_t *event = batch->events[i];
+
+    switch (event->response_type & 0x7F) {
+    case XCB_KEY_PRESS:
+      m->handled.keyPresses++;
+      break;
+    case XCB_KEY_RELEASE:
+      m->handled.keyReleases++;
+      break;
+    case XCB_MOTION_NOTIFY:
+      m->handled.motions++;
+      break;
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+      m->handled.buttons++;
+      break;
+
+    case XCB_CLIENT_MESSAGE: {
+      const xcb_client_message_event_t *message = (const void *)event;
+      if (m->stormAtom && message->type == m->stormAtom &&
+          message->format == 32) {
+        m->injected = (InputCounts){
+            .keyPresses = message->data.data32[0],
+            .keyReleases = message->data.data32[1],
+            .motions = message->data.data32[2],
+        };
+        m->haveInjected = true;
+      }
+      continue;
+    }
+
+    default:
+      continue;
+    }
+
+    // Key, button and motion events are laid out alike up to the time
+    const xcb_key_press_event_t *key = (const void *)event;
+    if (key->time) {
+      const uint32_t lag = lagMs(m, key->time, t);
+      maxLag = lag > maxLag ? lag : maxLag;
+    }
+    input++;
+  }
+
+  if (!input) {
+    return;
+  }
+
+  if (!m->startNs) {
+    m->startNs = t;
+    m->secondStartNs = t;
+  }
+  if (t - m->secondStartNs >= NS_PER_SECOND) {
+    endSecond(m, t);
+  }
+  m->lastNs = t;
+
+  uint32_t capacity = batch->capacity;
+  if (capacity == 0 || capacity > EVENT_BATCH_MAX) {
+    capacity = EVENT_BATCH_MAX;
+  }
+  const bool full = batch->count >= capacity;
+
+  m->batches++;
+  m->fullBatches += full;
+  m->secondEvents += input;
+  m->secondFull += full;
+  if (batch->count > m->secondLargest) {
+    m->secondLargest = batch->count;
+  }
+  if (maxLag > m->secondMaxLagMs) {
+    m->secondMaxLagMs = maxLag;
+  }
+  if (maxLag > m->maxLagMs) {
+    m->maxLagMs = maxLag;
+  }
+}
+
+static void printDropped(FILE *out, const char *kind, uint64_t injected,
+                         uint64_t handled) {
+  if (injected && !handled) {
+    fprintf(out, "  %s: %llu injected, none arrived, is it selected?\n", kind,
+            (unsigned long long)injected);
+    return;
+  }
+  fprintf(out, "  %s: %llu injected, %llu arrived, %lld dropped\n", kind,
+          (unsigned long long)injected, (unsigned long long)handled,
+          (long long)(injected - handled));
+}
+
+//
+// Print the totals, and what was dropped if the storm reported how much
+// it injected.
+//
+void printInputMeterStats(FILE *out, const InputMeter *m) {
+  const InputCounts *h = &m->handled;
+  const uint64_t total = h->keyPresses + h->keyReleases + h->motions +
+                         h->buttons;
+  if (!total) {
+    fprintf(out, "Input: none\n");
+    return;
+  }
+
+  const double seconds = (m->lastNs - m->startNs) / 1e9;
+  fprintf(out,
+          "Input: %llu key presses, %llu key releases, %llu motions, "
+          "%llu buttons in %.1f s\n",
+          (unsigned long long)h->keyPresses,
+          (unsigned long long)h->keyReleases, (unsigned long long)h->motions,
+          (unsigned long long)h->buttons, seconds);
+  fprintf(out,
+          "  %.0f events/s, peak %llu in one second, %llu of %llu batches "
+          "full, longest lag %u ms\n",
+          seconds > 0 ? total / seconds : 0.0,
+          (unsigned long long)m->peakPerSecond,
+          (unsigned long long)m->fullBatches,
+          (unsigned long long)m->batches, m->maxLagMs);
+
+  if (m->haveInjected) {
+    printDropped(out, "key presses", m->injected.keyPresses, h->keyPresses);
+    printDropped(out, "key releases", m->injected.keyReleases,
+                 h->keyReleases);
+    printDropped(out, "motions", m->injected.motions, h->motions);
+  }
+}
+
+// Print the last second and the totals if out is not nullptr, and free the
+// meter
+void inputMeterDestroy(InputMeter *m, FILE *out) {
+  if (!m) {
+    return;
+  }
+  if (m->startNs) {
+    endSecond(m, m->secondStartNs + NS_PER_SECOND);
+  }
+  if (out) {
+    printInputMeterStats(out, m);
+  }
+  free(m);
+}
@@ -0,0 +1,77 @@
+#ifndef INPUTMETER_H_20261017
+#define INPUTMETER_H_20261017
+
+#include "events.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+// Name of the client message bench_input_storm sends when it is done. The
+// data holds the key presses, key releases and motions it injected.
+#define INPUT_METER_STORM_ATOM "_XCB_INPUT_STORM"
+
+// Counts of input events by kind
+typedef struct {
+  uint64_t keyPresses;
+  uint64_t keyReleases;
+  uint64_t motions;
+  uint64_t buttons; // Presses and releases
+} InputCounts;
+
+//
+// Measures how well an event loop keeps up with a flood of input, such as
+// the one bench_input_storm makes with XTEST.
+//
+// Every batch the loop takes from xcb is looked at before it is
+// dispatched. Once a second a line with that second's throughput is
+// printed, along with how many batches were full, meaning more events were
+// already waiting, and the longest an input event had sat between the
+// server stamping it and the loop taking it from xcb. A loop that keeps up
+// shows a lag of a few milliseconds that stays put. One that has fallen
+// behind shows full batches and a lag that grows every second, which is
+// its queue growing.
+//
+// When bench_input_storm finishes it sends a client message saying how
+// much it injected, and the difference from what arrived is reported as
+// dropped.
+//
+typedef struct {
+  xcb_atom_t stormAtom;
+  FILE *out; // Where the per second lines go
+
+  uint64_t startNs;
+  uint64_t lastNs; // When the last input event was taken from xcb
+
+  InputCounts handled;
+  uint64_t batches;
+  uint64_t fullBatches; // Batches that reached capacity
+  uint64_t peakPerSecond;
+  uint32_t maxLagMs;
+
+  // The current second
+  uint64_t secondStartNs;
+  uint32_t second; // Seconds since the first input event
+  uint64_t secondEvents;
+  uint32_t secondFull;
+  uint32_t secondLargest;
+  uint32_t secondMaxLagMs;
+
+  // The server's clock is not ours. The smallest difference seen between
+  // the two is taken to be the offset, as in latency.c.
+  uint32_t clockOffsetMs;
+  bool haveOffset;
+
+  // From the storm's client message
+  InputCounts injected;
+  bool haveInjected;
+} InputMeter;
+
+InputMeter *inputMeterCreate(xcb_connection_t *c, FILE *out);
+InputMeter *inputMeterCreateFromEnv(xcb_connection_t *c, FILE *out,
+                                    const char *variable);
+void inputMeterDestroy(InputMeter *m, FILE *out);
+
+void inputMeterBatch(InputMeter *m, const EventBatch *batch);
+void printInputMeterStats(FILE *out, const InputMeter *m);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "journal.h"
+
+//
+// Remember an unchecked request. Does nothing if j is nullptr so callers
+// can make the journal optional.
+//
+void journalRecord(              //
+    RequestJournal *j,           ///> journal to record into
+    xcb_void_cookie_t cookie,    ///> cookie returned by the request
+    const char *what,            ///> description, usually a string literal
+    uint32_t resource            ///> id the request was about, or 0
+) {
+  if (!j) {
+    return;
+  }
+
+  j->entries[j->recorded & (JOURNAL_SIZE - 1)] = (JournalEntry){
+      .sequence = cookie.sequence,
+      .what = what,
+      .resource = resource,
+  };
+  j->recorded++;
+}
+
+//
+// Find the request with the given full sequence number.
+//
+// Sequence numbers only go up, so the search starts at the newest entry and
+// stops as soon as it passes the one wanted. Errors are rare, which makes
+// this fine even though it is a linear search.
+//
+// Returns nullptr if the request was never recorded or has been pushed out
+// of the ring.
+//
+const JournalEntry *journalFind(const RequestJournal *j, uint32_t sequence) {
+  if (!j) {
+    return nullptr;
+  }
+
+  const uint64_t n = j->recorded < JOURNAL_SIZE ? j->recorded : JOURNAL_SIZE;
+  for (uint64_t i = 1; i <= n; i++) {
+    const JournalEntry *e = &j->entries[(j->recorded - i) & (JOURNAL_SIZE - 1)];
+    if (e->sequence == sequence) {
+      return e;
+    }
+    // Compared as a signed difference so wrap around is handled
+    if ((int32_t)(e->sequence - sequence) < 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+//
+// Print an error from the event queue along with the request that caused
+// it, if the journal still has it.
+//
+void journalReportError(FILE *out, const RequestJournal *j,
+                        const xcb_generic_error_t *error,
+                        const char *errorName, const char *opcodeName) {
+  fprintf(out, "XCB %s %s error. Minor opcode %d\n", opcodeName, errorName,
+          error->minor_code);
+
+  const JournalEntry *e = journalFind(j, error->full_sequence);
+  if (e) {
+    fprintf(out, "  caused by %s (resource 0x%x, sequence %u)\n\n", e->what,
+            e->resource, e->sequence);
+  } else {
+    fprintf(out, "  sequence %u, request not in the journal\n\n",
+            error->full_sequence);
+  }
+}
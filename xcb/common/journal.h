@@ -0,0 +1,37 @@
+#ifndef JOURNAL_H_20261017
+#define JOURNAL_H_20261017
+
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+// Number of requests remembered. Must be a power of two.
+#define JOURNAL_SIZE 256
+
+typedef struct {
+  uint32_t sequence; // Full sequence number of the request
+  const char *what;  // Description, must outlive the journal
+  uint32_t resource; // The window, colormap, etc. the request was about
+} JournalEntry;
+
+//
+// Ring buffer of recently sent unchecked requests.
+//
+// Errors for unchecked requests arrive in the event queue carrying only the
+// sequence number of the request that failed. Recording each request's
+// sequence number as it is sent lets the error be traced back to it later
+// without making the request checked and waiting on it.
+//
+typedef struct {
+  JournalEntry entries[JOURNAL_SIZE];
+  uint64_t recorded; // Total ever recorded, the next slot is recorded % SIZE
+} RequestJournal;
+
+void journalRecord(RequestJournal *j, xcb_void_cookie_t cookie,
+                   const char *what, uint32_t resource);
+const JournalEntry *journalFind(const RequestJournal *j, uint32_t sequence);
+void journalReportError(FILE *out, const RequestJournal *j,
+                        const xcb_generic_error_t *error,
+                        const char *errorName, const char *opcodeName);
+
+#endif
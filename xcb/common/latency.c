@@ -0,0 +1,361 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "latency.h"
+#include "protocol.h"
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Where the server timestamp lives in each event type, 0 if it has none
+static const uint8_t timeOffset[128] = {
+    [XCB_KEY_PRESS] = offsetof(xcb_key_press_event_t, time),
+    [XCB_KEY_RELEASE] = offsetof(xcb_key_release_event_t, time),
+    [XCB_BUTTON_PRESS] = offsetof(xcb_button_press_event_t, time),
+    [XCB_BUTTON_RELEASE] = offsetof(xcb_button_release_event_t, time),
+    [XCB_MOTION_NOTIFY] = offsetof(xcb_motion_notify_event_t, time),
+    [XCB_ENTER_NOTIFY] = offsetof(xcb_enter_notify_event_t, time),
+    [XCB_LEAVE_NOTIFY] = offsetof(xcb_leave_notify_event_t, time),
+    [XCB_PROPERTY_NOTIFY] = offsetof(xcb_property_notify_event_t, time),
+    [XCB_SELECTION_CLEAR] = offsetof(xcb_selection_clear_event_t, time),
+    [XCB_SELECTION_REQUEST] = offsetof(xcb_selection_request_event_t, time),
+    [XCB_SELECTION_NOTIFY] = offsetof(xcb_selection_notify_event_t, time),
+};
+
+static const char *const stageNames[LATENCY_STAGES] = {
+    [LATENCY_SERVER_TO_RECEIPT] = "server->receipt",
+    [LATENCY_RECEIPT_TO_HANDLED] = "receipt->handled",
+    [LATENCY_SERVER_TO_HANDLED] = "server->handled",
+};
+
+// Set from the SIGUSR1 handler
+static volatile sig_atomic_t dumpRequested = 0;
+
+// Posted from the SIGUSR1 handler to wake a waker thread. sem_post is one
+// of the few things a signal handler may call.
+static sem_t dumpSignal;
+
+// The semaphore and the handler are set up with the first tracker and put
+// back with the last, under this lock
+static pthread_mutex_t trackersLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t trackers;
+static struct sigaction previousAction;
+
+static void onDumpSignal(int) {
+  dumpRequested = 1;
+  sem_post(&dumpSignal);
+}
+
+uint64_t latencyNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//
+// Waits for SIGUSR1 and sends the window an empty client message. The event
+// loop wakes up for it and calls latencyDumpIfSignalled, so the dump comes
+// out straight away even when nothing else is happening in the window.
+// xcb is safe to use from more than one thread.
+//
+// The thread is stopped with pthread_cancel, which can only act while it
+// waits in sem_wait, never while it holds xcb's lock.
+//
+static void *wakeOnSignal(void *data) {
+  LatencyTracker *t = data;
+
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+  for (;;) {
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+    while (sem_wait(&dumpSignal) && errno == EINTR) {
+    }
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+
+    // No handler looks at a client message with no type
+    xcb_client_message_event_t event = {
+        .response_type = XCB_CLIENT_MESSAGE,
+        .format = 32,
+        .window = t->window,
+        .type = XCB_ATOM_NONE,
+    };
+    xcb_send_event(t->connection, false, t->window, XCB_EVENT_MASK_NO_EVENT,
+                   (const char *)&event);
+    xcb_flush(t->connection);
+  }
+}
+
+//
+// Create an empty tracker. SIGUSR1 is set up to request a dump, which is
+// printed the next time latencyDumpIfSignalled is called. The window, which
+// must belong to this connection, is sent a client message so that the
+// event loop gets to that call without waiting for other events. With no
+// window the dump waits for the next event.
+//
+// Returns nullptr if out of memory.
+//
+LatencyTracker *latencyCreate(xcb_connection_t *c, xcb_window_t window) {
+  LatencyTracker *t = calloc(1, sizeof(LatencyTracker));
+  if (!t) {
+    return nullptr;
+  }
+  t->connection = c;
+  t->window = window;
+
+  pthread_mutex_lock(&trackersLock);
+  if (trackers++ == 0) {
+    sem_init(&dumpSignal, 0, 0);
+
+    struct sigaction sa = {};
+    sa.sa_handler = onDumpSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, &previousAction);
+  }
+  pthread_mutex_unlock(&trackersLock);
+
+  if (c && window) {
+    t->haveWaker = pthread_create(&t->waker, nullptr, wakeOnSignal, t) == 0;
+  }
+
+  return t;
+}
+
+// Create a tracker only if the environment variable is set to something
+// other than 0. Otherwise returns nullptr and nothing is recorded.
+LatencyTracker *latencyCreateFromEnv(xcb_connection_t *c, xcb_window_t window,
+                                     const char *variable) {
+  const char *value = getenv(variable);
+  if (!value || !*value || strcmp(value, "0") == 0) {
+    return nullptr;
+  }
+  return latencyCreate(c, window);
+}
+
+// Print the histograms if out is not nullptr and free the tracker
+void latencyDestroy(LatencyTracker *t, FILE *out) {
+  if (!t) {
+    return;
+  }
+  if (t->haveWaker) {
+    pthread_cancel(t->waker);
+    pthread_join(t->waker, nullptr);
+  }
+
+  // The handler goes before the semaphore it posts to
+  pthread_mutex_lock(&trackersLock);
+  if (--trackers == 0) {
+    sigaction(SIGUSR1, &previousAction, nullptr);
+    sem_destroy(&dumpSignal);
+  }
+  pthread_mutex_unlock(&trackersLock);
+  if (out) {
+    latencyDump(out, t);
+  }
+  for (uint32_t s = 0; s < LATENCY_STAGES; s++) {
+    for (uint32_t i = 0; i < 128; i++) {
+      free(t->histograms[s][i]);
+    }
+  }
+  free(t);
+}
+
+// Index of the highest set bit, v must not be 0
+static uint32_t highestBit(uint64_t v) {
+  uint32_t bit = 0;
+  for (uint32_t shift = 32; shift; shift >>= 1) {
+    if (v >> shift) {
+      v >>= shift;
+      bit += shift;
+    }
+  }
+  return bit;
+}
+
+//
+// Add a value to the histogram.
+//
+// Values below 2^LATENCY_SUB_BITS are kept exactly in magnitude 0. Above
+// that, magnitude m holds [2^(m + SUB_BITS - 1), 2^(m + SUB_BITS)) split into
+// LATENCY_SUB_BUCKETS equal buckets.
+//
+void latencyHistogramAdd(LatencyHistogram *h, uint64_t ns) {
+  uint32_t magnitude = 0;
+  uint32_t sub = (uint32_t)ns;
+
+  if (ns >= LATENCY_SUB_BUCKETS) {
+    const uint32_t top = highestBit(ns);
+    magnitude = top - LATENCY_SUB_BITS + 1;
+    if (magnitude >= LATENCY_MAGNITUDES) {
+      magnitude = LATENCY_MAGNITUDES - 1;
+      sub = LATENCY_SUB_BUCKETS - 1;
+    } else {
+      sub = (uint32_t)(ns >> (top - LATENCY_SUB_BITS)) &
+            (LATENCY_SUB_BUCKETS - 1);
+    }
+  }
+
+  h->counts[magnitude][sub]++;
+  if (h->total == 0 || ns < h->min) {
+    h->min = ns;
+  }
+  if (ns > h->max) {
+    h->max = ns;
+  }
+  h->total++;
+  h->sum += ns;
+}
+
+// Largest value that lands in the given bucket
+static uint64_t bucketHighest(uint32_t magnitude, uint32_t sub) {
+  if (magnitude == 0) {
+    return sub;
+  }
+  const uint64_t low = (uint64_t)(LATENCY_SUB_BUCKETS + sub) << (magnitude - 1);
+  return low + (1ull << (magnitude - 1)) - 1;
+}
+
+// The value below which p percent of the recorded values fall
+uint64_t latencyHistogramPercentile(const LatencyHistogram *h, double p) {
+  if (h->total == 0) {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t)((p / 100.0) * (double)h->total + 0.5);
+  if (target == 0) {
+    target = 1;
+  }
+
+  uint64_t seen = 0;
+  for (uint32_t m = 0; m < LATENCY_MAGNITUDES; m++) {
+    for (uint32_t s = 0; s < LATENCY_SUB_BUCKETS; s++) {
+      seen += h->counts[m][s];
+      if (seen >= target) {
+        const uint64_t v = bucketHighest(m, s);
+        return v < h->max ? v : h->max;
+      }
+    }
+  }
+  return h->max;
+}
+
+static void addTo(LatencyTracker *t, LatencyStage stage, uint8_t type,
+                  uint64_t ns) {
+  LatencyHistogram **h = &t->histograms[stage][type];
+  if (!*h) {
+    *h = calloc(1, sizeof(LatencyHistogram));
+    if (!*h) {
+      return;
+    }
+  }
+  latencyHistogramAdd(*h, ns);
+}
+
+//
+// Record one event after its handler has run.
+//
+// receivedNs is when the event was taken from xcb and handledNs when its
+// handler returned, both from latencyNow. Does nothing if t is nullptr.
+//
+void latencyRecord(LatencyTracker *t, const xcb_generic_event_t *event,
+                   uint64_t receivedNs, uint64_t handledNs) {
+  if (!t) {
+    return;
+  }
+
+  const uint8_t type = event->response_type & 0x7F;
+  const uint64_t handling = handledNs > receivedNs ? handledNs - receivedNs : 0;
+  addTo(t, LATENCY_RECEIPT_TO_HANDLED, type, handling);
+
+  if (!timeOffset[type]) {
+    return;
+  }
+
+  uint32_t serverMs;
+  memcpy(&serverMs, (const uint8_t *)event + timeOffset[type],
+         sizeof(serverMs));
+
+  // Server time is zero (CurrentTime) on some synthetic events
+  if (serverMs == 0) {
+    return;
+  }
+
+  // Work modulo 2^32 since the server's millisecond clock wraps
+  const uint32_t difference = (uint32_t)(receivedNs / 1000000) - serverMs;
+  if (!t->haveOffset || (int32_t)(difference - t->clockOffsetMs) < 0) {
+    t->clockOffsetMs = difference;
+    t->haveOffset = true;
+  }
+
+  const uint64_t queued =
+      (uint64_t)(uint32_t)(difference - t->clockOffsetMs) * 1000000;
+  addTo(t, LATENCY_SERVER_TO_RECEIPT, type, queued);
+  addTo(t, LATENCY_SERVER_TO_HANDLED, type, queued + handling);
+}
+
+static void dumpHistogram(FILE *out, const char *event, const char *stage,
+                          const LatencyHistogram *h) {
+  fprintf(out, "  %-18s %-17s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", event,
+          stage, (unsigned long long)h->total,
+          latencyHistogramPercentile(h, 50.0) / 1000.0,
+          latencyHistogramPercentile(h, 90.0) / 1000.0,
+          latencyHistogramPercentile(h, 99.0) / 1000.0,
+          latencyHistogramPercentile(h, 99.9) / 1000.0, h->max / 1000.0);
+}
+
+// Print the percentiles of every histogram that has something in it
+void latencyDump(FILE *out, const LatencyTracker *t) {
+  if (!t) {
+    return;
+  }
+
+  fprintf(out, "Event latency (us), server clock offset %u ms\n",
+          t->clockOffsetMs);
+  fprintf(out, "  %-18s %-17s %9s %9s %9s %9s %9s %9s\n", "event", "stage",
+          "count", "p50", "p90", "p99", "p99.9", "max");
+
+  for (uint32_t type = 0; type < 128; type++) {
+    // Names extension events too once protocolInit has been called
+    const char *const name = protocolEventName(type);
+
+    for (uint32_t s = 0; s < LATENCY_STAGES; s++) {
+      const LatencyHistogram *h = t->histograms[s][type];
+      if (h && h->total) {
+        dumpHistogram(out, name, stageNames[s], h);
+      }
+    }
+  }
+  fflush(out);
+}
+
+// Print the histograms if SIGUSR1 has been received since the last call
+void latencyDumpIfSignalled(FILE *out, const LatencyTracker *t) {
+  if (dumpRequested) {
+    dumpRequested = 0;
+    latencyDump(out, t);
+  }
+}
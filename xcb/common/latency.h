@@ -0,0 +1,75 @@
+#ifndef LATENCY_H_20261017
+#define LATENCY_H_20261017
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+// Each power of two is split into 2^LATENCY_SUB_BITS buckets, which keeps
+// every recorded value within about 3% of the truth
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+
+// Enough powers of two to cover a few days in nanoseconds
+#define LATENCY_MAGNITUDES 44
+
+// Log bucketed histogram in the style of HdrHistogram. Values are in
+// nanoseconds.
+typedef struct {
+  uint64_t counts[LATENCY_MAGNITUDES][LATENCY_SUB_BUCKETS];
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+} LatencyHistogram;
+
+// The stages an event goes through
+typedef enum {
+  LATENCY_SERVER_TO_RECEIPT,  // server timestamp -> taken from xcb
+  LATENCY_RECEIPT_TO_HANDLED, // taken from xcb -> handler returned
+  LATENCY_SERVER_TO_HANDLED,  // both of the above
+  LATENCY_STAGES,
+} LatencyStage;
+
+//
+// Histograms for every stage of every event type, indexed by response_type
+// with the send event bit cleared. They are allocated the first time a type
+// is seen.
+//
+// Only events that carry a server timestamp (input, property and selection
+// events) get the stages that start at the server.
+//
+typedef struct {
+  LatencyHistogram *histograms[LATENCY_STAGES][128];
+
+  // The X server's clock is not the client's. The smallest difference seen
+  // between a client receipt time and a server timestamp is taken to be the
+  // offset between the two.
+  uint32_t clockOffsetMs;
+  bool haveOffset;
+
+  // SIGUSR1 is turned into a client message to this window, so a loop
+  // blocked waiting for X events wakes up to print the dump
+  xcb_connection_t *connection;
+  xcb_window_t window;
+  pthread_t waker;
+  bool haveWaker;
+} LatencyTracker;
+
+LatencyTracker *latencyCreate(xcb_connection_t *c, xcb_window_t window);
+LatencyTracker *latencyCreateFromEnv(xcb_connection_t *c, xcb_window_t window,
+                                     const char *variable);
+void latencyDestroy(LatencyTracker *t, FILE *out);
+
+uint64_t latencyNow(void);
+void latencyRecord(LatencyTracker *t, const xcb_generic_event_t *event,
+                   uint64_t receivedNs, uint64_t handledNs);
+
+void latencyHistogramAdd(LatencyHistogram *h, uint64_t ns);
+uint64_t latencyHistogramPercentile(const LatencyHistogram *h, double p);
+
+void latencyDump(FILE *out, const LatencyTracker *t);
+void latencyDumpIfSignalled(FILE *out, const LatencyTracker *t);
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "pixelformat.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const char *const kernelNames[PIXEL_KERNEL_COUNT] = {
+    [PIXEL_KERNEL_AUTO] = "auto",     [PIXEL_KERNEL_GENERIC] = "generic",
+    [PIXEL_KERNEL_COPY] = "copy",     [PIXEL_KERNEL_SCALAR] = "scalar",
+    [PIXEL_KERNEL_SSE2] = "sse2",     [PIXEL_KERNEL_AVX2] = "avx2",
+    [PIXEL_KERNEL_NEON] = "neon",
+};
+
+//---------------------------------------------------------------------------
+// Kernels
+//
+// The source is read one byte at a time by the generic kernel, so it works
+// on any host. The others read whole pixels as uint32_t and are only used
+// on little endian hosts, see pixelConverterInit.
+
+static void convertGeneric(const PixelConverter *pc, uint32_t *dst,
+                           const uint8_t *src, size_t count) {
+  // Where red and blue are within each source pixel
+  const int r = pc->order == PIXEL_ORDER_RGBA ? 0 : 2;
+  const int b = 2 - r;
+
+  for (size_t i = 0; i < count; i++, src += 4) {
+    dst[i] = pc->lut[0][src[r]] | pc->lut[1][src[1]] | pc->lut[2][src[b]] |
+             pc->lut[3][src[3]];
+  }
+}
+
+static void convertCopy(const PixelConverter *, uint32_t *dst,
+                        const uint8_t *src, size_t count) {
+  memmove(dst, src, count * 4);
+}
+
+// Swap the bytes at bits 0-7 and 16-23, leaving green and alpha alone
+static inline uint32_t swapRedBlue(uint32_t p) {
+  return (p & 0xFF00FF00) | (p >> 16 & 0xFF) | (p & 0xFF) << 16;
+}
+
+static void convertScalar(const PixelConverter *, uint32_t *dst,
+                          const uint8_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint32_t p;
+    memcpy(&p, src + i * 4, 4);
+    dst[i] = swapRedBlue(p);
+  }
+}
+
+#if defined(__SSE2__)
+static void convertSse2(const PixelConverter *pc, uint32_t *dst,
+                        const uint8_t *src, size_t count) {
+  const __m128i keep = _mm_set1_epi32((int)0xFF00FF00);
+  const __m128i low = _mm_set1_epi32(0xFF);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i p = _mm_loadu_si128((const __m128i *)(src + i * 4));
+    const __m128i r = _mm_or_si128(
+        _mm_and_si128(p, keep),
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), low),
+                     _mm_slli_epi32(_mm_and_si128(p, low), 16)));
+    _mm_storeu_si128((__m128i *)(dst + i), r);
+  }
+  convertScalar(pc, dst + i, src + i * 4, count - i);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+// Built for AVX2 even when the rest of the file is not. Only called after
+// checking the CPU has it.
+[[gnu::target("avx2")]]
+static void convertAvx2(const PixelConverter *pc, uint32_t *dst,
+                        const uint8_t *src, size_t count) {
+  // Within each pixel, byte 0 <-> byte 2
+  const __m256i shuffle = _mm256_setr_epi8(
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, //
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i p = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(p, shuffle));
+  }
+  convertScalar(pc, dst + i, src + i * 4, count - i);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void convertNeon(const PixelConverter *pc, uint32_t *dst,
+                        const uint8_t *src, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    // Loads each channel into its own register, so swapping is free
+    uint8x16x4_t p = vld4q_u8(src + i * 4);
+    const uint8x16_t t = p.val[0];
+    p.val[0] = p.val[2];
+    p.val[2] = t;
+    vst4q_u8((uint8_t *)(dst + i), p);
+  }
+  convertScalar(pc, dst + i, src + i * 4, count - i);
+}
+#endif
+
+// Whether the CPU can run a kernel, shared with blend.c
+bool pixelKernelAvailable(PixelKernel kernel) {
+  switch (kernel) {
+  case PIXEL_KERNEL_AUTO:
+  case PIXEL_KERNEL_GENERIC:
+  case PIXEL_KERNEL_COPY:
+  case PIXEL_KERNEL_SCALAR:
+    return true;
+  case PIXEL_KERNEL_SSE2:
+#if defined(__SSE2__)
+    return true;
+#else
+    return false;
+#endif
+  case PIXEL_KERNEL_AVX2:
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+  case PIXEL_KERNEL_NEON:
+#if defined(__ARM_NEON)
+    return true;
+#else
+    return false;
+#endif
+  case PIXEL_KERNEL_COUNT:
+    break;
+  }
+  return false;
+}
+
+static PixelKernelFn kernelFn(PixelKernel kernel) {
+  switch (kernel) {
+  case PIXEL_KERNEL_COPY:
+    return convertCopy;
+  case PIXEL_KERNEL_SCALAR:
+    return convertScalar;
+#if defined(__SSE2__)
+  case PIXEL_KERNEL_SSE2:
+    return convertSse2;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  case PIXEL_KERNEL_AVX2:
+    return convertAvx2;
+#endif
+#if defined(__ARM_NEON)
+  case PIXEL_KERNEL_NEON:
+    return convertNeon;
+#endif
+  default:
+    break;
+  }
+  return convertGeneric;
+}
+
+//---------------------------------------------------------------------------
+// Setup
+
+// Fill in the lookup table that scales an 8 bit channel to a mask of any
+// width
+static void describeMask(PixelConverter *pc, int channel, uint32_t mask) {
+  pc->masks[channel] = mask;
+
+  const int shift = mask ? __builtin_ctz(mask) : 0;
+  const uint32_t max = mask >> shift;
+  for (uint32_t v = 0; v < 256; v++) {
+    pc->lut[channel][v] = ((v * max + 127) / 255 << shift) & mask;
+  }
+}
+
+//
+// Set up a converter for a visual.
+//
+// With PIXEL_KERNEL_AUTO the fastest kernel that gives the right answer for
+// the visual is picked. Asking for a particular kernel is meant for
+// benchmarks and tests, and fails if the CPU does not have it or if it
+// would give the wrong answer for this visual.
+//
+// Returns 0 on success, -1 if the visual is not TrueColor or the kernel
+// cannot be used.
+//
+int pixelConverterInit(                 //
+    PixelConverter *pc,                 ///> converter to set up
+    const xcb_visualtype_t *visual,     ///> from findDepthAndVisual
+    uint8_t depth,                      ///> depth of the drawable
+    PixelOrder order,                   ///> layout of the source pixels
+    PixelKernel kernel                  ///> PIXEL_KERNEL_AUTO normally
+) {
+  *pc = (PixelConverter){.order = order};
+
+  if (visual->_class != XCB_VISUAL_CLASS_TRUE_COLOR &&
+      visual->_class != XCB_VISUAL_CLASS_DIRECT_COLOR) {
+    return -1;
+  }
+
+  const uint32_t rgb = visual->red_mask | visual->green_mask | visual->blue_mask;
+
+  // At depth 32 whatever bits are not color are alpha. Below that the
+  // server ignores the extra bits.
+  const uint32_t alpha = depth == 32 ? ~rgb : 0;
+
+  describeMask(pc, 0, visual->red_mask);
+  describeMask(pc, 1, visual->green_mask);
+  describeMask(pc, 2, visual->blue_mask);
+  describeMask(pc, 3, alpha);
+
+  // Pixels are read as uint32_t by everything but the generic kernel
+  const uint16_t one = 1;
+  const bool littleEndian = *(const uint8_t *)&one;
+
+  // Alpha has to be in the top byte, or absent, for the fast paths
+  const bool alphaOnTop = depth != 32 || alpha == 0xFF000000;
+
+  // Little endian 0x00RRGGBB is B G R A in memory
+  const bool xrgb = visual->red_mask == 0xFF0000 &&
+                    visual->green_mask == 0xFF00 && visual->blue_mask == 0xFF;
+  const bool xbgr = visual->red_mask == 0xFF &&
+                    visual->green_mask == 0xFF00 &&
+                    visual->blue_mask == 0xFF0000;
+
+  PixelKernel same = PIXEL_KERNEL_GENERIC;
+  PixelKernel best = PIXEL_KERNEL_GENERIC;
+  if (littleEndian && alphaOnTop && (xrgb || xbgr)) {
+    const bool swap = xrgb == (order == PIXEL_ORDER_RGBA);
+    same = swap ? PIXEL_KERNEL_SCALAR : PIXEL_KERNEL_COPY;
+
+    best = same;
+    if (swap) {
+      const PixelKernel fastest[] = {PIXEL_KERNEL_AVX2, PIXEL_KERNEL_NEON,
+                                     PIXEL_KERNEL_SSE2};
+      for (uint32_t i = 0; i < sizeof(fastest) / sizeof(fastest[0]); i++) {
+        if (pixelKernelAvailable(fastest[i])) {
+          best = fastest[i];
+          break;
+        }
+      }
+    }
+  }
+
+  if (kernel == PIXEL_KERNEL_AUTO) {
+    kernel = best;
+  } else if (kernel != PIXEL_KERNEL_GENERIC) {
+    // The swapping kernels only work where swapping is the right answer,
+    // and copying only where it is not needed
+    const bool swapKernel =
+        kernel != PIXEL_KERNEL_COPY && same == PIXEL_KERNEL_SCALAR;
+    const bool copyKernel =
+        kernel == PIXEL_KERNEL_COPY && same == PIXEL_KERNEL_COPY;
+    if (!pixelKernelAvailable(kernel) || !(swapKernel || copyKernel)) {
+      return -1;
+    }
+  }
+
+  pc->kernel = kernel;
+  pc->fn = kernelFn(kernel);
+  return 0;
+}
+
+//
+// Convert count pixels from src, in the order given to pixelConverterInit,
+// to the visual's layout in dst. dst may be the same buffer as src.
+//
+void pixelConvert(const PixelConverter *pc, uint32_t *dst, const void *src,
+                  size_t count) {
+  if (pc->kernel == PIXEL_KERNEL_COPY && (const void *)dst == src) {
+    return;
+  }
+  pc->fn(pc, dst, src, count);
+}
+
+// Convert a rectangle. Strides are in bytes.
+void pixelConvertRect(const PixelConverter *pc, uint32_t *dst,
+                      uint32_t dstStride, const void *src, uint32_t srcStride,
+                      uint32_t width, uint32_t height) {
+  // Converting in place to the layout the pixels are already in is nothing
+  // to do. Example 06 converts in place every frame, and on the usual BGRA
+  // visual this would otherwise memmove every damaged row onto itself.
+  if (pc->kernel == PIXEL_KERNEL_COPY && (const void *)dst == src &&
+      dstStride == srcStride) {
+    return;
+  }
+
+  // One call when the rows are back to back
+  if (dstStride == width * 4 && srcStride == width * 4) {
+    pc->fn(pc, dst, src, (size_t)width * height);
+    return;
+  }
+
+  for (uint32_t y = 0; y < height; y++) {
+    pc->fn(pc, (uint32_t *)((uint8_t *)dst + (size_t)y * dstStride),
+           (const uint8_t *)src + (size_t)y * srcStride, width);
+  }
+}
+
+// A single color in the visual's layout, for things like XCB_CW_BACK_PIXEL
+uint32_t pixelConvertColor(const PixelConverter *pc, uint8_t r, uint8_t g,
+                           uint8_t b, uint8_t a) {
+  return pc->lut[0][r] | pc->lut[1][g] | pc->lut[2][b] | pc->lut[3][a];
+}
+
+const char *pixelKernelName(PixelKernel kernel) {
+  return kernel < PIXEL_KERNEL_COUNT ? kernelNames[kernel] : "unknown";
+}
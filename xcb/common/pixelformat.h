@@ -0,0 +1,67 @@
+#ifndef PIXELFORMAT_H_20261017
+#define PIXELFORMAT_H_20261017
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+// Byte order of the canonical pixels handed to the converter, 8 bits per
+// channel, as they sit in memory
+typedef enum {
+  PIXEL_ORDER_RGBA, // R G B A, what most image libraries produce
+  PIXEL_ORDER_BGRA, // B G R A, 0xAARRGGBB read as a little endian uint32_t
+} PixelOrder;
+
+// Which conversion kernel to use
+typedef enum {
+  PIXEL_KERNEL_AUTO,    // Fastest one that works for the visual
+  PIXEL_KERNEL_GENERIC, // Shift every channel by the visual's masks
+  PIXEL_KERNEL_COPY,    // Source is already in the visual's layout
+  PIXEL_KERNEL_SCALAR,  // Swap red and blue one pixel at a time
+  PIXEL_KERNEL_SSE2,    // Swap red and blue 4 pixels at a time
+  PIXEL_KERNEL_AVX2,    // Swap red and blue 8 pixels at a time
+  PIXEL_KERNEL_NEON,    // Swap red and blue 16 pixels at a time
+  PIXEL_KERNEL_COUNT,
+} PixelKernel;
+
+typedef struct PixelConverter PixelConverter;
+
+typedef void (*PixelKernelFn)(const PixelConverter *pc, uint32_t *dst,
+                              const uint8_t *src, size_t count);
+
+//
+// Turns canonical 8 bit per channel pixels into a 32 bits per pixel visual's
+// own layout, as given by its red, green and blue masks.
+//
+// Nearly every visual is either 0x00RRGGBB or 0x00BBGGRR with alpha, if
+// any, in the top byte. Those only ever need the pixels copied or red and
+// blue swapped, which is done with vector instructions. Anything else goes
+// through the generic path, which scales and shifts each channel.
+//
+struct PixelConverter {
+  PixelKernel kernel;
+  PixelKernelFn fn;
+
+  PixelOrder order;
+  uint32_t masks[4]; // red, green, blue, alpha
+
+  // Every 8 bit value of each channel already scaled and shifted into
+  // place, used by the generic path
+  uint32_t lut[4][256];
+};
+
+int pixelConverterInit(PixelConverter *pc, const xcb_visualtype_t *visual,
+                       uint8_t depth, PixelOrder order, PixelKernel kernel);
+
+void pixelConvert(const PixelConverter *pc, uint32_t *dst, const void *src,
+                  size_t count);
+void pixelConvertRect(const PixelConverter *pc, uint32_t *dst,
+                      uint32_t dstStride, const void *src, uint32_t srcStride,
+                      uint32_t width, uint32_t height);
+uint32_t pixelConvertColor(const PixelConverter *pc, uint8_t r, uint8_t g,
+                           uint8_t b, uint8_t a);
+
+const char *pixelKernelName(PixelKernel kernel);
+bool pixelKernelAvailable(PixelKernel kernel);
+
+#endif
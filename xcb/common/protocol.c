@@ -0,0 +1,196 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "protocol.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const unknown = "Unknown";
+
+//
+// Lookup tables filled in the first time a name is needed that the core
+// protocol does not cover, once the server has said where each extension's
+// opcodes, errors and events start. Until then only the core protocol is
+// known.
+//
+static struct {
+  // Indexed by major opcode - 128
+  const ProtocolExtension *byMajor[128];
+
+  // Names for every error code and event code the server can send
+  const char *errors[256];
+  const char *events[128];
+} tables = {};
+
+// Set by protocolInit and cleared once the server has been asked
+static xcb_connection_t *connection = nullptr;
+
+// Put the core protocol's names in the tables
+static void addCore(void) {
+  for (uint32_t i = 0; i < protocolCore.nErrors && i < 256; i++) {
+    tables.errors[i] = protocolCore.errors[i];
+  }
+  for (uint32_t i = 0; i < protocolCore.nEvents && i < 128; i++) {
+    tables.events[i] = protocolCore.events[i];
+  }
+}
+
+static void addExtension(const ProtocolExtension *ext,
+                         const xcb_query_extension_reply_t *reply) {
+  tables.byMajor[reply->major_opcode & 0x7F] = ext;
+
+  if (reply->first_error) {
+    for (uint32_t i = 0; i < ext->nErrors; i++) {
+      if (reply->first_error + i < 256 && ext->errors[i]) {
+        tables.errors[reply->first_error + i] = ext->errors[i];
+      }
+    }
+  }
+
+  if (reply->first_event) {
+    for (uint32_t i = 0; i < ext->nEvents; i++) {
+      if (reply->first_event + i < 128 && ext->events[i]) {
+        tables.events[reply->first_event + i] = ext->events[i];
+      }
+    }
+  }
+}
+
+//
+// Ask the server where every extension xcb-proto knows about lives.
+//
+// All of the QueryExtension requests are sent before any reply is read, so
+// this costs one round trip no matter how many extensions there are. It
+// happens at most once, and only if something outside the core protocol
+// has to be named, which for most programs is never.
+//
+static void loadExtensions(void) {
+  xcb_connection_t *const c = connection;
+  if (!c) {
+    return;
+  }
+  connection = nullptr;
+
+  xcb_query_extension_cookie_t *cookies =
+      calloc(protocolExtensionCount + 1, sizeof(*cookies));
+  if (!cookies) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < protocolExtensionCount; i++) {
+    const char *xname = protocolExtensions[i].xname;
+    cookies[i] = xcb_query_extension(c, strlen(xname), xname);
+  }
+
+  for (uint32_t i = 0; i < protocolExtensionCount; i++) {
+    xcb_query_extension_reply_t *reply =
+        xcb_query_extension_reply(c, cookies[i], nullptr);
+    if (reply && reply->present) {
+      addExtension(&protocolExtensions[i], reply);
+    }
+    free(reply);
+  }
+
+  free(cookies);
+}
+
+//
+// Get ready to name requests, errors and events on this connection.
+//
+// Nothing is sent to the server here, so this adds nothing to start up.
+// Extension names are looked up the first time one is asked for, which
+// must be while the connection is still open, on the thread that runs the
+// event loop.
+//
+void protocolInit(xcb_connection_t *c) {
+  addCore();
+  connection = c;
+}
+
+// Name of the extension that owns a major opcode, nullptr for the core
+// protocol
+const char *protocolExtensionName(uint8_t major) {
+  if (major < 128) {
+    return nullptr;
+  }
+  loadExtensions();
+  const ProtocolExtension *ext = tables.byMajor[major & 0x7F];
+  return ext ? ext->xname : unknown;
+}
+
+// Name of a request. The minor opcode is ignored for core requests.
+const char *protocolRequestName(uint8_t major, uint16_t minor) {
+  if (major >= 128) {
+    loadExtensions();
+  }
+  const ProtocolExtension *ext =
+      major < 128 ? &protocolCore : tables.byMajor[major & 0x7F];
+  const uint16_t opcode = major < 128 ? major : minor;
+
+  if (!ext || opcode >= ext->nRequests || !ext->requests[opcode]) {
+    return unknown;
+  }
+  return ext->requests[opcode];
+}
+
+const char *protocolErrorName(uint8_t code) {
+  if (code >= protocolCore.nErrors) {
+    loadExtensions();
+  }
+  if (!tables.errors[code]) {
+    // Allow core errors to be named before protocolInit is called
+    if (code < protocolCore.nErrors && protocolCore.errors[code]) {
+      return protocolCore.errors[code];
+    }
+    return unknown;
+  }
+  return tables.errors[code];
+}
+
+// Name of an event from its response_type. The send event bit is ignored.
+const char *protocolEventName(uint8_t responseType) {
+  const uint8_t code = responseType & 0x7F;
+  if (code >= protocolCore.nEvents) {
+    loadExtensions();
+  }
+  if (!tables.events[code]) {
+    if (code < protocolCore.nEvents && protocolCore.events[code]) {
+      return protocolCore.events[code];
+    }
+    return unknown;
+  }
+  return tables.events[code];
+}
+
+// Name of an event delivered through the generic event extension
+const char *protocolGenericEventName(uint8_t extension, uint16_t eventType) {
+  loadExtensions();
+  const ProtocolExtension *ext =
+      extension < 128 ? nullptr : tables.byMajor[extension & 0x7F];
+  if (!ext || eventType >= ext->nGenericEvents ||
+      !ext->genericEvents[eventType]) {
+    return unknown;
+  }
+  return ext->genericEvents[eventType];
+}
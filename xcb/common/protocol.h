@@ -0,0 +1,37 @@
+#ifndef PROTOCOL_H_20261017
+#define PROTOCOL_H_20261017
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+// Names from one xcb-proto XML file. Every array is indexed by opcode or
+// number and may contain nullptr where nothing is defined.
+typedef struct {
+  const char *name;  // xcb's name, e.g. "Shm"
+  const char *xname; // name the server knows it by, e.g. "MIT-SHM"
+
+  const char *const *requests; // by minor opcode, major for the core
+  uint16_t nRequests;
+  const char *const *errors; // by error number from the first error
+  uint16_t nErrors;
+  const char *const *events; // by event number from the first event
+  uint16_t nEvents;
+  const char *const *genericEvents; // XGE events by event_type
+  uint16_t nGenericEvents;
+} ProtocolExtension;
+
+// Generated at build time by gen_protocol.py, or protocol_core.c when
+// xcb-proto is not available
+extern const ProtocolExtension protocolCore;
+extern const ProtocolExtension protocolExtensions[];
+extern const uint32_t protocolExtensionCount;
+
+void protocolInit(xcb_connection_t *c);
+
+const char *protocolExtensionName(uint8_t major);
+const char *protocolRequestName(uint8_t major, uint16_t minor);
+const char *protocolErrorName(uint8_t code);
+const char *protocolEventName(uint8_t responseType);
+const char *protocolGenericEventName(uint8_t extension, uint16_t eventType);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "raster.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline int32_t min32(int32_t a, int32_t b) { return a < b ? a : b; }
+static inline int32_t max32(int32_t a, int32_t b) { return a > b ? a : b; }
+
+//
+// Clip a command to the target and add it to the list. Commands that end
+// up empty are dropped. The source pointer is moved along with the clipped
+// corner.
+//
+static void record(Rasterizer *r, RasterCommand c) {
+  const int32_t x1 = max32(c.x1, 0);
+  const int32_t y1 = max32(c.y1, 0);
+  const int32_t x2 = min32(c.x2, (int32_t)r->width);
+  const int32_t y2 = min32(c.y2, (int32_t)r->height);
+  if (x1 >= x2 || y1 >= y2) {
+    return;
+  }
+
+  if (c.src) {
+    c.src = (const uint32_t *)((const uint8_t *)c.src +
+                               (size_t)(y1 - c.y1) * c.srcStride) +
+            (x1 - c.x1);
+  }
+  c.x1 = x1;
+  c.y1 = y1;
+  c.x2 = x2;
+  c.y2 = y2;
+
+  if (r->count == r->capacity) {
+    const uint32_t capacity = r->capacity ? r->capacity * 2 : 64;
+    RasterCommand *commands =
+        realloc(r->commands, capacity * sizeof(RasterCommand));
+    if (!commands) {
+      return;
+    }
+    r->commands = commands;
+    r->capacity = capacity;
+  }
+  r->commands[r->count++] = c;
+}
+
+void rasterInit(Rasterizer *r, ThreadPool *pool, const Blender *blender) {
+  *r = (Rasterizer){.pool = pool, .blender = blender};
+}
+
+void rasterDestroy(Rasterizer *r) {
+  free(r->commands);
+  r->commands = nullptr;
+  r->count = r->capacity = 0;
+}
+
+//
+// Set the framebuffer to draw into. Pending commands are dropped, they were
+// clipped to the old one.
+//
+void rasterTarget(                 //
+    Rasterizer *r,                 ///> rasterizer
+    uint32_t *pixels,              ///> premultiplied 0xAARRGGBB pixels
+    uint32_t width,                ///> size in pixels
+    uint32_t height,               ///>
+    uint32_t stride                ///> bytes from one row to the next
+) {
+  r->pixels = pixels;
+  r->width = width;
+  r->height = height;
+  r->stride = stride;
+  r->tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  r->tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  r->count = 0;
+}
+
+// Fill a rectangle with a premultiplied color
+void rasterFill(Rasterizer *r, int32_t x, int32_t y, int32_t width,
+                int32_t height, uint32_t color) {
+  record(r, (RasterCommand){.type = RASTER_FILL,
+                            .x1 = x,
+                            .y1 = y,
+                            .x2 = x + width,
+                            .y2 = y + height,
+                            .color = color});
+}
+
+// Copy premultiplied pixels to (x, y)
+void rasterBlit(Rasterizer *r, int32_t x, int32_t y, int32_t width,
+                int32_t height, const uint32_t *src, uint32_t srcStride) {
+  record(r, (RasterCommand){.type = RASTER_BLIT,
+                            .x1 = x,
+                            .y1 = y,
+                            .x2 = x + width,
+                            .y2 = y + height,
+                            .src = src,
+                            .srcStride = srcStride});
+}
+
+// Blend premultiplied pixels over what is at (x, y)
+void rasterBlend(Rasterizer *r, int32_t x, int32_t y, int32_t width,
+                 int32_t height, const uint32_t *src, uint32_t srcStride) {
+  record(r, (RasterCommand){.type = RASTER_BLEND,
+                            .x1 = x,
+                            .y1 = y,
+                            .x2 = x + width,
+                            .y2 = y + height,
+                            .src = src,
+                            .srcStride = srcStride});
+}
+
+//
+// Apply every command to one tile, in the order they were recorded.
+//
+static void renderTile(uint32_t tile, uint32_t, void *data) {
+  const Rasterizer *r = data;
+
+  const int32_t tx1 = tile % r->tilesX * RASTER_TILE_SIZE;
+  const int32_t ty1 = tile / r->tilesX * RASTER_TILE_SIZE;
+  const int32_t tx2 = min32(tx1 + RASTER_TILE_SIZE, (int32_t)r->width);
+  const int32_t ty2 = min32(ty1 + RASTER_TILE_SIZE, (int32_t)r->height);
+
+  // One row of a translucent fill color, to blend from
+  uint32_t colorRow[RASTER_TILE_SIZE];
+  uint32_t colorRowColor = 0;
+  bool haveColorRow = false;
+
+  for (uint32_t i = 0; i < r->count; i++) {
+    const RasterCommand *c = &r->commands[i];
+
+    const int32_t x1 = max32(c->x1, tx1);
+    const int32_t y1 = max32(c->y1, ty1);
+    const int32_t x2 = min32(c->x2, tx2);
+    const int32_t y2 = min32(c->y2, ty2);
+    if (x1 >= x2 || y1 >= y2) {
+      continue;
+    }
+
+    const uint32_t width = x2 - x1;
+    const uint32_t height = y2 - y1;
+    uint32_t *dst = (uint32_t *)((uint8_t *)r->pixels +
+                                 (size_t)y1 * r->stride) +
+                    x1;
+    const uint32_t *src =
+        c->src ? (const uint32_t *)((const uint8_t *)c->src +
+                                    (size_t)(y1 - c->y1) * c->srcStride) +
+                     (x1 - c->x1)
+               : nullptr;
+
+    switch (c->type) {
+    case RASTER_FILL:
+      if (c->color >> 24 == 0xFF) {
+        for (uint32_t y = 0; y < height; y++) {
+          uint32_t *row = (uint32_t *)((uint8_t *)dst + (size_t)y * r->stride);
+          for (uint32_t x = 0; x < width; x++) {
+            row[x] = c->color;
+          }
+        }
+      } else if (c->color) {
+        if (!haveColorRow || colorRowColor != c->color) {
+          for (uint32_t x = 0; x < RASTER_TILE_SIZE; x++) {
+            colorRow[x] = c->color;
+          }
+          colorRowColor = c->color;
+          haveColorRow = true;
+        }
+        // A source stride of 0 blends the same row into every row
+        blendRect(r->blender, BLEND_OVER, dst, r->stride, colorRow, 0, width,
+                  height);
+      }
+      break;
+
+    case RASTER_BLIT:
+      blendRect(r->blender, BLEND_SRC, dst, r->stride, src, c->srcStride,
+                width, height);
+      break;
+
+    case RASTER_BLEND:
+      blendRect(r->blender, BLEND_OVER, dst, r->stride, src, c->srcStride,
+                width, height);
+      break;
+    }
+  }
+}
+
+//
+// Draw everything recorded since the last flush and return once it is all
+// in the framebuffer.
+//
+void rasterFlush(Rasterizer *r) {
+  if (r->count == 0) {
+    return;
+  }
+  TRACE_SCOPE("raster");
+  threadPoolRun(r->pool, r->tilesX * r->tilesY, renderTile, r);
+  r->count = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef RASTER_H_20261017
+#define RASTER_H_20261017
+
+#include "blend.h"
+#include "threadpool.h"
+#include <stdint.h>
+
+// Tiles are square. 64 by 64 pixels is 16 KiB, which leaves room in a 32
+// KiB L1 cache for the source pixels being blended into them.
+#define RASTER_TILE_SIZE 64
+
+typedef enum {
+  RASTER_FILL,  // A solid color, blended over when it is translucent
+  RASTER_BLIT,  // Copy pixels
+  RASTER_BLEND, // Blend pixels over
+} RasterCommandType;
+
+// One drawing operation, already clipped to the target
+typedef struct {
+  RasterCommandType type;
+  int32_t x1, y1;
+  int32_t x2, y2;
+  uint32_t color;        // RASTER_FILL
+  const uint32_t *src;   // RASTER_BLIT and RASTER_BLEND, pixel for (x1, y1)
+  uint32_t srcStride;    // in bytes
+} RasterCommand;
+
+//
+// Draws into a 32 bit premultiplied 0xAARRGGBB framebuffer in parallel.
+//
+// Drawing calls only record a command. rasterFlush splits the target into
+// RASTER_TILE_SIZE tiles and has the thread pool render them, each tile
+// running through every command that touches it. A tile is only ever
+// written by one thread, so no locking is needed, and it stays in that
+// thread's cache while all of its commands are applied.
+//
+// Source pixels for blits and blends must stay untouched until the flush.
+//
+typedef struct {
+  ThreadPool *pool;
+  const Blender *blender;
+
+  uint32_t *pixels;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride; // in bytes
+
+  uint32_t tilesX;
+  uint32_t tilesY;
+
+  RasterCommand *commands;
+  uint32_t count;
+  uint32_t capacity;
+} Rasterizer;
+
+void rasterInit(Rasterizer *r, ThreadPool *pool, const Blender *blender);
+void rasterDestroy(Rasterizer *r);
+void rasterTarget(Rasterizer *r, uint32_t *pixels, uint32_t width,
+                  uint32_t height, uint32_t stride);
+
+void rasterFill(Rasterizer *r, int32_t x, int32_t y, int32_t width,
+                int32_t height, uint32_t color);
+void rasterBlit(Rasterizer *r, int32_t x, int32_t y, int32_t width,
+                int32_t height, const uint32_t *src, uint32_t srcStride);
+void rasterBlend(Rasterizer *r, int32_t x, int32_t y, int32_t width,
+                 int32_t height, const uint32_t *src, uint32_t srcStride);
+
+void rasterFlush(Rasterizer *r);
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "roundtrip.h"
+#include "traffic.h"
+#include <dlfcn.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+//
+// The functions below replace libxcb's own. Because the generated *_reply
+// functions in libxcb call xcb_wait_for_reply through the dynamic linker,
+// they end up here too, as do the generated request functions that call
+// xcb_send_request. The real functions are found with dlsym(RTLD_NEXT, ...).
+//
+// Each request and wait is also counted per opcode by traffic.c.
+//
+
+static _Atomic uint64_t waits = 0;
+static _Atomic uint64_t roundTrips = 0;
+static _Atomic uint64_t blockedNs = 0;
+
+typedef void *(*WaitForReplyFn)(xcb_connection_t *, unsigned int,
+                                xcb_generic_error_t **);
+typedef void *(*WaitForReply64Fn)(xcb_connection_t *, uint64_t,
+                                  xcb_generic_error_t **);
+typedef xcb_generic_error_t *(*RequestCheckFn)(xcb_connection_t *,
+                                               xcb_void_cookie_t);
+typedef int (*PollForReplyFn)(xcb_connection_t *, unsigned int, void **,
+                              xcb_generic_error_t **);
+typedef int (*PollForReply64Fn)(xcb_connection_t *, uint64_t, void **,
+                                xcb_generic_error_t **);
+typedef unsigned int (*SendRequestFn)(xcb_connection_t *, int, struct iovec *,
+                                      const xcb_protocol_request_t *);
+typedef uint64_t (*SendRequest64Fn)(xcb_connection_t *, int, struct iovec *,
+                                    const xcb_protocol_request_t *);
+typedef unsigned int (*SendRequestFdsFn)(xcb_connection_t *, int,
+                                         struct iovec *,
+                                         const xcb_protocol_request_t *,
+                                         unsigned int, int *);
+typedef uint64_t (*SendRequestFds64Fn)(xcb_connection_t *, int,
+                                       struct iovec *,
+                                       const xcb_protocol_request_t *,
+                                       unsigned int, int *);
+
+static struct {
+  WaitForReplyFn wait;
+  WaitForReply64Fn wait64;
+  RequestCheckFn check;
+  PollForReplyFn poll;
+  PollForReply64Fn poll64;
+  SendRequestFn send;
+  SendRequest64Fn send64;
+  SendRequestFdsFn sendFds;
+  SendRequestFds64Fn sendFds64;
+} libxcb = {};
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Look up libxcb's version of a function the first time it is needed
+static void *real(void **fn, const char *name) {
+  if (!*fn) {
+    *fn = dlsym(RTLD_NEXT, name);
+    if (!*fn) {
+      abort();
+    }
+  }
+  return *fn;
+}
+
+#define REAL(field, name)                                                      \
+  ((typeof(libxcb.field))real((void **)&libxcb.field, name))
+
+static void countBlocked(uint64_t sequence, uint64_t start) {
+  const uint64_t ns = now() - start;
+  atomic_fetch_add_explicit(&blockedNs, ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&roundTrips, 1, memory_order_relaxed);
+  trafficWaited(sequence, true, ns);
+}
+
+// Hand back a reply that was already available the way xcb_wait_for_reply
+// would have
+static void *alreadyHere(uint64_t sequence, void *reply,
+                         xcb_generic_error_t *error,
+                         xcb_generic_error_t **e) {
+  trafficWaited(sequence, false, 0);
+  if (e) {
+    *e = error;
+  } else {
+    free(error);
+  }
+  return reply;
+}
+
+//
+// Each wrapper first tries to pick up the reply, or the error for a checked
+// request, without blocking. Only if it is not there yet does it call the
+// real function and count a round trip.
+//
+
+void *xcb_wait_for_reply(xcb_connection_t *c, unsigned int request,
+                         xcb_generic_error_t **e) {
+  atomic_fetch_add_explicit(&waits, 1, memory_order_relaxed);
+
+  void *reply = nullptr;
+  xcb_generic_error_t *error = nullptr;
+  if (REAL(poll, "xcb_poll_for_reply")(c, request, &reply, &error)) {
+    return alreadyHere(request, reply, error, e);
+  }
+
+  const uint64_t start = now();
+  reply = REAL(wait, "xcb_wait_for_reply")(c, request, e);
+  countBlocked(request, start);
+  return reply;
+}
+
+void *xcb_wait_for_reply64(xcb_connection_t *c, uint64_t request,
+                           xcb_generic_error_t **e) {
+  atomic_fetch_add_explicit(&waits, 1, memory_order_relaxed);
+
+  void *reply = nullptr;
+  xcb_generic_error_t *error = nullptr;
+  if (REAL(poll64, "xcb_poll_for_reply64")(c, request, &reply, &error)) {
+    return alreadyHere(request, reply, error, e);
+  }
+
+  const uint64_t start = now();
+  reply = REAL(wait64, "xcb_wait_for_reply64")(c, request, e);
+  countBlocked(request, start);
+  return reply;
+}
+
+xcb_generic_error_t *xcb_request_check(xcb_connection_t *c,
+                                       xcb_void_cookie_t cookie) {
+  atomic_fetch_add_explicit(&waits, 1, memory_order_relaxed);
+
+  // Once a later reply has been read, libxcb knows the request finished and
+  // the check needs nothing from the server
+  void *reply = nullptr;
+  xcb_generic_error_t *error = nullptr;
+  if (REAL(poll, "xcb_poll_for_reply")(c, cookie.sequence, &reply, &error)) {
+    trafficWaited(cookie.sequence, false, 0);
+    free(reply);
+    return error;
+  }
+
+  const uint64_t start = now();
+  error = REAL(check, "xcb_request_check")(c, cookie);
+  countBlocked(cookie.sequence, start);
+  return error;
+}
+
+//
+// libxcb's send functions call one another, so a request can pass through
+// more than one of the wrappers below. Only the first counts it. A request
+// sent from inside another, such as the QueryExtension libxcb sends the
+// first time an extension is used, is a different request and is counted.
+//
+static thread_local const xcb_protocol_request_t *sending = nullptr;
+
+// Bytes in a request's parts, before libxcb adds anything of its own
+static uint64_t requestBytes(const struct iovec *vector,
+                             const xcb_protocol_request_t *request) {
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < request->count; i++) {
+    bytes += vector[i].iov_len;
+  }
+  return bytes;
+}
+
+#define SEND(call)                                                             \
+  do {                                                                         \
+    if (sending == request) {                                                  \
+      return call;                                                             \
+    }                                                                          \
+    const xcb_protocol_request_t *outer = sending;                             \
+    const uint64_t bytes = requestBytes(vector, request);                      \
+    sending = request;                                                         \
+    const typeof(call) sequence = call;                                        \
+    sending = outer;                                                           \
+    if (sequence) {                                                            \
+      trafficSent(request, bytes, sequence);                                   \
+    }                                                                          \
+    return sequence;                                                           \
+  } while (0)
+
+unsigned int xcb_send_request(xcb_connection_t *c, int flags,
+                              struct iovec *vector,
+                              const xcb_protocol_request_t *request) {
+  SEND(REAL(send, "xcb_send_request")(c, flags, vector, request));
+}
+
+uint64_t xcb_send_request64(xcb_connection_t *c, int flags,
+                            struct iovec *vector,
+                            const xcb_protocol_request_t *request) {
+  SEND(REAL(send64, "xcb_send_request64")(c, flags, vector, request));
+}
+
+unsigned int xcb_send_request_with_fds(xcb_connection_t *c, int flags,
+                                       struct iovec *vector,
+                                       const xcb_protocol_request_t *request,
+                                       unsigned int num_fds, int *fds) {
+  SEND(REAL(sendFds, "xcb_send_request_with_fds")(c, flags, vector, request,
+                                                  num_fds, fds));
+}
+
+uint64_t xcb_send_request_with_fds64(xcb_connection_t *c, int flags,
+                                     struct iovec *vector,
+                                     const xcb_protocol_request_t *request,
+                                     unsigned int num_fds, int *fds) {
+  SEND(REAL(sendFds64, "xcb_send_request_with_fds64")(c, flags, vector,
+                                                      request, num_fds, fds));
+}
+
+// Copy the current totals
+void roundTripSnapshot(RoundTripStats *stats) {
+  stats->waits = atomic_load_explicit(&waits, memory_order_relaxed);
+  stats->roundTrips = atomic_load_explicit(&roundTrips, memory_order_relaxed);
+  stats->blockedNs = atomic_load_explicit(&blockedNs, memory_order_relaxed);
+}
@@ -0,0 +1,22 @@
+#ifndef ROUNDTRIP_H_20261017
+#define ROUNDTRIP_H_20261017
+
+#include <stdint.h>
+
+//
+// Counts of how often the program had to stop and wait for the X server.
+//
+// Linking the xcb_roundtrip library into a program wraps xcb_wait_for_reply,
+// xcb_wait_for_reply64 and xcb_request_check, which every *_reply function
+// goes through. A wait only counts as a round trip if the reply was not
+// already available, so pipelined requests are counted once.
+//
+typedef struct {
+  uint64_t waits;      // Calls that wanted a reply or a request check
+  uint64_t roundTrips; // Calls that had to block for the server
+  uint64_t blockedNs;  // Time spent blocked
+} RoundTripStats;
+
+void roundTripSnapshot(RoundTripStats *stats);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "shmring.h"
+#include <stdlib.h>
+
+// The server is done reading a buffer
+static void onCompletion(xcb_generic_event_t *event, void *data) {
+  ShmRing *r = data;
+  const xcb_shm_completion_event_t *e = (xcb_shm_completion_event_t *)event;
+
+  for (uint32_t i = 0; i < r->count; i++) {
+    ShmRingSlot *slot = &r->slots[i];
+    if (slot->busy && slot->fb.shmSeg == e->shmseg) {
+      slot->busy = false;
+      r->stats.inFlight--;
+      r->stats.completions++;
+      latencyHistogramAdd(&r->stats.release, latencyNow() - slot->sentNs);
+      return;
+    }
+  }
+}
+
+//
+// Create count shared memory framebuffers for a drawable and register for
+// the ShmCompletion events that release them.
+//
+// When shared memory cannot be used the framebuffers fall back to copying,
+// see framebufferCreate. They are then never busy, since the pixels have
+// been copied by the time they are presented.
+//
+// Returns 0 on success, -1 if count is out of range or a framebuffer could
+// not be created.
+//
+int shmRingInit(                     //
+    ShmRing *r,                      ///> ring to set up
+    xcb_connection_t *c,             ///> server connection
+    xcb_drawable_t drawable,         ///> window or pixmap to present to
+    uint8_t depth,                   ///> depth of the drawable
+    uint16_t width,                  ///> size in pixels
+    uint16_t height,                 ///>
+    uint32_t count,                  ///> buffers, 2 to SHM_RING_MAX
+    EventDispatcher *d               ///> where to register for events
+) {
+  *r = (ShmRing){.connection = c, .dispatcher = d};
+  if (count < 2 || count > SHM_RING_MAX) {
+    return -1;
+  }
+
+  for (; r->count < count; r->count++) {
+    if (framebufferCreate(&r->slots[r->count].fb, c, drawable, depth, width,
+                          height, FRAMEBUFFER_SHM)) {
+      shmRingDestroy(r);
+      return -1;
+    }
+  }
+
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(c, &xcb_shm_id);
+  if (ext && ext->present) {
+    dispatcherSetHandler(d, ext->first_event + XCB_SHM_COMPLETION,
+                         onCompletion, r);
+  }
+  return 0;
+}
+
+// Buffers still busy are detached after the presents that use them, since
+// the server handles requests in order
+void shmRingDestroy(ShmRing *r) {
+  for (uint32_t i = 0; i < r->count; i++) {
+    framebufferDestroy(&r->slots[i].fb);
+  }
+  r->count = 0;
+}
+
+//
+// Resize every buffer, see framebufferResize. A busy buffer can be resized
+// too, the server keeps reading the old memory until it is done with it.
+//
+// A buffer that had to grow has new memory the server has never seen, so it
+// is free straight away. The ShmCompletion for the old memory names a
+// segment no slot has any more and is ignored.
+//
+int shmRingResize(ShmRing *r, uint16_t width, uint16_t height) {
+  for (uint32_t i = 0; i < r->count; i++) {
+    ShmRingSlot *slot = &r->slots[i];
+    const xcb_shm_seg_t oldSeg = slot->fb.shmSeg;
+    const int result = framebufferResize(&slot->fb, width, height);
+    if (result) {
+      return result;
+    }
+    if (slot->busy && slot->fb.shmSeg != oldSeg) {
+      slot->busy = false;
+      r->stats.inFlight--;
+    }
+  }
+  return 0;
+}
+
+// The next buffer the server is not reading, in turn, or nullptr
+static Framebuffer *takeFree(ShmRing *r) {
+  for (uint32_t i = 0; i < r->count; i++) {
+    const uint32_t index = (r->next + i) % r->count;
+    if (!r->slots[index].busy) {
+      r->next = (index + 1) % r->count;
+      return &r->slots[index].fb;
+    }
+  }
+  return nullptr;
+}
+
+//
+// A buffer the server is not reading, or nullptr if they are all busy. The
+// buffers are handed out in turn, so the one returned is the one that was
+// presented longest ago.
+//
+Framebuffer *shmRingAcquire(ShmRing *r) {
+  Framebuffer *fb = takeFree(r);
+  if (!fb) {
+    r->stats.stalls++;
+  }
+  return fb;
+}
+
+//
+// shmRingAcquire, but if every buffer is busy handle events until one is
+// released. Other events that arrive meanwhile go to their handlers as
+// usual. Returns nullptr only if the connection fails.
+//
+Framebuffer *shmRingAcquireWait(ShmRing *r) {
+  Framebuffer *fb = shmRingAcquire(r);
+  if (fb) {
+    return fb;
+  }
+
+  const uint64_t start = latencyNow();
+  xcb_flush(r->connection);
+
+  while (!(fb = takeFree(r))) {
+    xcb_generic_event_t *event = xcb_wait_for_event(r->connection);
+    if (!event) {
+      return nullptr;
+    }
+    dispatchEvent(r->dispatcher, event);
+    free(event);
+  }
+
+  r->stats.stallNs += latencyNow() - start;
+  return fb;
+}
+
+//
+// Present a rectangle of a buffer and mark the buffer busy until the server
+// has read it.
+//
+// A frame that is more than one rectangle sends the others with
+// framebufferPresent first and this one last. Requests are handled in
+// order, so by the time this one completes all of them have.
+//
+void shmRingPresent(                 //
+    ShmRing *r,                      ///> ring the buffer came from
+    Framebuffer *fb,                 ///> from shmRingAcquire
+    int16_t x,                       ///> rectangle to present
+    int16_t y,                       ///>
+    uint16_t width,                  ///>
+    uint16_t height                  ///>
+) {
+  ShmRingSlot *slot = (ShmRingSlot *)fb;
+  r->stats.presents++;
+
+  if (framebufferPresentNotify(fb, x, y, width, height)) {
+    slot->busy = true;
+    slot->sentNs = latencyNow();
+    if (++r->stats.inFlight > r->stats.maxInFlight) {
+      r->stats.maxInFlight = r->stats.inFlight;
+    }
+  }
+}
+
+void printShmRingStats(FILE *out, const ShmRing *r) {
+  const ShmRingStats *s = &r->stats;
+  fprintf(out,
+          "SHM ring: %u buffers, %llu presents, %llu completions, at most "
+          "%u in flight\n",
+          r->count, (unsigned long long)s->presents,
+          (unsigned long long)s->completions, s->maxInFlight);
+  fprintf(out, "  %llu stalls with every buffer busy, %.3f ms waiting\n",
+          (unsigned long long)s->stalls, s->stallNs / 1e6);
+
+  if (s->release.total) {
+    fprintf(out, "  released after (us): p50 %.1f, p99 %.1f, max %.1f\n",
+            latencyHistogramPercentile(&s->release, 50.0) / 1e3,
+            latencyHistogramPercentile(&s->release, 99.0) / 1e3,
+            s->release.max / 1e3);
+  }
+}
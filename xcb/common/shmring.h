@@ -0,0 +1,68 @@
+#ifndef SHMRING_H_20261017
+#define SHMRING_H_20261017
+
+#include "dispatch.h"
+#include "framebuffer.h"
+#include "latency.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/shm.h>
+#include <xcb/xcb.h>
+
+#define SHM_RING_MAX 8
+
+typedef struct {
+  Framebuffer fb; // First, so a Framebuffer pointer is also the slot's
+  bool busy;      // Presented and not yet released by a ShmCompletion
+  uint64_t sentNs;
+} ShmRingSlot;
+
+typedef struct {
+  uint64_t presents;
+  uint64_t completions;
+  uint64_t stalls;   // Acquires that found every buffer busy
+  uint64_t stallNs;  // Time spent waiting in shmRingAcquireWait
+  uint32_t inFlight; // Buffers busy right now
+  uint32_t maxInFlight;
+
+  // Present to ShmCompletion, how long the server holds on to a buffer
+  LatencyHistogram release;
+} ShmRingStats;
+
+//
+// A ring of shared memory framebuffers for one drawable.
+//
+// Each frame is drawn into a buffer the server has finished reading and
+// presented with a request for a ShmCompletion event. The buffer is busy
+// until that event arrives through the event dispatcher, and meanwhile the
+// next frame is drawn into another one. Drawing and the server's copying
+// overlap, and nothing waits for a round trip as framebufferSync does.
+//
+// A buffer only holds what was drawn into it, so callers draw everything
+// they present from it, not just what changed since the frame before.
+//
+typedef struct {
+  xcb_connection_t *connection;
+  const EventDispatcher *dispatcher;
+
+  ShmRingSlot slots[SHM_RING_MAX];
+  uint32_t count;
+  uint32_t next; // Where to start looking for a free buffer
+
+  ShmRingStats stats;
+} ShmRing;
+
+int shmRingInit(ShmRing *r, xcb_connection_t *c, xcb_drawable_t drawable,
+                uint8_t depth, uint16_t width, uint16_t height,
+                uint32_t count, EventDispatcher *d);
+void shmRingDestroy(ShmRing *r);
+int shmRingResize(ShmRing *r, uint16_t width, uint16_t height);
+
+Framebuffer *shmRingAcquire(ShmRing *r);
+Framebuffer *shmRingAcquireWait(ShmRing *r);
+void shmRingPresent(ShmRing *r, Framebuffer *fb, int16_t x, int16_t y,
+                    uint16_t width, uint16_t height);
+
+void printShmRingStats(FILE *out, const ShmRing *r);
+
+#endif
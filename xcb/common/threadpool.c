@@ -0,0 +1,234 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "threadpool.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static inline uint64_t pack(uint32_t next, uint32_t end) {
+  return (uint64_t)next << 32 | end;
+}
+
+// The owner takes items from the front of its own queue
+static bool popFront(ThreadPoolQueue *q, uint32_t *item) {
+  uint64_t range = atomic_load_explicit(&q->range, memory_order_relaxed);
+  for (;;) {
+    const uint32_t next = range >> 32;
+    const uint32_t end = (uint32_t)range;
+    if (next >= end) {
+      return false;
+    }
+    if (atomic_compare_exchange_weak_explicit(&q->range, &range,
+                                              pack(next + 1, end),
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      *item = next;
+      return true;
+    }
+  }
+}
+
+// Other threads take items from the back, away from where the owner is
+static bool popBack(ThreadPoolQueue *q, uint32_t *item) {
+  uint64_t range = atomic_load_explicit(&q->range, memory_order_relaxed);
+  for (;;) {
+    const uint32_t next = range >> 32;
+    const uint32_t end = (uint32_t)range;
+    if (next >= end) {
+      return false;
+    }
+    if (atomic_compare_exchange_weak_explicit(&q->range, &range,
+                                              pack(next, end - 1),
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      *item = end - 1;
+      return true;
+    }
+  }
+}
+
+//
+// Run everything in this thread's own queue, then help the others. No new
+// items show up while a job runs, so once every queue has been found empty
+// the job is done as far as this thread is concerned.
+//
+static void work(ThreadPool *p, uint32_t self) {
+  TRACE_SCOPE("pool work");
+
+  uint32_t item;
+  while (popFront(&p->queues[self], &item)) {
+    p->fn(item, self, p->data);
+  }
+
+  uint64_t stolen = 0;
+  for (uint32_t i = 1; i < p->threads; i++) {
+    ThreadPoolQueue *victim = &p->queues[(self + i) % p->threads];
+    while (popBack(victim, &item)) {
+      p->fn(item, self, p->data);
+      stolen++;
+    }
+  }
+
+  if (stolen) {
+    atomic_fetch_add_explicit(&p->steals, stolen, memory_order_relaxed);
+  }
+}
+
+static void *workerMain(void *arg) {
+  ThreadPoolWorker *w = arg;
+  ThreadPool *p = w->pool;
+  uint64_t seen = 0;
+
+  TRACE_THREAD_NAME("pool worker %u", w->index);
+
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (p->generation == seen && !p->quit) {
+      pthread_cond_wait(&p->start, &p->lock);
+    }
+    seen = p->generation;
+    const bool quit = p->quit;
+    pthread_mutex_unlock(&p->lock);
+
+    if (quit) {
+      return nullptr;
+    }
+
+    work(p, w->index);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->running == 0) {
+      pthread_cond_signal(&p->finished);
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+// Online processors, at least 1
+uint32_t threadPoolCpuCount(void) {
+  const long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (uint32_t)n : 1;
+}
+
+//
+// Start a pool. The calling thread counts as one of them, so threads - 1
+// new ones are started.
+//
+// Returns 0 on success, -1 if memory or threads ran out.
+//
+int threadPoolCreate(              //
+    ThreadPool *p,                 ///> pool to start
+    uint32_t threads               ///> 0 for one per processor
+) {
+  *p = (ThreadPool){.threads = threads ? threads : threadPoolCpuCount()};
+
+  p->workers = calloc(p->threads, sizeof(ThreadPoolWorker));
+  p->queues = aligned_alloc(alignof(ThreadPoolQueue),
+                            p->threads * sizeof(ThreadPoolQueue));
+  if (!p->workers || !p->queues) {
+    free(p->workers);
+    free(p->queues);
+    return -1;
+  }
+  for (uint32_t i = 0; i < p->threads; i++) {
+    atomic_init(&p->queues[i].range, 0);
+  }
+
+  pthread_mutex_init(&p->lock, nullptr);
+  pthread_cond_init(&p->start, nullptr);
+  pthread_cond_init(&p->finished, nullptr);
+
+  for (uint32_t i = 1; i < p->threads; i++) {
+    p->workers[i] = (ThreadPoolWorker){.pool = p, .index = i};
+    if (pthread_create(&p->workers[i].thread, nullptr, workerMain,
+                       &p->workers[i])) {
+      // Only the threads started so far get stopped
+      p->threads = i;
+      threadPoolDestroy(p);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void threadPoolDestroy(ThreadPool *p) {
+  pthread_mutex_lock(&p->lock);
+  p->quit = true;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  for (uint32_t i = 1; i < p->threads; i++) {
+    pthread_join(p->workers[i].thread, nullptr);
+  }
+
+  pthread_cond_destroy(&p->finished);
+  pthread_cond_destroy(&p->start);
+  pthread_mutex_destroy(&p->lock);
+  free(p->workers);
+  free(p->queues);
+  p->workers = nullptr;
+  p->queues = nullptr;
+}
+
+//
+// Call fn for every item from 0 up to items and return once all of them are
+// done. Anything fn writes is visible to the caller afterwards.
+//
+void threadPoolRun(                //
+    ThreadPool *p,                 ///> pool to run on
+    uint32_t items,                ///> number of items
+    ThreadPoolFn fn,               ///> called for each item
+    void *data                     ///> passed on to fn
+) {
+  if (items == 0) {
+    return;
+  }
+
+  // One contiguous run of items per thread
+  for (uint32_t i = 0; i < p->threads; i++) {
+    const uint32_t begin = (uint64_t)items * i / p->threads;
+    const uint32_t end = (uint64_t)items * (i + 1) / p->threads;
+    atomic_store_explicit(&p->queues[i].range, pack(begin, end),
+                          memory_order_relaxed);
+  }
+
+  // The lock orders the queues and fn before the workers look at them
+  pthread_mutex_lock(&p->lock);
+  p->fn = fn;
+  p->data = data;
+  p->running = p->threads - 1;
+  p->generation++;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  work(p, 0);
+
+  // and orders everything the workers wrote before the caller reads it
+  pthread_mutex_lock(&p->lock);
+  while (p->running) {
+    pthread_cond_wait(&p->finished, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
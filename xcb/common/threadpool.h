@@ -0,0 +1,68 @@
+#ifndef THREADPOOL_H_20261017
+#define THREADPOOL_H_20261017
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Called once for every item of a job, on whichever thread got to it
+typedef void (*ThreadPoolFn)(uint32_t item, uint32_t thread, void *data);
+
+//
+// The items one thread has left, next up to but not including end, packed
+// into one word so the owner taking from the front and a thief taking from
+// the back can both do it with a single compare and swap.
+//
+// Each queue has a cache line to itself so threads working through their
+// own items do not fight over the line.
+//
+typedef struct {
+  alignas(64) _Atomic uint64_t range; // next << 32 | end
+} ThreadPoolQueue;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+  ThreadPool *pool;
+  pthread_t thread;
+  uint32_t index;
+} ThreadPoolWorker;
+
+//
+// A fixed set of threads that work through jobs made of numbered items.
+//
+// Each job's items are split into one contiguous run per thread, so
+// neighbouring items, neighbouring tiles for the rasterizer, stay on one
+// thread. A thread that runs out steals single items off the back of
+// another thread's run. The thread that starts a job works on it too, as
+// thread 0, and returns once every item is done.
+//
+struct ThreadPool {
+  uint32_t threads; // Including the one calling threadPoolRun
+  ThreadPoolWorker *workers;
+  ThreadPoolQueue *queues;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;    // A job is ready, or the pool is shutting down
+  pthread_cond_t finished; // The last worker is done with a job
+
+  // Guarded by lock
+  uint64_t generation; // Counts jobs, so workers can tell a new one
+  uint32_t running;    // Workers still busy with the current job
+  bool quit;
+
+  ThreadPoolFn fn;
+  void *data;
+
+  // Items that were run by a thread other than the one they were given to
+  _Atomic uint64_t steals;
+};
+
+int threadPoolCreate(ThreadPool *p, uint32_t threads);
+void threadPoolDestroy(ThreadPool *p);
+void threadPoolRun(ThreadPool *p, uint32_t items, ThreadPoolFn fn,
+                   void *data);
+
+uint32_t threadPoolCpuCount(void);
+
+#endif
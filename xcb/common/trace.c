@@ -0,0 +1,312 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "trace.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+// One thread's markers. Only the thread itself records into it, and only
+// the thread that opened the trace reads it, so the ring needs nothing more
+// than the count of records written.
+//
+typedef struct TraceBuffer {
+  TraceRecord records[TRACE_RING_SIZE];
+  _Atomic uint64_t written; // Records ever written, the next is written % SIZE
+  uint64_t flushed;         // Records already written to the file
+
+  struct TraceBuffer *next;
+  uint32_t tid;
+
+  char name[32];
+  _Atomic bool named;  // name has been set
+  bool nameWritten;    // and has been written to the file
+} TraceBuffer;
+
+static FILE *file;
+static _Atomic bool tracing;
+static uint64_t originNs; // Time 0 in the trace
+static int pid;
+static bool firstEvent;
+static uint64_t dropped;
+
+// Every thread's buffer, newest first
+static _Atomic(TraceBuffer *) buffers;
+static _Atomic uint32_t nextTid;
+
+// Bumped whenever the buffers are freed, so threads know theirs is gone
+static _Atomic uint32_t epoch;
+
+static thread_local TraceBuffer *mine;
+static thread_local uint32_t mineEpoch;
+static thread_local char threadName[32];
+
+// Records are copied out of a ring before they are written, see traceFlush
+static TraceRecord scratch[TRACE_RING_SIZE];
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void setName(TraceBuffer *b) {
+  if (threadName[0] && !atomic_load_explicit(&b->named, memory_order_relaxed)) {
+    memcpy(b->name, threadName, sizeof(b->name));
+    atomic_store_explicit(&b->named, true, memory_order_release);
+  }
+}
+
+// The calling thread's buffer, made the first time it records anything
+static TraceBuffer *getBuffer(void) {
+  const uint32_t e = atomic_load_explicit(&epoch, memory_order_acquire);
+  if (mine && mineEpoch == e) {
+    return mine;
+  }
+
+  TraceBuffer *b = calloc(1, sizeof(TraceBuffer));
+  if (!b) {
+    return nullptr;
+  }
+  b->tid = atomic_fetch_add_explicit(&nextTid, 1, memory_order_relaxed) + 1;
+  setName(b);
+
+  b->next = atomic_load_explicit(&buffers, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&buffers, &b->next, b,
+                                                memory_order_release,
+                                                memory_order_relaxed)) {
+  }
+
+  mine = b;
+  mineEpoch = e;
+  return b;
+}
+
+static void record(const char *name, uint64_t startNs, uint64_t value,
+                   TraceRecordType type) {
+  TraceBuffer *b = getBuffer();
+  if (!b) {
+    return;
+  }
+  const uint64_t w = atomic_load_explicit(&b->written, memory_order_relaxed);
+  b->records[w & (TRACE_RING_SIZE - 1)] = (TraceRecord){
+      .name = name, .startNs = startNs, .value = value, .type = type};
+  atomic_store_explicit(&b->written, w + 1, memory_order_release);
+}
+
+//
+// Start writing a trace to path, replacing the file. Markers recorded
+// before this are not kept.
+//
+// Returns 0 on success, -1 if the file could not be opened or a trace is
+// already open.
+//
+int traceOpen(const char *path) {
+  if (file) {
+    return -1;
+  }
+  file = fopen(path, "w");
+  if (!file) {
+    return -1;
+  }
+
+  originNs = now();
+  pid = getpid();
+  firstEvent = true;
+  dropped = 0;
+  fprintf(file, "{\"traceEvents\": [");
+
+  atomic_store_explicit(&tracing, true, memory_order_release);
+  return 0;
+}
+
+// traceOpen the file named by an environment variable, if it is set. Says
+// so on stderr if it cannot be opened, as callers usually carry on anyway.
+int traceOpenFromEnv(const char *variable) {
+  const char *path = getenv(variable);
+  if (!path || !*path) {
+    return 0;
+  }
+  if (traceOpen(path) != 0) {
+    fprintf(stderr, "Unable to open the trace file %s\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+static void beginEvent(void) {
+  fprintf(file, firstEvent ? "\n" : ",\n");
+  firstEvent = false;
+}
+
+static void writeRecord(const TraceBuffer *b, const TraceRecord *r) {
+  const double ts = (double)(r->startNs - originNs) / 1e3;
+
+  beginEvent();
+  switch (r->type) {
+  case TRACE_RECORD_SCOPE:
+    fprintf(file,
+            "{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+            "\"pid\": %d, \"tid\": %u}",
+            r->name, ts, r->value / 1e3, pid, b->tid);
+    break;
+
+  case TRACE_RECORD_COUNTER:
+    fprintf(file,
+            "{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, "
+            "\"tid\": %u, \"args\": {\"value\": %llu}}",
+            r->name, ts, pid, b->tid, (unsigned long long)r->value);
+    break;
+  }
+}
+
+static void flushBuffer(TraceBuffer *b) {
+  if (!b->nameWritten &&
+      atomic_load_explicit(&b->named, memory_order_acquire)) {
+    beginEvent();
+    fprintf(file,
+            "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+            pid, b->tid, b->name);
+    b->nameWritten = true;
+  }
+
+  const uint64_t written =
+      atomic_load_explicit(&b->written, memory_order_acquire);
+  uint64_t from = b->flushed;
+  if (written - from > TRACE_RING_SIZE) {
+    from = written - TRACE_RING_SIZE;
+  }
+
+  for (uint64_t i = from; i < written; i++) {
+    scratch[i & (TRACE_RING_SIZE - 1)] = b->records[i & (TRACE_RING_SIZE - 1)];
+  }
+
+  // The thread may have gone on recording while the ring was copied. Any
+  // slot it has started to reuse since is thrown away rather than written
+  // half old and half new.
+  atomic_thread_fence(memory_order_acquire);
+  const uint64_t latest =
+      atomic_load_explicit(&b->written, memory_order_relaxed);
+  if (latest - from >= TRACE_RING_SIZE) {
+    from = latest - TRACE_RING_SIZE + 1;
+    if (from > written) {
+      from = written;
+    }
+  }
+
+  for (uint64_t i = from; i < written; i++) {
+    writeRecord(b, &scratch[i & (TRACE_RING_SIZE - 1)]);
+  }
+
+  dropped += from - b->flushed;
+  b->flushed = written;
+}
+
+//
+// Write everything recorded since the last flush to the file. Call it from
+// the thread that opened the trace, somewhere outside the phases being
+// measured, once a frame is about right.
+//
+void traceFlush(void) {
+  if (!file) {
+    return;
+  }
+  for (TraceBuffer *b = atomic_load_explicit(&buffers, memory_order_acquire);
+       b; b = b->next) {
+    flushBuffer(b);
+  }
+}
+
+//
+// Flush and finish the file. Every other thread must be done recording, or
+// have exited, as their buffers are freed.
+//
+// Returns 0 on success, -1 if the file could not be written.
+//
+int traceClose(void) {
+  if (!file) {
+    return 0;
+  }
+  atomic_store_explicit(&tracing, false, memory_order_relaxed);
+  traceFlush();
+
+  fprintf(file,
+          "\n], \"displayTimeUnit\": \"ms\", "
+          "\"otherData\": {\"dropped\": \"%llu\"}}\n",
+          (unsigned long long)dropped);
+  const int result = fclose(file) == 0 ? 0 : -1;
+  file = nullptr;
+
+  TraceBuffer *b = atomic_exchange(&buffers, nullptr);
+  while (b) {
+    TraceBuffer *next = b->next;
+    free(b);
+    b = next;
+  }
+  atomic_fetch_add(&epoch, 1);
+  return result;
+}
+
+//
+// Name the calling thread's row in the trace, printf style. The name is
+// cut to 31 characters. It can be set before the trace is opened.
+//
+void traceThreadName(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(threadName, sizeof(threadName), format, args);
+  va_end(args);
+
+  if (mine && mineEpoch == atomic_load(&epoch)) {
+    setName(mine);
+  }
+}
+
+TraceScope traceBegin(const char *name) {
+  if (!atomic_load_explicit(&tracing, memory_order_relaxed)) {
+    return (TraceScope){.name = name};
+  }
+  return (TraceScope){.name = name, .startNs = now()};
+}
+
+void traceEnd(TraceScope *scope) {
+  if (!scope->startNs ||
+      !atomic_load_explicit(&tracing, memory_order_relaxed)) {
+    return;
+  }
+  record(scope->name, scope->startNs, now() - scope->startNs,
+         TRACE_RECORD_SCOPE);
+}
+
+void traceCounter(const char *name, uint64_t value) {
+  if (atomic_load_explicit(&tracing, memory_order_relaxed)) {
+    record(name, now(), value, TRACE_RECORD_COUNTER);
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef TRACE_H_20261017
+#define TRACE_H_20261017
+
+//
+// Trace markers that show where the time in a frame goes, written out in
+// the Chrome trace format. Open the file in https://ui.perfetto.dev or
+// chrome://tracing to see wait, dispatch, render, upload and flush on a
+// timeline, one row per thread.
+//
+// Markers are only compiled in when the XCB_TRACE CMake option is on.
+// Otherwise every macro below expands to nothing, so they can be left in
+// the hottest code.
+//
+//     TRACE_OPEN_FROM_ENV("XCB_TRACE");  // start writing if it is set
+//     ...
+//     {
+//       TRACE_SCOPE("render");  // from here to the end of the block
+//       drawFrame(...);
+//     }
+//     TRACE_COUNTER("events", batch.count);
+//     TRACE_FLUSH();  // once a frame, from the thread that opened it
+//     ...
+//     TRACE_CLOSE();  // after every other traced thread is done
+//
+// Each thread records into a ring buffer of its own, so a marker is two
+// clock reads and a store, with no locks and nothing shared between
+// threads. TRACE_FLUSH copies what the rings hold into the file. If a
+// thread records more than TRACE_RING_SIZE markers between two flushes the
+// oldest are lost, and are counted as dropped.
+//
+#ifdef XCB_TRACE
+
+#include <stdint.h>
+
+// Markers each thread can hold between flushes. Must be a power of two.
+#define TRACE_RING_SIZE 4096
+
+typedef enum {
+  TRACE_RECORD_SCOPE,   // A named span of time
+  TRACE_RECORD_COUNTER, // A named value at a point in time
+} TraceRecordType;
+
+typedef struct {
+  const char *name; // Must outlive the trace, in practice a string literal
+  uint64_t startNs;
+  uint64_t value; // Duration for a scope, the value for a counter
+  TraceRecordType type;
+} TraceRecord;
+
+// The open half of a scope, closed by traceEnd when it goes out of scope
+typedef struct {
+  const char *name;
+  uint64_t startNs; // 0 when no trace is open
+} TraceScope;
+
+int traceOpen(const char *path);
+int traceOpenFromEnv(const char *variable);
+void traceFlush(void);
+int traceClose(void);
+
+void traceThreadName(const char *format, ...);
+TraceScope traceBegin(const char *name);
+void traceEnd(TraceScope *scope);
+void traceCounter(const char *name, uint64_t value);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_OPEN_FROM_ENV(variable) traceOpenFromEnv(variable)
+#define TRACE_FLUSH() traceFlush()
+#define TRACE_CLOSE() traceClose()
+#define TRACE_THREAD_NAME(...) traceThreadName(__VA_ARGS__)
+#define TRACE_COUNTER(name, value) traceCounter(name, value)
+
+// The cleanup attribute calls traceEnd however the block is left
+#define TRACE_SCOPE(name)                                                    \
+  [[gnu::cleanup(traceEnd)]] TraceScope TRACE_CONCAT(traceScope, __LINE__) = \
+      traceBegin(name)
+
+#else
+
+#define TRACE_OPEN_FROM_ENV(variable) ((void)0)
+#define TRACE_FLUSH() ((void)0)
+#define TRACE_CLOSE() ((void)0)
+#define TRACE_THREAD_NAME(...) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
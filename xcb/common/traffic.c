@@ -0,0 +1,372 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "traffic.h"
+#include "protocol.h"
+#include "roundtrip.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcbext.h>
+
+typedef struct {
+  _Atomic uint64_t requests;
+  _Atomic uint64_t bytes;
+  _Atomic uint64_t waits;
+  _Atomic uint64_t roundTrips;
+  _Atomic uint64_t blockedNs;
+} Counters;
+
+// Core requests by major opcode, then 256 minor opcodes for each extension
+// in extensions[], then one slot for everything else
+#define SLOT_CORE 0
+#define SLOT_EXTENSIONS 256
+#define SLOT_OTHER (TRAFFIC_SLOTS - 1)
+
+static Counters counters[TRAFFIC_SLOTS];
+
+// The wait totals are roundtrip.c's, see trafficSnapshot
+static _Atomic uint64_t totalRequests;
+static _Atomic uint64_t totalBytes;
+
+// Extensions in the order they were first used. A slot is claimed once and
+// never given back.
+static _Atomic(const xcb_extension_t *) extensions[TRAFFIC_EXTENSIONS];
+
+// The low 32 bits of a request's sequence number above its slot, indexed by
+// sequence number
+static _Atomic uint64_t recent[TRAFFIC_RECENT];
+
+static inline void add(_Atomic uint64_t *counter, uint64_t n) {
+  atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+static inline uint64_t load(const _Atomic uint64_t *counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// Where a request is counted. Extensions are told apart by their
+// xcb_extension_t, which libxcb keeps one of per extension.
+static uint32_t slotFor(const xcb_protocol_request_t *request) {
+  if (!request->ext) {
+    return SLOT_CORE + request->opcode;
+  }
+
+  for (uint32_t i = 0; i < TRAFFIC_EXTENSIONS; i++) {
+    const xcb_extension_t *ext =
+        atomic_load_explicit(&extensions[i], memory_order_acquire);
+    if (!ext) {
+      // Claim the slot. If another thread got there first, it may have
+      // claimed it for the same extension.
+      const xcb_extension_t *expected = nullptr;
+      if (atomic_compare_exchange_strong_explicit(
+              &extensions[i], &expected, request->ext, memory_order_acq_rel,
+              memory_order_acquire)) {
+        ext = request->ext;
+      } else {
+        ext = expected;
+      }
+    }
+    if (ext == request->ext) {
+      return SLOT_EXTENSIONS + i * 256 + request->opcode;
+    }
+  }
+  return SLOT_OTHER;
+}
+
+//
+// Count a request that has just been sent. Called by the xcb_send_request
+// wrappers in roundtrip.c.
+//
+void trafficSent(const xcb_protocol_request_t *request, uint64_t bytes,
+                 uint64_t sequence) {
+  const uint32_t slot = slotFor(request);
+  add(&counters[slot].requests, 1);
+  add(&counters[slot].bytes, bytes);
+  add(&totalRequests, 1);
+  add(&totalBytes, bytes);
+
+  atomic_store_explicit(&recent[sequence % TRAFFIC_RECENT],
+                        (sequence & 0xFFFFFFFF) << 32 | slot,
+                        memory_order_relaxed);
+}
+
+//
+// Charge a wait for a reply or a request check to the request it was for,
+// if that is still remembered. Only the low 32 bits of the sequence number
+// are compared, which is all xcb_wait_for_reply gets. roundtrip.c counts
+// the wait in its totals itself.
+//
+void trafficWaited(uint64_t sequence, bool blocked, uint64_t ns) {
+  const uint64_t entry = atomic_load_explicit(
+      &recent[sequence % TRAFFIC_RECENT], memory_order_relaxed);
+  if (entry >> 32 != (sequence & 0xFFFFFFFF)) {
+    return;
+  }
+  Counters *c = &counters[entry & 0xFFFFFFFF];
+  add(&c->waits, 1);
+  if (blocked) {
+    add(&c->roundTrips, 1);
+    add(&c->blockedNs, ns);
+  }
+}
+
+static void copy(TrafficCounts *out, const Counters *c) {
+  *out = (TrafficCounts){
+      .requests = load(&c->requests),
+      .bytes = load(&c->bytes),
+      .waits = load(&c->waits),
+      .roundTrips = load(&c->roundTrips),
+      .blockedNs = load(&c->blockedNs),
+  };
+}
+
+// Copy the totals since the program started
+void trafficSnapshot(TrafficCounts *counts) {
+  RoundTripStats waits;
+  roundTripSnapshot(&waits);
+  *counts = (TrafficCounts){
+      .requests = load(&totalRequests),
+      .bytes = load(&totalBytes),
+      .waits = waits.waits,
+      .roundTrips = waits.roundTrips,
+      .blockedNs = waits.blockedNs,
+  };
+}
+
+static inline uint64_t max64(uint64_t a, uint64_t b) { return a > b ? a : b; }
+
+static TrafficCounts difference(const TrafficCounts *now,
+                                const TrafficCounts *last) {
+  return (TrafficCounts){
+      .requests = now->requests - last->requests,
+      .bytes = now->bytes - last->bytes,
+      .waits = now->waits - last->waits,
+      .roundTrips = now->roundTrips - last->roundTrips,
+      .blockedNs = now->blockedNs - last->blockedNs,
+  };
+}
+
+static TrafficCounts maximum(const TrafficCounts *a, const TrafficCounts *b) {
+  return (TrafficCounts){
+      .requests = max64(a->requests, b->requests),
+      .bytes = max64(a->bytes, b->bytes),
+      .waits = max64(a->waits, b->waits),
+      .roundTrips = max64(a->roundTrips, b->roundTrips),
+      .blockedNs = max64(a->blockedNs, b->blockedNs),
+  };
+}
+
+//
+// Start counting frames from now.
+//
+// Returns 0 on success, or -1 if there was no memory for the per opcode
+// counts. The totals are still counted per frame then.
+//
+int trafficMeterInit(TrafficMeter *m) {
+  *m = (TrafficMeter){};
+  trafficSnapshot(&m->start);
+  m->last = m->start;
+
+  m->slots = calloc(TRAFFIC_SLOTS, sizeof(TrafficSlotFrames));
+  if (!m->slots) {
+    return -1;
+  }
+  for (uint32_t slot = 0; slot < TRAFFIC_SLOTS; slot++) {
+    copy(&m->slots[slot].last, &counters[slot]);
+  }
+  return 0;
+}
+
+void trafficMeterDestroy(TrafficMeter *m) {
+  free(m->slots);
+  m->slots = nullptr;
+}
+
+static void slotFrame(TrafficMeter *m, uint32_t slot) {
+  TrafficSlotFrames *f = &m->slots[slot];
+  TrafficCounts now;
+  copy(&now, &counters[slot]);
+  f->frame = difference(&now, &f->last);
+  f->max = maximum(&f->max, &f->frame);
+  f->last = now;
+}
+
+//
+// End a frame. Everything since the last call is the frame's traffic.
+//
+// Only the opcodes of the core protocol and of the extensions used so far
+// are looked at, which is a few hundred slots rather than all of them.
+//
+void trafficFrame(TrafficMeter *m) {
+  TrafficCounts now;
+  trafficSnapshot(&now);
+
+  m->frame = difference(&now, &m->last);
+  m->max = maximum(&m->max, &m->frame);
+  m->last = now;
+  m->frames++;
+
+  if (!m->slots) {
+    return;
+  }
+  for (uint32_t op = 0; op < 256; op++) {
+    slotFrame(m, SLOT_CORE + op);
+  }
+  for (uint32_t i = 0; i < TRAFFIC_EXTENSIONS; i++) {
+    if (!atomic_load_explicit(&extensions[i], memory_order_acquire)) {
+      break;
+    }
+    for (uint32_t op = 0; op < 256; op++) {
+      slotFrame(m, SLOT_EXTENSIONS + i * 256 + op);
+    }
+  }
+  slotFrame(m, SLOT_OTHER);
+}
+
+// The request's name from the tables gen_protocol.py made from xcb-proto
+static const char *requestName(const xcb_extension_t *ext, uint8_t opcode) {
+  const ProtocolExtension *p = nullptr;
+  if (!ext) {
+    p = &protocolCore;
+  } else {
+    for (uint32_t i = 0; i < protocolExtensionCount; i++) {
+      if (strcmp(protocolExtensions[i].xname, ext->name) == 0) {
+        p = &protocolExtensions[i];
+        break;
+      }
+    }
+  }
+  if (p && opcode < p->nRequests && p->requests[opcode]) {
+    return p->requests[opcode];
+  }
+  return "Unknown";
+}
+
+static void writeCounts(FILE *out, const TrafficCounts *c) {
+  fprintf(out,
+          "\"requests\": %llu, \"bytes\": %llu, \"waits\": %llu, "
+          "\"round_trips\": %llu, \"blocked_us\": %.1f",
+          (unsigned long long)c->requests, (unsigned long long)c->bytes,
+          (unsigned long long)c->waits, (unsigned long long)c->roundTrips,
+          c->blockedNs / 1e3);
+}
+
+static void writeSlot(FILE *out, const TrafficMeter *m, const char *extension,
+                      const char *name, uint32_t slot, bool *first) {
+  TrafficCounts c;
+  copy(&c, &counters[slot]);
+  if (!c.requests && !c.waits) {
+    return;
+  }
+  fprintf(out, "%s\n    {\"extension\": \"%s\", \"request\": \"%s\", ",
+          *first ? "" : ",", extension, name);
+  writeCounts(out, &c);
+  if (m && m->frames && m->slots) {
+    fprintf(out, ",\n     \"last_frame\": {");
+    writeCounts(out, &m->slots[slot].frame);
+    fprintf(out, "}, \"max_frame\": {");
+    writeCounts(out, &m->slots[slot].max);
+    fprintf(out, "}");
+  }
+  fprintf(out, "}");
+  *first = false;
+}
+
+//
+// Write the totals, the per frame figures and every opcode that was used as
+// JSON. With frames counted each opcode also has its last frame and its
+// largest frame. m may be nullptr if frames were not counted.
+//
+void trafficWriteJson(FILE *out, const TrafficMeter *m) {
+  TrafficCounts total;
+  trafficSnapshot(&total);
+
+  fprintf(out, "{\n  \"total\": {");
+  writeCounts(out, &total);
+  fprintf(out, "},\n");
+
+  if (m && m->frames) {
+    fprintf(out,
+            "  \"frames\": %llu,\n  \"per_frame\": {\"requests\": %.2f, "
+            "\"bytes\": %.1f, \"waits\": %.2f, \"round_trips\": %.2f, "
+            "\"blocked_us\": %.1f},\n",
+            (unsigned long long)m->frames,
+            (double)(m->last.requests - m->start.requests) / m->frames,
+            (double)(m->last.bytes - m->start.bytes) / m->frames,
+            (double)(m->last.waits - m->start.waits) / m->frames,
+            (double)(m->last.roundTrips - m->start.roundTrips) / m->frames,
+            (m->last.blockedNs - m->start.blockedNs) / 1e3 / m->frames);
+    fprintf(out, "  \"last_frame\": {");
+    writeCounts(out, &m->frame);
+    fprintf(out, "},\n  \"max_frame\": {");
+    writeCounts(out, &m->max);
+    fprintf(out, "},\n");
+  }
+
+  fprintf(out, "  \"opcodes\": [");
+  bool first = true;
+  for (uint32_t op = 0; op < 256; op++) {
+    writeSlot(out, m, "core", requestName(nullptr, op), SLOT_CORE + op,
+              &first);
+  }
+  for (uint32_t i = 0; i < TRAFFIC_EXTENSIONS; i++) {
+    const xcb_extension_t *ext =
+        atomic_load_explicit(&extensions[i], memory_order_acquire);
+    if (!ext) {
+      break;
+    }
+    for (uint32_t op = 0; op < 256; op++) {
+      writeSlot(out, m, ext->name, requestName(ext, op),
+                SLOT_EXTENSIONS + i * 256 + op, &first);
+    }
+  }
+  writeSlot(out, m, "other", "other", SLOT_OTHER, &first);
+  fprintf(out, "\n  ]\n}\n");
+}
+
+//
+// Write the JSON to the file named by an environment variable, or to
+// stdout if it is "-". Nothing is written if it is not set.
+//
+// Returns 0 on success or when nothing was asked for, -1 if the file could
+// not be written.
+//
+int trafficWriteJsonToEnv(const char *variable, const TrafficMeter *m) {
+  const char *path = getenv(variable);
+  if (!path || !*path) {
+    return 0;
+  }
+  if (strcmp(path, "-") == 0) {
+    trafficWriteJson(stdout, m);
+    return 0;
+  }
+
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    return -1;
+  }
+  trafficWriteJson(out, m);
+  return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,71 @@
+#ifndef TRAFFIC_H_20261017
+#define TRAFFIC_H_20261017
+
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+// Requests remembered by sequence number, so a reply can be charged to the
+// request that asked for it. Must be a power of two.
+#define TRAFFIC_RECENT 4096
+
+// Extensions with counters of their own. Requests of any more are counted
+// together under "other".
+#define TRAFFIC_EXTENSIONS 16
+
+// Core requests, 256 minor opcodes for each extension, then "other"
+#define TRAFFIC_SLOTS (256 + TRAFFIC_EXTENSIONS * 256 + 1)
+
+typedef struct {
+  uint64_t requests;   // Requests sent
+  uint64_t bytes;      // Bytes of those requests
+  uint64_t waits;      // Replies or checks waited on
+  uint64_t roundTrips; // Waits that had to block for the server
+  uint64_t blockedNs;  // Time spent blocked
+} TrafficCounts;
+
+//
+// Traffic on the wire, counted per opcode.
+//
+// Linking the xcb_roundtrip library wraps xcb_send_request and its 64 bit
+// and fd passing versions, which every generated request function goes
+// through, next to the reply wrappers in roundtrip.c. Every counter is a
+// relaxed atomic add and nothing takes a lock, so it costs a few adds per
+// request and can stay on.
+//
+// The totals are kept for the whole program. A TrafficMeter turns them into
+// counts per frame by taking the difference each time trafficFrame is
+// called, both for the totals and for every opcode, so the JSON says which
+// requests the last frame sent and the most of each that any frame sent.
+//
+typedef struct {
+  TrafficCounts last;  // The opcode's totals at the previous trafficFrame
+  TrafficCounts frame; // The most recent frame
+  TrafficCounts max;   // The most in any one frame
+} TrafficSlotFrames;
+
+typedef struct {
+  TrafficCounts start; // Totals at trafficMeterInit
+  TrafficCounts last;  // Totals at the previous trafficFrame
+  TrafficCounts frame; // The most recent frame
+  TrafficCounts max;   // The most of each in any one frame
+  uint64_t frames;
+
+  // TRAFFIC_SLOTS of them, nullptr if they could not be allocated
+  TrafficSlotFrames *slots;
+} TrafficMeter;
+
+void trafficSnapshot(TrafficCounts *counts);
+int trafficMeterInit(TrafficMeter *m);
+void trafficMeterDestroy(TrafficMeter *m);
+void trafficFrame(TrafficMeter *m);
+void trafficWriteJson(FILE *out, const TrafficMeter *m);
+int trafficWriteJsonToEnv(const char *variable, const TrafficMeter *m);
+
+// Called by the wrappers in roundtrip.c
+void trafficSent(const xcb_protocol_request_t *request, uint64_t bytes,
+                 uint64_t sequence);
+void trafficWaited(uint64_t sequence, bool blocked, uint64_t ns);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "visual.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+//
+// This function searches for the requested depth. It then searches for an
+// appropriate visual. Finally, it creates a color map for the
+// depth and visual.
+//
+// NOTE: The color map created by this should be freed using 
+// xcb_free_colormap when it is no longer needed.
+//
+// When a journal is given the colormap is created unchecked and recorded in
+// the journal, so no round trip is needed. Any error shows up later in the
+// event loop, where the journal can name the request. Without a journal the
+// request is checked and errors are reported here.
+//
+int findDepthAndVisual(      //
+    xcb_connection_t *c,     ///> server connection
+    xcb_screen_t *screen,    /// xcb Screen
+    const uint8_t depth,     /// The desired screen depth i.e. 24 or 32
+    VisualConfig *cfg,       /// structure in which to write results
+    RequestJournal *journal  /// journal for unchecked requests, or nullptr
+) {
+
+  // Get an iterator for the screen's available depths
+  xcb_depth_iterator_t d = xcb_screen_allowed_depths_iterator(screen);
+
+  bool depthFound = false;
+  while (d.rem) {
+    // Find an xcb_depth_t with the correct depth and that has visuals
+    if (d.data->depth == depth && d.data->visuals_len) {
+      cfg->depth = d.data;
+      depthFound = true;
+      break;
+    }
+    xcb_depth_next(&d);
+  }
+  if (!depthFound) {
+    return -1;
+  }
+
+  bool visualFound = false;
+  // Search for a suitable visual
+  for (xcb_visualtype_iterator_t v = xcb_depth_visuals_iterator(cfg->depth);
+       v.rem; xcb_visualtype_next(&v)) {
+    if (v.data->_class == XCB_VISUAL_CLASS_TRUE_COLOR) {
+      cfg->visual = v.data;
+      visualFound = true;
+      break;
+    }
+  }
+  if (!visualFound) {
+    fprintf(stderr, "Failed to find visual");
+    return -2;
+  }
+
+  cfg->colormap = xcb_generate_id(c);
+
+  if (journal) {
+    xcb_void_cookie_t cookie =
+        xcb_create_colormap(c, XCB_COLORMAP_ALLOC_NONE, cfg->colormap,
+                            screen->root, cfg->visual->visual_id);
+    journalRecord(journal, cookie, "xcb_create_colormap", cfg->colormap);
+    return 0;
+  }
+
+  xcb_void_cookie_t cookie =
+      xcb_create_colormap_checked(c, XCB_COLORMAP_ALLOC_NONE, cfg->colormap,
+                                  screen->root, cfg->visual->visual_id);
+
+  xcb_generic_error_t *error = xcb_request_check(c, cookie);
+  if (error) {
+    fprintf(stderr, "Fail to create colormap\n");
+    free(error);
+    return -3;
+  }
+
+  return 0;
+}
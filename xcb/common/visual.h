@@ -0,0 +1,20 @@
+#ifndef VISUAL_H_20261017
+#define VISUAL_H_20261017
+
+#include "journal.h"
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+// This structure is used to store the results of the findDepthAndVisul function
+typedef struct {
+    xcb_depth_t* depth;
+    xcb_visualtype_t* visual;
+    xcb_colormap_t colormap;
+
+} VisualConfig;
+
+int findDepthAndVisual(xcb_connection_t *c, xcb_screen_t *screen,
+                       const uint8_t depth, VisualConfig *cfg,
+                       RequestJournal *journal);
+
+#endif
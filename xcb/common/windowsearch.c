@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "windowsearch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xproto.h>
+
+// True if the window's WM_NAME is name
+static bool hasName(xcb_connection_t *c, xcb_window_t window,
+                    const char *name) {
+  xcb_get_property_reply_t *reply = xcb_get_property_reply(
+      c,
+      xcb_get_property(c, 0, window, XCB_ATOM_WM_NAME, XCB_ATOM_ANY, 0, 256),
+      nullptr);
+  if (!reply) {
+    return false;
+  }
+  const int length = xcb_get_property_value_length(reply);
+  const bool match = length == (int)strlen(name) &&
+                     memcmp(xcb_get_property_value(reply), name, length) == 0;
+  free(reply);
+  return match;
+}
+
+static xcb_window_t search(xcb_connection_t *c, xcb_window_t parent,
+                           const char *name, int depth) {
+  xcb_query_tree_reply_t *tree =
+      xcb_query_tree_reply(c, xcb_query_tree(c, parent), nullptr);
+  if (!tree) {
+    return XCB_NONE;
+  }
+
+  xcb_window_t found = XCB_NONE;
+  const xcb_window_t *children = xcb_query_tree_children(tree);
+  const int count = xcb_query_tree_children_length(tree);
+  for (int i = 0; i < count && !found; i++) {
+    if (hasName(c, children[i], name)) {
+      found = children[i];
+    } else if (depth > 1) {
+      found = search(c, children[i], name, depth - 1);
+    }
+  }
+  free(tree);
+  return found;
+}
+
+//
+// Depth first search below root for a window whose WM_NAME is name, for
+// tools that act on another program's window.
+//
+// Every window looked at costs two round trips, which is fine for finding
+// a window once but not for anything done often.
+//
+// Returns XCB_NONE if there is no such window.
+//
+xcb_window_t findWindowByName(xcb_connection_t *c, xcb_window_t root,
+                              const char *name) {
+  return search(c, root, name, WINDOW_SEARCH_DEPTH);
+}
+
+// A number, in any base strtoul understands, is taken as a window id and
+// anything else as a name for findWindowByName
+xcb_window_t findWindowByIdOrName(xcb_connection_t *c, xcb_window_t root,
+                                  const char *idOrName) {
+  char *end;
+  const unsigned long id = strtoul(idOrName, &end, 0);
+  if (*idOrName && !*end && id) {
+    return (xcb_window_t)id;
+  }
+  return findWindowByName(c, root, idOrName);
+}
+
+//
+// Find where the window is on the root and give it the input focus, so
+// that key presses injected with XTEST go to it.
+//
+// Returns 0 on success, -1 if the window does not exist.
+//
+int focusWindow(xcb_connection_t *c, xcb_window_t root, xcb_window_t window,
+                WindowArea *area) {
+  xcb_get_geometry_reply_t *geometry =
+      xcb_get_geometry_reply(c, xcb_get_geometry(c, window), nullptr);
+  xcb_translate_coordinates_reply_t *origin = xcb_translate_coordinates_reply(
+      c, xcb_translate_coordinates(c, window, root, 0, 0), nullptr);
+  if (!geometry || !origin) {
+    free(geometry);
+    free(origin);
+    return -1;
+  }
+
+  *area = (WindowArea){
+      .x = origin->dst_x,
+      .y = origin->dst_y,
+      .width = geometry->width,
+      .height = geometry->height,
+  };
+  free(geometry);
+  free(origin);
+
+  xcb_set_input_focus(c, XCB_INPUT_FOCUS_POINTER_ROOT, window,
+                      XCB_CURRENT_TIME);
+  return 0;
+}
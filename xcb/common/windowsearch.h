@@ -0,0 +1,24 @@
+#ifndef WINDOWSEARCH_H_20261017
+#define WINDOWSEARCH_H_20261017
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+// How deep below the root to look. Window managers put the client's window
+// inside a frame or two.
+#define WINDOW_SEARCH_DEPTH 3
+
+// Where a window is, in root window coordinates
+typedef struct {
+  int16_t x, y; // Top left corner
+  uint16_t width, height;
+} WindowArea;
+
+xcb_window_t findWindowByName(xcb_connection_t *c, xcb_window_t root,
+                              const char *name);
+xcb_window_t findWindowByIdOrName(xcb_connection_t *c, xcb_window_t root,
+                                  const char *idOrName);
+int focusWindow(xcb_connection_t *c, xcb_window_t root, xcb_window_t window,
+                WindowArea *area);
+
+#endif
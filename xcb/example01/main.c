@@ -23,7 +23,10 @@
  *
  */
 
-#include "util.h"
+#include "dispatch.h"
+#include "events.h"
+#include "latency.h"
+#include "protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -51,6 +54,54 @@ static struct {
 // Chanel order: alpha red green blue
 #define BG_COLOR 0xFF404050
 
+#define ESCAPE_KEYCODE 9
+
+// State shared with the event handlers
+static struct {
+  bool should_exit;
+} app = {};
+
+//---------------------------------------------------------------------------
+// Event handlers
+//
+// Each handler is registered with the dispatcher once before the event loop
+// starts. The dispatcher looks the handler up by event type in a table, so
+// there is no switch to grow as more events are handled.
+
+// An xcb error has occured
+static void onError(xcb_generic_event_t *event, void *) {
+  xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+
+  const char *const error_type = protocolErrorName(error->error_code);
+  const char *const request =
+      protocolRequestName(error->major_code, error->minor_code);
+
+  // Extension requests are told apart by their minor opcode, so name the
+  // extension as well
+  const char *const extension = protocolExtensionName(error->major_code);
+  if (extension) {
+    fprintf(stderr, "XCB %s %s %s error\n\n", extension, request,
+            error_type);
+  } else {
+    fprintf(stderr, "XCB %s %s error. Minor opcode %d\n\n", request,
+            error_type, error->minor_code);
+  }
+}
+
+// A key press event
+static void onKeyPress(xcb_generic_event_t *event, void *) {
+  // The event is a key press. Cast the event to a key press event
+  xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+
+  // print the keycode received
+  printf("Keycode: %d\n", press->detail);
+
+  // If escape is pressed
+  if (ESCAPE_KEYCODE == press->detail) {
+    app.should_exit = true;
+  }
+}
+
 int main(void) {
 
   // This will connect to the default display and screen 0
@@ -70,6 +121,10 @@ int main(void) {
     return -1;
   }
 
+  // Learn where the server put each extension's opcodes, errors and events
+  // so errors from any request can be named without another round trip
+  protocolInit(xcb.connection);
+
   // Print some information about your display just because we can
   printf("Your screen is %d x %d pixels\n\n", xcb.screen->width_in_pixels,
          xcb.screen->height_in_pixels);
@@ -132,56 +187,55 @@ int main(void) {
   xcb_flush(xcb.connection);
 
   // Event loop
+  //
+  // Events are handled in batches. The loop blocks once in xcb_wait_for_event
+  // and then takes every event xcb has already queued, so a burst of input
+  // costs one wakeup and one flush instead of one of each per event.
+  // Setting EVENT_BATCH_SIZE to 1 gives the one event per wakeup behaviour.
 
-  xcb_generic_event_t *event = nullptr;
-
-#define ESCAPE_KEYCODE 9
-
-  bool should_exit = false;
-  while ((event = xcb_wait_for_event(xcb.connection))) {
+#define EVENT_BATCH_SIZE EVENT_BATCH_MAX
 
-    switch (event->response_type & ~80) {
+  // Register a handler for each type of event the example cares about.
+  // Everything else is ignored.
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+  dispatcherSetHandler(&dispatcher, 0, onError, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_KEY_PRESS, onKeyPress, nullptr);
 
-    // Case an xcb error has occured
-    case 0: { // Error
-      xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+  EventBatch batch = {.capacity = EVENT_BATCH_SIZE};
+  EventBatchStats batchStats = {};
 
-      const char *const error_type = errorCodeToText(error->error_code);
-      const char *const opcode = opcodeToText(error->major_code);
+  // Run with XCB_EVENT_LATENCY=1 in the environment to record how long each
+  // type of event takes to get from the server to the end of its handler.
+  // The histograms are printed on exit, or as soon as the program receives
+  // SIGUSR1, which wakes the loop with a client message to the window.
+  LatencyTracker *latency = latencyCreateFromEnv(xcb.connection, window1,
+                                                 "XCB_EVENT_LATENCY");
 
-      fprintf(stderr, "XCB %s %s error. Minor opcode %d\n\n", opcode,
-              error_type, error->minor_code);
-      break;
-    }
+  while (!app.should_exit &&
+         waitForEventBatch(xcb.connection, &batch, &batchStats)) {
 
-    // A key press event
-    case XCB_KEY_PRESS: {
-      // The event is a key press. Cast the event to a key press event
-      xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+    const uint64_t received = latency ? latencyNow() : 0;
 
-      // print the keycode received
-      printf("Keycode: %d\n", press->detail);
+    for (uint32_t i = 0; i < batch.count; i++) {
+      dispatchEvent(&dispatcher, batch.events[i]);
 
-      // If escape is pressed
-      if (ESCAPE_KEYCODE == press->detail) {
-        should_exit = true;
+      if (latency) {
+        latencyRecord(latency, batch.events[i], received, latencyNow());
       }
-      break;
     }
 
-    default: {
-      break;
-    }
-
-    } // end switch
-
-    free(event);
+    latencyDumpIfSignalled(stdout, latency);
+    freeEventBatch(&batch);
 
-    if (should_exit) {
-      break;
-    }
+    // Send anything the handlers queued up to the server all at once
+    xcb_flush(xcb.connection);
   }
 
+  printEventBatchStats(stdout, &batchStats);
+  latencyDestroy(latency, stdout);
+  dispatcherDestroy(&dispatcher);
+
   xcb_destroy_window(xcb.connection, window1);
 
   // Close connection and free resources
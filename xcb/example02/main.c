@@ -23,7 +23,11 @@
  *
  */
 
-#include "util.h"
+#include "atoms.h"
+#include "dispatch.h"
+#include "events.h"
+#include "latency.h"
+#include "protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -51,6 +55,69 @@ static struct {
 // Chanel order: alpha red green blue
 #define BG_COLOR 0xFF404050
 
+#define ESCAPE_KEYCODE 9
+
+// State shared with the event handlers
+static struct {
+  Atoms atoms;
+  bool should_exit;
+} app = {};
+
+//---------------------------------------------------------------------------
+// Event handlers
+//
+// Each handler is registered with the dispatcher once before the event loop
+// starts. The dispatcher looks the handler up by event type in a table, so
+// there is no switch to grow as more events are handled.
+
+// An xcb error has occured
+static void onError(xcb_generic_event_t *event, void *) {
+  xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+
+  const char *const error_type = protocolErrorName(error->error_code);
+  const char *const request =
+      protocolRequestName(error->major_code, error->minor_code);
+
+  // Extension requests are told apart by their minor opcode, so name the
+  // extension as well
+  const char *const extension = protocolExtensionName(error->major_code);
+  if (extension) {
+    fprintf(stderr, "XCB %s %s %s error\n\n", extension, request,
+            error_type);
+  } else {
+    fprintf(stderr, "XCB %s %s error. Minor opcode %d\n\n", request,
+            error_type, error->minor_code);
+  }
+}
+
+// A key press event
+static void onKeyPress(xcb_generic_event_t *event, void *) {
+  // The event is a key press. Cast the event to a key press event
+  xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+
+  // print the keycode received
+  printf("Keycode: %d\n", press->detail);
+
+  // If escape is pressed
+  if (ESCAPE_KEYCODE == press->detail) {
+    app.should_exit = true;
+  }
+}
+
+// Received a client message
+static void onClientMessage(xcb_generic_event_t *event, void *) {
+  xcb_client_message_event_t *cmessage = (xcb_client_message_event_t *)event;
+
+  if (cmessage->type == app.atoms.WM_PROTOCOLS) {
+
+    // Check to see if client message is of type WM_DELETE_WINDOW
+    if (cmessage->data.data32[0] == app.atoms.WM_DELETE_WINDOW) {
+      // WM_DELETE_WINDOW message recieved, set should exit to true
+      app.should_exit = true;
+    }
+  }
+}
+
 int main(void) {
 
   // This will connect to the default display and screen 0
@@ -70,6 +137,10 @@ int main(void) {
     return -1;
   }
 
+  // Learn where the server put each extension's opcodes, errors and events
+  // so errors from any request can be named without another round trip
+  protocolInit(xcb.connection);
+
   // Print some information about your display just because we can
   printf("Your screen is %d x %d pixels\n\n", xcb.screen->width_in_pixels,
          xcb.screen->height_in_pixels);
@@ -127,106 +198,79 @@ int main(void) {
   );
 
   // Fix the problem with pressing the close button
-  // First, get the value of the WM_PROTOCOLS atom.
-  xcb_intern_atom_cookie_t internAtomCookie = xcb_intern_atom(
-      xcb.connection, 1, 12 , "WM_PROTOCOLS");
-  xcb_intern_atom_reply_t *reply =
-      xcb_intern_atom_reply(xcb.connection, internAtomCookie, nullptr);
-  xcb_atom_t wm_protocols = reply->atom;
-  if (wm_protocols == 0) {
-    fprintf(stderr, "Unable to get WM_PROTOCOLS atom\n");
+  // First, get the values of the WM_PROTOCOLS and WM_DELETE_WINDOW atoms.
+  // Both requests are sent before waiting on either reply, so this costs one
+  // round trip to the server instead of two. See ../common/atoms.c
+  if (internAtoms(xcb.connection, &app.atoms)) {
+    fprintf(stderr, "Unable to get WM_PROTOCOLS or WM_DELETE_WINDOW atom\n");
   }
-  free(reply);
-
-  // Second, get the value of the WM_DELETE_WINDOW atom.
-  internAtomCookie = xcb_intern_atom(
-      xcb.connection, 1, 16, "WM_DELETE_WINDOW");
-  reply = xcb_intern_atom_reply(xcb.connection, internAtomCookie, nullptr);
-  xcb_atom_t wm_delete_window = reply->atom;
-  if (wm_delete_window == 0) {
-    fprintf(stderr, "Unable to get WM_DELETE_WINDOW atom\n");
-  }
-  free(reply);
 
   // Finally, send the change property command to register to receive the
   // WM_DELETE_WINDOW message
   xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
-                      wm_protocols, XCB_ATOM, 32, 1, &wm_delete_window);
+                      app.atoms.WM_PROTOCOLS, XCB_ATOM, 32, 1,
+                      &app.atoms.WM_DELETE_WINDOW);
 
   // Make the window visiable
   xcb_map_window(xcb.connection, window1);
   xcb_flush(xcb.connection);
 
   // Event loop
-
-  xcb_generic_event_t *event = nullptr;
-
-#define ESCAPE_KEYCODE 9
-
-  bool should_exit = false;
-  while ((event = xcb_wait_for_event(xcb.connection))) {
-
-    switch (event->response_type & ~80) {
-
-    // Case an xcb error has occured
-    case 0: { // Error
-      xcb_generic_error_t *error = (xcb_generic_error_t *)event;
-
-      const char *const error_type = errorCodeToText(error->error_code);
-      const char *const opcode = opcodeToText(error->major_code);
-
-      fprintf(stderr, "XCB %s %s error. Minor opcode %d\n\n", opcode,
-              error_type, error->minor_code);
-      break;
-    }
-
-    // A key press event
-    case XCB_KEY_PRESS: {
-      // The event is a key press. Cast the event to a key press event
-      xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
-
-      // print the keycode received
-      printf("Keycode: %d\n", press->detail);
-
-      // If escape is pressed
-      if (ESCAPE_KEYCODE == press->detail) {
-        should_exit = true;
+  //
+  // Events are handled in batches. The loop blocks once in xcb_wait_for_event
+  // and then takes every event xcb has already queued, so a burst of input
+  // costs one wakeup and one flush instead of one of each per event.
+  // Setting EVENT_BATCH_SIZE to 1 gives the one event per wakeup behaviour.
+
+#define EVENT_BATCH_SIZE EVENT_BATCH_MAX
+
+  // Register a handler for each type of event the example cares about.
+  // Everything else is ignored.
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+  dispatcherSetHandler(&dispatcher, 0, onError, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_KEY_PRESS, onKeyPress, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_CLIENT_MESSAGE, onClientMessage,
+                       nullptr);
+
+  EventBatch batch = {.capacity = EVENT_BATCH_SIZE};
+  EventBatchStats batchStats = {};
+
+  // Run with XCB_EVENT_LATENCY=1 in the environment to record how long each
+  // type of event takes to get from the server to the end of its handler.
+  // The histograms are printed on exit, or as soon as the program receives
+  // SIGUSR1, which wakes the loop with a client message to the window.
+  LatencyTracker *latency = latencyCreateFromEnv(xcb.connection, window1,
+                                                 "XCB_EVENT_LATENCY");
+
+  while (!app.should_exit &&
+         waitForEventBatch(xcb.connection, &batch, &batchStats)) {
+
+    const uint64_t received = latency ? latencyNow() : 0;
+
+    for (uint32_t i = 0; i < batch.count; i++) {
+      dispatchEvent(&dispatcher, batch.events[i]);
+
+      if (latency) {
+        latencyRecord(latency, batch.events[i], received, latencyNow());
       }
-      break;
     }
 
-    // Received a client message
-    case XCB_CLIENT_MESSAGE: {
-      xcb_client_message_event_t *cmessage =
-          (xcb_client_message_event_t *)event;
+    latencyDumpIfSignalled(stdout, latency);
+    freeEventBatch(&batch);
 
-      if (cmessage->type == wm_protocols) {
-
-        // Check to see if client message is of type WM_DELETE_WINDOW
-        if (cmessage->data.data32[0] == wm_delete_window) {
-          // WM_DELETE_WINDOW message recieved, set should exit to true
-          should_exit = true;
-        }
-      }
-      break;
-    }
-
-    default: {
-      break;
-    }
-
-    } // end switch
-
-    free(event);
-
-    if (should_exit) {
-      break;
-    }
+    // Send anything the handlers queued up to the server all at once
+    xcb_flush(xcb.connection);
   }
 
+  printEventBatchStats(stdout, &batchStats);
+  latencyDestroy(latency, stdout);
+  dispatcherDestroy(&dispatcher);
+
   xcb_destroy_window(xcb.connection, window1);
 
   // Close connection and free resources
+  atomCacheClear();
   xcb_disconnect(xcb.connection);
   return 0;
 }
@@ -1,9 +0,0 @@
-#ifndef UTIL_H_20241224
-#define UTIL_H_20241224
-
-#include<stdint.h>
-
-const char *errorCodeToText(uint8_t error_code);
-const char *opcodeToText(uint8_t opcode);
-
-#endif
@@ -23,7 +23,14 @@
  *
  */
 
-#include "util.h"
+#include "atoms.h"
+#include "blend.h"
+#include "dispatch.h"
+#include "events.h"
+#include "journal.h"
+#include "latency.h"
+#include "protocol.h"
+#include "visual.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,79 +54,72 @@ static struct {
 // NOTE: The oreder of the color chanels are a little different than what is
 // typically used.
 // Chanel order: alpha red green blue
+//
+// This is the straight, or unpremultiplied, color. Compositors expect the
+// red, green and blue of a 32 bit window to already be multiplied by alpha,
+// so it is passed through blendPremultiplyColor before being used.
 #define BG_COLOR 0xA0404050
 
 #define WIN_WIDTH 400
 #define WIN_HEIGHT 300
 
-// This structure is used to store the results of the findDepthAndVisul function
-typedef struct {
-    xcb_depth_t* depth;
-    xcb_visualtype_t* visual;
-    xcb_colormap_t colormap;
+#define ESCAPE_KEYCODE 9
 
-} VisualConfig;
+// State shared with the event handlers
+static struct {
+  Atoms atoms;
+  bool should_exit;
 
+  // Unchecked requests, so errors can be traced back to them
+  RequestJournal journal;
+} app = {};
+
+//---------------------------------------------------------------------------
+// Event handlers
 //
-// This function searches for the requested depth. It then searches for an
-// appropriate visual. Finally, it creates a color map for the
-// depth and visual.
-//
-// NOTE: The color map created by this should be freed using 
-// xcb_free_colormap when it is no longer needed.
-//
-int findDepthAndVisual(   //
-    xcb_connection_t *c,  ///> server connection
-    xcb_screen_t *screen, /// xcb Screen
-    const uint8_t depth,  /// The desired screen depth i.e. 24 or 32
-    VisualConfig *cfg     /// structure in which to write results
-) {
-
-  // Get an iterator for the screen's available depths
-  xcb_depth_iterator_t d = xcb_screen_allowed_depths_iterator(screen);
-
-  bool depthFound = false;
-  while (d.rem) {
-    // Find an xcb_depth_t with the correct depth and that has visuals
-    if (d.data->depth == depth && d.data->visuals_len) {
-      cfg->depth = d.data;
-      depthFound = true;
-      break;
-    }
-    xcb_depth_next(&d);
-  }
-  if (!depthFound) {
-    return -1;
-  }
+// Each handler is registered with the dispatcher once before the event loop
+// starts. The dispatcher looks the handler up by event type in a table, so
+// there is no switch to grow as more events are handled.
 
-  bool visualFound = false;
-  // Search for a suitable visual
-  for (xcb_visualtype_iterator_t v = xcb_depth_visuals_iterator(cfg->depth);
-       v.rem; xcb_visualtype_next(&v)) {
-    if (v.data->_class == XCB_VISUAL_CLASS_TRUE_COLOR) {
-      cfg->visual = v.data;
-      visualFound = true;
-      break;
-    }
-  }
-  if (!visualFound) {
-    fprintf(stderr, "Failed to find visual");
-    return -2;
-  }
+// An xcb error has occured
+static void onError(xcb_generic_event_t *event, void *) {
+  xcb_generic_error_t *error = (xcb_generic_error_t *)event;
 
-  cfg->colormap = xcb_generate_id(c);
-  xcb_void_cookie_t cookie =
-      xcb_create_colormap_checked(c, XCB_COLORMAP_ALLOC_NONE, cfg->colormap,
-                                  screen->root, cfg->visual->visual_id);
-
-  xcb_generic_error_t *error = xcb_request_check(c, cookie);
-  if (error) {
-    fprintf(stderr, "Fail to create colormap\n");
-    free(error);
-    return -3;
+  const char *const error_type = protocolErrorName(error->error_code);
+  const char *const opcode =
+      protocolRequestName(error->major_code, error->minor_code);
+
+  // Errors for unchecked requests only carry a sequence number. The journal
+  // turns that back into the request that failed.
+  journalReportError(stderr, &app.journal, error, error_type, opcode);
+}
+
+// A key press event
+static void onKeyPress(xcb_generic_event_t *event, void *) {
+  // The event is a key press. Cast the event to a key press event
+  xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+
+  // print the keycode received
+  printf("Keycode: %d\n", press->detail);
+
+  // If escape is pressed
+  if (ESCAPE_KEYCODE == press->detail) {
+    app.should_exit = true;
   }
+}
 
-  return 0;
+// Received a client message
+static void onClientMessage(xcb_generic_event_t *event, void *) {
+  xcb_client_message_event_t *cmessage = (xcb_client_message_event_t *)event;
+
+  if (cmessage->type == app.atoms.WM_PROTOCOLS) {
+
+    // Check to see if client message is of type WM_DELETE_WINDOW
+    if (cmessage->data.data32[0] == app.atoms.WM_DELETE_WINDOW) {
+      // WM_DELETE_WINDOW message recieved, set should exit to true
+      app.should_exit = true;
+    }
+  }
 }
 
 int main(void) {
@@ -141,15 +141,23 @@ int main(void) {
     return -1;
   }
 
+  // Learn where the server put each extension's opcodes, errors and events
+  // so errors from any request can be named without another round trip
+  protocolInit(xcb.connection);
+
   // Print some information about your display just because we can
   printf("Your screen is %d x %d pixels\n\n", xcb.screen->width_in_pixels,
          xcb.screen->height_in_pixels);
 
   // To support transparency, we need 32 bit depth and a visual that
   // supports it. We'll also need to generate a new colormap 
+  //
+  // The colormap is created unchecked and recorded in the journal rather
+  // than waiting to hear whether it worked. If it failed, the error handler
+  // will say so.
   VisualConfig cfg = {};
 
-  if( findDepthAndVisual(xcb.connection, xcb.screen, 32, &cfg) ) {
+  if( findDepthAndVisual(xcb.connection, xcb.screen, 32, &cfg, &app.journal) ) {
       fprintf(stderr, "Error finding depth and visul\n");
       xcb_disconnect(xcb.connection);
       return -1;
@@ -170,9 +178,11 @@ int main(void) {
   // XCB_CW_BACK_PIXEL = 2
   // XCB_CW_BORDER_PIXEL = 8
   // XCB_CW_EVENT_MASK =  2048
+  const uint32_t background = blendPremultiplyColor(BG_COLOR);
+
   uint32_t values[] = {
-      BG_COLOR,                 // background color
-      BG_COLOR,                 // Border color
+      background,               // background color
+      background,               // Border color
       XCB_EVENT_MASK_KEY_PRESS, // Receive key press events
       cfg.colormap              // provide the colormap generated above
   };
@@ -180,6 +190,9 @@ int main(void) {
   // Generate an id for our window
   xcb_window_t window1 = xcb_generate_id(xcb.connection);
 
+  // Each request below is recorded in the journal so any error it causes can
+  // be matched back to it
+  xcb_void_cookie_t cookie =
   xcb_create_window(xcb.connection,    // connection to the X11 server
                     cfg.depth->depth, // Use the same depth as the parent
                     window1,           // Id of window to create
@@ -194,11 +207,13 @@ int main(void) {
                     valueMask, // Specify which values will be pased to server
                     values     // The actual values
   );
+  journalRecord(&app.journal, cookie, "xcb_create_window", window1);
 
   // Give the window a name
   const char *const wName = "Example 02";
   const uint32_t wNameLen = strlen(wName);
 
+  cookie =
   xcb_change_property(xcb.connection,        // Conection to the X11 server
                       XCB_PROP_MODE_REPLACE, // Replace the property
                       window1,               // The window to be modified
@@ -208,32 +223,23 @@ int main(void) {
                       wNameLen, // lenght of data
                       wName     // pointer the the actual data
   );
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_NAME", window1);
 
   // Fix the problem with pressing the close button
-  // First, get the value of the WM_PROTOCOLS atom.
-  xcb_intern_atom_cookie_t internAtomCookie =
-      xcb_intern_atom(xcb.connection, 1, 12, "WM_PROTOCOLS");
-  xcb_intern_atom_reply_t *reply =
-      xcb_intern_atom_reply(xcb.connection, internAtomCookie, nullptr);
-  xcb_atom_t wm_protocols = reply->atom;
-  if (wm_protocols == 0) {
-    fprintf(stderr, "Unable to get WM_PROTOCOLS atom\n");
+  // First, get the values of the WM_PROTOCOLS and WM_DELETE_WINDOW atoms.
+  // Both requests are sent before waiting on either reply, so this costs one
+  // round trip to the server instead of two. See ../common/atoms.c
+  if (internAtoms(xcb.connection, &app.atoms)) {
+    fprintf(stderr, "Unable to get WM_PROTOCOLS or WM_DELETE_WINDOW atom\n");
   }
-  free(reply);
-
-  // Second, get the value of the WM_DELETE_WINDOW atom.
-  internAtomCookie = xcb_intern_atom(xcb.connection, 1, 16, "WM_DELETE_WINDOW");
-  reply = xcb_intern_atom_reply(xcb.connection, internAtomCookie, nullptr);
-  xcb_atom_t wm_delete_window = reply->atom;
-  if (wm_delete_window == 0) {
-    fprintf(stderr, "Unable to get WM_DELETE_WINDOW atom\n");
-  }
-  free(reply);
 
   // Finally, send the change property command to register to receive the
   // WM_DELETE_WINDOW message
-  xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
-                      wm_protocols, XCB_ATOM, 32, 1, &wm_delete_window);
+  cookie = xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
+                               app.atoms.WM_PROTOCOLS, XCB_ATOM, 32, 1,
+                               &app.atoms.WM_DELETE_WINDOW);
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_PROTOCOLS",
+                window1);
 
   //
   // FIXED SIZE WINDOW
@@ -249,6 +255,7 @@ int main(void) {
       .min_width = WIN_WIDTH,
   };
 
+  cookie =
   xcb_change_property(xcb.connection,           // Connection to the X11 server
                       XCB_PROP_MODE_REPLACE,    // Replace the property
                       window1,                  // The window to be modified
@@ -258,86 +265,75 @@ int main(void) {
                       sizeof(xcb_size_hints_t) / 4, // size of data
                       &sizeHints // pointer to the data to be sent
   );
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_NORMAL_HINTS",
+                window1);
 
   //
   // Make the window visiable
   //
-  xcb_map_window(xcb.connection, window1);
+  cookie = xcb_map_window(xcb.connection, window1);
+  journalRecord(&app.journal, cookie, "xcb_map_window", window1);
   xcb_flush(xcb.connection);
 
   // Event loop
-
-  xcb_generic_event_t *event = nullptr;
-
-#define ESCAPE_KEYCODE 9
-
-  bool should_exit = false;
-  while ((event = xcb_wait_for_event(xcb.connection))) {
-
-    switch (event->response_type & ~80) {
-
-    // Case an xcb error has occured
-    case 0: { // Error
-      xcb_generic_error_t *error = (xcb_generic_error_t *)event;
-
-      const char *const error_type = errorCodeToText(error->error_code);
-      const char *const opcode = opcodeToText(error->major_code);
-
-      fprintf(stderr, "XCB %s %s error. Minor opcode %d\n\n", opcode,
-              error_type, error->minor_code);
-      break;
-    }
-
-    // A key press event
-    case XCB_KEY_PRESS: {
-      // The event is a key press. Cast the event to a key press event
-      xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
-
-      // print the keycode received
-      printf("Keycode: %d\n", press->detail);
-
-      // If escape is pressed
-      if (ESCAPE_KEYCODE == press->detail) {
-        should_exit = true;
-      }
-      break;
-    }
-
-    // Received a client message
-    case XCB_CLIENT_MESSAGE: {
-      xcb_client_message_event_t *cmessage =
-          (xcb_client_message_event_t *)event;
-
-      if (cmessage->type == wm_protocols) {
-
-        // Check to see if client message is of type WM_DELETE_WINDOW
-        if (cmessage->data.data32[0] == wm_delete_window) {
-          // WM_DELETE_WINDOW message recieved, set should exit to true
-          should_exit = true;
-        }
+  //
+  // Events are handled in batches. The loop blocks once in xcb_wait_for_event
+  // and then takes every event xcb has already queued, so a burst of input
+  // costs one wakeup and one flush instead of one of each per event.
+  // Setting EVENT_BATCH_SIZE to 1 gives the one event per wakeup behaviour.
+
+#define EVENT_BATCH_SIZE EVENT_BATCH_MAX
+
+  // Register a handler for each type of event the example cares about.
+  // Everything else is ignored.
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+  dispatcherSetHandler(&dispatcher, 0, onError, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_KEY_PRESS, onKeyPress, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_CLIENT_MESSAGE, onClientMessage,
+                       nullptr);
+
+  EventBatch batch = {.capacity = EVENT_BATCH_SIZE};
+  EventBatchStats batchStats = {};
+
+  // Run with XCB_EVENT_LATENCY=1 in the environment to record how long each
+  // type of event takes to get from the server to the end of its handler.
+  // The histograms are printed on exit, or as soon as the program receives
+  // SIGUSR1, which wakes the loop with a client message to the window.
+  LatencyTracker *latency = latencyCreateFromEnv(xcb.connection, window1,
+                                                 "XCB_EVENT_LATENCY");
+
+  while (!app.should_exit &&
+         waitForEventBatch(xcb.connection, &batch, &batchStats)) {
+
+    const uint64_t received = latency ? latencyNow() : 0;
+
+    for (uint32_t i = 0; i < batch.count; i++) {
+      dispatchEvent(&dispatcher, batch.events[i]);
+
+      if (latency) {
+        latencyRecord(latency, batch.events[i], received, latencyNow());
       }
-      break;
-    }
-
-    default: {
-      break;
     }
 
-    } // end switch
+    latencyDumpIfSignalled(stdout, latency);
+    freeEventBatch(&batch);
 
-    free(event);
-
-    if (should_exit) {
-      break;
-    }
+    // Send anything the handlers queued up to the server all at once
+    xcb_flush(xcb.connection);
   }
 
+  printEventBatchStats(stdout, &batchStats);
+  latencyDestroy(latency, stdout);
+  dispatcherDestroy(&dispatcher);
+
   xcb_destroy_window(xcb.connection, window1);
 
   // Free the color map generated at the begining of the program
   xcb_free_colormap(xcb.connection, cfg.colormap); 
 
   // Close connection and free resources
+  atomCacheClear();
   xcb_disconnect(xcb.connection);
   return 0;
 }
@@ -0,0 +1,333 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "atoms.h"
+#include "dispatch.h"
+#include "eventloop.h"
+#include "protocol.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_event.h>
+#include <xcb/xcb_icccm.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+
+// Structure to hold xcb specific information
+static struct {
+  xcb_connection_t *connection;
+  int32_t screenNumber;
+  xcb_screen_t *screen;
+
+} xcb = {};
+
+// Everything the loop's handlers need to get at
+static struct {
+  xcb_window_t window;
+  Atoms atoms;
+
+  uint64_t frames;
+
+  // Shared with the worker thread
+  atomic_bool workerStop;
+  atomic_uint_fast64_t jobsDone;
+  uint64_t jobsReported;
+
+} app = {};
+
+// Define the Backgrouund Color
+//
+// NOTE: The oreder of the color chanels are a little different than what is
+// typically used.
+// Chanel order: alpha red green blue
+#define BG_COLOR 0xFF404050
+
+#define WIN_WIDTH 400
+#define WIN_HEIGHT 300
+
+// The frame timer runs at 60 frames per second
+#define FRAME_PERIOD_NS (1000000000ull / 60)
+
+// How long the pretend work done by the worker thread takes
+#define JOB_MIN_MS 50
+#define JOB_MAX_MS 250
+
+#define ESCAPE_KEYCODE 9
+
+//---------------------------------------------------------------------------
+// Event handlers
+//
+// These are registered with the dispatcher before the loop starts. Each one
+// is given the event loop so it can stop it.
+
+// An xcb error has occured
+static void onError(xcb_generic_event_t *event, void *) {
+  xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+
+  const char *const error_type = protocolErrorName(error->error_code);
+  const char *const request =
+      protocolRequestName(error->major_code, error->minor_code);
+
+  // Extension requests are told apart by their minor opcode, so name the
+  // extension as well
+  const char *const extension = protocolExtensionName(error->major_code);
+  if (extension) {
+    fprintf(stderr, "XCB %s %s %s error\n\n", extension, request,
+            error_type);
+  } else {
+    fprintf(stderr, "XCB %s %s error. Minor opcode %d\n\n", request,
+            error_type, error->minor_code);
+  }
+}
+
+// A key press event
+static void onKeyPress(xcb_generic_event_t *event, void *loop) {
+  xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+
+  // print the keycode received
+  printf("Keycode: %d\n", press->detail);
+
+  // If escape is pressed
+  if (ESCAPE_KEYCODE == press->detail) {
+    eventLoopStop(loop);
+  }
+}
+
+// Received a client message
+static void onClientMessage(xcb_generic_event_t *event, void *loop) {
+  xcb_client_message_event_t *cmessage = (xcb_client_message_event_t *)event;
+
+  if (cmessage->type == app.atoms.WM_PROTOCOLS &&
+      cmessage->data.data32[0] == app.atoms.WM_DELETE_WINDOW) {
+    eventLoopStop(loop);
+  }
+}
+
+// The event loop hands every X event to the dispatcher
+static void onXEvent(EventLoop *, xcb_generic_event_t *event, void *data) {
+  dispatchEvent(data, event);
+}
+
+//
+// Called by the frame timer. The background slowly pulses so it is easy to
+// see that frames keep coming no matter what else is happening.
+//
+// If the loop was held up long enough for more than one tick to pass,
+// expirations will be more than one. The missed ticks are simply skipped.
+//
+static void onFrame(EventLoop *, uint64_t expirations, void *) {
+  app.frames += expirations;
+
+  // Ramp the blue channel up and back down every 2 seconds
+  const uint32_t phase = app.frames % 120;
+  const uint32_t blue = 0x50 + (phase < 60 ? phase : 120 - phase);
+  const uint32_t color = (BG_COLOR & 0xFFFFFF00) | blue;
+
+  xcb_change_window_attributes(xcb.connection, app.window, XCB_CW_BACK_PIXEL,
+                               &color);
+  xcb_clear_area(xcb.connection, 0, app.window, 0, 0, 0, 0);
+}
+
+// Called on the loop's thread after the worker thread calls eventLoopWake
+static void onWorkerWake(EventLoop *, uint64_t, void *) {
+  const uint64_t done = atomic_load(&app.jobsDone);
+  if (done != app.jobsReported) {
+    printf("Worker finished %llu job(s), %llu total\n",
+           (unsigned long long)(done - app.jobsReported),
+           (unsigned long long)done);
+    app.jobsReported = done;
+  }
+}
+
+//
+// Pretend to do some slow work, such as loading a file, and tell the event
+// loop every time a job is finished.
+//
+static void *worker(void *arg) {
+  EventLoop *loop = arg;
+  uint32_t seed = 2024;
+
+  while (!atomic_load(&app.workerStop)) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t ms = JOB_MIN_MS + (seed >> 16) % (JOB_MAX_MS - JOB_MIN_MS);
+
+    const struct timespec work = {.tv_sec = 0, .tv_nsec = ms * 1000000l};
+    nanosleep(&work, nullptr);
+
+    atomic_fetch_add(&app.jobsDone, 1);
+    eventLoopWake(loop);
+  }
+  return nullptr;
+}
+
+int main(void) {
+
+  // This will connect to the default display and screen 0
+  xcb.connection = xcb_connect(nullptr, &xcb.screenNumber);
+
+  // Get the screen
+  // This function can be repleaced with a for loop iterating over
+  // the screens, but this function exists to make it easier.
+  xcb.screen = xcb_aux_get_screen(xcb.connection, xcb.screenNumber);
+
+  // Push all commands to the server
+  xcb_flush(xcb.connection);
+
+  //  Check to see if a proper connection was possible
+  if (xcb_connection_has_error(xcb.connection)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    return -1;
+  }
+
+  // Learn where the server put each extension's opcodes, errors and events
+  // so errors from any request can be named without another round trip
+  protocolInit(xcb.connection);
+
+  //---------------------------------------------------------------------------
+  // Creating the Window
+
+  // The value mask specifies what information is being pased in values to the
+  // server
+  uint32_t valueMask = XCB_CW_BACK_PIXEL |   // Specify color for background
+                       XCB_CW_BORDER_PIXEL | // Specify border pixel color
+                       XCB_CW_EVENT_MASK;    // Specify events to receive
+
+  uint32_t values[] = {
+      BG_COLOR,                // background color
+      BG_COLOR,                // Border color
+      XCB_EVENT_MASK_KEY_PRESS // Receive key press events
+  };
+
+  // Generate an id for our window
+  app.window = xcb_generate_id(xcb.connection);
+
+  xcb_create_window(xcb.connection,       // connection to the X11 server
+                    XCB_COPY_FROM_PARENT, // Use the same depth as the parent
+                    app.window,           // Id of window to create
+                    xcb.screen->root,     // Parent window id
+                    0,                    // Window x postion
+                    0,                    // Winodw y position
+                    WIN_WIDTH,            // Window width
+                    WIN_HEIGHT,           // Window height
+                    1,                    // border width
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, //
+                    xcb.screen->root_visual,       //
+                    valueMask, // Specify which values will be pased to server
+                    values     // The actual values
+  );
+
+  // Give the window a name
+  const char *const wName = "Example 05";
+  const uint32_t wNameLen = strlen(wName);
+
+  xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, app.window,
+                      XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, wNameLen, wName);
+
+  // Register for the WM_DELETE_WINDOW message, see example 02
+  if (internAtoms(xcb.connection, &app.atoms)) {
+    fprintf(stderr, "Unable to get WM_PROTOCOLS or WM_DELETE_WINDOW atom\n");
+  }
+
+  xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, app.window,
+                      app.atoms.WM_PROTOCOLS, XCB_ATOM, 32, 1,
+                      &app.atoms.WM_DELETE_WINDOW);
+
+  // Fixed size window, see example 03
+  xcb_size_hints_t sizeHints = {
+      .flags = XCB_ICCCM_SIZE_HINT_P_MIN_SIZE | XCB_ICCCM_SIZE_HINT_P_MAX_SIZE,
+      .max_height = WIN_HEIGHT,
+      .min_height = WIN_HEIGHT,
+      .max_width = WIN_WIDTH,
+      .min_width = WIN_WIDTH,
+  };
+
+  xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, app.window,
+                      XCB_ATOM_WM_NORMAL_HINTS, XCB_ATOM_WM_SIZE_HINTS, 32,
+                      sizeof(xcb_size_hints_t) / 4, &sizeHints);
+
+  //
+  // Make the window visiable
+  //
+  xcb_map_window(xcb.connection, app.window);
+  xcb_flush(xcb.connection);
+
+  //---------------------------------------------------------------------------
+  // Event loop
+  //
+  // Instead of sleeping in xcb_wait_for_event, the loop sleeps in epoll_wait
+  // on the X connection's file descriptor, a timerfd for the frame tick, and
+  // an eventfd the worker thread uses to say it has finished something.
+  // Whichever is ready first gets handled, and nothing spins while waiting.
+
+  EventLoop loop;
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+
+  if (eventLoopInit(&loop, xcb.connection, onXEvent, &dispatcher)) {
+    fprintf(stderr, "Unable to create the event loop\n");
+    xcb_disconnect(xcb.connection);
+    return -1;
+  }
+
+  dispatcherSetHandler(&dispatcher, 0, onError, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_KEY_PRESS, onKeyPress, &loop);
+  dispatcherSetHandler(&dispatcher, XCB_CLIENT_MESSAGE, onClientMessage,
+                       &loop);
+
+  eventLoopSetWakeHandler(&loop, onWorkerWake, nullptr);
+
+  if (eventLoopAddTimer(&loop, FRAME_PERIOD_NS, onFrame, nullptr) < 0) {
+    fprintf(stderr, "Unable to create the frame timer\n");
+  }
+
+  pthread_t workerThread;
+  const bool haveWorker =
+      pthread_create(&workerThread, nullptr, worker, &loop) == 0;
+
+  if (eventLoopRun(&loop)) {
+    fprintf(stderr, "Event loop stopped with an error\n");
+  }
+
+  if (haveWorker) {
+    atomic_store(&app.workerStop, true);
+    pthread_join(workerThread, nullptr);
+  }
+
+  printf("\n%llu frames\n", (unsigned long long)app.frames);
+  printEventLoopStats(stdout, &loop);
+  eventLoopDestroy(&loop);
+  dispatcherDestroy(&dispatcher);
+
+  xcb_destroy_window(xcb.connection, app.window);
+
+  // Close connection and free resources
+  atomCacheClear();
+  xcb_disconnect(xcb.connection);
+  return 0;
+}
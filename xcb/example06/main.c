@@ -0,0 +1,778 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "atoms.h"
+#include "blend.h"
+#include "damage.h"
+#include "dispatch.h"
+#include "events.h"
+#include "framebuffer.h"
+#include "glyphs.h"
+#include "inputmeter.h"
+#include "journal.h"
+#include "pixelformat.h"
+#include "protocol.h"
+#include "raster.h"
+#include "shmring.h"
+#include "trace.h"
+#include "visual.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_event.h>
+#include <xcb/xcb_icccm.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+
+// Structure to hold xcb specific information
+static struct {
+  xcb_connection_t *connection;
+  int32_t screenNumber;
+  xcb_screen_t *screen;
+
+} xcb = {};
+
+// Background color as red, green, blue, alpha. It is turned into the
+// visual's own layout with pixelConvertColor.
+#define BG_COLOR 0x000000FF
+
+// Starting size. The window can be resized down to the minimum.
+#define WIN_WIDTH 400
+#define WIN_HEIGHT 300
+#define WIN_MIN_WIDTH 160
+#define WIN_MIN_HEIGHT 120
+
+#define ESCAPE_KEYCODE 9
+
+// Buffers in the ring. With three one can be on its way to the screen, one
+// waiting behind it and one being drawn.
+#define SHM_RING_SIZE 3
+
+// State shared with the event handlers
+static struct {
+  Atoms atoms;
+  bool should_exit;
+
+  // The window's pixels, drawn into whichever buffer the server is not
+  // reading
+  ShmRing ring;
+
+  // Turns 0xAARRGGBB pixels into whatever layout the visual uses
+  PixelConverter converter;
+
+  // Premultiplied alpha blending
+  Blender blender;
+
+  // The backdrop and the panel are drawn by every processor at once, one
+  // tile each, see raster.h
+  ThreadPool pool;
+  Rasterizer raster;
+
+  // The parts of the window that need drawing again
+  DamageTracker damage;
+  DamageStats damageStats;
+
+  // Top left corner of the panel
+  int32_t panelX;
+  int32_t panelY;
+
+  // The last key pressed, drawn in the top left corner. Without a font
+  // it is printed instead.
+  GlyphAtlas glyphs;
+  bool haveFont;
+  char keyText[32];
+  DamageBox keyBox;
+
+  // The size from the last ConfigureNotify, applied once per frame
+  uint16_t pendingWidth;
+  uint16_t pendingHeight;
+  uint64_t configureEvents;
+  uint64_t resizes;
+
+  // Set with XCB_INPUT_RECEIPT, see markReceipt
+  xcb_atom_t receiptAtom;
+
+  // Unchecked requests, so errors can be traced back to them
+  RequestJournal journal;
+} app = {};
+
+// A translucent panel that follows the pointer around
+#define PANEL_COLOR 0x60FFFFFF
+#define PANEL_WIDTH 120
+#define PANEL_HEIGHT 80
+
+static uint32_t panel[PANEL_WIDTH * PANEL_HEIGHT];
+
+#define TEXT_SIZE 18
+#define TEXT_COLOR 0xFFFFFFFF
+#define TEXT_X 12
+
+//
+// v reflected back and forth over 0 to period. The gradient is repeated
+// this way rather than stretched to the window, so a pixel's color does not
+// depend on the window's size and resizing leaves every pixel that is still
+// visible as it is.
+//
+static inline uint32_t mirror(uint32_t v, uint32_t period) {
+  v %= 2 * period;
+  return v < period ? v : 2 * period - 1 - v;
+}
+
+// The gradient repeats every two window sizes, so one repeat of it is drawn
+// once up front and copied from then on
+#define BACKDROP_WIDTH (2 * WIN_WIDTH)
+#define BACKDROP_HEIGHT (2 * WIN_HEIGHT)
+
+static uint32_t *backdrop;
+
+//
+// Draw one repeat of the gradient, which fades out towards the bottom.
+//
+// Pixels come in with straight alpha, the way image files and hand picked
+// colors have them, and are premultiplied on the way in, since that is what
+// blending wants.
+//
+// Returns -1 if out of memory.
+//
+static int makeBackdrop(void) {
+  backdrop = malloc((size_t)BACKDROP_WIDTH * BACKDROP_HEIGHT * 4);
+  if (!backdrop) {
+    return -1;
+  }
+
+  for (uint32_t y = 0; y < BACKDROP_HEIGHT; y++) {
+    uint32_t *row = backdrop + (size_t)y * BACKDROP_WIDTH;
+    const uint32_t my = mirror(y, WIN_HEIGHT);
+    const uint32_t a = 255 - my * 127 / WIN_HEIGHT;
+
+    for (uint32_t x = 0; x < BACKDROP_WIDTH; x++) {
+      const uint32_t r = mirror(x, WIN_WIDTH) * 255 / WIN_WIDTH;
+      const uint32_t g = my * 255 / WIN_HEIGHT;
+      const uint32_t b = 0x80;
+      row[x] = a << 24 | r << 16 | g << 8 | b;
+    }
+    blendPremultiply(&app.blender, row, row, BACKDROP_WIDTH);
+  }
+  return 0;
+}
+
+//
+// Record the backdrop and the panel inside box with the rasterizer. Nothing
+// is drawn until rasterFlush.
+//
+// The box is cut where the backdrop repeats, so each piece is a plain copy
+// out of the one repeat that was drawn.
+//
+static void recordBox(const DamageBox *box) {
+  for (int32_t y = box->y1; y < box->y2;) {
+    const int32_t sy = y % BACKDROP_HEIGHT;
+    const int32_t height = BACKDROP_HEIGHT - sy < box->y2 - y
+                               ? BACKDROP_HEIGHT - sy
+                               : box->y2 - y;
+
+    for (int32_t x = box->x1; x < box->x2;) {
+      const int32_t sx = x % BACKDROP_WIDTH;
+      const int32_t width = BACKDROP_WIDTH - sx < box->x2 - x
+                                ? BACKDROP_WIDTH - sx
+                                : box->x2 - x;
+      rasterBlit(&app.raster, x, y, width, height,
+                 backdrop + (size_t)sy * BACKDROP_WIDTH + sx,
+                 BACKDROP_WIDTH * 4);
+      x += width;
+    }
+    y += height;
+  }
+
+  // The part of the panel inside the box
+  const int32_t x1 = app.panelX > box->x1 ? app.panelX : box->x1;
+  const int32_t y1 = app.panelY > box->y1 ? app.panelY : box->y1;
+  const int32_t x2 = app.panelX + PANEL_WIDTH < box->x2
+                         ? app.panelX + PANEL_WIDTH
+                         : box->x2;
+  const int32_t y2 = app.panelY + PANEL_HEIGHT < box->y2
+                         ? app.panelY + PANEL_HEIGHT
+                         : box->y2;
+  if (x1 < x2 && y1 < y2) {
+    rasterBlend(&app.raster, x1, y1, x2 - x1, y2 - y1,
+                panel + (y1 - app.panelY) * PANEL_WIDTH + (x1 - app.panelX),
+                PANEL_WIDTH * 4);
+  }
+}
+
+//
+// Finish the part of the picture inside box once the rasterizer has drawn
+// it.
+//
+// The text goes on last. Once everything is blended the result is converted
+// to the visual's layout in place, on the way out.
+//
+// At depth 24 the alpha byte is ignored, so the picture looks as though it
+// was drawn over black.
+//
+static void finishBox(Framebuffer *fb, const DamageBox *box) {
+  const uint32_t pitch = fb->stride / 4;
+
+  // The key text, clipped to the box. Its glyphs were rendered the first
+  // time they were drawn and come out of the atlas after that.
+  if (app.haveFont) {
+    const TextTarget target = {fb->pixels, fb->stride, box->x1,
+                               box->y1,    box->x2,    box->y2};
+    textDraw(&app.glyphs, &target, TEXT_X, TEXT_X + app.glyphs.ascender,
+             app.keyText, TEXT_COLOR);
+  }
+
+  uint32_t *corner = fb->pixels + (size_t)box->y1 * pitch + box->x1;
+  pixelConvertRect(&app.converter, corner, fb->stride, corner, fb->stride,
+                   box->x2 - box->x1, box->y2 - box->y1);
+}
+
+//
+// Bring the framebuffer to the window's latest size.
+//
+// Dragging an edge sends a ConfigureNotify for nearly every pixel. They are
+// only recorded as they arrive and the last one is applied here, once per
+// batch. framebufferResize grows its memory geometrically, so most resizes
+// allocate nothing. Every buffer in the ring is resized together.
+//
+// The window has NorthWest bit gravity, so the server keeps what was on
+// screen where it was and only the strips a resize uncovers need drawing.
+//
+static void applyResize(void) {
+  const uint16_t oldWidth = app.ring.slots[0].fb.width;
+  const uint16_t oldHeight = app.ring.slots[0].fb.height;
+  const uint16_t width = app.pendingWidth;
+  const uint16_t height = app.pendingHeight;
+  if (width == oldWidth && height == oldHeight) {
+    return;
+  }
+
+  if (shmRingResize(&app.ring, width, height)) {
+    fprintf(stderr, "Unable to resize the framebuffer to %dx%d\n", width,
+            height);
+    app.should_exit = true;
+    return;
+  }
+  app.resizes++;
+
+  damageResize(&app.damage, width, height);
+  if (width > oldWidth) {
+    damageAdd(&app.damage, oldWidth, 0, width - oldWidth, height);
+  }
+  if (height > oldHeight) {
+    damageAdd(&app.damage, 0, oldHeight, width, height - oldHeight);
+  }
+}
+
+//
+// Draw and upload everything that changed since the last frame. Only the
+// damaged boxes are drawn and only they are sent to the server.
+//
+// The frame goes into a buffer the server is not reading. The window keeps
+// what earlier frames put on screen, so it does not matter that the buffer
+// holds an older picture everywhere else.
+//
+static void drawFrame(void) {
+  applyResize();
+
+  if (damageEmpty(&app.damage)) {
+    return;
+  }
+
+  // Every buffer is still being read. The damage is kept and the
+  // ShmCompletion that frees a buffer wakes the event loop to try again.
+  Framebuffer *fb = shmRingAcquire(&app.ring);
+  if (!fb) {
+    return;
+  }
+
+  // Every box's backdrop and panel are drawn in one go, so the threads
+  // are woken once per frame rather than once per box
+  rasterTarget(&app.raster, fb->pixels, fb->width, fb->height, fb->stride);
+  for (uint32_t i = 0; i < app.damage.count; i++) {
+    recordBox(&app.damage.boxes[i]);
+  }
+  rasterFlush(&app.raster);
+
+  for (uint32_t i = 0; i < app.damage.count; i++) {
+    const DamageBox *box = &app.damage.boxes[i];
+    finishBox(fb, box);
+
+    // The last box asks the server to say when it is done with the buffer
+    if (i + 1 < app.damage.count) {
+      framebufferPresent(fb, box->x1, box->y1, box->x2 - box->x1,
+                         box->y2 - box->y1);
+    } else {
+      shmRingPresent(&app.ring, fb, box->x1, box->y1, box->x2 - box->x1,
+                     box->y2 - box->y1);
+    }
+  }
+
+  damageFrameDone(&app.damage, &app.damageStats);
+}
+
+//---------------------------------------------------------------------------
+// Event handlers
+//
+// Each handler is registered with the dispatcher once before the event loop
+// starts. The dispatcher looks the handler up by event type in a table, so
+// there is no switch to grow as more events are handled.
+
+// An xcb error has occured
+static void onError(xcb_generic_event_t *event, void *) {
+  xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+
+  const char *const error_type = protocolErrorName(error->error_code);
+  const char *const opcode =
+      protocolRequestName(error->major_code, error->minor_code);
+
+  // Errors for unchecked requests only carry a sequence number. The journal
+  // turns that back into the request that failed.
+  journalReportError(stderr, &app.journal, error, error_type, opcode);
+}
+
+// Part of the window needs to be shown again
+static void onExpose(xcb_generic_event_t *event, void *) {
+  xcb_expose_event_t *expose = (xcb_expose_event_t *)event;
+
+  // No one buffer in the ring holds the whole picture, so the exposed
+  // rectangle is drawn again with the next frame. Anything outside the
+  // window's size is clipped away by the damage tracker.
+  damageAdd(&app.damage, expose->x, expose->y, expose->width,
+            expose->height);
+}
+
+// The window was moved, resized or restacked. Only the size matters.
+static void onConfigure(xcb_generic_event_t *event, void *) {
+  xcb_configure_notify_event_t *configure =
+      (xcb_configure_notify_event_t *)event;
+
+  app.configureEvents++;
+  app.pendingWidth = configure->width;
+  app.pendingHeight = configure->height;
+}
+
+//
+// Tell whoever is watching that the loop has taken an input event, by
+// setting a property on the window to the event's time. bench_photon
+// times the PropertyNotify as the receipt. The request is flushed at once
+// rather than with the frame, or the receipt would include the drawing.
+//
+static void markReceipt(xcb_window_t window, xcb_timestamp_t time) {
+  if (app.receiptAtom == XCB_ATOM_NONE) {
+    return;
+  }
+  xcb_void_cookie_t cookie = xcb_change_property(
+      xcb.connection, XCB_PROP_MODE_REPLACE, window, app.receiptAtom,
+      XCB_ATOM_CARDINAL, 32, 1, &time);
+  journalRecord(&app.journal, cookie, "xcb_change_property receipt", window);
+  xcb_flush(xcb.connection);
+}
+
+// The pointer moved, take the panel with it
+static void onMotion(xcb_generic_event_t *event, void *) {
+  xcb_motion_notify_event_t *motion = (xcb_motion_notify_event_t *)event;
+  markReceipt(motion->event, motion->time);
+
+  // Where the panel was needs the gradient back, where it is going needs
+  // the panel. Nothing else has changed.
+  damageAdd(&app.damage, app.panelX, app.panelY, PANEL_WIDTH, PANEL_HEIGHT);
+  app.panelX = motion->event_x - PANEL_WIDTH / 2;
+  app.panelY = motion->event_y - PANEL_HEIGHT / 2;
+  damageAdd(&app.damage, app.panelX, app.panelY, PANEL_WIDTH, PANEL_HEIGHT);
+}
+
+//
+// Change the key text and mark where it was and where it will be as
+// damaged. Glyphs can reach a little past the pen on either side, so the
+// box is widened by a few pixels.
+//
+static void setKeyText(const char *text) {
+  DamageBox *b = &app.keyBox;
+  damageAdd(&app.damage, b->x1, b->y1, b->x2 - b->x1, b->y2 - b->y1);
+
+  snprintf(app.keyText, sizeof(app.keyText), "%s", text);
+
+  const int32_t pad = TEXT_SIZE / 4;
+  const int32_t baseline = TEXT_X + app.glyphs.ascender;
+  *b = (DamageBox){
+      TEXT_X - pad,
+      baseline - app.glyphs.ascender,
+      TEXT_X + textWidth(&app.glyphs, app.keyText) + pad,
+      baseline + app.glyphs.descender,
+  };
+  damageAdd(&app.damage, b->x1, b->y1, b->x2 - b->x1, b->y2 - b->y1);
+}
+
+// A key press event
+static void onKeyPress(xcb_generic_event_t *event, void *) {
+  // The event is a key press. Cast the event to a key press event
+  xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+  markReceipt(press->event, press->time);
+
+  // Show the keycode received in the window, or print it without a font
+  char text[32];
+  snprintf(text, sizeof(text), "Keycode: %d", press->detail);
+  if (app.haveFont) {
+    setKeyText(text);
+  } else {
+    printf("%s\n", text);
+  }
+
+  // If escape is pressed
+  if (ESCAPE_KEYCODE == press->detail) {
+    app.should_exit = true;
+  }
+}
+
+// Received a client message
+static void onClientMessage(xcb_generic_event_t *event, void *) {
+  xcb_client_message_event_t *cmessage = (xcb_client_message_event_t *)event;
+
+  if (cmessage->type == app.atoms.WM_PROTOCOLS) {
+
+    // Check to see if client message is of type WM_DELETE_WINDOW
+    if (cmessage->data.data32[0] == app.atoms.WM_DELETE_WINDOW) {
+      // WM_DELETE_WINDOW message recieved, set should exit to true
+      app.should_exit = true;
+    }
+  }
+}
+
+int main(void) {
+
+  // This will connect to the default display and screen 0
+  xcb.connection = xcb_connect(nullptr, &xcb.screenNumber);
+
+  // Get the screen
+  // This function can be repleaced with a for loop iterating over
+  // the screens, but this function exists to make it easier.
+  xcb.screen = xcb_aux_get_screen(xcb.connection, xcb.screenNumber);
+
+  // Push all commands to the server
+  xcb_flush(xcb.connection);
+
+  //  Check to see if a proper connection was possible
+  if (xcb_connection_has_error(xcb.connection)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    return -1;
+  }
+
+  // Learn where the server put each extension's opcodes, errors and events
+  // so errors from any request can be named without another round trip
+  protocolInit(xcb.connection);
+
+  // Use the 32 bit ARGB visual when there is one, as in example 04.
+  // Otherwise fall back to a TrueColor visual at the screen's own depth.
+  VisualConfig cfg = {};
+  uint8_t depth = 32;
+
+  if (findDepthAndVisual(xcb.connection, xcb.screen, 32, &cfg,
+                         &app.journal)) {
+    if (findDepthAndVisual(xcb.connection, xcb.screen,
+                           xcb.screen->root_depth, &cfg, nullptr)) {
+      fprintf(stderr, "Error finding depth and visual\n");
+      xcb_disconnect(xcb.connection);
+      return -1;
+    }
+    depth = xcb.screen->root_depth;
+  }
+  const xcb_visualid_t visual = cfg.visual->visual_id;
+
+  // The visual's red, green and blue masks say where each channel goes
+  if (pixelConverterInit(&app.converter, cfg.visual, depth, PIXEL_ORDER_BGRA,
+                         PIXEL_KERNEL_AUTO)) {
+    fprintf(stderr, "The visual is not TrueColor\n");
+    xcb_disconnect(xcb.connection);
+    return -1;
+  }
+  const uint32_t background = pixelConvertColor(
+      &app.converter, BG_COLOR >> 24, BG_COLOR >> 16 & 0xFF,
+      BG_COLOR >> 8 & 0xFF, BG_COLOR & 0xFF);
+
+  //---------------------------------------------------------------------------
+  // Creating the Window
+
+  // The value mask specifies what information is being pased in values to the
+  // server
+  uint32_t valueMask = XCB_CW_BACK_PIXEL |   // Specify color for background
+                       XCB_CW_BORDER_PIXEL | // Specify border pixel color
+                       XCB_CW_BIT_GRAVITY |  // What happens on resize
+                       XCB_CW_EVENT_MASK |   // Specify events to receive
+                       XCB_CW_COLORMAP;      //
+
+  // Events to receive
+  const uint32_t eventMask = XCB_EVENT_MASK_KEY_PRESS |      // key presses
+                             XCB_EVENT_MASK_EXPOSURE |       // when to draw
+                             XCB_EVENT_MASK_POINTER_MOTION | // the pointer
+                             XCB_EVENT_MASK_STRUCTURE_NOTIFY; // resizes
+
+  // Values to pass to the server
+  // They must be in the order from least to highest mask value
+  uint32_t values[] = {
+      background,                  // background color
+      background,                  // Border color
+      XCB_GRAVITY_NORTH_WEST,      // Keep the pixels on resize
+      eventMask,                   // Events to receive
+      cfg.colormap                 // colormap for the visual
+  };
+
+  // Generate an id for our window
+  xcb_window_t window1 = xcb_generate_id(xcb.connection);
+
+  // Each request below is recorded in the journal so any error it causes can
+  // be matched back to it
+  xcb_void_cookie_t cookie =
+  xcb_create_window(xcb.connection,    // connection to the X11 server
+                    depth,             // 32 bit or the screen's depth
+                    window1,           // Id of window to create
+                    xcb.screen->root,  // Parent window id
+                    0,                 // Window x postion
+                    0,                 // Winodw y position
+                    WIN_WIDTH,         // Window width
+                    WIN_HEIGHT,        // Window height
+                    1,                 // border width
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, //
+                    visual,                        //
+                    valueMask, // Specify which values will be pased to server
+                    values     // The actual values
+  );
+  journalRecord(&app.journal, cookie, "xcb_create_window", window1);
+
+  // Give the window a name
+  const char *const wName = "Example 06";
+  const uint32_t wNameLen = strlen(wName);
+
+  cookie =
+  xcb_change_property(xcb.connection,        // Conection to the X11 server
+                      XCB_PROP_MODE_REPLACE, // Replace the property
+                      window1,               // The window to be modified
+                      XCB_ATOM_WM_NAME,      // Property to replace
+                      XCB_ATOM_STRING,       // Type of Data
+                      8,        // Data is in 8-bit chunks since it is a string
+                      wNameLen, // lenght of data
+                      wName     // pointer the the actual data
+  );
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_NAME", window1);
+
+  // Register to receive the WM_DELETE_WINDOW message. See example 02.
+  if (internAtoms(xcb.connection, &app.atoms)) {
+    fprintf(stderr, "Unable to get WM_PROTOCOLS or WM_DELETE_WINDOW atom\n");
+  }
+
+  cookie = xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
+                               app.atoms.WM_PROTOCOLS, XCB_ATOM, 32, 1,
+                               &app.atoms.WM_DELETE_WINDOW);
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_PROTOCOLS",
+                window1);
+
+  // Run with XCB_INPUT_RECEIPT=1 to have every key press and pointer move
+  // marked on the window as the loop takes it, for bench_photon
+  const char *receipt = getenv("XCB_INPUT_RECEIPT");
+  if (receipt && *receipt && strcmp(receipt, "0") != 0) {
+    const char *const receiptName = INPUT_RECEIPT_ATOM;
+    if (internAtomList(xcb.connection, 1, &receiptName, false,
+                       &app.receiptAtom)) {
+      fprintf(stderr, "Unable to get the %s atom\n", receiptName);
+    }
+  }
+
+  // Unlike example 03 the window can be resized, only a minimum is set
+  xcb_size_hints_t sizeHints = {
+      .flags = XCB_ICCCM_SIZE_HINT_P_MIN_SIZE,
+      .min_height = WIN_MIN_HEIGHT,
+      .min_width = WIN_MIN_WIDTH,
+  };
+
+  cookie = xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
+                               XCB_ATOM_WM_NORMAL_HINTS,
+                               XCB_ATOM_WM_SIZE_HINTS, 32,
+                               sizeof(xcb_size_hints_t) / 4, &sizeHints);
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_NORMAL_HINTS",
+                window1);
+
+  // Register a handler for each type of event the example cares about.
+  // Everything else is ignored. The SHM ring adds its own below.
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+  dispatcherSetHandler(&dispatcher, 0, onError, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_EXPOSE, onExpose, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_MOTION_NOTIFY, onMotion, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_CONFIGURE_NOTIFY, onConfigure,
+                       nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_KEY_PRESS, onKeyPress, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_CLIENT_MESSAGE, onClientMessage,
+                       nullptr);
+
+  //
+  // The framebuffers
+  //
+  // Try shared memory first. framebufferCreate falls back to copying the
+  // pixels with xcb_put_image by itself if it has to, and then the ring's
+  // buffers are never busy.
+  if (shmRingInit(&app.ring, xcb.connection, window1, depth, WIN_WIDTH,
+                  WIN_HEIGHT, SHM_RING_SIZE, &dispatcher)) {
+    fprintf(stderr, "Unable to create %d bit framebuffers\n", depth);
+    dispatcherDestroy(&dispatcher);
+    xcb_disconnect(xcb.connection);
+    return -1;
+  }
+  printf("Depth %d, presenting with %s from %u buffers, converting pixels "
+         "with %s\n",
+         depth, framebufferModeName(&app.ring.slots[0].fb), app.ring.count,
+         pixelKernelName(app.converter.kernel));
+
+  blenderInit(&app.blender, PIXEL_KERNEL_AUTO);
+
+  // One thread per processor, the main thread among them
+  if (makeBackdrop() || threadPoolCreate(&app.pool, 0)) {
+    fprintf(stderr, "Unable to set up drawing\n");
+    free(backdrop);
+    shmRingDestroy(&app.ring);
+    dispatcherDestroy(&dispatcher);
+    xcb_disconnect(xcb.connection);
+    return -1;
+  }
+  rasterInit(&app.raster, &app.pool, &app.blender);
+
+  // The panel is one color, so only one pixel needs premultiplying
+  const uint32_t panelColor = blendPremultiplyColor(PANEL_COLOR);
+  for (uint32_t i = 0; i < PANEL_WIDTH * PANEL_HEIGHT; i++) {
+    panel[i] = panelColor;
+  }
+  app.panelX = (WIN_WIDTH - PANEL_WIDTH) / 2;
+  app.panelY = (WIN_HEIGHT - PANEL_HEIGHT) / 2;
+
+  // Any font FreeType can read will do, see glyphFindFont
+  const char *const font = glyphFindFont();
+  app.haveFont =
+      font && glyphAtlasInit(&app.glyphs, font, TEXT_SIZE, &app.blender) == 0;
+  if (!app.haveFont) {
+    fprintf(stderr, "No font found, set XCB_EXAMPLES_FONT to a font file. "
+                    "Key presses will be printed.\n");
+  }
+
+  // The whole window is drawn with the first frame. After that only what
+  // the panel moves over is drawn again.
+  damageInit(&app.damage, WIN_WIDTH, WIN_HEIGHT);
+  app.pendingWidth = WIN_WIDTH;
+  app.pendingHeight = WIN_HEIGHT;
+  if (app.haveFont) {
+    setKeyText("Press a key");
+  }
+  damageAddAll(&app.damage);
+
+  //
+  // Make the window visiable
+  //
+  cookie = xcb_map_window(xcb.connection, window1);
+  journalRecord(&app.journal, cookie, "xcb_map_window", window1);
+  xcb_flush(xcb.connection);
+
+  // Event loop, see example 01
+
+#define EVENT_BATCH_SIZE EVENT_BATCH_MAX
+
+  EventBatch batch = {.capacity = EVENT_BATCH_SIZE};
+  EventBatchStats batchStats = {};
+
+  // With trace markers compiled in, see trace.h, XCB_TRACE names a file to
+  // write a timeline of every frame to
+  TRACE_OPEN_FROM_ENV("XCB_TRACE");
+  TRACE_THREAD_NAME("main");
+
+  // Run with XCB_INPUT_METER=1 to see, once a second, how well the loop
+  // keeps up with input, such as a storm from bench_input_storm
+  InputMeter *inputMeter =
+      inputMeterCreateFromEnv(xcb.connection, stdout, "XCB_INPUT_METER");
+
+  // A storm releases every key it presses and the meter counts releases
+  // too, so ask for them while measuring. The example itself only cares
+  // about presses.
+  if (inputMeter) {
+    const uint32_t meterMask = eventMask | XCB_EVENT_MASK_KEY_RELEASE;
+    cookie = xcb_change_window_attributes(xcb.connection, window1,
+                                          XCB_CW_EVENT_MASK, &meterMask);
+    journalRecord(&app.journal, cookie,
+                  "xcb_change_window_attributes event mask", window1);
+  }
+
+  while (!app.should_exit &&
+         waitForEventBatch(xcb.connection, &batch, &batchStats)) {
+
+    inputMeterBatch(inputMeter, &batch);
+    TRACE_COUNTER("events", batch.count);
+    {
+      TRACE_SCOPE("dispatch");
+      for (uint32_t i = 0; i < batch.count; i++) {
+        dispatchEvent(&dispatcher, batch.events[i]);
+      }
+      freeEventBatch(&batch);
+    }
+
+    // A whole batch of motion events becomes one frame
+    {
+      TRACE_SCOPE("render");
+      drawFrame();
+    }
+
+    // Send anything the handlers queued up to the server all at once
+    {
+      TRACE_SCOPE("flush");
+      xcb_flush(xcb.connection);
+    }
+    TRACE_FLUSH();
+  }
+  TRACE_CLOSE();
+
+  printEventBatchStats(stdout, &batchStats);
+  inputMeterDestroy(inputMeter, stdout);
+  printDamageStats(stdout, &app.damageStats, 4);
+  const Framebuffer *fb = &app.ring.slots[0].fb;
+  printf("Resize: %llu ConfigureNotify, %llu resizes, %u reallocations, "
+         "room for %ux%u\n",
+         (unsigned long long)app.configureEvents,
+         (unsigned long long)app.resizes, fb->reallocations, fb->stride / 4,
+         (unsigned)(fb->size / fb->stride));
+  if (app.haveFont) {
+    printGlyphStats(stdout, &app.glyphs);
+    glyphAtlasDestroy(&app.glyphs);
+  }
+  printShmRingStats(stdout, &app.ring);
+  dispatcherDestroy(&dispatcher);
+
+  rasterDestroy(&app.raster);
+  threadPoolDestroy(&app.pool);
+  free(backdrop);
+
+  shmRingDestroy(&app.ring);
+  xcb_destroy_window(xcb.connection, window1);
+
+  xcb_free_colormap(xcb.connection, cfg.colormap);
+
+  // Close connection and free resources
+  atomCacheClear();
+  xcb_disconnect(xcb.connection);
+  return 0;
+}
@@ -0,0 +1,415 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Ezekiel Holliday
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "atoms.h"
+#include "dispatch.h"
+#include "events.h"
+#include "frames.h"
+#include "journal.h"
+#include "pixelformat.h"
+#include "protocol.h"
+#include "trace.h"
+#include "traffic.h"
+#include "visual.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_event.h>
+#include <xcb/xcb_icccm.h>
+#include <xcb/xcb_util.h>
+#include <xcb/xproto.h>
+
+// Structure to hold xcb specific information
+static struct {
+  xcb_connection_t *connection;
+  int32_t screenNumber;
+  xcb_screen_t *screen;
+
+} xcb = {};
+
+// Background color as red, green, blue, alpha. It is turned into the
+// visual's own layout with pixelConvertColor.
+#define BG_COLOR 0x000000FF
+
+#define WIN_WIDTH 400
+#define WIN_HEIGHT 300
+
+#define ESCAPE_KEYCODE 9
+
+// State shared with the event handlers
+static struct {
+  Atoms atoms;
+  bool should_exit;
+
+  // Hands out back buffers and presents them in time with the display
+  FrameScheduler frames;
+
+  // Turns 0xAARRGGBB pixels into whatever layout the visual uses
+  PixelConverter converter;
+
+  // Nothing is drawn until the window has been shown
+  bool exposed;
+
+  // Frames drawn so far, which is all the animation needs to know
+  uint32_t frame;
+
+  // Unchecked requests, so errors can be traced back to them
+  RequestJournal journal;
+} app = {};
+
+// How far the bars move each frame, in pixels
+#define BAR_SPEED 2
+#define BAR_WIDTH 40
+
+//
+// Draw the whole picture for the current frame into a back buffer.
+//
+// The animation moves on by one step per frame rather than by the time
+// since the last one. Frames come exactly one refresh apart unless one is
+// missed, and a missed frame shows up as a visible stutter, which is the
+// point of the example.
+//
+static void drawFrame(Framebuffer *fb) {
+  const uint32_t pitch = fb->stride / 4;
+  const uint32_t offset = app.frame * BAR_SPEED % (2 * BAR_WIDTH);
+
+  for (uint32_t y = 0; y < fb->height; y++) {
+    uint32_t *row = fb->pixels + (size_t)y * pitch;
+    const uint32_t g = y * 255 / fb->height;
+
+    // Diagonal bars sliding to the right over a gradient
+    for (uint32_t x = 0; x < fb->width; x++) {
+      const bool bar = (x + y + 2 * BAR_WIDTH - offset) / BAR_WIDTH % 2;
+      const uint32_t r = bar ? 0xE0 : x * 255 / fb->width;
+      const uint32_t b = bar ? 0x40 : 0x80;
+      row[x] = 0xFFu << 24 | r << 16 | g << 8 | b;
+    }
+  }
+
+  pixelConvertRect(&app.converter, fb->pixels, fb->stride, fb->pixels,
+                   fb->stride, fb->width, fb->height);
+  app.frame++;
+}
+
+//---------------------------------------------------------------------------
+// Event handlers
+//
+// Each handler is registered with the dispatcher once before the event loop
+// starts. The dispatcher looks the handler up by event type in a table, so
+// there is no switch to grow as more events are handled. The Present events
+// are registered by frameSchedulerInit.
+
+// An xcb error has occured
+static void onError(xcb_generic_event_t *event, void *) {
+  xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+
+  const char *const error_type = protocolErrorName(error->error_code);
+  const char *const opcode =
+      protocolRequestName(error->major_code, error->minor_code);
+
+  // Errors for unchecked requests only carry a sequence number. The journal
+  // turns that back into the request that failed.
+  journalReportError(stderr, &app.journal, error, error_type, opcode);
+}
+
+// Part of the window needs to be shown again. The next frame covers all of
+// it, so the only thing to do is start the animation.
+static void onExpose(xcb_generic_event_t *, void *) { app.exposed = true; }
+
+// A key press event
+static void onKeyPress(xcb_generic_event_t *event, void *) {
+  // The event is a key press. Cast the event to a key press event
+  xcb_key_press_event_t *press = (xcb_key_press_event_t *)event;
+
+  // print the keycode received
+  printf("Keycode: %d\n", press->detail);
+
+  // If escape is pressed
+  if (ESCAPE_KEYCODE == press->detail) {
+    app.should_exit = true;
+  }
+}
+
+// Received a client message
+static void onClientMessage(xcb_generic_event_t *event, void *) {
+  xcb_client_message_event_t *cmessage = (xcb_client_message_event_t *)event;
+
+  if (cmessage->type == app.atoms.WM_PROTOCOLS) {
+
+    // Check to see if client message is of type WM_DELETE_WINDOW
+    if (cmessage->data.data32[0] == app.atoms.WM_DELETE_WINDOW) {
+      // WM_DELETE_WINDOW message recieved, set should exit to true
+      app.should_exit = true;
+    }
+  }
+}
+
+int main(void) {
+
+  // This will connect to the default display and screen 0
+  xcb.connection = xcb_connect(nullptr, &xcb.screenNumber);
+
+  // Get the screen
+  // This function can be repleaced with a for loop iterating over
+  // the screens, but this function exists to make it easier.
+  xcb.screen = xcb_aux_get_screen(xcb.connection, xcb.screenNumber);
+
+  // Push all commands to the server
+  xcb_flush(xcb.connection);
+
+  //  Check to see if a proper connection was possible
+  if (xcb_connection_has_error(xcb.connection)) {
+    fprintf(stderr, "Error with connection to X11 server\n");
+    return -1;
+  }
+
+  // Learn where the server put each extension's opcodes, errors and events
+  // so errors from any request can be named without another round trip
+  protocolInit(xcb.connection);
+
+  // Use the 32 bit ARGB visual when there is one, as in example 04.
+  // Otherwise fall back to a TrueColor visual at the screen's own depth.
+  VisualConfig cfg = {};
+  uint8_t depth = 32;
+
+  if (findDepthAndVisual(xcb.connection, xcb.screen, 32, &cfg,
+                         &app.journal)) {
+    if (findDepthAndVisual(xcb.connection, xcb.screen,
+                           xcb.screen->root_depth, &cfg, nullptr)) {
+      fprintf(stderr, "Error finding depth and visual\n");
+      xcb_disconnect(xcb.connection);
+      return -1;
+    }
+    depth = xcb.screen->root_depth;
+  }
+  const xcb_visualid_t visual = cfg.visual->visual_id;
+
+  // The visual's red, green and blue masks say where each channel goes
+  if (pixelConverterInit(&app.converter, cfg.visual, depth, PIXEL_ORDER_BGRA,
+                         PIXEL_KERNEL_AUTO)) {
+    fprintf(stderr, "The visual is not TrueColor\n");
+    xcb_disconnect(xcb.connection);
+    return -1;
+  }
+  const uint32_t background = pixelConvertColor(
+      &app.converter, BG_COLOR >> 24, BG_COLOR >> 16 & 0xFF,
+      BG_COLOR >> 8 & 0xFF, BG_COLOR & 0xFF);
+
+  //---------------------------------------------------------------------------
+  // Creating the Window
+
+  // The value mask specifies what information is being pased in values to the
+  // server
+  uint32_t valueMask = XCB_CW_BACK_PIXEL |   // Specify color for background
+                       XCB_CW_BORDER_PIXEL | // Specify border pixel color
+                       XCB_CW_EVENT_MASK |   // Specify events to receive
+                       XCB_CW_COLORMAP;      //
+
+  // Values to pass to the server
+  // They must be in the order from least to highest mask value
+  uint32_t values[] = {
+      background,                  // background color
+      background,                  // Border color
+      XCB_EVENT_MASK_KEY_PRESS |   // Receive key press events
+          XCB_EVENT_MASK_EXPOSURE, // and know when to start drawing
+      cfg.colormap                 // colormap for the visual
+  };
+
+  // Generate an id for our window
+  xcb_window_t window1 = xcb_generate_id(xcb.connection);
+
+  // Each request below is recorded in the journal so any error it causes can
+  // be matched back to it
+  xcb_void_cookie_t cookie =
+  xcb_create_window(xcb.connection,    // connection to the X11 server
+                    depth,             // 32 bit or the screen's depth
+                    window1,           // Id of window to create
+                    xcb.screen->root,  // Parent window id
+                    0,                 // Window x postion
+                    0,                 // Winodw y position
+                    WIN_WIDTH,         // Window width
+                    WIN_HEIGHT,        // Window height
+                    1,                 // border width
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, //
+                    visual,                        //
+                    valueMask, // Specify which values will be pased to server
+                    values     // The actual values
+  );
+  journalRecord(&app.journal, cookie, "xcb_create_window", window1);
+
+  // Give the window a name
+  const char *const wName = "Example 07";
+  const uint32_t wNameLen = strlen(wName);
+
+  cookie =
+  xcb_change_property(xcb.connection,        // Conection to the X11 server
+                      XCB_PROP_MODE_REPLACE, // Replace the property
+                      window1,               // The window to be modified
+                      XCB_ATOM_WM_NAME,      // Property to replace
+                      XCB_ATOM_STRING,       // Type of Data
+                      8,        // Data is in 8-bit chunks since it is a string
+                      wNameLen, // lenght of data
+                      wName     // pointer the the actual data
+  );
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_NAME", window1);
+
+  // Register to receive the WM_DELETE_WINDOW message. See example 02.
+  if (internAtoms(xcb.connection, &app.atoms)) {
+    fprintf(stderr, "Unable to get WM_PROTOCOLS or WM_DELETE_WINDOW atom\n");
+  }
+
+  cookie = xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
+                               app.atoms.WM_PROTOCOLS, XCB_ATOM, 32, 1,
+                               &app.atoms.WM_DELETE_WINDOW);
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_PROTOCOLS",
+                window1);
+
+  // Fixed size window, see example 03
+  xcb_size_hints_t sizeHints = {
+      .flags = XCB_ICCCM_SIZE_HINT_P_MIN_SIZE | XCB_ICCCM_SIZE_HINT_P_MAX_SIZE,
+      .max_height = WIN_HEIGHT,
+      .min_height = WIN_HEIGHT,
+      .max_width = WIN_WIDTH,
+      .min_width = WIN_WIDTH,
+  };
+
+  cookie = xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window1,
+                               XCB_ATOM_WM_NORMAL_HINTS,
+                               XCB_ATOM_WM_SIZE_HINTS, 32,
+                               sizeof(xcb_size_hints_t) / 4, &sizeHints);
+  journalRecord(&app.journal, cookie, "xcb_change_property WM_NORMAL_HINTS",
+                window1);
+
+  // Register a handler for each type of event the example cares about.
+  // Everything else is ignored.
+  EventDispatcher dispatcher;
+  dispatcherInit(&dispatcher);
+  dispatcherSetHandler(&dispatcher, 0, onError, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_EXPOSE, onExpose, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_KEY_PRESS, onKeyPress, nullptr);
+  dispatcherSetHandler(&dispatcher, XCB_CLIENT_MESSAGE, onClientMessage,
+                       nullptr);
+
+  //
+  // The back buffers
+  //
+  // Each is a shared memory framebuffer, presented straight from shared
+  // memory when the server can make a pixmap out of it
+  int status = frameSchedulerInit(&app.frames, xcb.connection, window1,
+                                  depth, WIN_WIDTH, WIN_HEIGHT, &dispatcher);
+  if (status) {
+    fprintf(stderr, status == -1 ? "The server has no Present extension\n"
+                                 : "Unable to create the back buffers\n");
+    dispatcherDestroy(&dispatcher);
+    xcb_disconnect(xcb.connection);
+    return -1;
+  }
+
+  const FrameSlot *first = &app.frames.buffers[0];
+  printf("Depth %d, %s with %s, converting pixels with %s\n", depth,
+         first->shared ? "presenting shared pixmaps" : "uploading to pixmaps",
+         framebufferModeName(&first->fb),
+         pixelKernelName(app.converter.kernel));
+
+  //
+  // Make the window visiable
+  //
+  cookie = xcb_map_window(xcb.connection, window1);
+  journalRecord(&app.journal, cookie, "xcb_map_window", window1);
+  xcb_flush(xcb.connection);
+
+  // Event loop, see example 01
+  //
+  // There is no timer. Once the first frame is presented the loop is woken
+  // by PresentCompleteNotify once every refresh, and that is when the next
+  // frame is drawn.
+
+#define EVENT_BATCH_SIZE EVENT_BATCH_MAX
+
+  EventBatch batch = {.capacity = EVENT_BATCH_SIZE};
+  EventBatchStats batchStats = {};
+
+  // Count what each frame costs on the wire. Set XCB_TRAFFIC to a file name,
+  // or to - for stdout, to get the counts as JSON on exit.
+  TrafficMeter traffic;
+  if (trafficMeterInit(&traffic)) {
+    fprintf(stderr, "Unable to count traffic per opcode, counting totals\n");
+  }
+
+  // With trace markers compiled in, see trace.h, XCB_TRACE names a file to
+  // write a timeline of every frame to
+  TRACE_OPEN_FROM_ENV("XCB_TRACE");
+  TRACE_THREAD_NAME("main");
+
+  while (!app.should_exit &&
+         waitForEventBatch(xcb.connection, &batch, &batchStats)) {
+
+    TRACE_COUNTER("events", batch.count);
+    {
+      TRACE_SCOPE("dispatch");
+      for (uint32_t i = 0; i < batch.count; i++) {
+        dispatchEvent(&dispatcher, batch.events[i]);
+      }
+      freeEventBatch(&batch);
+    }
+
+    // Draw the next frame if the last one has made it to the screen
+    FrameSlot *slot = app.exposed ? frameAcquire(&app.frames) : nullptr;
+    if (slot) {
+      {
+        TRACE_SCOPE("render");
+        drawFrame(&slot->fb);
+      }
+      framePresent(&app.frames, slot);
+      trafficFrame(&traffic);
+    }
+
+    // Send anything the handlers queued up to the server all at once
+    {
+      TRACE_SCOPE("flush");
+      xcb_flush(xcb.connection);
+    }
+    TRACE_FLUSH();
+  }
+  TRACE_CLOSE();
+
+  printEventBatchStats(stdout, &batchStats);
+  printFrameStats(stdout, &app.frames);
+  if (trafficWriteJsonToEnv("XCB_TRAFFIC", &traffic) != 0) {
+    fprintf(stderr, "Unable to write the traffic counts\n");
+  }
+  trafficMeterDestroy(&traffic);
+  dispatcherDestroy(&dispatcher);
+
+  frameSchedulerDestroy(&app.frames);
+  xcb_destroy_window(xcb.connection, window1);
+
+  xcb_free_colormap(xcb.connection, cfg.colormap);
+
+  // Close connection and free resources
+  atomCacheClear();
+  xcb_disconnect(xcb.connection);
+  return 0;
+}